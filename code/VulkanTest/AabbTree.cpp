@@ -0,0 +1,530 @@
+#include "AabbTree.h"
+
+// std::vector::resize takes it by reference
+const int32_t AabbTree::NULL_NODE;
+
+AabbTree::AabbTree(float margin)
+{
+   this->margin = margin;
+}
+
+int32_t AabbTree::allocateNode()
+{
+   if(freeList == NULL_NODE)
+   {
+      // the free list is in the order of the new nodes, so they are handed out front to back
+      uint32_t oldSize = static_cast<uint32_t>(nodes.size());
+      uint32_t newSize = std::max(oldSize * 2, 16u);
+
+      nodes.resize(newSize);
+
+      for(uint32_t i = oldSize; i < newSize - 1; i++)
+      {
+         nodes[i].parent = static_cast<int32_t>(i + 1);
+      }
+
+      nodes[newSize - 1].parent = NULL_NODE;
+      freeList = static_cast<int32_t>(oldSize);
+   }
+
+   int32_t node = freeList;
+   freeList = nodes[node].parent;
+
+   nodes[node] = Node();
+   nodes[node].height = 0;
+
+   return node;
+}
+
+void AabbTree::freeNode(int32_t node)
+{
+   nodes[node] = Node();
+   nodes[node].parent = freeList;
+
+   freeList = node;
+}
+
+int32_t AabbTree::createProxy(const Aabb& aabb, uint32_t userData)
+{
+   int32_t proxy = allocateNode();
+
+   Node& node = nodes[proxy];
+   node.tightAabb = aabb;
+   node.aabb      = Aabb(aabb.min - glm::vec3(margin), aabb.max + glm::vec3(margin));
+   node.userData  = userData;
+
+   insertLeaf(proxy);
+
+   numberOfProxies++;
+
+   return proxy;
+}
+
+void AabbTree::destroyProxy(int32_t proxy)
+{
+   removeLeaf(proxy);
+   freeNode(proxy);
+
+   numberOfProxies--;
+}
+
+bool AabbTree::moveProxy(int32_t proxy, const Aabb& aabb)
+{
+   Node& node = nodes[proxy];
+   node.tightAabb = aabb;
+
+   if(node.aabb.contains(aabb))
+   {
+      return false;
+   }
+
+   removeLeaf(proxy);
+
+   nodes[proxy].aabb = Aabb(aabb.min - glm::vec3(margin), aabb.max + glm::vec3(margin));
+
+   insertLeaf(proxy);
+
+   return true;
+}
+
+void AabbTree::rebuild()
+{
+   if(root == NULL_NODE)
+   {
+      return;
+   }
+
+   std::vector<int32_t> leaves;
+   leaves.reserve(numberOfProxies);
+
+   for(uint32_t i = 0; i < nodes.size(); i++)
+   {
+      if(nodes[i].height == 0)
+      {
+         leaves.push_back(static_cast<int32_t>(i));
+      }
+      else if(nodes[i].height > 0)
+      {
+         freeNode(static_cast<int32_t>(i));
+      }
+   }
+
+   root = buildSubtree(leaves.data(), leaves.size());
+   nodes[root].parent = NULL_NODE;
+}
+
+int32_t AabbTree::buildSubtree(int32_t* leaves, size_t count)
+{
+   if(count == 1)
+   {
+      return leaves[0];
+   }
+
+   glm::vec3 minCenter = nodes[leaves[0]].aabb.getCenter();
+   glm::vec3 maxCenter = minCenter;
+
+   for(size_t i = 1; i < count; i++)
+   {
+      glm::vec3 center = nodes[leaves[i]].aabb.getCenter();
+
+      minCenter = glm::min(minCenter, center);
+      maxCenter = glm::max(maxCenter, center);
+   }
+
+   glm::vec3 size = maxCenter - minCenter;
+   int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+   size_t half = count / 2;
+
+   std::nth_element(leaves, leaves + half, leaves + count, [this, axis](int32_t a, int32_t b)
+   {
+      return nodes[a].aabb.min[axis] + nodes[a].aabb.max[axis] < nodes[b].aabb.min[axis] + nodes[b].aabb.max[axis];
+   });
+
+   int32_t child1 = buildSubtree(leaves, half);
+   int32_t child2 = buildSubtree(leaves + half, count - half);
+
+   // after the children, allocating can move the nodes
+   int32_t index = allocateNode();
+
+   Node& node = nodes[index];
+   node.child1 = child1;
+   node.child2 = child2;
+   node.aabb   = Aabb::merge(nodes[child1].aabb, nodes[child2].aabb);
+   node.height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+
+   nodes[child1].parent = index;
+   nodes[child2].parent = index;
+
+   return index;
+}
+
+void AabbTree::insertLeaf(int32_t leaf)
+{
+   if(root == NULL_NODE)
+   {
+      root = leaf;
+      nodes[root].parent = NULL_NODE;
+      return;
+   }
+
+   const Aabb leafAabb = nodes[leaf].aabb;
+
+   // walk down to the best sibling, the cost is the surface area the tree grows by. A child can only be cheaper than
+   // the node itself if the rest of the way down doesn't cost more than what it saves here
+   int32_t index = root;
+
+   while(!nodes[index].isLeaf())
+   {
+      const Node& node = nodes[index];
+
+      float area = node.aabb.getSurfaceArea();
+      float combinedArea = Aabb::merge(node.aabb, leafAabb).getSurfaceArea();
+
+      // a new parent for this node and the leaf
+      float cost = 2.f * combinedArea;
+
+      // every node further down grows this node as well
+      float inheritanceCost = 2.f * (combinedArea - area);
+
+      auto descendCost = [this, &leafAabb, inheritanceCost](int32_t child)
+      {
+         const Node& childNode = nodes[child];
+         float mergedArea = Aabb::merge(leafAabb, childNode.aabb).getSurfaceArea();
+
+         if(childNode.isLeaf())
+         {
+            return mergedArea + inheritanceCost;
+         }
+
+         return mergedArea - childNode.aabb.getSurfaceArea() + inheritanceCost;
+      };
+
+      float cost1 = descendCost(node.child1);
+      float cost2 = descendCost(node.child2);
+
+      if(cost < cost1 && cost < cost2)
+      {
+         break;
+      }
+
+      index = cost1 < cost2 ? node.child1 : node.child2;
+   }
+
+   int32_t sibling = index;
+
+   // the new parent takes the place of the sibling
+   int32_t oldParent = nodes[sibling].parent;
+   int32_t newParent = allocateNode();
+
+   nodes[newParent].parent = oldParent;
+   nodes[newParent].aabb   = Aabb::merge(leafAabb, nodes[sibling].aabb);
+   nodes[newParent].height = nodes[sibling].height + 1;
+   nodes[newParent].child1 = sibling;
+   nodes[newParent].child2 = leaf;
+
+   if(oldParent != NULL_NODE)
+   {
+      if(nodes[oldParent].child1 == sibling)
+      {
+         nodes[oldParent].child1 = newParent;
+      }
+      else
+      {
+         nodes[oldParent].child2 = newParent;
+      }
+   }
+   else
+   {
+      root = newParent;
+   }
+
+   nodes[sibling].parent = newParent;
+   nodes[leaf].parent = newParent;
+
+   refitUpwards(nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(int32_t leaf)
+{
+   if(leaf == root)
+   {
+      root = NULL_NODE;
+      return;
+   }
+
+   int32_t parent = nodes[leaf].parent;
+   int32_t grandParent = nodes[parent].parent;
+   int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+   // the sibling takes the place of the parent
+   if(grandParent != NULL_NODE)
+   {
+      if(nodes[grandParent].child1 == parent)
+      {
+         nodes[grandParent].child1 = sibling;
+      }
+      else
+      {
+         nodes[grandParent].child2 = sibling;
+      }
+
+      nodes[sibling].parent = grandParent;
+      freeNode(parent);
+
+      refitUpwards(grandParent);
+   }
+   else
+   {
+      root = sibling;
+      nodes[sibling].parent = NULL_NODE;
+      freeNode(parent);
+   }
+}
+
+void AabbTree::refitUpwards(int32_t index)
+{
+   while(index != NULL_NODE)
+   {
+      index = balance(index);
+
+      Node& node = nodes[index];
+      const Node& child1 = nodes[node.child1];
+      const Node& child2 = nodes[node.child2];
+
+      node.height = 1 + std::max(child1.height, child2.height);
+      node.aabb   = Aabb::merge(child1.aabb, child2.aabb);
+
+      index = node.parent;
+   }
+}
+
+int32_t AabbTree::balance(int32_t iA)
+{
+   Node& a = nodes[iA];
+
+   if(a.isLeaf() || a.height < 2)
+   {
+      return iA;
+   }
+
+   int32_t iB = a.child1;
+   int32_t iC = a.child2;
+
+   Node& b = nodes[iB];
+   Node& c = nodes[iC];
+
+   int32_t heightDifference = c.height - b.height;
+
+   // C is too deep, it takes the place of A and A takes its smaller child
+   if(heightDifference > 1)
+   {
+      int32_t iF = c.child1;
+      int32_t iG = c.child2;
+
+      Node& f = nodes[iF];
+      Node& g = nodes[iG];
+
+      c.child1 = iA;
+      c.parent = a.parent;
+      a.parent = iC;
+
+      if(c.parent != NULL_NODE)
+      {
+         if(nodes[c.parent].child1 == iA)
+         {
+            nodes[c.parent].child1 = iC;
+         }
+         else
+         {
+            nodes[c.parent].child2 = iC;
+         }
+      }
+      else
+      {
+         root = iC;
+      }
+
+      if(f.height > g.height)
+      {
+         c.child2 = iF;
+         a.child2 = iG;
+         g.parent = iA;
+
+         a.aabb   = Aabb::merge(b.aabb, g.aabb);
+         c.aabb   = Aabb::merge(a.aabb, f.aabb);
+         a.height = 1 + std::max(b.height, g.height);
+         c.height = 1 + std::max(a.height, f.height);
+      }
+      else
+      {
+         c.child2 = iG;
+         a.child2 = iF;
+         f.parent = iA;
+
+         a.aabb   = Aabb::merge(b.aabb, f.aabb);
+         c.aabb   = Aabb::merge(a.aabb, g.aabb);
+         a.height = 1 + std::max(b.height, f.height);
+         c.height = 1 + std::max(a.height, g.height);
+      }
+
+      return iC;
+   }
+
+   // the same with B
+   if(heightDifference < -1)
+   {
+      int32_t iD = b.child1;
+      int32_t iE = b.child2;
+
+      Node& d = nodes[iD];
+      Node& e = nodes[iE];
+
+      b.child1 = iA;
+      b.parent = a.parent;
+      a.parent = iB;
+
+      if(b.parent != NULL_NODE)
+      {
+         if(nodes[b.parent].child1 == iA)
+         {
+            nodes[b.parent].child1 = iB;
+         }
+         else
+         {
+            nodes[b.parent].child2 = iB;
+         }
+      }
+      else
+      {
+         root = iB;
+      }
+
+      if(d.height > e.height)
+      {
+         b.child2 = iD;
+         a.child1 = iE;
+         e.parent = iA;
+
+         a.aabb   = Aabb::merge(c.aabb, e.aabb);
+         b.aabb   = Aabb::merge(a.aabb, d.aabb);
+         a.height = 1 + std::max(c.height, e.height);
+         b.height = 1 + std::max(a.height, d.height);
+      }
+      else
+      {
+         b.child2 = iE;
+         a.child1 = iD;
+         d.parent = iA;
+
+         a.aabb   = Aabb::merge(c.aabb, d.aabb);
+         b.aabb   = Aabb::merge(a.aabb, e.aabb);
+         a.height = 1 + std::max(c.height, d.height);
+         b.height = 1 + std::max(a.height, e.height);
+      }
+
+      return iB;
+   }
+
+   return iA;
+}
+
+bool AabbTree::splitPair(const PairTask& task, std::vector<PairTask>& tasks) const
+{
+   const Node& node1 = nodes[task.node1];
+
+   if(task.node1 == task.node2)
+   {
+      // a leaf has no pairs with itself
+      if(!node1.isLeaf())
+      {
+         tasks.push_back({ node1.child1, node1.child1 });
+         tasks.push_back({ node1.child2, node1.child2 });
+
+         if(nodes[node1.child1].aabb.overlaps(nodes[node1.child2].aabb))
+         {
+            tasks.push_back({ node1.child1, node1.child2 });
+         }
+      }
+
+      return true;
+   }
+
+   const Node& node2 = nodes[task.node2];
+
+   if(node1.isLeaf() && node2.isLeaf())
+   {
+      return false;
+   }
+
+   // down the bigger one, so the boxes on both sides stay about the same size
+   bool splitFirst = node2.isLeaf() || (!node1.isLeaf() && node1.aabb.getSurfaceArea() >= node2.aabb.getSurfaceArea());
+
+   const Node& split = splitFirst ? node1 : node2;
+   const Node& other = splitFirst ? node2 : node1;
+   int32_t otherNode = splitFirst ? task.node2 : task.node1;
+
+   for(int32_t child : { split.child1, split.child2 })
+   {
+      if(nodes[child].aabb.overlaps(other.aabb))
+      {
+         tasks.push_back({ child, otherNode });
+      }
+   }
+
+   return true;
+}
+
+void AabbTree::splitPairs(uint32_t count, std::vector<PairTask>& tasks) const
+{
+   tasks.clear();
+
+   if(root == NULL_NODE)
+   {
+      return;
+   }
+
+   // breadth first, so the tasks are about the same size
+   std::vector<PairTask> open;
+   open.push_back({ root, root });
+
+   size_t next = 0;
+
+   while(next < open.size() && tasks.size() + (open.size() - next) < count)
+   {
+      const PairTask task = open[next++];
+
+      if(!splitPair(task, open))
+      {
+         tasks.push_back(task);
+      }
+   }
+
+   tasks.insert(tasks.end(), open.begin() + next, open.end());
+}
+
+void AabbTree::findPairs(const PairTask& task, std::vector<std::pair<uint32_t, uint32_t>>& pairs) const
+{
+   std::vector<PairTask> stack;
+   stack.push_back(task);
+
+   while(!stack.empty())
+   {
+      const PairTask pair = stack.back();
+      stack.pop_back();
+
+      if(splitPair(pair, stack))
+      {
+         continue;
+      }
+
+      // two leaves with overlapping fat boxes
+      const Node& leaf1 = nodes[pair.node1];
+      const Node& leaf2 = nodes[pair.node2];
+
+      if(leaf1.tightAabb.overlaps(leaf2.tightAabb))
+      {
+         pairs.push_back(std::make_pair(std::min(leaf1.userData, leaf2.userData), std::max(leaf1.userData, leaf2.userData)));
+      }
+   }
+}
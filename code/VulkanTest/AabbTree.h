@@ -0,0 +1,385 @@
+#pragma once
+
+// Dynamic bounding volume tree over axis aligned boxes, the same idea as the dynamic tree of Box2D and Bullet.
+//
+// Every proxy is a leaf with a "fat" box, its box grown by a margin. Moving a proxy only touches the tree when its new
+// box leaves the fat one, so objects that rotate or move a little every frame cost a containment test. A leaf is
+// inserted next to the sibling that grows the surface area of the tree the least, and every node on the way back up
+// is rotated like an AVL tree when one child is more than one level deeper than the other, so the tree stays
+// balanced however the proxies are added and moved.
+//
+// The nodes are in one array and refer to each other by index, the nodes that are not used are in a free list.
+// The queries only read the tree, so any number of them can run at the same time.
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+struct Aabb
+{
+   glm::vec3 min = glm::vec3(0.f);
+   glm::vec3 max = glm::vec3(0.f);
+
+   Aabb()
+   {
+   }
+
+   Aabb(glm::vec3 min, glm::vec3 max) : min(min), max(max)
+   {
+   }
+
+   glm::vec3 getCenter() const
+   {
+      return (min + max) * 0.5f;
+   }
+
+   // half the size
+   glm::vec3 getExtent() const
+   {
+      return (max - min) * 0.5f;
+   }
+
+   float getSurfaceArea() const
+   {
+      glm::vec3 size = max - min;
+      return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+   }
+
+   bool contains(const Aabb& other) const
+   {
+      return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+   }
+
+   bool overlaps(const Aabb& other) const
+   {
+      return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+   }
+
+   static Aabb merge(const Aabb& a, const Aabb& b)
+   {
+      return Aabb(glm::min(a.min, b.min), glm::max(a.max, b.max));
+   }
+};
+
+class AabbTree
+{
+public:
+   static const int32_t NULL_NODE = -1;
+
+   // an object can move this far out of its box before it's moved in the tree
+   explicit AabbTree(float margin = 0.1f);
+
+   // userData is handed back by the queries, the proxy is the index of the leaf
+   int32_t createProxy(const Aabb& aabb, uint32_t userData);
+
+   void destroyProxy(int32_t proxy);
+
+   // true if the proxy had to be moved in the tree
+   bool moveProxy(int32_t proxy, const Aabb& aabb);
+
+   // Builds the tree again from the top, splitting the leaves in half along the longest axis every time. Gives a
+   // better tree than inserting them one by one, for when most of the proxies are new or moved. The proxies stay the same.
+   void rebuild();
+
+   uint32_t getUserData(int32_t proxy) const
+   {
+      return nodes[proxy].userData;
+   }
+
+   // the box the proxy was created or moved with
+   const Aabb& getAabb(int32_t proxy) const
+   {
+      return nodes[proxy].tightAabb;
+   }
+
+   const Aabb& getFatAabb(int32_t proxy) const
+   {
+      return nodes[proxy].aabb;
+   }
+
+   uint32_t getNumberOfProxies() const
+   {
+      return numberOfProxies;
+   }
+
+   // 0 for a single leaf
+   int32_t getHeight() const
+   {
+      return root != NULL_NODE ? nodes[root].height : 0;
+   }
+
+   // Calls callback(proxy) for every proxy whose box overlaps aabb. The callback returns false to stop the query.
+   template<typename Callback>
+   void query(const Aabb& aabb, const Callback& callback) const;
+
+   // Calls callback(proxy, distance) for every proxy whose box is hit by the ray before maxDistance, distance is in
+   // units of direction. The callback returns the new maxDistance: its distance to only find closer hits, maxDistance
+   // to find all of them, or 0 to stop.
+   template<typename Callback>
+   void raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, const Callback& callback) const;
+
+   // Calls callback(proxy) for every proxy whose box isn't outside of the frustum. The nodes that are completely
+   // inside hand over all of their leaves without testing them.
+   template<typename Callback>
+   void query(const Frustum& frustum, const Callback& callback) const;
+
+   // The overlapping pairs are found by walking the tree against itself, starting with the root against the root.
+   // A node against itself stands for the pairs inside of its subtree.
+   struct PairTask
+   {
+      int32_t node1;
+      int32_t node2;
+   };
+
+   // Splits walking the tree against itself into about count tasks that can run at the same time, fewer if the tree
+   // is small. Every pair is in exactly one of them.
+   void splitPairs(uint32_t count, std::vector<PairTask>& tasks) const;
+
+   // Appends the user data of every pair of proxies in the task whose boxes overlap, the smaller user data first.
+   void findPairs(const PairTask& task, std::vector<std::pair<uint32_t, uint32_t>>& pairs) const;
+
+private:
+
+   struct Node
+   {
+      // fat for the leaves
+      Aabb aabb;
+
+      // leaves only
+      Aabb tightAabb;
+      uint32_t userData = 0;
+
+      // the next free node when the node is free
+      int32_t parent = NULL_NODE;
+      int32_t child1 = NULL_NODE;
+      int32_t child2 = NULL_NODE;
+
+      // 0 for leaves, -1 when the node is free
+      int32_t height = -1;
+
+      bool isLeaf() const
+      {
+         return child1 == NULL_NODE;
+      }
+   };
+
+   // enough for any tree that fits in memory, the rest goes on the heap
+   class NodeStack
+   {
+   public:
+      void push(int32_t node)
+      {
+         if(count < FIXED_SIZE)
+         {
+            fixed[count] = node;
+         }
+         else
+         {
+            overflow.push_back(node);
+         }
+
+         count++;
+      }
+
+      int32_t pop()
+      {
+         count--;
+
+         if(count < FIXED_SIZE)
+         {
+            return fixed[count];
+         }
+
+         int32_t node = overflow.back();
+         overflow.pop_back();
+
+         return node;
+      }
+
+      bool empty() const
+      {
+         return count == 0;
+      }
+
+   private:
+      static const uint32_t FIXED_SIZE = 128;
+
+      int32_t fixed[FIXED_SIZE];
+      std::vector<int32_t> overflow;
+      uint32_t count = 0;
+   };
+
+   std::vector<Node> nodes;
+
+   int32_t root = NULL_NODE;
+   int32_t freeList = NULL_NODE;
+
+   uint32_t numberOfProxies = 0;
+
+   float margin;
+
+   int32_t allocateNode();
+   void freeNode(int32_t node);
+
+   void insertLeaf(int32_t leaf);
+   void removeLeaf(int32_t leaf);
+
+   // rotates the subtree if it's out of balance, returns the node that took its place
+   int32_t balance(int32_t node);
+
+   // the boxes and heights from node up to the root, after a child changed
+   void refitUpwards(int32_t node);
+
+   // the subtree over the leaves, returns its root
+   int32_t buildSubtree(int32_t* leaves, size_t count);
+
+   // Appends the tasks one step further down, the node pairs whose boxes don't overlap are dropped. false if the
+   // task is two leaves.
+   bool splitPair(const PairTask& task, std::vector<PairTask>& tasks) const;
+};
+
+template<typename Callback>
+void AabbTree::query(const Aabb& aabb, const Callback& callback) const
+{
+   if(root == NULL_NODE)
+   {
+      return;
+   }
+
+   NodeStack stack;
+   stack.push(root);
+
+   while(!stack.empty())
+   {
+      const Node& node = nodes[stack.pop()];
+
+      if(!node.aabb.overlaps(aabb))
+      {
+         continue;
+      }
+
+      if(node.isLeaf())
+      {
+         if(node.tightAabb.overlaps(aabb) && !callback(static_cast<int32_t>(&node - nodes.data())))
+         {
+            return;
+         }
+      }
+      else
+      {
+         stack.push(node.child1);
+         stack.push(node.child2);
+      }
+   }
+}
+
+template<typename Callback>
+void AabbTree::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, const Callback& callback) const
+{
+   if(root == NULL_NODE)
+   {
+      return;
+   }
+
+   // slab test, a zero component gives an infinite inverse and the slab is either always or never hit
+   glm::vec3 inverseDirection = 1.f / direction;
+
+   auto intersect = [&origin, &inverseDirection](const Aabb& aabb, float maxDistance, float& distance)
+   {
+      glm::vec3 t1 = (aabb.min - origin) * inverseDirection;
+      glm::vec3 t2 = (aabb.max - origin) * inverseDirection;
+
+      glm::vec3 tNear = glm::min(t1, t2);
+      glm::vec3 tFar = glm::max(t1, t2);
+
+      float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+      float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+
+      distance = enter;
+
+      return enter <= exit;
+   };
+
+   NodeStack stack;
+   stack.push(root);
+
+   float distance;
+
+   while(!stack.empty())
+   {
+      const Node& node = nodes[stack.pop()];
+
+      if(!intersect(node.aabb, maxDistance, distance))
+      {
+         continue;
+      }
+
+      if(node.isLeaf())
+      {
+         if(intersect(node.tightAabb, maxDistance, distance))
+         {
+            maxDistance = callback(static_cast<int32_t>(&node - nodes.data()), distance);
+
+            if(maxDistance <= 0.f)
+            {
+               return;
+            }
+         }
+      }
+      else
+      {
+         stack.push(node.child1);
+         stack.push(node.child2);
+      }
+   }
+}
+
+template<typename Callback>
+void AabbTree::query(const Frustum& frustum, const Callback& callback) const
+{
+   if(root == NULL_NODE)
+   {
+      return;
+   }
+
+   // the lowest bit says the node is inside
+   NodeStack stack;
+   stack.push(root << 1);
+
+   while(!stack.empty())
+   {
+      int32_t entry = stack.pop();
+      const Node& node = nodes[entry >> 1];
+
+      bool inside = (entry & 1) != 0;
+
+      if(!inside)
+      {
+         const Aabb& aabb = node.isLeaf() ? node.tightAabb : node.aabb;
+
+         Frustum::Containment containment = frustum.classify(aabb.getCenter(), aabb.getExtent());
+
+         if(containment == Frustum::Containment::Outside)
+         {
+            continue;
+         }
+
+         inside = containment == Frustum::Containment::Inside;
+      }
+
+      if(node.isLeaf())
+      {
+         callback(entry >> 1);
+      }
+      else
+      {
+         stack.push((node.child1 << 1) | (inside ? 1 : 0));
+         stack.push((node.child2 << 1) | (inside ? 1 : 0));
+      }
+   }
+}
@@ -0,0 +1,342 @@
+#include "AssetLoader.h"
+#include "TextureAtlas.h"
+#include "UploadManager.h"
+
+#include <algorithm>
+#include <iostream>
+
+AssetLoader::AssetLoader(vks::VulkanDevice* vulkanDevice, Mesh* mesh, JobSystem* jobSystem)
+{
+   this->vulkanDevice = vulkanDevice;
+   this->mesh         = mesh;
+   this->jobSystem    = jobSystem;
+
+   loaderThread = std::thread(&AssetLoader::loaderLoop, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+   // the jobs push into our queues, they have to be done before we go away
+   jobSystem->waitIdle();
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+   }
+   workAvailable.notify_all();
+
+   loaderThread.join();
+
+   for(auto& imageData : decodedImages)
+   {
+      Texture::freeImageData(imageData);
+   }
+
+   if(loadedMeshes.empty() && loadedTextures.empty())
+   {
+      return;
+   }
+
+   // never installed, destroy them here instead. the uploads might still be running.
+   vulkanDevice->uploadManager->waitIdle();
+
+   for(auto& loadedMesh : loadedMeshes)
+   {
+      mesh->freeMeshBuffers(loadedMesh.meshBuffers);
+   }
+   for(auto& loadedTexture : loadedTextures)
+   {
+      mesh->getTexture()->destroyTextureResources(loadedTexture.resources);
+   }
+}
+
+uint32_t AssetLoader::loadMesh(const std::string& fileName)
+{
+   uint32_t meshId = mesh->reserveMesh(fileName);
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      pendingCount++;
+   }
+
+   jobSystem->schedule([this, meshId, fileName]() { parseMesh(meshId, fileName); });
+
+   return meshId;
+}
+
+void AssetLoader::parseMesh(uint32_t meshId, const std::string& fileName)
+{
+   ParsedMesh parsedMesh;
+   parsedMesh.meshId = meshId;
+
+   try
+   {
+      parsedMesh.meshData = Mesh::parseMesh(fileName);
+      TextureAtlas::pack(parsedMesh.meshData);
+   }
+   catch(const std::exception& e)
+   {
+      std::cerr << "failed to load mesh " << fileName << ": " << e.what() << std::endl;
+
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         pendingCount--;
+      }
+      uploaded.notify_all();
+      return;
+   }
+
+   std::vector<std::string> newTextures;
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for(const auto& materialData : parsedMesh.meshData.materials)
+      {
+         for(const std::string* textureName : { &materialData.diffuseTexture, &materialData.specularTexture, &materialData.bumpTexture })
+         {
+            if(textureName->empty())
+            {
+               continue;
+            }
+
+            // the same file might be named differently by two materials
+            std::string path = Texture::normalizePath(*textureName);
+            if(requestedTextures.insert(path).second)
+            {
+               newTextures.push_back(path);
+            }
+         }
+      }
+
+      pendingCount += static_cast<uint32_t>(newTextures.size());
+
+      parsedMeshes.push_back(std::move(parsedMesh));
+   }
+   workAvailable.notify_one();
+
+   // the mesh can be uploaded while its textures are decoded
+   for(const auto& textureName : newTextures)
+   {
+      jobSystem->schedule([this, textureName]() { decodeImage(textureName); });
+   }
+}
+
+void AssetLoader::decodeImage(const std::string& fileName)
+{
+   Texture::ImageData imageData;
+
+   try
+   {
+      imageData = Texture::decodeImage(fileName, mesh->getTexture()->isCompressionSupported(), jobSystem);
+   }
+   catch(const std::exception& e)
+   {
+      std::cerr << e.what() << std::endl;
+
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         pendingCount--;
+      }
+      uploaded.notify_all();
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      decodedImages.push_back(imageData);
+   }
+   workAvailable.notify_one();
+}
+
+void AssetLoader::loaderLoop()
+{
+   for(;;)
+   {
+      std::deque<ParsedMesh> meshes;
+      std::deque<Texture::ImageData> images;
+
+      {
+         std::unique_lock<std::mutex> lock(mutex);
+         workAvailable.wait(lock, [this] { return quit || !parsedMeshes.empty() || !decodedImages.empty(); });
+
+         if(quit)
+         {
+            return;
+         }
+
+         meshes.swap(parsedMeshes);
+         images.swap(decodedImages);
+      }
+
+      std::vector<LoadedMesh> newMeshes;
+      std::vector<LoadedTexture> newTextures;
+
+      for(auto& parsedMesh : meshes)
+      {
+         try
+         {
+            LoadedMesh loadedMesh;
+            loadedMesh.meshId      = parsedMesh.meshId;
+            loadedMesh.meshBuffers = mesh->createMeshBuffers(parsedMesh.meshData);
+            loadedMesh.meshData    = std::move(parsedMesh.meshData);
+
+            newMeshes.push_back(std::move(loadedMesh));
+         }
+         catch(const std::exception& e)
+         {
+            std::cerr << "failed to upload mesh " << parsedMesh.meshData.fileName << ": " << e.what() << std::endl;
+         }
+      }
+
+      for(auto& imageData : images)
+      {
+         try
+         {
+            LoadedTexture loadedTexture;
+            loadedTexture.name      = imageData.name;
+            loadedTexture.resources = mesh->getTexture()->createTextureResources(imageData);
+
+            newTextures.push_back(loadedTexture);
+         }
+         catch(const std::exception& e)
+         {
+            std::cerr << "failed to upload texture " << imageData.name << ": " << e.what() << std::endl;
+         }
+
+         Texture::freeImageData(imageData);
+      }
+
+      // one submit for everything that was ready this round
+      vulkanDevice->uploadManager->flush();
+
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+
+         for(auto& loadedMesh : newMeshes)
+         {
+            loadedMeshes.push_back(std::move(loadedMesh));
+         }
+         for(auto& loadedTexture : newTextures)
+         {
+            loadedTextures.push_back(loadedTexture);
+         }
+
+         pendingCount -= static_cast<uint32_t>(meshes.size() + images.size());
+      }
+      uploaded.notify_all();
+   }
+}
+
+bool AssetLoader::processCompleted()
+{
+   std::vector<LoadedMesh> readyMeshes;
+   std::vector<LoadedTexture> readyTextures;
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for(size_t i = 0; i < loadedMeshes.size();)
+      {
+         if(vulkanDevice->uploadManager->isComplete(loadedMeshes[i].meshBuffers.uploadTicket))
+         {
+            readyMeshes.push_back(std::move(loadedMeshes[i]));
+            loadedMeshes.erase(loadedMeshes.begin() + i);
+         }
+         else
+         {
+            i++;
+         }
+      }
+
+      std::set<std::string> wantedTextures;
+      for(const auto& loadedMesh : readyMeshes)
+      {
+         for(const auto& materialData : loadedMesh.meshData.materials)
+         {
+            for(const std::string* textureName : { &materialData.diffuseTexture, &materialData.specularTexture, &materialData.bumpTexture })
+            {
+               wantedTextures.insert(Texture::normalizePath(*textureName));
+            }
+         }
+      }
+
+      // a texture can be uploaded before the mesh that uses it, it waits for the mesh then. if it's not requested
+      // anymore every mesh using it was unloaded, installTexture destroys it
+      for(size_t i = 0; i < loadedTextures.size();)
+      {
+         const std::string& name = loadedTextures[i].name;
+         bool waitsForMesh = mesh->getTexture()->findTexture(name) < 0 && wantedTextures.count(name) == 0 && requestedTextures.count(name) > 0;
+
+         if(!waitsForMesh && vulkanDevice->uploadManager->isComplete(loadedTextures[i].resources.uploadTicket))
+         {
+            readyTextures.push_back(loadedTextures[i]);
+            loadedTextures.erase(loadedTextures.begin() + i);
+         }
+         else
+         {
+            i++;
+         }
+      }
+   }
+
+   if(readyMeshes.empty() && readyTextures.empty())
+   {
+      return false;
+   }
+
+   // nothing waits for the GPU here, the material sets of frames still in flight are only rewritten after their fence
+   // (Mesh::updateDescriptorSets). meshes first, so the textures find the materials that use them
+   for(const auto& loadedMesh : readyMeshes)
+   {
+      mesh->installMesh(loadedMesh.meshId, loadedMesh.meshData, loadedMesh.meshBuffers);
+   }
+   for(auto& loadedTexture : readyTextures)
+   {
+      mesh->installTexture(loadedTexture.name, loadedTexture.resources);
+   }
+
+   return true;
+}
+
+void AssetLoader::unloadMesh(uint32_t meshId)
+{
+   std::vector<std::string> evictedTextures = mesh->unloadMesh(meshId);
+
+   // loaded again when another mesh wants them
+   std::lock_guard<std::mutex> lock(mutex);
+   for(const auto& textureName : evictedTextures)
+   {
+      requestedTextures.erase(textureName);
+   }
+}
+
+void AssetLoader::waitIdle()
+{
+   uint64_t lastTicket = 0;
+
+   {
+      std::unique_lock<std::mutex> lock(mutex);
+      uploaded.wait(lock, [this] { return pendingCount == 0; });
+
+      for(const auto& loadedMesh : loadedMeshes)
+      {
+         lastTicket = std::max(lastTicket, loadedMesh.meshBuffers.uploadTicket);
+      }
+      for(const auto& loadedTexture : loadedTextures)
+      {
+         lastTicket = std::max(lastTicket, loadedTexture.resources.uploadTicket);
+      }
+   }
+
+   if(lastTicket > 0)
+   {
+      vulkanDevice->uploadManager->wait(lastTicket);
+   }
+}
+
+uint32_t AssetLoader::getPendingCount()
+{
+   std::lock_guard<std::mutex> lock(mutex);
+   return pendingCount;
+}
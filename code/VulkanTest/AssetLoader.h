@@ -0,0 +1,95 @@
+#pragma once
+
+// Loads meshes and their textures in the background.
+//
+// loadMesh reserves a mesh id right away, so world objects can use it before the mesh is loaded. Parsing the obj (and
+// packing its small textures into a TextureAtlas) and decoding the textures runs on the job system, one job per file.
+// The GPU side (creating buffers/images and recording the uploads) runs on a single loader thread, which flushes the
+// upload manager once per round so everything that was ready at the same time ends up in the same submit.
+//
+// processCompleted has to be called on the main thread, it installs everything whose upload has finished. Until then
+// the mesh is not resident and should not be drawn, and materials are drawn with the placeholder texture.
+
+#include "JobSystem.h"
+#include "Mesh.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+class AssetLoader
+{
+public:
+   AssetLoader(vks::VulkanDevice* vulkanDevice, Mesh* mesh, JobSystem* jobSystem);
+   ~AssetLoader();
+
+   // returns the id the mesh will have
+   uint32_t loadMesh(const std::string& fileName);
+
+   // installs finished meshes and textures. returns true if anything was installed, the command buffers have to be
+   // re-recorded then. Doesn't wait for the GPU, the changed material sets are rewritten frame by frame with
+   // Mesh::updateDescriptorSets.
+   bool processCompleted();
+
+   // Mesh::unloadMesh, textures it evicts are loaded again if a mesh wants them later
+   void unloadMesh(uint32_t meshId);
+
+   // blocks until everything requested so far is uploaded, processCompleted still has to be called after
+   void waitIdle();
+
+   // files that are not uploaded yet
+   uint32_t getPendingCount();
+
+private:
+
+   struct ParsedMesh
+   {
+      uint32_t meshId;
+      Mesh::MeshData meshData;
+   };
+
+   struct LoadedMesh
+   {
+      uint32_t meshId;
+      Mesh::MeshData meshData;
+      Mesh::MeshBuffers meshBuffers;
+   };
+
+   struct LoadedTexture
+   {
+      std::string name;
+      Texture::TextureResources resources;
+   };
+
+   vks::VulkanDevice* vulkanDevice;
+   Mesh* mesh;
+   JobSystem* jobSystem;
+
+   std::thread loaderThread;
+
+   std::mutex mutex;
+   std::condition_variable workAvailable;
+   std::condition_variable uploaded;
+
+   // filled by the jobs, emptied by the loader thread
+   std::deque<ParsedMesh> parsedMeshes;
+   std::deque<Texture::ImageData> decodedImages;
+
+   // filled by the loader thread, emptied by processCompleted
+   std::vector<LoadedMesh> loadedMeshes;
+   std::vector<LoadedTexture> loadedTextures;
+
+   // textures are shared between meshes, only load each one once. normalised paths
+   std::set<std::string> requestedTextures;
+
+   uint32_t pendingCount = 0;
+   bool quit = false;
+
+   void parseMesh(uint32_t meshId, const std::string& fileName);
+   void decodeImage(const std::string& fileName);
+
+   void loaderLoop();
+};
@@ -0,0 +1,41 @@
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+void BoundsStreams::resize(uint32_t count)
+{
+   this->count = count;
+
+   size_t paddedCount = (size_t(count) + 3) & ~size_t(3);
+
+   for(auto* stream : { &centerX, &centerY, &centerZ, &radius, &extentX, &extentY, &extentZ })
+   {
+      stream->resize(paddedCount, 0.f);
+   }
+}
+
+void BoundsStreams::set(uint32_t index, const Bounds& bounds, const glm::mat4& modelMatrix)
+{
+   glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(bounds.center, 1.f));
+
+   centerX[index] = center.x;
+   centerY[index] = center.y;
+   centerZ[index] = center.z;
+
+   glm::vec3 axisX = glm::vec3(modelMatrix[0]);
+   glm::vec3 axisY = glm::vec3(modelMatrix[1]);
+   glm::vec3 axisZ = glm::vec3(modelMatrix[2]);
+
+   float maxScaleSquared = std::max({ glm::dot(axisX, axisX), glm::dot(axisY, axisY), glm::dot(axisZ, axisZ) });
+
+   radius[index] = bounds.radius * std::sqrt(maxScaleSquared);
+
+   // every world axis gets the part of each local axis that points along it
+   glm::vec3 extent = bounds.getExtent();
+   glm::vec3 worldExtent = glm::abs(axisX) * extent.x + glm::abs(axisY) * extent.y + glm::abs(axisZ) * extent.z;
+
+   extentX[index] = worldExtent.x;
+   extentY[index] = worldExtent.y;
+   extentZ[index] = worldExtent.z;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Bounds is an axis aligned box and a sphere around it, in the space of the mesh. The sphere is centered on the box,
+// its radius is the distance to the farthest vertex (not half the diagonal), so it's usually tighter than the corners.
+//
+// BoundsStreams holds the world space bounds of many objects as separate float streams (SoA), so Frustum can test
+// 4 of them at once. The box is still centered on the sphere after the transform, so they share the center.
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct Bounds
+{
+   glm::vec3 min = glm::vec3(0.f);
+   glm::vec3 max = glm::vec3(0.f);
+
+   glm::vec3 center = glm::vec3(0.f);
+   float radius = 0.f;
+
+   // half the size of the box
+   glm::vec3 getExtent() const
+   {
+      return (max - min) * 0.5f;
+   }
+
+   bool operator==(const Bounds& other) const
+   {
+      return min == other.min && max == other.max && center == other.center && radius == other.radius;
+   }
+
+   bool operator!=(const Bounds& other) const
+   {
+      return !(*this == other);
+   }
+};
+
+struct BoundsStreams
+{
+   std::vector<float> centerX, centerY, centerZ;
+   std::vector<float> radius;
+
+   // half the size of the world space box around the transformed box
+   std::vector<float> extentX, extentY, extentZ;
+
+   // padded to a multiple of 4, Frustum::cull skips the padding
+   void resize(uint32_t count);
+
+   uint32_t size() const
+   {
+      return count;
+   }
+
+   // bounds transformed by the model matrix. the radius is scaled by the largest scale of the matrix, the box is
+   // the one around the rotated box
+   void set(uint32_t index, const Bounds& bounds, const glm::mat4& modelMatrix);
+
+private:
+
+   uint32_t count = 0;
+};
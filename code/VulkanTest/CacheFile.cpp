@@ -0,0 +1,135 @@
+#include "CacheFile.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+const char* CacheFile::CACHE_DIRECTORY = "./cache/";
+
+std::string CacheFile::getFileName(const std::string& sourceFile, const char* extension)
+{
+   std::ostringstream name;
+   name << CACHE_DIRECTORY << std::hex << std::setw(16) << std::setfill('0') << hash(sourceFile.data(), sourceFile.size()) << extension;
+
+   return name.str();
+}
+
+bool CacheFile::getSourceInfo(const std::string& sourceFile, uint64_t* time, uint64_t* size)
+{
+#ifdef _WIN32
+   struct _stat64 fileInfo;
+   if(_stat64(sourceFile.c_str(), &fileInfo) != 0)
+#else
+   struct stat fileInfo;
+   if(stat(sourceFile.c_str(), &fileInfo) != 0)
+#endif
+   {
+      return false;
+   }
+
+   *time = static_cast<uint64_t>(fileInfo.st_mtime);
+   *size = static_cast<uint64_t>(fileInfo.st_size);
+
+   return true;
+}
+
+bool CacheFile::hashFile(const std::string& fileName, uint64_t* hash)
+{
+   MappedFile file;
+   if(!file.open(fileName))
+   {
+      return false;
+   }
+
+   *hash = CacheFile::hash(file.getData(), file.getSize());
+
+   return true;
+}
+
+bool CacheFile::isUpToDate(const std::string& sourceFile, uint64_t time, uint64_t size, uint64_t hash)
+{
+   uint64_t sourceTime;
+   uint64_t sourceSize;
+   if(!getSourceInfo(sourceFile, &sourceTime, &sourceSize) || sourceSize != size)
+   {
+      return false;
+   }
+
+   if(sourceTime != time)
+   {
+      uint64_t sourceHash;
+      if(!hashFile(sourceFile, &sourceHash) || sourceHash != hash)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool CacheFile::write(const std::string& fileName, const std::vector<char>& buffer)
+{
+#ifdef _WIN32
+   _mkdir(CACHE_DIRECTORY);
+#else
+   mkdir(CACHE_DIRECTORY, 0755);
+#endif
+
+   // write to a temporary file and move it in place when it's complete
+   std::ostringstream tempFile;
+   tempFile << fileName << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+
+   {
+      std::ofstream file(tempFile.str(), std::ios::binary | std::ios::trunc);
+      if(!file.is_open())
+      {
+         return false;
+      }
+
+      file.write(buffer.data(), buffer.size());
+
+      if(!file.good())
+      {
+         file.close();
+         std::remove(tempFile.str().c_str());
+         return false;
+      }
+   }
+
+   // rename doesn't replace existing files on windows
+   if(std::rename(tempFile.str().c_str(), fileName.c_str()) != 0)
+   {
+      std::remove(fileName.c_str());
+
+      if(std::rename(tempFile.str().c_str(), fileName.c_str()) != 0)
+      {
+         std::remove(tempFile.str().c_str());
+         return false;
+      }
+   }
+
+   return true;
+}
+
+uint64_t CacheFile::hash(const void* data, size_t size)
+{
+   const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+   uint64_t result = 14695981039346656037ull;
+   for(size_t i = 0; i < size; i++)
+   {
+      result ^= bytes[i];
+      result *= 1099511628211ull;
+   }
+
+   return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// What the binary caches (MeshCache, TextureCache) have in common: where their files go, checking if the source file
+// changed since the cache was written and writing the cache so a half written file is never used.
+//
+// A cache stores the modification time, size and a hash of the contents of its source. It's up to date if the time and
+// size still match, or if the contents hash still matches (e.g. after a fresh checkout).
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CacheFile
+{
+public:
+   static const char* CACHE_DIRECTORY;
+
+   // in CACHE_DIRECTORY, named by a hash of the source path
+   static std::string getFileName(const std::string& sourceFile, const char* extension);
+
+   static bool getSourceInfo(const std::string& sourceFile, uint64_t* time, uint64_t* size);
+   static bool hashFile(const std::string& fileName, uint64_t* hash);
+
+   // the time, size and hash of the source when the cache was written
+   static bool isUpToDate(const std::string& sourceFile, uint64_t time, uint64_t size, uint64_t hash);
+
+   // thread safe, the same file might be written from two threads at once. false if it couldn't be written
+   static bool write(const std::string& fileName, const std::vector<char>& buffer);
+
+   // FNV-1a
+   static uint64_t hash(const void* data, size_t size);
+};
@@ -1,6 +1,6 @@
 #include "Camera.h"
 #include "stdafx.h"
-#include <glm\gtc\matrix_transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <chrono>
 #include <algorithm>
 
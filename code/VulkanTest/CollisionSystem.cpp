@@ -0,0 +1,828 @@
+#include "CollisionSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const uint32_t CollisionSystem::MIN_BODIES_PER_JOB;
+const float CollisionSystem::ALLOWED_DEPTH = 0.005f;
+const float CollisionSystem::DEPTH_CORRECTION = 0.8f;
+const float CollisionSystem::LARGE_BODY_SIZE = 2.f;
+
+Obb Obb::transform(const Bounds& bounds, const glm::mat4& matrix)
+{
+   Obb obb;
+   obb.center = glm::vec3(matrix * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.f));
+
+   glm::vec3 extent = bounds.getExtent();
+
+   // the scale is the length of the columns
+   for(int i = 0; i < 3; i++)
+   {
+      glm::vec3 column(matrix[i]);
+      float length = glm::length(column);
+
+      if(length > 0.f)
+      {
+         obb.axes[i] = column / length;
+      }
+
+      obb.extent[i] = extent[i] * length;
+   }
+
+   return obb;
+}
+
+Aabb Obb::getAabb() const
+{
+   glm::vec3 aabbExtent = glm::abs(axes[0]) * extent.x + glm::abs(axes[1]) * extent.y + glm::abs(axes[2]) * extent.z;
+
+   return Aabb(center - aabbExtent, center + aabbExtent);
+}
+
+Sphere Sphere::transform(const Bounds& bounds, const glm::mat4& matrix)
+{
+   float scale = std::max(std::max(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1]))), glm::length(glm::vec3(matrix[2])));
+
+   Sphere sphere;
+   sphere.center = glm::vec3(matrix * glm::vec4(bounds.center, 1.f));
+   sphere.radius = bounds.radius * scale;
+
+   return sphere;
+}
+
+CollisionSystem::CollisionSystem(JobSystem* jobSystem)
+{
+   this->jobSystem = jobSystem;
+}
+
+void CollisionSystem::setCollider(uint32_t index, ColliderShape shape, const Bounds& bounds, bool movable)
+{
+   if(index >= colliders.size())
+   {
+      colliders.resize(index + 1);
+   }
+
+   if((colliders[index].shape == ColliderShape::None) != (shape == ColliderShape::None))
+   {
+      numberOfColliders += shape == ColliderShape::None ? -1 : 1;
+      collidersChanged = true;
+   }
+
+   colliders[index].shape = shape;
+   colliders[index].bounds = bounds;
+   colliders[index].movable = movable;
+}
+
+void CollisionSystem::setColliderBounds(uint32_t index, const Bounds& bounds)
+{
+   if(index < colliders.size())
+   {
+      colliders[index].bounds = bounds;
+   }
+}
+
+void CollisionSystem::resolve(TransformStreams& transforms, const glm::mat4* matrices, float dt)
+{
+   if(collidersChanged)
+   {
+      colliderObjects.clear();
+      objectBody.assign(colliders.size(), UINT32_MAX);
+
+      for(uint32_t index = 0; index < colliders.size(); index++)
+      {
+         if(colliders[index].shape != ColliderShape::None)
+         {
+            objectBody[index] = static_cast<uint32_t>(colliderObjects.size());
+            colliderObjects.push_back(index);
+         }
+      }
+
+      bodies.resize(colliderObjects.size());
+
+      collidersChanged = false;
+   }
+
+   contacts.clear();
+   resolvedObjects.clear();
+   numberOfPairs = 0;
+
+   if(bodies.empty())
+   {
+      return;
+   }
+
+   buildBodies(transforms, matrices, dt);
+   buildGrid();
+   findContacts();
+   respond();
+
+   // one at a time, the objects of a block share their dirty bits
+   for(uint32_t body = 0; body < bodies.size(); body++)
+   {
+      const Body& resolved = bodies[body];
+
+      if(firstContact[body] == firstContact[body + 1] || resolved.inverseMass == 0.f)
+      {
+         continue;
+      }
+
+      transforms.setVelocity(resolved.object, resolved.velocity + resolved.velocityChange);
+
+      if(resolved.positionChange != glm::vec3(0.f))
+      {
+         transforms.setPosition(resolved.object, resolved.position + resolved.positionChange);
+      }
+
+      resolvedObjects.push_back(resolved.object);
+   }
+}
+
+void CollisionSystem::buildBodies(const TransformStreams& transforms, const glm::mat4* matrices, float dt)
+{
+   uint32_t numberOfBodies = static_cast<uint32_t>(bodies.size());
+   uint32_t bodiesPerJob = std::max(MIN_BODIES_PER_JOB, numberOfBodies / ((jobSystem->getNumberOfWorkers() + 1) * 4));
+
+   jobSystem->parallelFor(0, numberOfBodies, bodiesPerJob, [this, &transforms, matrices, dt](uint32_t first, uint32_t last)
+   {
+      for(uint32_t index = first; index < last; index++)
+      {
+         Body& body = bodies[index];
+         body.object = colliderObjects[index];
+
+         const Collider& collider = colliders[body.object];
+         const glm::mat4& matrix = matrices[body.object];
+
+         body.shape = collider.shape;
+         body.obb = Obb::transform(collider.bounds, matrix);
+
+         if(body.shape == ColliderShape::Sphere)
+         {
+            body.sphere = Sphere::transform(collider.bounds, matrix);
+            body.aabb = Aabb(body.sphere.center - glm::vec3(body.sphere.radius), body.sphere.center + glm::vec3(body.sphere.radius));
+         }
+         else
+         {
+            body.aabb = body.obb.getAabb();
+         }
+
+         // an AABB is an OBB that doesn't rotate, when it's tested against one
+         if(body.shape == ColliderShape::Aabb)
+         {
+            body.obb = Obb();
+            body.obb.center = body.aabb.getCenter();
+            body.obb.extent = body.aabb.getExtent();
+         }
+
+         body.position = transforms.getPosition(body.object);
+         body.velocity = transforms.getVelocity(body.object);
+         body.displacement = body.velocity * dt;
+
+         Aabb startAabb(body.aabb.min - body.displacement, body.aabb.max - body.displacement);
+         body.sweptAabb = Aabb::merge(startAabb, body.aabb);
+
+         body.inverseMass = collider.movable ? 1.f : 0.f;
+
+         glm::vec3 size = body.aabb.max - body.aabb.min;
+         body.fast = glm::length(body.displacement) > 0.5f * std::min(std::min(size.x, size.y), size.z);
+
+         glm::vec3 sweptSize = body.sweptAabb.max - body.sweptAabb.min;
+         body.size = std::max(std::max(sweptSize.x, sweptSize.y), sweptSize.z);
+
+         body.positionChange = glm::vec3(0.f);
+         body.velocityChange = glm::vec3(0.f);
+      }
+   });
+}
+
+void CollisionSystem::buildGrid()
+{
+   uint32_t numberOfBodies = static_cast<uint32_t>(bodies.size());
+
+   // in the order of the bodies, so it comes out the same every time
+   float totalSize = 0.f;
+
+   for(const Body& body : bodies)
+   {
+      totalSize += body.size;
+   }
+
+   float maxSize = LARGE_BODY_SIZE * totalSize / numberOfBodies;
+
+   // as big as the biggest body in the grid, so the bodies that touch are in neighbouring cells
+   cellSize = 0.f;
+   largeBodies.clear();
+
+   for(uint32_t index = 0; index < numberOfBodies; index++)
+   {
+      Body& body = bodies[index];
+      body.large = body.size > maxSize;
+
+      if(body.large)
+      {
+         largeBodies.push_back(index);
+      }
+      else
+      {
+         cellSize = std::max(cellSize, body.size);
+      }
+   }
+
+   // no bounds yet
+   if(cellSize <= 0.f)
+   {
+      cellSize = 1.f;
+   }
+
+   uint32_t numberOfBuckets = 1;
+
+   while(numberOfBuckets < numberOfBodies * 2)
+   {
+      numberOfBuckets *= 2;
+   }
+
+   bucketMask = numberOfBuckets - 1;
+
+   glm::ivec3 lastCell(std::numeric_limits<int>::min());
+   firstCell = glm::ivec3(std::numeric_limits<int>::max());
+
+   for(Body& body : bodies)
+   {
+      if(!body.large)
+      {
+         // far enough out to not overflow
+         glm::vec3 cell = glm::clamp(glm::floor(body.sweptAabb.getCenter() / cellSize), glm::vec3(-1e9f), glm::vec3(1e9f));
+         body.cell = glm::ivec3(cell);
+
+         firstCell = glm::min(firstCell, body.cell);
+         lastCell = glm::max(lastCell, body.cell);
+      }
+   }
+
+   // only large bodies
+   if(largeBodies.size() == numberOfBodies)
+   {
+      firstCell = glm::ivec3(0);
+      lastCell = glm::ivec3(0);
+   }
+
+   // the rows are a cell longer than the box, so the last cell of a row and the first of the next one aren't neighbours
+   cellsPerRow = uint32_t(lastCell.x - firstCell.x) + 2;
+   cellsPerLayer = cellsPerRow * (uint32_t(lastCell.y - firstCell.y) + 2);
+
+   // counting sort of the bodies by bucket, firstInBucket is moved up by one bucket while filling in and moved back after
+   firstInBucket.assign(numberOfBuckets + 1, 0);
+
+   for(const Body& body : bodies)
+   {
+      if(!body.large)
+      {
+         firstInBucket[getBucket(body.cell) + 1]++;
+      }
+   }
+
+   for(uint32_t bucket = 0; bucket < numberOfBuckets; bucket++)
+   {
+      firstInBucket[bucket + 1] += firstInBucket[bucket];
+   }
+
+   bucketBodies.resize(firstInBucket[numberOfBuckets]);
+
+   for(uint32_t index = 0; index < numberOfBodies; index++)
+   {
+      const Body& body = bodies[index];
+
+      if(!body.large)
+      {
+         GridBody& gridBody = bucketBodies[firstInBucket[getBucket(body.cell)]++];
+         gridBody.cell = body.cell;
+         gridBody.body = index;
+         gridBody.sweptAabb = body.sweptAabb;
+      }
+   }
+
+   for(uint32_t bucket = numberOfBuckets; bucket > 0; bucket--)
+   {
+      firstInBucket[bucket] = firstInBucket[bucket - 1];
+   }
+
+   firstInBucket[0] = 0;
+}
+
+uint32_t CollisionSystem::getBucket(glm::ivec3 cell) const
+{
+   glm::uvec3 offset(cell - firstCell);
+
+   return (offset.x + offset.y * cellsPerRow + offset.z * cellsPerLayer) & bucketMask;
+}
+
+void CollisionSystem::findContacts()
+{
+   // the bodies in the grid in the order of the buckets, so the ones after each other look at the same buckets, then
+   // the large bodies
+   uint32_t numberOfGridBodies = static_cast<uint32_t>(bucketBodies.size());
+   uint32_t numberOfEntries = numberOfGridBodies + static_cast<uint32_t>(largeBodies.size());
+
+   uint32_t entriesPerJob = std::max(MIN_BODIES_PER_JOB, numberOfEntries / ((jobSystem->getNumberOfWorkers() + 1) * 4));
+   uint32_t numberOfJobs = (numberOfEntries + entriesPerJob - 1) / entriesPerJob;
+
+   contactsInJob.resize(numberOfJobs);
+   pairsInJob.resize(numberOfJobs);
+
+   jobSystem->parallelFor(0, numberOfEntries, entriesPerJob, [this, entriesPerJob, numberOfGridBodies](uint32_t first, uint32_t last)
+   {
+      uint32_t job = first / entriesPerJob;
+
+      std::vector<Contact>& found = contactsInJob[job];
+      found.clear();
+
+      uint32_t pairs = 0;
+
+      // the first body of a pair is the one of the lower object, so the contacts don't depend on which one found the pair
+      auto test = [this, &found, &pairs](const Body& body, const Body& other)
+      {
+         if(body.inverseMass + other.inverseMass == 0.f)
+         {
+            return;
+         }
+
+         pairs++;
+
+         Contact contact;
+
+         if(body.object < other.object ? collide(body, other, contact) : collide(other, body, contact))
+         {
+            found.push_back(contact);
+         }
+      };
+
+      for(uint32_t entry = first; entry < last; entry++)
+      {
+         if(entry >= numberOfGridBodies)
+         {
+            // the large bodies after this one
+            const Body& body = bodies[largeBodies[entry - numberOfGridBodies]];
+
+            for(uint32_t other : largeBodies)
+            {
+               if(bodies[other].object > body.object && body.sweptAabb.overlaps(bodies[other].sweptAabb))
+               {
+                  test(body, bodies[other]);
+               }
+            }
+
+            continue;
+         }
+
+         const GridBody& gridBody = bucketBodies[entry];
+         const Body& body = bodies[gridBody.body];
+
+         // its own cell and the 13 after it, the other 13 find it. rows along x: y, z, the first and the last x
+         const glm::ivec4 rows[5] = { glm::ivec4(0, 0, 0, 1), glm::ivec4(1, 0, -1, 1), glm::ivec4(-1, 1, -1, 1), glm::ivec4(0, 1, -1, 1), glm::ivec4(1, 1, -1, 1) };
+
+         for(const glm::ivec4& row : rows)
+         {
+            glm::ivec3 rowStart = gridBody.cell + glm::ivec3(row.z, row.x, row.y);
+            glm::ivec3 rowEnd = gridBody.cell + glm::ivec3(row.w, row.x, row.y);
+
+            uint32_t firstBucket = getBucket(rowStart);
+            uint32_t lastBucket = firstBucket + uint32_t(row.w - row.z);
+
+            // the cells of the row are in one run of bodies, unless the row wraps around the end of the table
+            uint32_t runs[2][2] = { { firstInBucket[firstBucket], firstInBucket[std::min(lastBucket, bucketMask) + 1] }, { 0, 0 } };
+
+            if(lastBucket > bucketMask)
+            {
+               runs[1][1] = firstInBucket[lastBucket - bucketMask];
+            }
+
+            for(const auto& run : runs)
+            {
+               for(uint32_t i = run[0]; i < run[1]; i++)
+               {
+                  const GridBody& other = bucketBodies[i];
+
+                  // other rows can end up in the same buckets
+                  if(other.cell.y != rowStart.y || other.cell.z != rowStart.z || other.cell.x < rowStart.x || other.cell.x > rowEnd.x)
+                  {
+                     continue;
+                  }
+
+                  // in its own cell the pair is found by the first body
+                  if(other.cell == gridBody.cell && other.body <= gridBody.body)
+                  {
+                     continue;
+                  }
+
+                  if(gridBody.sweptAabb.overlaps(other.sweptAabb))
+                  {
+                     test(body, bodies[other.body]);
+                  }
+               }
+            }
+         }
+
+         for(uint32_t other : largeBodies)
+         {
+            if(body.sweptAabb.overlaps(bodies[other].sweptAabb))
+            {
+               test(body, bodies[other]);
+            }
+         }
+      }
+
+      pairsInJob[job] = pairs;
+   });
+
+   for(uint32_t job = 0; job < numberOfJobs; job++)
+   {
+      contacts.insert(contacts.end(), contactsInJob[job].begin(), contactsInJob[job].end());
+      numberOfPairs += pairsInJob[job];
+   }
+}
+
+bool CollisionSystem::collide(const Body& body1, const Body& body2, Contact& contact) const
+{
+   contact.object1 = body1.object;
+   contact.object2 = body2.object;
+   contact.timeOfImpact = 1.f;
+
+   bool touching;
+
+   // most of the pairs only overlap because of the swept boxes
+   if(!body1.aabb.overlaps(body2.aabb))
+   {
+      touching = false;
+   }
+   else if(body1.shape == ColliderShape::Sphere && body2.shape == ColliderShape::Sphere)
+   {
+      touching = intersect(body1.sphere, body2.sphere, contact);
+   }
+   else if(body1.shape == ColliderShape::Sphere)
+   {
+      touching = intersect(body1.sphere, body2.obb, contact);
+   }
+   else if(body2.shape == ColliderShape::Sphere)
+   {
+      touching = intersect(body2.sphere, body1.obb, contact);
+      contact.normal = -contact.normal;
+   }
+   else if(body1.shape == ColliderShape::Aabb && body2.shape == ColliderShape::Aabb)
+   {
+      touching = intersect(body1.aabb, body2.aabb, contact);
+   }
+   else
+   {
+      touching = intersect(body1.obb, body2.obb, contact);
+   }
+
+   if(touching)
+   {
+      return true;
+   }
+
+   // they are apart now, but could have passed through each other
+   if(body1.fast || body2.fast)
+   {
+      Aabb start1(body1.aabb.min - body1.displacement, body1.aabb.max - body1.displacement);
+      Aabb start2(body2.aabb.min - body2.displacement, body2.aabb.max - body2.displacement);
+
+      return sweep(start1, body1.displacement, start2, body2.displacement, contact);
+   }
+
+   return false;
+}
+
+void CollisionSystem::respond()
+{
+   uint32_t numberOfBodies = static_cast<uint32_t>(bodies.size());
+
+   // the contacts of every body in the order they were found, a counting sort by body
+   firstContact.assign(numberOfBodies + 1, 0);
+
+   for(const Contact& contact : contacts)
+   {
+      firstContact[objectBody[contact.object1] + 1]++;
+      firstContact[objectBody[contact.object2] + 1]++;
+   }
+
+   for(uint32_t body = 0; body < numberOfBodies; body++)
+   {
+      firstContact[body + 1] += firstContact[body];
+   }
+
+   bodyContacts.resize(contacts.size() * 2);
+
+   // firstContact is moved up by one body while filling in, and moved back after
+   for(uint32_t contact = 0; contact < contacts.size(); contact++)
+   {
+      bodyContacts[firstContact[objectBody[contacts[contact].object1]]++] = contact;
+      bodyContacts[firstContact[objectBody[contacts[contact].object2]]++] = contact;
+   }
+
+   for(uint32_t body = numberOfBodies; body > 0; body--)
+   {
+      firstContact[body] = firstContact[body - 1];
+   }
+
+   firstContact[0] = 0;
+
+   // every body only writes its own response, from the positions and velocities before any response
+   uint32_t bodiesPerJob = std::max(MIN_BODIES_PER_JOB, numberOfBodies / ((jobSystem->getNumberOfWorkers() + 1) * 4));
+
+   jobSystem->parallelFor(0, numberOfBodies, bodiesPerJob, [this](uint32_t first, uint32_t last)
+   {
+      for(uint32_t index = first; index < last; index++)
+      {
+         Body& body = bodies[index];
+
+         uint32_t numberOfContacts = firstContact[index + 1] - firstContact[index];
+
+         if(numberOfContacts == 0 || body.inverseMass == 0.f)
+         {
+            continue;
+         }
+
+         glm::vec3 positionChange(0.f);
+         glm::vec3 velocityChange(0.f);
+
+         for(uint32_t i = firstContact[index]; i < firstContact[index + 1]; i++)
+         {
+            const Contact& contact = contacts[bodyContacts[i]];
+
+            bool isFirst = contact.object1 == body.object;
+            const Body& other = bodies[objectBody[isFirst ? contact.object2 : contact.object1]];
+
+            // away from the other one
+            glm::vec3 normal = isFirst ? -contact.normal : contact.normal;
+
+            float share = body.inverseMass / (body.inverseMass + other.inverseMass);
+
+            if(contact.timeOfImpact < 1.f)
+            {
+               // back to where they touched
+               positionChange -= body.displacement * (1.f - contact.timeOfImpact);
+            }
+            else
+            {
+               positionChange += normal * (std::max(contact.depth - ALLOWED_DEPTH, 0.f) * DEPTH_CORRECTION * share);
+            }
+
+            // only if they are getting closer, otherwise they are already moving apart
+            float approachSpeed = glm::dot(body.velocity - other.velocity, normal);
+
+            if(approachSpeed < 0.f)
+            {
+               velocityChange -= normal * ((1.f + restitution) * approachSpeed * share);
+            }
+         }
+
+         body.positionChange = positionChange / float(numberOfContacts);
+         body.velocityChange = velocityChange / float(numberOfContacts);
+      }
+   });
+}
+
+bool CollisionSystem::intersect(const Aabb& a, const Aabb& b, Contact& contact)
+{
+   glm::vec3 overlap = glm::min(a.max, b.max) - glm::max(a.min, b.min);
+
+   if(overlap.x < 0.f || overlap.y < 0.f || overlap.z < 0.f)
+   {
+      return false;
+   }
+
+   // out along the axis they overlap the least on
+   int axis = overlap.x <= overlap.y ? (overlap.x <= overlap.z ? 0 : 2) : (overlap.y <= overlap.z ? 1 : 2);
+
+   contact.normal = glm::vec3(0.f);
+   contact.normal[axis] = b.getCenter()[axis] >= a.getCenter()[axis] ? 1.f : -1.f;
+   contact.depth = overlap[axis];
+
+   return true;
+}
+
+bool CollisionSystem::intersect(const Obb& a, const Obb& b, Contact& contact)
+{
+   // separating axis test in the space of a: the 3 face normals of both boxes and the 9 cross products of their edges,
+   // like in Real-Time Collision Detection. rotation[i][j] is b's axis j in a's axis i
+   float rotation[3][3];
+   float absRotation[3][3];
+
+   for(int i = 0; i < 3; i++)
+   {
+      for(int j = 0; j < 3; j++)
+      {
+         rotation[i][j] = glm::dot(a.axes[i], b.axes[j]);
+         absRotation[i][j] = std::abs(rotation[i][j]);
+      }
+   }
+
+   glm::vec3 worldDistance = b.center - a.center;
+   glm::vec3 distance(glm::dot(worldDistance, a.axes[0]), glm::dot(worldDistance, a.axes[1]), glm::dot(worldDistance, a.axes[2]));
+
+   float bestDepth = std::numeric_limits<float>::max();
+   int bestAxis = 0;
+   bool bestFlipped = false;
+
+   // length is the length of the axis, the edge axes have to be a bit better to win, they are less stable when the
+   // boxes are almost aligned
+   auto testAxis = [&bestDepth, &bestAxis, &bestFlipped](int axis, float radius, float projectedDistance, float length, float bias)
+   {
+      float depth = radius - std::abs(projectedDistance);
+
+      if(depth < 0.f)
+      {
+         return false;
+      }
+
+      depth /= length;
+
+      if(depth < bestDepth * bias)
+      {
+         bestDepth = depth;
+         bestAxis = axis;
+         bestFlipped = projectedDistance < 0.f;
+      }
+
+      return true;
+   };
+
+   for(int i = 0; i < 3; i++)
+   {
+      float radius = a.extent[i] + b.extent.x * absRotation[i][0] + b.extent.y * absRotation[i][1] + b.extent.z * absRotation[i][2];
+
+      if(!testAxis(i, radius, distance[i], 1.f, 1.f))
+      {
+         return false;
+      }
+   }
+
+   for(int j = 0; j < 3; j++)
+   {
+      float radius = a.extent.x * absRotation[0][j] + a.extent.y * absRotation[1][j] + a.extent.z * absRotation[2][j] + b.extent[j];
+      float projectedDistance = distance.x * rotation[0][j] + distance.y * rotation[1][j] + distance.z * rotation[2][j];
+
+      if(!testAxis(3 + j, radius, projectedDistance, 1.f, 1.f))
+      {
+         return false;
+      }
+   }
+
+   for(int i = 0; i < 3; i++)
+   {
+      int i1 = (i + 1) % 3;
+      int i2 = (i + 2) % 3;
+
+      for(int j = 0; j < 3; j++)
+      {
+         // the edges are sin(angle) long
+         float lengthSquared = 1.f - rotation[i][j] * rotation[i][j];
+
+         // parallel edges, the face axes cover it
+         if(lengthSquared < 1e-6f)
+         {
+            continue;
+         }
+
+         int j1 = (j + 1) % 3;
+         int j2 = (j + 2) % 3;
+
+         float radius = a.extent[i1] * absRotation[i2][j] + a.extent[i2] * absRotation[i1][j] + b.extent[j1] * absRotation[i][j2] + b.extent[j2] * absRotation[i][j1];
+         float projectedDistance = distance[i2] * rotation[i1][j] - distance[i1] * rotation[i2][j];
+
+         if(!testAxis(6 + i * 3 + j, radius, projectedDistance, std::sqrt(lengthSquared), 0.95f))
+         {
+            return false;
+         }
+      }
+   }
+
+   glm::vec3 normal;
+
+   if(bestAxis < 3)
+   {
+      normal = a.axes[bestAxis];
+   }
+   else if(bestAxis < 6)
+   {
+      normal = b.axes[bestAxis - 3];
+   }
+   else
+   {
+      normal = glm::normalize(glm::cross(a.axes[(bestAxis - 6) / 3], b.axes[(bestAxis - 6) % 3]));
+   }
+
+   contact.normal = bestFlipped ? -normal : normal;
+   contact.depth = bestDepth;
+
+   return true;
+}
+
+bool CollisionSystem::intersect(const Sphere& a, const Sphere& b, Contact& contact)
+{
+   glm::vec3 distance = b.center - a.center;
+   float radius = a.radius + b.radius;
+
+   float lengthSquared = glm::dot(distance, distance);
+
+   if(lengthSquared > radius * radius)
+   {
+      return false;
+   }
+
+   float length = std::sqrt(lengthSquared);
+
+   // on top of each other, any direction will do
+   contact.normal = length > 1e-6f ? distance / length : glm::vec3(0.f, 1.f, 0.f);
+   contact.depth = radius - length;
+
+   return true;
+}
+
+bool CollisionSystem::intersect(const Sphere& a, const Obb& b, Contact& contact)
+{
+   // the center in the space of the box, and the closest point of the box to it
+   glm::vec3 offset = a.center - b.center;
+   glm::vec3 local(glm::dot(offset, b.axes[0]), glm::dot(offset, b.axes[1]), glm::dot(offset, b.axes[2]));
+   glm::vec3 closest = glm::clamp(local, -b.extent, b.extent);
+
+   if(closest != local)
+   {
+      glm::vec3 closestPoint = b.center + b.axes[0] * closest.x + b.axes[1] * closest.y + b.axes[2] * closest.z;
+      glm::vec3 distance = closestPoint - a.center;
+
+      float lengthSquared = glm::dot(distance, distance);
+
+      if(lengthSquared > a.radius * a.radius)
+      {
+         return false;
+      }
+
+      float length = std::sqrt(lengthSquared);
+
+      contact.normal = length > 1e-6f ? distance / length : -glm::normalize(offset);
+      contact.depth = a.radius - length;
+
+      return true;
+   }
+
+   // the center is inside of the box, out through the closest face
+   glm::vec3 faceDistance = b.extent - glm::abs(local);
+   int axis = faceDistance.x <= faceDistance.y ? (faceDistance.x <= faceDistance.z ? 0 : 2) : (faceDistance.y <= faceDistance.z ? 1 : 2);
+
+   contact.normal = local[axis] < 0.f ? b.axes[axis] : -b.axes[axis];
+   contact.depth = faceDistance[axis] + a.radius;
+
+   return true;
+}
+
+bool CollisionSystem::sweep(const Aabb& a, glm::vec3 displacementA, const Aabb& b, glm::vec3 displacementB, Contact& contact)
+{
+   // b stands still and a moves by the difference, the time a enters and leaves the slab of b on every axis
+   glm::vec3 displacement = displacementA - displacementB;
+
+   float enter = -std::numeric_limits<float>::max();
+   float exit = std::numeric_limits<float>::max();
+   int enterAxis = -1;
+
+   for(int i = 0; i < 3; i++)
+   {
+      if(displacement[i] == 0.f)
+      {
+         if(a.max[i] < b.min[i] || a.min[i] > b.max[i])
+         {
+            return false;
+         }
+
+         continue;
+      }
+
+      float time1 = (b.min[i] - a.max[i]) / displacement[i];
+      float time2 = (b.max[i] - a.min[i]) / displacement[i];
+
+      float axisEnter = std::min(time1, time2);
+      float axisExit = std::max(time1, time2);
+
+      if(axisEnter > enter)
+      {
+         enter = axisEnter;
+         enterAxis = i;
+      }
+
+      exit = std::min(exit, axisExit);
+   }
+
+   // not moving, already overlapping at the start, or not touching during the step
+   if(enterAxis < 0 || enter < 0.f || enter > 1.f || enter > exit)
+   {
+      return false;
+   }
+
+   contact.normal = glm::vec3(0.f);
+   contact.normal[enterAxis] = displacement[enterAxis] > 0.f ? 1.f : -1.f;
+   contact.depth = 0.f;
+   contact.timeOfImpact = enter;
+
+   return true;
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+// Collisions between moving objects, run by WorldObject::update after the objects were moved.
+//
+// The broad phase is a spatial hash: every object gets a box around where it was at the start of the step and where
+// it is at the end, and goes into the grid cell its center is in. The cells are as big as the biggest box, so an
+// object only has to be tested against the ones in its own and the 26 cells around it, and every pair of cells is only
+// looked at from one side: its own cell and the 13 after it. The cells are numbered row by row and wrap around a table
+// of about twice as many buckets as there are objects, filled with a counting sort. The objects are tested in the
+// order of the table, so the rows they look at are next to the ones the objects before looked at. Objects much bigger
+// than the average (walls, the floor) would make the cells huge, they are kept out of the grid and tested against all.
+//
+// The narrow phase tests the shapes where they are at the end of the step. The shapes come from the bounds of the
+// mesh: AABB is the box around the rotated mesh box, OBB is the mesh box rotated with the object and sphere is the
+// sphere of the bounds. An object that moved more than half its size in the step could have passed through the other
+// one, for those the boxes are swept against each other and the contact is where they first touched.
+//
+// The response pushes the objects apart along the contact normal and reflects their velocities along it, averaged
+// over all contacts of an object. Objects that aren't movable (walls, the floor) push the others but are never pushed.
+// No friction and no rotation.
+//
+// Finding the contacts and the response are split over the job system. The grid is filled on one thread, the contacts
+// are found in the order of the grid and every object adds up its contacts in that order, so the result is the same
+// for any number of threads.
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AabbTree.h"
+#include "Bounds.h"
+#include "JobSystem.h"
+#include "TransformStreams.h"
+
+enum class ColliderShape
+{
+   None,
+   Aabb,
+   Obb,
+   Sphere
+};
+
+struct Obb
+{
+   glm::vec3 center = glm::vec3(0.f);
+
+   // normalized
+   glm::vec3 axes[3] = { glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f) };
+
+   // half the size along the axes
+   glm::vec3 extent = glm::vec3(0.f);
+
+   // the box of the bounds moved, rotated and scaled by the matrix
+   static Obb transform(const Bounds& bounds, const glm::mat4& matrix);
+
+   Aabb getAabb() const;
+};
+
+struct Sphere
+{
+   glm::vec3 center = glm::vec3(0.f);
+   float radius = 0.f;
+
+   // the radius is scaled by the largest scale of the matrix
+   static Sphere transform(const Bounds& bounds, const glm::mat4& matrix);
+};
+
+class CollisionSystem
+{
+public:
+   struct Contact
+   {
+      uint32_t object1;
+      uint32_t object2;
+
+      // from object1 to object2
+      glm::vec3 normal;
+
+      // how far they overlap along the normal
+      float depth;
+
+      // when in the step they first touched, 1 if it wasn't swept
+      float timeOfImpact;
+   };
+
+   explicit CollisionSystem(JobSystem* jobSystem);
+
+   // The shape is made from the bounds of the mesh of the object, in mesh space. ColliderShape::None removes it.
+   void setCollider(uint32_t index, ColliderShape shape, const Bounds& bounds, bool movable = true);
+
+   // for when the bounds of the mesh are known later
+   void setColliderBounds(uint32_t index, const Bounds& bounds);
+
+   ColliderShape getColliderShape(uint32_t index) const
+   {
+      return index < colliders.size() ? colliders[index].shape : ColliderShape::None;
+   }
+
+   uint32_t getNumberOfColliders() const
+   {
+      return numberOfColliders;
+   }
+
+   // 1 bounces back with the same speed, 0 stops along the normal
+   void setRestitution(float restitution)
+   {
+      this->restitution = restitution;
+   }
+
+   // Finds the contacts after transforms.integrate moved the objects by dt and updateMatrices built their matrices
+   // (matrices has one per object), then moves the objects apart and changes their velocities. The objects that were
+   // moved are dirty in transforms again.
+   void resolve(TransformStreams& transforms, const glm::mat4* matrices, float dt);
+
+   // of the last resolve
+   const std::vector<Contact>& getContacts() const
+   {
+      return contacts;
+   }
+
+   // objects whose velocity was changed by the last resolve, in order
+   const std::vector<uint32_t>& getResolvedObjects() const
+   {
+      return resolvedObjects;
+   }
+
+   // boxes that overlapped in the broad phase in the last resolve
+   uint32_t getNumberOfPairs() const
+   {
+      return numberOfPairs;
+   }
+
+   // The narrow phase tests, they fill in the normal (from a to b) and the depth if the shapes overlap.
+   static bool intersect(const Aabb& a, const Aabb& b, Contact& contact);
+   static bool intersect(const Obb& a, const Obb& b, Contact& contact);
+   static bool intersect(const Sphere& a, const Sphere& b, Contact& contact);
+   static bool intersect(const Sphere& a, const Obb& b, Contact& contact);
+
+   // The boxes at the start of the step, moving by their displacement over the step. Fills in the time of impact and
+   // the normal of the face that was hit if they touch during the step but didn't overlap at the start.
+   static bool sweep(const Aabb& a, glm::vec3 displacementA, const Aabb& b, glm::vec3 displacementB, Contact& contact);
+
+private:
+
+   struct Collider
+   {
+      ColliderShape shape = ColliderShape::None;
+      Bounds bounds;
+      bool movable = true;
+   };
+
+   // an object with a collider, in world space for the current step
+   struct Body
+   {
+      uint32_t object;
+      ColliderShape shape;
+
+      // the shape at the end of the step, the sphere only for spheres
+      Obb obb;
+      Sphere sphere;
+      Aabb aabb;
+
+      // from where it was at the start of the step to where it is at the end
+      Aabb sweptAabb;
+
+      // the longest side of the swept box
+      float size;
+
+      // too big for the grid
+      bool large;
+      glm::ivec3 cell;
+
+      glm::vec3 position;
+      glm::vec3 velocity;
+      glm::vec3 displacement;
+
+      // 0 for objects that aren't movable
+      float inverseMass;
+
+      // moved more than half its size
+      bool fast;
+
+      // the response, the sum over all its contacts
+      glm::vec3 positionChange;
+      glm::vec3 velocityChange;
+   };
+
+   JobSystem* jobSystem;
+
+   float restitution = 1.f;
+
+   // by object index
+   std::vector<Collider> colliders;
+   uint32_t numberOfColliders = 0;
+
+   // the objects with a collider, in order. rebuilt when colliders are added or removed
+   std::vector<uint32_t> colliderObjects;
+   bool collidersChanged = false;
+
+   std::vector<Body> bodies;
+
+   // object index -> body, only for the objects with a collider
+   std::vector<uint32_t> objectBody;
+
+   // a body in the grid, what the broad phase looks at next to each other
+   struct GridBody
+   {
+      glm::ivec3 cell;
+      uint32_t body;
+      Aabb sweptAabb;
+   };
+
+   // the grid of the last step, the bodies in every bucket are in firstInBucket[bucket]..firstInBucket[bucket + 1]
+   float cellSize = 1.f;
+
+   // the cells are numbered row by row in the box around the grid bodies, from firstCell. the number of buckets is a
+   // power of 2 and the numbers wrap around
+   glm::ivec3 firstCell = glm::ivec3(0);
+   uint32_t cellsPerRow = 1;
+   uint32_t cellsPerLayer = 1;
+   uint32_t bucketMask = 0;
+   std::vector<uint32_t> firstInBucket;
+   std::vector<GridBody> bucketBodies;
+
+   std::vector<uint32_t> largeBodies;
+
+   // per job in findContacts
+   std::vector<std::vector<Contact>> contactsInJob;
+   std::vector<uint32_t> pairsInJob;
+
+   std::vector<Contact> contacts;
+
+   // the contacts of every body, firstContact has one more entry than there are bodies
+   std::vector<uint32_t> firstContact;
+   std::vector<uint32_t> bodyContacts;
+
+   std::vector<uint32_t> resolvedObjects;
+
+   uint32_t numberOfPairs = 0;
+
+   // fewer are not worth a job
+   static const uint32_t MIN_BODIES_PER_JOB = 512;
+
+   // bodies bigger than this times the average size are large
+   static const float LARGE_BODY_SIZE;
+
+   // the overlap that is left so resting objects keep touching, and how much of the rest is pushed out per step
+   static const float ALLOWED_DEPTH;
+   static const float DEPTH_CORRECTION;
+
+   void buildBodies(const TransformStreams& transforms, const glm::mat4* matrices, float dt);
+   void buildGrid();
+
+   uint32_t getBucket(glm::ivec3 cell) const;
+   void findContacts();
+   void respond();
+
+   // the narrow phase for two bodies, false if they don't touch
+   bool collide(const Body& body1, const Body& body2, Contact& contact) const;
+};
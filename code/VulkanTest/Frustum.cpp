@@ -0,0 +1,158 @@
+#include "Frustum.h"
+
+#include <algorithm>
+#include <cmath>
+
+// same as TransformStreams, 4 objects at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+
+Frustum::Frustum()
+{
+   for(auto& plane : planes)
+   {
+      plane = glm::vec4(0.f, 0.f, 0.f, 1.f);
+   }
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+   // glm is column major, viewProjection[column][row]
+   glm::vec4 row[4];
+   for(int i = 0; i < 4; i++)
+   {
+      row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+   }
+
+   // left, right, bottom, top, near, far
+   planes[0] = row[3] + row[0];
+   planes[1] = row[3] - row[0];
+   planes[2] = row[3] + row[1];
+   planes[3] = row[3] - row[1];
+   planes[4] = row[3] + row[2];
+   planes[5] = row[3] - row[2];
+
+   for(auto& plane : planes)
+   {
+      plane /= glm::length(glm::vec3(plane));
+   }
+}
+
+bool Frustum::isVisible(glm::vec3 center, float radius, glm::vec3 extent) const
+{
+   for(const auto& plane : planes)
+   {
+      float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+      float boxRadius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+
+      if(distance < -std::min(radius, boxRadius))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+Frustum::Containment Frustum::classify(glm::vec3 center, glm::vec3 extent) const
+{
+   Containment containment = Containment::Inside;
+
+   for(const auto& plane : planes)
+   {
+      float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+      float boxRadius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+
+      if(distance < -boxRadius)
+      {
+         return Containment::Outside;
+      }
+
+      if(distance < boxRadius)
+      {
+         containment = Containment::Intersecting;
+      }
+   }
+
+   return containment;
+}
+
+void Frustum::cull(const BoundsStreams& bounds, uint32_t first, uint32_t last, std::vector<uint32_t>& visible, bool simd) const
+{
+   last = std::min(last, bounds.size());
+
+#ifdef FRUSTUM_SSE
+   if(simd)
+   {
+      __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+      __m128 absX[6], absY[6], absZ[6];
+
+      for(int i = 0; i < 6; i++)
+      {
+         planeX[i] = _mm_set1_ps(planes[i].x);
+         planeY[i] = _mm_set1_ps(planes[i].y);
+         planeZ[i] = _mm_set1_ps(planes[i].z);
+         planeW[i] = _mm_set1_ps(planes[i].w);
+
+         absX[i] = _mm_set1_ps(std::abs(planes[i].x));
+         absY[i] = _mm_set1_ps(std::abs(planes[i].y));
+         absZ[i] = _mm_set1_ps(std::abs(planes[i].z));
+      }
+
+      for(uint32_t i = first; i < last; i += 4)
+      {
+         __m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+         __m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+         __m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+         __m128 radius  = _mm_loadu_ps(&bounds.radius[i]);
+         __m128 extentX = _mm_loadu_ps(&bounds.extentX[i]);
+         __m128 extentY = _mm_loadu_ps(&bounds.extentY[i]);
+         __m128 extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+
+         __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+         for(int p = 0; p < 6; p++)
+         {
+            __m128 distance = _mm_add_ps(
+               _mm_add_ps(_mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+               _mm_add_ps(_mm_mul_ps(planeZ[p], centerZ), planeW[p]));
+
+            __m128 boxRadius = _mm_add_ps(
+               _mm_add_ps(_mm_mul_ps(absX[p], extentX), _mm_mul_ps(absY[p], extentY)),
+               _mm_mul_ps(absZ[p], extentZ));
+
+            // distance >= -radius
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(radius, boxRadius)), _mm_setzero_ps()));
+         }
+
+         int mask = _mm_movemask_ps(inside);
+
+         // the last group can reach into the padding
+         uint32_t lanes = std::min(last - i, 4u);
+
+         for(uint32_t lane = 0; lane < lanes; lane++)
+         {
+            if(mask & (1 << lane))
+            {
+               visible.push_back(i + lane);
+            }
+         }
+      }
+
+      return;
+   }
+#endif
+
+   for(uint32_t i = first; i < last; i++)
+   {
+      glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+      glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+
+      if(isVisible(center, bounds.radius[i], extent))
+      {
+         visible.push_back(i);
+      }
+   }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// The 6 planes of a view projection matrix (Gribb/Hartmann), normalized and pointing inwards, so the distance of a
+// point to a plane is dot(plane.xyz, point) + plane.w.
+//
+// An object is culled when its sphere or its box is completely outside of one plane. The box test uses the
+// projected radius of the box on the plane normal, so both come down to the same compare with the smaller radius.
+// Objects that are outside of the frustum but not of any single plane (near the corners) stay visible.
+//
+// glm builds the projection for OpenGL depth (-1..1), so the near plane is the one at z = -w. Vulkan clips at z = 0,
+// a bit further away, which only lets a few more objects through.
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+
+class Frustum
+{
+public:
+   enum class Containment
+   {
+      Outside,
+      Intersecting,
+      Inside
+   };
+
+   // everything is visible
+   Frustum();
+
+   explicit Frustum(const glm::mat4& viewProjection);
+
+   // left, right, bottom, top, near, far
+   const glm::vec4* getPlanes() const
+   {
+      return planes;
+   }
+
+   bool isVisible(glm::vec3 center, float radius, glm::vec3 extent) const;
+
+   // the box alone, for the nodes of AabbTree. Inside means everything in the box is visible
+   Containment classify(glm::vec3 center, glm::vec3 extent) const;
+
+   // Appends the indices in [first, last) of the bounds that are visible, in order. first has to be a multiple of 4.
+   // simd = false uses the scalar version, for comparison.
+   void cull(const BoundsStreams& bounds, uint32_t first, uint32_t last, std::vector<uint32_t>& visible, bool simd = true) const;
+
+private:
+
+   glm::vec4 planes[6];
+};
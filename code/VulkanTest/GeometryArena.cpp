@@ -0,0 +1,216 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace vks
+{
+   bool GeometryArena::FreeList::allocate(uint32_t size, uint32_t* offset)
+   {
+      for(auto it = ranges.begin(); it != ranges.end(); ++it)
+      {
+         if(it->second < size)
+         {
+            continue;
+         }
+
+         *offset = it->first;
+
+         if(it->second > size)
+         {
+            ranges[it->first + size] = it->second - size;
+         }
+         ranges.erase(it);
+
+         return true;
+      }
+
+      return false;
+   }
+
+   void GeometryArena::FreeList::free(uint32_t offset, uint32_t size)
+   {
+      auto next = ranges.lower_bound(offset);
+
+      // merge with the range after it
+      if(next != ranges.end() && offset + size == next->first)
+      {
+         size += next->second;
+         next = ranges.erase(next);
+      }
+
+      // and with the one before it
+      if(next != ranges.begin())
+      {
+         auto previous = std::prev(next);
+         if(previous->first + previous->second == offset)
+         {
+            previous->second += size;
+            return;
+         }
+      }
+
+      ranges[offset] = size;
+   }
+
+   void GeometryArena::init(VulkanDevice* vulkanDevice, VkDeviceSize vertexStride, uint32_t verticesPerArena, uint32_t indicesPerArena)
+   {
+      this->vulkanDevice     = vulkanDevice;
+      this->vertexStride     = vertexStride;
+      this->verticesPerArena = verticesPerArena;
+      this->indicesPerArena  = indicesPerArena;
+   }
+
+   void GeometryArena::destroy()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for(auto& arena : arenas)
+      {
+         vulkanDevice->destroyBuffer(arena.vertexBuffer, arena.vertexMemory);
+         vulkanDevice->destroyBuffer(arena.indexBuffer, arena.indexMemory);
+      }
+
+      arenas.clear();
+   }
+
+   GeometryAllocation GeometryArena::allocate(uint32_t numberOfVertices, uint32_t numberOfIndices)
+   {
+      if(numberOfVertices == 0 || numberOfIndices == 0)
+      {
+         throw std::runtime_error("empty geometry allocation!");
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      GeometryAllocation allocation;
+      allocation.numberOfVertices = numberOfVertices;
+      allocation.numberOfIndices  = numberOfIndices;
+
+      for(uint32_t i = 0; i <= arenas.size(); i++)
+      {
+         if(i == arenas.size())
+         {
+            createArena(std::max(numberOfVertices, verticesPerArena), std::max(numberOfIndices, indicesPerArena));
+         }
+
+         Arena& arena = arenas[i];
+
+         if(!arena.freeVertices.allocate(numberOfVertices, &allocation.vertexOffset))
+         {
+            continue;
+         }
+
+         if(!arena.freeIndices.allocate(numberOfIndices, &allocation.firstIndex))
+         {
+            arena.freeVertices.free(allocation.vertexOffset, numberOfVertices);
+            continue;
+         }
+
+         allocation.arenaIndex = i;
+         arena.allocationCount++;
+
+         return allocation;
+      }
+
+      // a new arena always fits the mesh
+      throw std::runtime_error("failed to allocate geometry!");
+   }
+
+   void GeometryArena::free(GeometryAllocation& allocation)
+   {
+      if(!allocation.isValid())
+      {
+         return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      Arena& arena = arenas[allocation.arenaIndex];
+      arena.freeVertices.free(allocation.vertexOffset, allocation.numberOfVertices);
+      arena.freeIndices.free(allocation.firstIndex, allocation.numberOfIndices);
+      arena.allocationCount--;
+
+      allocation = GeometryAllocation();
+   }
+
+   VkBuffer GeometryArena::getVertexBuffer(uint32_t arenaIndex)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return arenas[arenaIndex].vertexBuffer;
+   }
+
+   VkBuffer GeometryArena::getIndexBuffer(uint32_t arenaIndex)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return arenas[arenaIndex].indexBuffer;
+   }
+
+   void GeometryArena::printStats()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for(size_t i = 0; i < arenas.size(); i++)
+      {
+         const Arena& arena = arenas[i];
+
+         uint32_t freeVertices = 0;
+         for(const auto& range : arena.freeVertices.ranges)
+         {
+            freeVertices += range.second;
+         }
+
+         uint32_t freeIndices = 0;
+         for(const auto& range : arena.freeIndices.ranges)
+         {
+            freeIndices += range.second;
+         }
+
+         std::cout
+            << "geometry arena " << i << ": " << arena.allocationCount << " meshes"
+            << ", vertices: " << arena.vertexCapacity - freeVertices << "/" << arena.vertexCapacity
+            << ", indices: " << arena.indexCapacity - freeIndices << "/" << arena.indexCapacity
+            << ", free ranges: " << arena.freeVertices.ranges.size() << "/" << arena.freeIndices.ranges.size() << std::endl;
+      }
+   }
+
+   uint32_t GeometryArena::createArena(uint32_t vertexCapacity, uint32_t indexCapacity)
+   {
+      Arena arena;
+      arena.vertexCapacity = vertexCapacity;
+      arena.indexCapacity  = indexCapacity;
+
+      vulkanDevice->createBuffer(
+         vertexStride * vertexCapacity,
+         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+         &arena.vertexBuffer,
+         &arena.vertexMemory);
+
+      // the arena isn't in arenas yet, so the destructor wouldn't free the vertex buffer
+      try
+      {
+         vulkanDevice->createBuffer(
+            sizeof(uint32_t) * VkDeviceSize(indexCapacity),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &arena.indexBuffer,
+            &arena.indexMemory);
+      }
+      catch(...)
+      {
+         vulkanDevice->destroyBuffer(arena.vertexBuffer, arena.vertexMemory);
+         throw;
+      }
+
+      arena.freeVertices.ranges[0] = vertexCapacity;
+      arena.freeIndices.ranges[0]  = indexCapacity;
+
+      arenas.push_back(arena);
+
+      return static_cast<uint32_t>(arenas.size()) - 1;
+   }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Keeps the geometry of all meshes in a few big device local vertex and index buffers, so drawing doesn't have to bind
+// buffers per mesh. A mesh gets a range of vertices and a range of indices, and is drawn with vertexOffset/firstIndex.
+// The indices stay relative to the first vertex of the mesh.
+//
+// Every arena has a free list per buffer (sorted by offset, neighbours merge when freed), ranges are handed out
+// first fit. A new arena is only created when a mesh doesn't fit in any of the existing ones, it's made big enough
+// for the mesh if the default size isn't.
+
+#include "VulkanDevice.hpp"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+   struct GeometryAllocation
+   {
+      uint32_t arenaIndex = 0;
+
+      // in vertices and indices, not bytes
+      uint32_t vertexOffset = 0;
+      uint32_t numberOfVertices = 0;
+      uint32_t firstIndex = 0;
+      uint32_t numberOfIndices = 0;
+
+      bool isValid() const
+      {
+         return numberOfIndices > 0;
+      }
+   };
+
+   class GeometryArena
+   {
+   public:
+      void init(VulkanDevice* vulkanDevice, VkDeviceSize vertexStride, uint32_t verticesPerArena = DEFAULT_VERTICES, uint32_t indicesPerArena = DEFAULT_INDICES);
+
+      // the buffers must not be in use anymore
+      void destroy();
+
+      // thread safe. the buffers are not filled, upload to getVertexBuffer/getIndexBuffer at the offsets of the allocation
+      GeometryAllocation allocate(uint32_t numberOfVertices, uint32_t numberOfIndices);
+
+      // thread safe. the range can be handed out again right away, so the GPU must be done with it
+      void free(GeometryAllocation& allocation);
+
+      // thread safe
+      VkBuffer getVertexBuffer(uint32_t arenaIndex);
+      VkBuffer getIndexBuffer(uint32_t arenaIndex);
+
+      VkDeviceSize getVertexStride()
+      {
+         return vertexStride;
+      }
+
+      void printStats();
+
+   private:
+
+      static const uint32_t DEFAULT_VERTICES = 1024 * 1024;
+      static const uint32_t DEFAULT_INDICES = 4 * 1024 * 1024;
+
+      // offset -> size, in elements
+      struct FreeList
+      {
+         std::map<uint32_t, uint32_t> ranges;
+
+         bool allocate(uint32_t size, uint32_t* offset);
+         void free(uint32_t offset, uint32_t size);
+      };
+
+      struct Arena
+      {
+         VkBuffer vertexBuffer = VK_NULL_HANDLE;
+         Allocation vertexMemory;
+         VkBuffer indexBuffer = VK_NULL_HANDLE;
+         Allocation indexMemory;
+
+         uint32_t vertexCapacity = 0;
+         uint32_t indexCapacity = 0;
+
+         FreeList freeVertices;
+         FreeList freeIndices;
+
+         uint32_t allocationCount = 0;
+      };
+
+      VulkanDevice* vulkanDevice = nullptr;
+
+      VkDeviceSize vertexStride = 0;
+      uint32_t verticesPerArena = 0;
+      uint32_t indicesPerArena = 0;
+
+      std::mutex mutex;
+      std::vector<Arena> arenas;
+
+      uint32_t createArena(uint32_t vertexCapacity, uint32_t indexCapacity);
+   };
+}
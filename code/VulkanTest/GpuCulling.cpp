@@ -0,0 +1,377 @@
+#include "GpuCulling.h"
+#include <algorithm>
+#include <cstring>
+
+
+GpuCulling::GpuCulling(vks::VulkanDevice* vulkanDevice)
+{
+   this->vulkanDevice = vulkanDevice;
+}
+
+GpuCulling::~GpuCulling()
+{
+   for(auto& culling : frameCulling)
+   {
+      for(FrameBuffer* frameBuffer : { &culling.instanceBatches, &culling.batches, &culling.batchDraws, &culling.draws })
+      {
+         if(frameBuffer->buffer != VK_NULL_HANDLE)
+         {
+            vulkanDevice->destroyBuffer(frameBuffer->buffer, frameBuffer->memory);
+         }
+      }
+   }
+
+   vkDestroyPipeline(vulkanDevice->device, pipeline, nullptr);
+   vkDestroyPipelineLayout(vulkanDevice->device, pipelineLayout, nullptr);
+   vkDestroyDescriptorPool(vulkanDevice->device, descriptorPool, nullptr);
+   vkDestroyDescriptorSetLayout(vulkanDevice->device, descriptorSetLayout, nullptr);
+}
+
+bool GpuCulling::isSupported(vks::VulkanDevice* vulkanDevice)
+{
+   if(!vulkanDevice->deviceFeatures.drawIndirectFirstInstance)
+   {
+      return false;
+   }
+
+   uint32_t queueFamilyCount = 0;
+   vkGetPhysicalDeviceQueueFamilyProperties(vulkanDevice->physicalDevice, &queueFamilyCount, nullptr);
+
+   std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+   vkGetPhysicalDeviceQueueFamilyProperties(vulkanDevice->physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+   // the dispatch is in the same command buffer as the draws
+   int graphicsFamily = vulkanDevice->queueFamilyIndices.graphicsFamily;
+
+   return graphicsFamily >= 0 && (queueFamilies[graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+}
+
+void GpuCulling::createPipeline(uint32_t framesInFlight)
+{
+   frameCulling.resize(framesInFlight);
+
+   computeShader.loadShader("shaders/comp.spv");
+   computeShader.createShaderModule(vulkanDevice->device);
+
+   // instance matrices, batch of every slot, batches, draws of every batch, draws, visible slots
+   std::array<VkDescriptorSetLayoutBinding, 6> descriptorSetLayoutBindings;
+
+   for(uint32_t i = 0; i < descriptorSetLayoutBindings.size(); i++)
+   {
+      descriptorSetLayoutBindings[i] = vkn::inits::descriptorSetLayoutBinding(
+         i,
+         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         VK_SHADER_STAGE_COMPUTE_BIT);
+   }
+
+   auto layoutCreateInfo = vkn::inits::
+      descriptorSetLayoutCreateInfo(
+         descriptorSetLayoutBindings.data(),
+         static_cast<uint32_t>(descriptorSetLayoutBindings.size()));
+
+   if(vkCreateDescriptorSetLayout(vulkanDevice->device, &layoutCreateInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to create culling descriptor set layout!");
+   }
+
+   VkDescriptorPoolSize poolSize ={};
+   poolSize.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+   poolSize.descriptorCount = framesInFlight * static_cast<uint32_t>(descriptorSetLayoutBindings.size());
+
+   VkDescriptorPoolCreateInfo poolInfo ={};
+   poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+   poolInfo.poolSizeCount = 1;
+   poolInfo.pPoolSizes    = &poolSize;
+   poolInfo.maxSets       = framesInFlight;
+
+   if(vkCreateDescriptorPool(vulkanDevice->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to create culling descriptor pool!");
+   }
+
+   std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
+   std::vector<VkDescriptorSet> descriptorSets(framesInFlight);
+
+   VkDescriptorSetAllocateInfo allocInfo ={};
+   allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+   allocInfo.descriptorPool     = descriptorPool;
+   allocInfo.descriptorSetCount = framesInFlight;
+   allocInfo.pSetLayouts        = layouts.data();
+
+   if(vkAllocateDescriptorSets(vulkanDevice->device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to allocate culling descriptor sets!");
+   }
+
+   for(uint32_t i = 0; i < framesInFlight; i++)
+   {
+      frameCulling[i].descriptorSet = descriptorSets[i];
+   }
+
+   // the frustum planes and the number of instances
+   VkPushConstantRange pushConstantRange ={};
+   pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+   pushConstantRange.offset     = 0;
+   pushConstantRange.size       = sizeof(PushConstants);
+
+   VkPipelineLayoutCreateInfo pipelineLayoutInfo ={};
+   pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+   pipelineLayoutInfo.setLayoutCount         = 1;
+   pipelineLayoutInfo.pSetLayouts            = &descriptorSetLayout;
+   pipelineLayoutInfo.pushConstantRangeCount = 1;
+   pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+
+   if(vkCreatePipelineLayout(vulkanDevice->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to create culling pipeline layout!");
+   }
+
+   VkComputePipelineCreateInfo pipelineInfo ={};
+   pipelineInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+   pipelineInfo.stage  = computeShader.createShaderStage(ShaderType::COMPUTE);
+   pipelineInfo.layout = pipelineLayout;
+
+   if(vkCreateComputePipelines(vulkanDevice->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to create culling pipeline!");
+   }
+}
+
+bool GpuCulling::reserve(FrameBuffer& frameBuffer, uint32_t count, VkDeviceSize elementSize, VkMemoryPropertyFlags properties)
+{
+   if(frameBuffer.buffer != VK_NULL_HANDLE && frameBuffer.capacity >= count)
+   {
+      return false;
+   }
+
+   if(frameBuffer.buffer != VK_NULL_HANDLE)
+   {
+      vulkanDevice->destroyBuffer(frameBuffer.buffer, frameBuffer.memory);
+   }
+
+   // room to grow like the instance buffers, a buffer can't be empty
+   frameBuffer.capacity = std::max({ count, frameBuffer.capacity * 2, 1u });
+
+   vulkanDevice->createBuffer(
+      frameBuffer.capacity * elementSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      properties,
+      &frameBuffer.buffer,
+      &frameBuffer.memory);
+
+   return true;
+}
+
+void GpuCulling::writeDescriptorSet(FrameCulling& culling)
+{
+   VkBuffer buffers[] =
+   {
+      culling.instanceBuffer,
+      culling.instanceBatches.buffer,
+      culling.batches.buffer,
+      culling.batchDraws.buffer,
+      culling.draws.buffer,
+      culling.visibleBuffer
+   };
+
+   std::array<VkDescriptorBufferInfo, 6> bufferInfos ={};
+   std::array<VkWriteDescriptorSet, 6> descriptorWrites ={};
+
+   for(uint32_t i = 0; i < descriptorWrites.size(); i++)
+   {
+      bufferInfos[i].buffer = buffers[i];
+      bufferInfos[i].offset = 0;
+      bufferInfos[i].range  = VK_WHOLE_SIZE;
+
+      descriptorWrites[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[i].dstSet          = culling.descriptorSet;
+      descriptorWrites[i].dstBinding      = i;
+      descriptorWrites[i].dstArrayElement = 0;
+      descriptorWrites[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptorWrites[i].descriptorCount = 1;
+      descriptorWrites[i].pBufferInfo     = &bufferInfos[i];
+   }
+
+   vkUpdateDescriptorSets(vulkanDevice->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+uint32_t GpuCulling::getNumberOfVisible(uint32_t frame)
+{
+   const FrameCulling& culling = frameCulling[frame];
+
+   if(culling.draws.buffer == VK_NULL_HANDLE)
+   {
+      return 0;
+   }
+
+   const VkDrawIndexedIndirectCommand* drawCommands = static_cast<const VkDrawIndexedIndirectCommand*>(culling.draws.memory.mapped);
+
+   uint32_t numberOfVisible = 0;
+
+   for(uint32_t draw : culling.firstDraws)
+   {
+      numberOfVisible += drawCommands[draw].instanceCount;
+   }
+
+   return numberOfVisible;
+}
+
+void GpuCulling::update(uint32_t frame, WorldObject* worldObject, const std::vector<Draw>& draws)
+{
+   FrameCulling& culling = frameCulling[frame];
+
+   const std::vector<WorldObject::InstanceBatch>& instanceBatches = worldObject->getInstanceBatches();
+
+   uint32_t numberOfBatches = static_cast<uint32_t>(instanceBatches.size());
+   uint32_t numberOfDraws = static_cast<uint32_t>(draws.size());
+
+   culling.numberOfInstances = worldObject->getNumberOfInstances();
+
+   bool newBuffers = false;
+
+   if(reserve(culling.instanceBatches, culling.numberOfInstances, sizeof(uint32_t), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+   {
+      culling.writtenBatches.clear();
+      newBuffers = true;
+   }
+
+   newBuffers |= reserve(culling.batches, numberOfBatches, sizeof(GpuBatch), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+   newBuffers |= reserve(culling.batchDraws, numberOfDraws, sizeof(uint32_t), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+   newBuffers |= reserve(culling.draws, numberOfDraws, sizeof(VkDrawIndexedIndirectCommand), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+   if(newBuffers || culling.instanceBuffer != worldObject->getInstanceBuffer(frame) || culling.visibleBuffer != worldObject->getVisibleBuffer(frame))
+   {
+      culling.instanceBuffer = worldObject->getInstanceBuffer(frame);
+      culling.visibleBuffer  = worldObject->getVisibleBuffer(frame);
+
+      writeDescriptorSet(culling);
+   }
+
+   // the only part that grows with the instances, and it only changes when objects are added
+   bool batchesChanged = !std::equal(
+      instanceBatches.begin(), instanceBatches.end(),
+      culling.writtenBatches.begin(), culling.writtenBatches.end(),
+      [](const WorldObject::InstanceBatch& a, const WorldObject::InstanceBatch& b)
+   {
+      return a.firstInstance == b.firstInstance && a.numberOfInstances == b.numberOfInstances;
+   });
+
+   if(batchesChanged)
+   {
+      uint32_t* slotBatches = static_cast<uint32_t*>(culling.instanceBatches.memory.mapped);
+
+      for(uint32_t batch = 0; batch < numberOfBatches; batch++)
+      {
+         std::fill_n(slotBatches + instanceBatches[batch].firstInstance, instanceBatches[batch].numberOfInstances, batch);
+      }
+
+      vulkanDevice->memoryAllocator.flush(culling.instanceBatches.memory, 0, culling.numberOfInstances * sizeof(uint32_t));
+
+      culling.writtenBatches = instanceBatches;
+   }
+
+   // the draws of every batch next to each other, so a visible instance finds all of them
+   batchTable.assign(numberOfBatches, GpuBatch());
+
+   for(const auto& draw : draws)
+   {
+      batchTable[draw.batch].numberOfDraws++;
+   }
+
+   uint32_t firstDraw = 0;
+
+   for(uint32_t batch = 0; batch < numberOfBatches; batch++)
+   {
+      const Bounds& bounds = worldObject->getMeshBounds(instanceBatches[batch].meshId);
+
+      GpuBatch& gpuBatch = batchTable[batch];
+      gpuBatch.sphere        = glm::vec4(bounds.center, bounds.radius);
+      gpuBatch.extent        = glm::vec4(bounds.getExtent(), 0.f);
+      gpuBatch.firstInstance = instanceBatches[batch].firstInstance;
+      gpuBatch.firstDraw     = firstDraw;
+
+      firstDraw += gpuBatch.numberOfDraws;
+
+      // counts the draws that are filled in below
+      gpuBatch.padding = 0;
+   }
+
+   batchDrawTable.resize(numberOfDraws);
+
+   VkDrawIndexedIndirectCommand* drawCommands = static_cast<VkDrawIndexedIndirectCommand*>(culling.draws.memory.mapped);
+
+   for(uint32_t i = 0; i < numberOfDraws; i++)
+   {
+      const Draw& draw = draws[i];
+
+      GpuBatch& gpuBatch = batchTable[draw.batch];
+      batchDrawTable[gpuBatch.firstDraw + gpuBatch.padding++] = i;
+
+      // the shader counts the visible instances
+      drawCommands[i].indexCount    = draw.numberOfIndices;
+      drawCommands[i].instanceCount = 0;
+      drawCommands[i].firstIndex    = draw.firstIndex;
+      drawCommands[i].vertexOffset  = draw.vertexOffset;
+      drawCommands[i].firstInstance = gpuBatch.firstInstance;
+   }
+
+   culling.firstDraws.clear();
+
+   for(auto& gpuBatch : batchTable)
+   {
+      if(gpuBatch.numberOfDraws > 0)
+      {
+         culling.firstDraws.push_back(batchDrawTable[gpuBatch.firstDraw]);
+      }
+
+      gpuBatch.padding = 0;
+   }
+
+   if(numberOfBatches > 0)
+   {
+      memcpy(culling.batches.memory.mapped, batchTable.data(), numberOfBatches * sizeof(GpuBatch));
+      vulkanDevice->memoryAllocator.flush(culling.batches.memory, 0, numberOfBatches * sizeof(GpuBatch));
+   }
+
+   if(numberOfDraws > 0)
+   {
+      memcpy(culling.batchDraws.memory.mapped, batchDrawTable.data(), numberOfDraws * sizeof(uint32_t));
+      vulkanDevice->memoryAllocator.flush(culling.batchDraws.memory, 0, numberOfDraws * sizeof(uint32_t));
+   }
+}
+
+void GpuCulling::recordCulling(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum)
+{
+   const FrameCulling& culling = frameCulling[frame];
+
+   if(culling.numberOfInstances == 0)
+   {
+      return;
+   }
+
+   PushConstants pushConstants;
+   std::copy(frustum.getPlanes(), frustum.getPlanes() + 6, pushConstants.planes);
+   pushConstants.numberOfInstances = culling.numberOfInstances;
+
+   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &culling.descriptorSet, 0, nullptr);
+   vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+   vkCmdDispatch(commandBuffer, (culling.numberOfInstances + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+   // the draws read the instance counts, the vertex shader the visible slots, and the CPU reads the counts back
+   // after the fence
+   VkMemoryBarrier barrier ={};
+   barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+   barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+   barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+   vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+      0,
+      1, &barrier,
+      0, nullptr,
+      0, nullptr);
+}
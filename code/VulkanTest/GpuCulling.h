@@ -0,0 +1,140 @@
+#pragma once
+
+#include <vector>
+
+#include "stdafx.h"
+
+#include "Frustum.h"
+#include "VulkanDevice.hpp"
+#include "VulkanShader.h"
+#include "WorldObject.h"
+
+
+// Frustum culling in a compute shader (shaders/cull.comp), so the CPU doesn't touch the instances at all.
+//
+// The draws of a frame go into an indirect buffer with an instanceCount of 0. One invocation per instance buffer slot
+// tests the bounds of its instance, and if it's visible it bumps the instanceCount of every draw of its mesh and writes
+// its slot into the visible buffer of the WorldObject, in the range of its mesh. The vertex shader reads it the same
+// way as after culling on the CPU, the draws then come from vkCmdDrawIndexedIndirect.
+//
+// The tables the shader needs are per frame in flight like the instance buffers. The batch of every slot is only
+// written when the batches change, the batches and the draws are a few per mesh, so the CPU cost doesn't grow with
+// the number of instances.
+
+class GpuCulling
+{
+public:
+   // a sub mesh drawn for the visible instances of a batch
+   struct Draw
+   {
+      // in WorldObject::getInstanceBatches
+      uint32_t batch;
+      uint32_t firstIndex;
+      uint32_t numberOfIndices;
+      int32_t vertexOffset;
+   };
+
+   GpuCulling(vks::VulkanDevice* vulkanDevice);
+   ~GpuCulling();
+
+   // needs compute on the graphics queue, and firstInstance in indirect draws as that's where the instances of a
+   // mesh start in the visible buffer. not while recording frames
+   static bool isSupported(vks::VulkanDevice* vulkanDevice);
+
+   void createPipeline(uint32_t framesInFlight);
+
+   // Writes the draws of the frame with no instances, and the batches and their bounds. The draws of a batch don't
+   // have to be next to each other. After updateInstanceBuffer, the GPU must be done with the frame.
+   void update(uint32_t frame, WorldObject* worldObject, const std::vector<Draw>& draws);
+
+   // The dispatch and the barrier in front of the draws, outside of the render pass.
+   void recordCulling(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum);
+
+   // VkDrawIndexedIndirectCommand, in the order of the draws given to update
+   VkBuffer getDrawBuffer(uint32_t frame)
+   {
+      return frameCulling[frame].draws.buffer;
+   }
+
+   // Instances the GPU found visible the last time the frame was drawn, the GPU must be done with the frame.
+   // Has to come before update.
+   uint32_t getNumberOfVisible(uint32_t frame);
+
+private:
+
+   // std430 layout of Batch in cull.comp
+   struct GpuBatch
+   {
+      glm::vec4 sphere;
+      glm::vec4 extent;
+      uint32_t firstInstance;
+      uint32_t firstDraw;
+      uint32_t numberOfDraws;
+      uint32_t padding;
+   };
+
+   // layout of the push constants in cull.comp
+   struct PushConstants
+   {
+      glm::vec4 planes[6];
+      uint32_t numberOfInstances;
+   };
+
+   // host visible, and coherent for the draws so the instance counts can be read back
+   struct FrameBuffer
+   {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      vks::Allocation memory;
+
+      // in elements
+      uint32_t capacity = 0;
+   };
+
+   struct FrameCulling
+   {
+      // slot -> batch index
+      FrameBuffer instanceBatches;
+      FrameBuffer batches;
+      // the draws of every batch, indices into draws
+      FrameBuffer batchDraws;
+
+      FrameBuffer draws;
+
+      // the batches instanceBatches was written for
+      std::vector<WorldObject::InstanceBatch> writtenBatches;
+
+      // first draw of every batch with draws, its instanceCount is the number of visible instances
+      std::vector<uint32_t> firstDraws;
+
+      uint32_t numberOfInstances = 0;
+
+      // the WorldObject buffers the descriptor set points at
+      VkBuffer instanceBuffer = VK_NULL_HANDLE;
+      VkBuffer visibleBuffer = VK_NULL_HANDLE;
+
+      VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+   };
+
+   std::vector<FrameCulling> frameCulling;
+
+   // built here and copied in one go, the mapped memory can be write combined
+   std::vector<GpuBatch> batchTable;
+   std::vector<uint32_t> batchDrawTable;
+
+   // same as the local_size_x of the shader
+   static const uint32_t GROUP_SIZE = 64;
+
+   // grows the buffer to fit count elements, true if it's a new buffer
+   bool reserve(FrameBuffer& frameBuffer, uint32_t count, VkDeviceSize elementSize, VkMemoryPropertyFlags properties);
+
+   void writeDescriptorSet(FrameCulling& culling);
+
+   vks::VulkanDevice* vulkanDevice;
+
+   VulkanShader computeShader;
+
+   VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+   VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+   VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+   VkPipeline pipeline = VK_NULL_HANDLE;
+};
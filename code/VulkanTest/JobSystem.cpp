@@ -0,0 +1,252 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+   // which job system (if any) the current thread is a worker of
+   thread_local JobSystem* currentJobSystem = nullptr;
+   thread_local uint32_t currentWorkerIndex = 0;
+}
+
+JobSystem::JobSystem(uint32_t numberOfWorkers)
+{
+   if(numberOfWorkers == 0)
+   {
+      // hardware_concurrency is allowed to return 0 when it does not know
+      numberOfWorkers = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+   }
+
+   // all queues have to exist before the first worker starts stealing
+   for(uint32_t i = 0; i < numberOfWorkers; i++)
+   {
+      workerQueues.emplace_back(new WorkerQueue());
+   }
+
+   for(uint32_t i = 0; i < numberOfWorkers; i++)
+   {
+      workers.emplace_back(&JobSystem::workerLoop, this, i);
+   }
+}
+
+JobSystem::~JobSystem()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+   }
+   jobAvailable.notify_all();
+
+   for(auto& worker : workers)
+   {
+      worker.join();
+   }
+}
+
+JobSystem::JobHandle JobSystem::schedule(std::function<void()> function, const std::vector<JobHandle>& dependencies)
+{
+   JobHandle job = std::make_shared<Job>();
+   job->function = std::move(function);
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      unfinishedJobs++;
+
+      for(const auto& dependency : dependencies)
+      {
+         if(dependency && !dependency->finished)
+         {
+            job->unfinishedDependencies++;
+            dependency->dependents.push_back(job);
+         }
+      }
+   }
+
+   // all dependencies might have finished already
+   if(--job->unfinishedDependencies == 0)
+   {
+      enqueue(job);
+   }
+
+   return job;
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+   uint32_t workerIndex = getWorkerIndex();
+
+   while(!job->finished)
+   {
+      JobHandle otherJob = findJob(workerIndex);
+
+      if(otherJob)
+      {
+         run(otherJob);
+         continue;
+      }
+
+      // nothing to help with, the job runs on another thread
+      std::unique_lock<std::mutex> lock(mutex);
+      jobsDone.wait(lock, [this, &job] { return job->finished || queuedJobs > 0; });
+   }
+
+   if(job->error)
+   {
+      std::rethrow_exception(job->error);
+   }
+}
+
+void JobSystem::waitIdle()
+{
+   std::unique_lock<std::mutex> lock(mutex);
+   jobsDone.wait(lock, [this] { return unfinishedJobs == 0; });
+}
+
+uint32_t JobSystem::getWorkerIndex()
+{
+   return currentJobSystem == this ? currentWorkerIndex : NO_WORKER;
+}
+
+void JobSystem::enqueue(JobHandle job)
+{
+   uint32_t workerIndex = getWorkerIndex();
+
+   WorkerQueue& queue = workerIndex != NO_WORKER ? *workerQueues[workerIndex] : sharedQueue;
+
+   {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(std::move(job));
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      queuedJobs++;
+   }
+
+   jobAvailable.notify_one();
+
+   // someone might be waiting for a job to finish and can help with this one
+   jobsDone.notify_all();
+}
+
+JobSystem::JobHandle JobSystem::findJob(uint32_t workerIndex)
+{
+   JobHandle job;
+
+   // newest first, its data is most likely still in the cache
+   if(workerIndex != NO_WORKER)
+   {
+      WorkerQueue& queue = *workerQueues[workerIndex];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      if(!queue.jobs.empty())
+      {
+         job = std::move(queue.jobs.back());
+         queue.jobs.pop_back();
+      }
+   }
+
+   if(!job)
+   {
+      std::lock_guard<std::mutex> lock(sharedQueue.mutex);
+
+      if(!sharedQueue.jobs.empty())
+      {
+         job = std::move(sharedQueue.jobs.front());
+         sharedQueue.jobs.pop_front();
+      }
+   }
+
+   // steal the oldest job, it's usually the biggest piece of work left
+   uint32_t numberOfQueues = static_cast<uint32_t>(workerQueues.size());
+   uint32_t start = workerIndex != NO_WORKER ? workerIndex + 1 : 0;
+
+   for(uint32_t i = 0; i < numberOfQueues && !job; i++)
+   {
+      WorkerQueue& queue = *workerQueues[(start + i) % numberOfQueues];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      if(!queue.jobs.empty())
+      {
+         job = std::move(queue.jobs.front());
+         queue.jobs.pop_front();
+      }
+   }
+
+   if(job)
+   {
+      queuedJobs--;
+   }
+
+   return job;
+}
+
+void JobSystem::run(const JobHandle& job)
+{
+   // a failing job should not take the whole worker down with it
+   try
+   {
+      job->function();
+   }
+   catch(const std::exception& e)
+   {
+      std::cerr << "job failed: " << e.what() << std::endl;
+      job->error = std::current_exception();
+   }
+   catch(...)
+   {
+      std::cerr << "job failed with an unknown exception" << std::endl;
+      job->error = std::current_exception();
+   }
+
+   // frees whatever the job captured
+   job->function = nullptr;
+
+   std::vector<JobHandle> dependents;
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      job->finished = true;
+      dependents.swap(job->dependents);
+      unfinishedJobs--;
+   }
+
+   jobsDone.notify_all();
+
+   for(auto& dependent : dependents)
+   {
+      if(--dependent->unfinishedDependencies == 0)
+      {
+         enqueue(std::move(dependent));
+      }
+   }
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex)
+{
+   currentJobSystem = this;
+   currentWorkerIndex = workerIndex;
+
+   for(;;)
+   {
+      JobHandle job = findJob(workerIndex);
+
+      if(job)
+      {
+         run(job);
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      jobAvailable.wait(lock, [this] { return quit || queuedJobs > 0; });
+
+      if(quit && queuedJobs <= 0)
+      {
+         return;
+      }
+   }
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+// Pool of worker threads with work stealing. Used for work that should not block the main thread, like parsing
+// models and decoding images, and for splitting the per frame work (transforms, command recording) over all cores.
+//
+// Every worker has its own deque: jobs scheduled from a job go to the back of it and the worker takes its newest job
+// first, other workers steal the oldest one from the front. Jobs scheduled from other threads go into a shared queue
+// and start in the order they were scheduled.
+//
+// A job can depend on other jobs, it is only queued once they have all finished. wait() runs other jobs while it
+// waits, so a job can wait for the jobs it schedules (parallelFor inside a job) without tying up a worker.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+   struct Job;
+   typedef std::shared_ptr<Job> JobHandle;
+
+   // 0 = one worker per hardware thread, minus the main thread
+   JobSystem(uint32_t numberOfWorkers = 0);
+   ~JobSystem();
+
+   // exceptions thrown by the job are logged, and rethrown by wait()
+   JobHandle schedule(std::function<void()> job, const std::vector<JobHandle>& dependencies ={});
+
+   // blocks until the job has finished, running other jobs in the meantime. rethrows what the job threw
+   void wait(const JobHandle& job);
+
+   // blocks until every scheduled job has finished
+   void waitIdle();
+
+   // Calls function(first, last) for ranges of at most grainSize out of [begin, end) on all workers and the calling
+   // thread, and returns when all of them are done. The first exception thrown by function is rethrown here.
+   template<typename Function>
+   void parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function);
+
+   uint32_t getNumberOfWorkers()
+   {
+      return static_cast<uint32_t>(workers.size());
+   }
+
+   struct Job
+   {
+      std::function<void()> function;
+
+      // + 1 while schedule() is still adding dependencies
+      std::atomic<uint32_t> unfinishedDependencies{ 1 };
+
+      // queued when this job has finished, guarded by the JobSystem mutex
+      std::vector<JobHandle> dependents;
+
+      std::atomic<bool> finished{ false };
+
+      // set before finished
+      std::exception_ptr error;
+   };
+
+private:
+
+   static const uint32_t NO_WORKER = ~0u;
+
+   struct WorkerQueue
+   {
+      std::mutex mutex;
+      std::deque<JobHandle> jobs;
+   };
+
+   void workerLoop(uint32_t workerIndex);
+
+   // the index of the calling thread in this job system, NO_WORKER for other threads
+   uint32_t getWorkerIndex();
+
+   void enqueue(JobHandle job);
+
+   // own queue first, then the shared queue, then steal from the other workers
+   JobHandle findJob(uint32_t workerIndex);
+
+   void run(const JobHandle& job);
+
+   std::vector<std::thread> workers;
+   std::vector<std::unique_ptr<WorkerQueue>> workerQueues;
+
+   // jobs scheduled from threads that are not workers
+   WorkerQueue sharedQueue;
+
+   std::mutex mutex;
+   std::condition_variable jobAvailable;
+   std::condition_variable jobsDone;
+
+   // jobs in the queues. can be off by one for a moment while a job is being queued
+   std::atomic<int32_t> queuedJobs{ 0 };
+
+   // scheduled and not finished yet, including the ones waiting for dependencies
+   uint32_t unfinishedJobs = 0;
+   bool quit = false;
+};
+
+template<typename Function>
+void JobSystem::parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function)
+{
+   if(end <= begin)
+   {
+      return;
+   }
+
+   grainSize = grainSize > 0 ? grainSize : 1;
+
+   // one range, no need for a job
+   if(end - begin <= grainSize)
+   {
+      function(begin, end);
+      return;
+   }
+
+   std::mutex errorMutex;
+   std::exception_ptr error;
+
+   auto runRange = [&function, &errorMutex, &error](uint32_t first, uint32_t last)
+   {
+      try
+      {
+         function(first, last);
+      }
+      catch(...)
+      {
+         std::lock_guard<std::mutex> lock(errorMutex);
+         if(!error)
+         {
+            error = std::current_exception();
+         }
+      }
+   };
+
+   std::vector<JobHandle> jobs;
+
+   for(uint32_t first = begin + grainSize; first < end; first += grainSize)
+   {
+      uint32_t last = end - first > grainSize ? first + grainSize : end;
+
+      jobs.push_back(schedule([&runRange, first, last]() { runRange(first, last); }));
+   }
+
+   // the first range on this thread
+   runRange(begin, begin + grainSize);
+
+   for(const auto& job : jobs)
+   {
+      wait(job);
+   }
+
+   if(error)
+   {
+      std::rethrow_exception(error);
+   }
+}
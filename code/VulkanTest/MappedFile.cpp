@@ -0,0 +1,127 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& fileName)
+{
+   close();
+
+   HANDLE fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if(fileHandle == INVALID_HANDLE_VALUE)
+   {
+      return false;
+   }
+   file = fileHandle;
+
+   LARGE_INTEGER fileSize;
+   if(!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+   {
+      close();
+      return false;
+   }
+
+   mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if(mapping == nullptr)
+   {
+      close();
+      return false;
+   }
+
+   data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+   if(data == nullptr)
+   {
+      close();
+      return false;
+   }
+
+   size = static_cast<size_t>(fileSize.QuadPart);
+
+   return true;
+}
+
+void MappedFile::close()
+{
+   if(data != nullptr)
+   {
+      UnmapViewOfFile(data);
+   }
+   if(mapping != nullptr)
+   {
+      CloseHandle(mapping);
+   }
+   if(file != nullptr)
+   {
+      CloseHandle(file);
+   }
+
+   data    = nullptr;
+   size    = 0;
+   mapping = nullptr;
+   file    = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& fileName)
+{
+   close();
+
+   file = ::open(fileName.c_str(), O_RDONLY);
+   if(file < 0)
+   {
+      return false;
+   }
+
+   struct stat fileInfo;
+   if(fstat(file, &fileInfo) != 0 || fileInfo.st_size == 0)
+   {
+      close();
+      return false;
+   }
+
+   void* mapped = mmap(nullptr, static_cast<size_t>(fileInfo.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+   if(mapped == MAP_FAILED)
+   {
+      close();
+      return false;
+   }
+
+   data = static_cast<const uint8_t*>(mapped);
+   size = static_cast<size_t>(fileInfo.st_size);
+
+   return true;
+}
+
+void MappedFile::close()
+{
+   if(data != nullptr)
+   {
+      munmap(const_cast<uint8_t*>(data), size);
+   }
+   if(file >= 0)
+   {
+      ::close(file);
+   }
+
+   data = nullptr;
+   size = 0;
+   file = -1;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+// Read only memory mapped file. The data stays valid until close() or the destructor.
+
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+public:
+   MappedFile() = default;
+   ~MappedFile();
+
+   MappedFile(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+
+   // returns false if the file doesn't exist, is empty or can't be mapped
+   bool open(const std::string& fileName);
+   void close();
+
+   const uint8_t* getData() const
+   {
+      return data;
+   }
+
+   size_t getSize() const
+   {
+      return size;
+   }
+
+private:
+
+   const uint8_t* data = nullptr;
+   size_t size = 0;
+
+#ifdef _WIN32
+   // HANDLEs, windows.h is only included in the cpp
+   void* file = nullptr;
+   void* mapping = nullptr;
+#else
+   int file = -1;
+#endif
+};
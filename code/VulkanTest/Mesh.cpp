@@ -1,32 +1,25 @@
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "TextureAtlas.h"
+#include "VertexWelder.h"
+#include "UploadManager.h"
 
-#include <unordered_map>
+#include <algorithm>
+#include <cmath>
 
 Mesh::Mesh(vks::VulkanDevice *vulkanDevice)
 {
    this->vulkanDevice = vulkanDevice;
 
    texture = new Texture(vulkanDevice);
+
+   geometryArena.init(vulkanDevice, sizeof(Vertex));
 }
 
 Mesh::~Mesh()
 {
-   for(auto &buffer : vertexBuffer)
-   {
-      vkDestroyBuffer(vulkanDevice->device, buffer, nullptr);
-   }
-   for(auto &memory : vertexBufferMemory)
-   {
-      vkFreeMemory(vulkanDevice->device, memory, nullptr);
-   }
-   for(auto &buffer : indexBuffer)
-   {
-      vkDestroyBuffer(vulkanDevice->device, buffer, nullptr);
-   }
-   for(auto &memory : indexBufferMemory)
-   {
-      vkFreeMemory(vulkanDevice->device, memory, nullptr);
-   }
+   geometryArena.destroy();
 
   // if(descriptorPool != VK_NULL_HANDLE)
   //    vkDestroyDescriptorPool(vulkanDevice->device, descriptorPool, nullptr);
@@ -43,9 +36,60 @@ Mesh::~Mesh()
 // all meshes have at least one submesh, even if the mesh only is one single mesh and is not divided.
 // that makes it easy to optimize the code for each scenario. 
 
+uint32_t Mesh::loadMesh(const char* fileName)
+{
+   MeshData meshData = parseMesh(fileName);
+   TextureAtlas::pack(meshData);
+   MeshBuffers meshBuffers = createMeshBuffers(meshData);
+
+   uint32_t meshId = reserveMesh(fileName);
+   installMesh(meshId, meshData, meshBuffers);
+
+   for(const auto& materialData : meshData.materials)
+   {
+      for(const std::string* textureName : { &materialData.diffuseTexture, &materialData.specularTexture, &materialData.bumpTexture })
+      {
+         if(textureName->empty() || isTextureResident(*textureName))
+         {
+            continue;
+         }
+
+         Texture::ImageData imageData = Texture::decodeImage(Texture::normalizePath(*textureName), texture->isCompressionSupported());
+         Texture::TextureResources resources = texture->createTextureResources(imageData);
+         Texture::freeImageData(imageData);
+
+         installTexture(*textureName, resources);
+      }
+   }
+
+   return meshId;
+}
+
+void Mesh::createPlaceholderTexture()
+{
+   texture->createPlaceholder();
+}
+
+Mesh::MeshData Mesh::parseMesh(const std::string& fileName)
+{
+   MeshData meshData;
+
+   if(MeshCache::load(fileName, meshData))
+   {
+      // cheap next to parsing, so they are not in the cache
+      computeBounds(meshData);
+
+      return meshData;
+   }
+
+   meshData = parseObj(fileName);
+
+   MeshCache::store(fileName, meshData);
+
+   return meshData;
+}
 
-// TODO: I currently do not support models where a material is used several times in a model with other material(s) in between
-void Mesh::loadMesh(const char* fileName)
+Mesh::MeshData Mesh::parseObj(const std::string& fileName, ObjParser parser)
 {
    // Load TempMaterials.
    // create vector tempSubMeshes for each meterial
@@ -57,129 +101,310 @@ void Mesh::loadMesh(const char* fileName)
    // at least I should not create descriptorSet for these materials.. 
    // descriptor sets exists in the submesh, so unused materials should not be included.
 
-   VertexData tVertexData;
+   MeshData meshData;
+   meshData.fileName = fileName;
 
-   tinyobj::attrib_t attrib;
-   std::vector<tinyobj::shape_t> shapes;
-   std::vector<tinyobj::material_t> materials;
-   std::string err;
-   std::unordered_map<Vertex, uint32_t>uniqueVertices ={};
-   
-   if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName, "./models/"))
-   {
-      throw std::runtime_error(err);
-   }
+   VertexData& tVertexData = meshData.vertexData;
 
-   uint32_t baseMaterialId = static_cast<uint32_t>(material.size());
+   ObjLoader::ObjData objData = ObjLoader::load(fileName, parser);
+
+   meshData.materials = std::move(objData.materials);
 
-   loadMaterials(materials);
+   // triangles without a material get a plain white one
+   uint32_t defaultMaterialId = static_cast<uint32_t>(meshData.materials.size());
+   bool needsDefaultMaterial = false;
 
-   std::vector<SubMesh> tSubMeshes(materials.size());
+   size_t numberOfTriangles = objData.triangleMaterials.size();
 
-   for(const auto& shape : shapes)
+   for(auto& materialId : objData.triangleMaterials)
    {
-      for(int i = 0; i < shape.mesh.indices.size(); i++)
-      //for(const auto& index : shape.mesh.indices)
+      if(materialId < 0 || uint32_t(materialId) >= defaultMaterialId)
       {
-         tinyobj::index_t index = shape.mesh.indices[i];
+         materialId = static_cast<int32_t>(defaultMaterialId);
+         needsDefaultMaterial = true;
+      }
+   }
 
-         Vertex vertex ={};
-         
-         extractVertexFromAttrib(vertex, attrib, index);
+   if(needsDefaultMaterial)
+   {
+      MaterialData defaultMaterial;
+      defaultMaterial.diffuseColour  = glm::vec3(1.f);
+      defaultMaterial.specularColour = glm::vec3(0.f);
+      defaultMaterial.ambientColour  = glm::vec3(0.f);
 
-         int subMeshId = shape.mesh.material_ids[(int)std::floor(i / 3)];
+      meshData.materials.push_back(defaultMaterial);
+   }
 
-         if(tSubMeshes[subMeshId].numberOfIndices == 0)
-         {
-            int materialId = baseMaterialId + subMeshId;
-            tSubMeshes[subMeshId].materialId = materialId;
-            tSubMeshes[subMeshId].startIndex = static_cast<uint32_t>(tVertexData.indices.size());
-            tSubMeshes[subMeshId].meshId = static_cast<uint32_t>(modelName.size());
-         }
+   // a material can show up several times in a file with other materials in between. the triangles are grouped by
+   // material (keeping their order otherwise) before welding, so every material ends up as one index range
+   std::vector<uint32_t> trianglesPerMaterial(meshData.materials.size() + 1, 0);
+   for(int32_t materialId : objData.triangleMaterials)
+   {
+      trianglesPerMaterial[materialId + 1]++;
+   }
 
-         tSubMeshes[subMeshId].numberOfIndices++;
+   // -> first triangle of every material
+   for(size_t i = 1; i < trianglesPerMaterial.size(); i++)
+   {
+      trianglesPerMaterial[i] += trianglesPerMaterial[i - 1];
+   }
 
-         if(uniqueVertices.count(vertex) == 0)
-         {
-            uniqueVertices[vertex] = static_cast<uint32_t>(tVertexData.vertices.size());
-            tVertexData.vertices.push_back(vertex);
-         }
+   for(uint32_t materialId = 0; materialId < meshData.materials.size(); materialId++)
+   {
+      uint32_t numberOfMaterialTriangles = trianglesPerMaterial[materialId + 1] - trianglesPerMaterial[materialId];
+
+      if(numberOfMaterialTriangles > 0)
+      {
+         SubMesh subMesh;
+         subMesh.materialId      = static_cast<int32_t>(materialId);
+         subMesh.startIndex      = static_cast<int32_t>(trianglesPerMaterial[materialId] * 3);
+         subMesh.numberOfIndices = static_cast<int32_t>(numberOfMaterialTriangles * 3);
 
-         tVertexData.indices.push_back(static_cast<uint32_t>(uniqueVertices[vertex]));
+         meshData.subMeshes.push_back(subMesh);
       }
    }
 
-   for(const auto& tSubMesh : tSubMeshes)
+   std::vector<Vertex> groupedCorners;
+   const std::vector<Vertex>* corners = &objData.corners;
+
+   // nothing to move around if the file already is in order, which is the usual case
+   if(meshData.subMeshes.size() > 1 && !std::is_sorted(objData.triangleMaterials.begin(), objData.triangleMaterials.end()))
    {
-      if(tSubMesh.numberOfIndices > 0)
+      groupedCorners.resize(objData.corners.size());
+
+      for(size_t triangle = 0; triangle < numberOfTriangles; triangle++)
       {
-         subMeshMap[numberOfMeshes].push_back(tSubMesh);
+         uint32_t target = trianglesPerMaterial[objData.triangleMaterials[triangle]]++;
+
+         std::copy_n(&objData.corners[triangle * 3], 3, &groupedCorners[target * size_t(3)]);
       }
+
+      corners = &groupedCorners;
    }
 
-   vertexData.push_back(tVertexData);
+   // big meshes are welded on several threads, this usually runs on a job system worker so keep small ones on this thread
+   uint32_t weldThreads = corners->size() >= PARALLEL_WELD_CORNERS ? 0 : 1;
 
-   createVertexBuffer();
-   createIndexBuffer();
+   VertexWelder::weld(corners->data(), corners->size(), tVertexData.vertices, tVertexData.indices, weldThreads);
 
-   modelName.push_back(fileName);
+   computeBounds(meshData);
 
-   numberOfMeshes++;
+   return meshData;
 }
 
-void Mesh::draw(int commandBufferIndex)
+void Mesh::computeBounds(MeshData& meshData)
 {
-   //for loops here. for each mesh, for each instance
-   // the objects need to be sorted by mesh to be optimized. this might need to be moved into a coupler class/struct to work best
-  // vkCmdBindDescriptorSets(vulkanStuff->commandBuffers[commandBufferIndex], VkPipelineBindPoint(), 0, 0, 1, descriptor->getDescriptorSet(0), 0, nullptr);
-   
+   meshData.bounds = computeBounds(meshData, 0, meshData.getNumberOfIndices());
+
+   for(auto& subMesh : meshData.subMeshes)
+   {
+      subMesh.bounds = computeBounds(meshData, static_cast<uint32_t>(subMesh.startIndex), static_cast<uint32_t>(subMesh.numberOfIndices));
+   }
 }
 
-inline void Mesh::loadMaterials(std::vector<tinyobj::material_t>& materials)
+Bounds Mesh::computeBounds(const MeshData& meshData, uint32_t firstIndex, uint32_t numberOfIndices)
 {
-   for(const auto& material : materials)
+   Bounds bounds;
+
+   if(numberOfIndices == 0)
+   {
+      return bounds;
+   }
+
+   const Vertex* vertices = meshData.getVertices();
+   const uint32_t* indices = meshData.getIndices() + firstIndex;
+
+   bounds.min = vertices[indices[0]].position;
+   bounds.max = bounds.min;
+
+   // shared vertices are visited more than once, still cheaper than finding the unique ones
+   for(uint32_t i = 1; i < numberOfIndices; i++)
+   {
+      bounds.min = glm::min(bounds.min, vertices[indices[i]].position);
+      bounds.max = glm::max(bounds.max, vertices[indices[i]].position);
+   }
+
+   bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+   float radiusSquared = 0.f;
+
+   for(uint32_t i = 0; i < numberOfIndices; i++)
+   {
+      glm::vec3 offset = vertices[indices[i]].position - bounds.center;
+      radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+   }
+
+   bounds.radius = std::sqrt(radiusSquared);
+
+   return bounds;
+}
+
+Mesh::MeshBuffers Mesh::createMeshBuffers(const MeshData& meshData)
+{
+   MeshBuffers meshBuffers;
+
+   meshBuffers.geometry = geometryArena.allocate(meshData.getNumberOfVertices(), meshData.getNumberOfIndices());
+
+   const vks::GeometryAllocation& geometry = meshBuffers.geometry;
+
+   // straight from the mapped cache file into the staging ring when the mesh came from the cache
+   vulkanDevice->uploadManager->uploadBuffer(
+      geometryArena.getVertexBuffer(geometry.arenaIndex),
+      sizeof(Vertex) * VkDeviceSize(geometry.vertexOffset),
+      meshData.getVertices(),
+      sizeof(Vertex) * VkDeviceSize(geometry.numberOfVertices));
+
+   // both copies end up in the same batch unless the staging ring runs full in between, the index buffer ticket covers both then
+   meshBuffers.uploadTicket = vulkanDevice->uploadManager->uploadBuffer(
+      geometryArena.getIndexBuffer(geometry.arenaIndex),
+      sizeof(uint32_t) * VkDeviceSize(geometry.firstIndex),
+      meshData.getIndices(),
+      sizeof(uint32_t) * VkDeviceSize(geometry.numberOfIndices));
+
+   return meshBuffers;
+}
+
+void Mesh::freeMeshBuffers(MeshBuffers& meshBuffers)
+{
+   geometryArena.free(meshBuffers.geometry);
+}
+
+uint32_t Mesh::reserveMesh(const std::string& fileName)
+{
+   geometry.push_back(vks::GeometryAllocation());
+   meshResident.push_back(false);
+   bounds.push_back(Bounds());
+   firstMaterial.push_back(0);
+   numberOfMaterials.push_back(0);
+
+   modelName.push_back(fileName);
+
+   return numberOfMeshes++;
+}
+
+void Mesh::installMesh(uint32_t meshId, const MeshData& meshData, const MeshBuffers& meshBuffers)
+{
+   uint32_t baseMaterialId = static_cast<uint32_t>(material.size());
+
+   firstMaterial[meshId]     = baseMaterialId;
+   numberOfMaterials[meshId] = static_cast<uint32_t>(meshData.materials.size());
+
+   for(const auto& materialData : meshData.materials)
    {
       Material tMaterial ={};
 
-      if(material.diffuse_texname != "")
+      if(materialData.diffuseTexture != "")
       {
-         tMaterial.diffuseTextureId = texture->loadTexture("./textures/" + material.diffuse_texname);
+         tMaterial.diffuseTextureId = texture->acquireTexture(materialData.diffuseTexture);
       }
-      if(material.specular_texname != "")
+      if(materialData.specularTexture != "")
       {
-         tMaterial.specularTextureId = texture->loadTexture("./textures/" + material.specular_texname);
+         tMaterial.specularTextureId = texture->acquireTexture(materialData.specularTexture);
       }
-      if(material.bump_texname != "")
+      if(materialData.bumpTexture != "")
       {
-         tMaterial.bumpTextureId = texture->loadTexture("./textures/" + material.bump_texname);
+         tMaterial.bumpTextureId = texture->acquireTexture(materialData.bumpTexture);
       }
 
-      tMaterial.ambientColour = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
-      tMaterial.diffuseColour = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
-      tMaterial.specularColour = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
+      tMaterial.ambientColour  = materialData.ambientColour;
+      tMaterial.diffuseColour  = materialData.diffuseColour;
+      tMaterial.specularColour = materialData.specularColour;
+
+      material.push_back(tMaterial);
 
-      this->material.push_back(tMaterial);
+      if(descriptorPool != VK_NULL_HANDLE)
+      {
+         allocateDescriptorSet(getDescriptorSetId(static_cast<uint32_t>(material.size()) - 1));
+      }
    }
+
+   for(auto subMesh : meshData.subMeshes)
+   {
+      subMesh.materialId += baseMaterialId;
+      subMesh.meshId = meshId;
+      subMesh.descriptorSetId = static_cast<int32_t>(getDescriptorSetId(subMesh.materialId));
+
+      subMeshMap[meshId].push_back(subMesh);
+   }
+
+   geometry[meshId] = meshBuffers.geometry;
+   bounds[meshId] = meshData.bounds;
+
+   meshResident[meshId] = true;
 }
 
-inline void Mesh::extractVertexFromAttrib(Vertex& vertex, tinyobj::attrib_t& attrib, tinyobj::index_t& index)
+std::vector<std::string> Mesh::unloadMesh(uint32_t meshId)
 {
-   vertex.position =
+   if(!meshResident[meshId])
    {
-      attrib.vertices[3 * index.vertex_index + 0],
-      attrib.vertices[3 * index.vertex_index + 1],
-      attrib.vertices[3 * index.vertex_index + 2]
-   };
+      throw std::runtime_error("only resident meshes can be unloaded!");
+   }
+
+   std::vector<std::string> evictedTextures;
 
-   vertex.texCoord =
+   for(uint32_t i = firstMaterial[meshId]; i < firstMaterial[meshId] + numberOfMaterials[meshId]; i++)
    {
-      attrib.texcoords[2 * index.texcoord_index + 0],
-      1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-   };
+      for(int32_t* textureId : { &material[i].diffuseTextureId, &material[i].specularTextureId, &material[i].bumpTextureId })
+      {
+         if(*textureId < 0)
+         {
+            continue;
+         }
+
+         std::string textureName = texture->getImageName(*textureId);
+         if(texture->releaseTexture(*textureId))
+         {
+            evictedTextures.push_back(textureName);
+
+            // points at the placeholder now, the set shouldn't keep the destroyed view
+            markDescriptorSetChanged(*textureId);
+         }
+
+         *textureId = -1;
+      }
+   }
 
-   vertex.colour ={ 1.0f,1.0f,1.0f };
+   geometryArena.free(geometry[meshId]);
+   bounds[meshId] = Bounds();
+   subMeshMap.erase(meshId);
 
+   meshResident[meshId] = false;
+
+   return evictedTextures;
 }
+
+bool Mesh::installTexture(const std::string& fileName, Texture::TextureResources& resources)
+{
+   // -1 if every mesh using it was unloaded while it was loading
+   int textureId = texture->findTexture(fileName);
+
+   if(textureId < 0 || texture->isResident(textureId))
+   {
+      texture->destroyTextureResources(resources);
+      return false;
+   }
+
+   texture->installTexture(textureId, resources);
+
+   // the materials using it were drawn with the placeholder
+   markDescriptorSetChanged(textureId);
+
+   return true;
+}
+
+bool Mesh::isTextureResident(const std::string& fileName)
+{
+   return texture->isResident(texture->findTexture(fileName));
+}
+
+void Mesh::draw(int commandBufferIndex)
+{
+   //for loops here. for each mesh, for each instance
+   // the objects need to be sorted by mesh to be optimized. this might need to be moved into a coupler class/struct to work best
+  // vkCmdBindDescriptorSets(vulkanStuff->commandBuffers[commandBufferIndex], VkPipelineBindPoint(), 0, 0, 1, descriptor->getDescriptorSet(0), 0, nullptr);
+   
+}
+
 void Mesh::createDescriptorSetLayout()
 {
    // TODO: Add materia ubo 
@@ -199,17 +424,20 @@ void Mesh::createDescriptorSetLayout()
    }
 }
 
-void Mesh::createDescriptorPool()
+void Mesh::createDescriptorPool(uint32_t framesInFlight)
 {
+   descriptorSet.resize(framesInFlight);
+   changedDescriptorSets.resize(framesInFlight);
+
    VkDescriptorPoolSize poolSize ={};
    poolSize.type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-   poolSize.descriptorCount = static_cast<uint32_t>(material.size());
+   poolSize.descriptorCount = MAX_DESCRIPTOR_SETS * framesInFlight;
 
    VkDescriptorPoolCreateInfo poolInfo ={};
    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
    poolInfo.poolSizeCount = 1;
    poolInfo.pPoolSizes    = &poolSize;
-   poolInfo.maxSets       = static_cast<uint32_t>(material.size());
+   poolInfo.maxSets       = MAX_DESCRIPTOR_SETS * framesInFlight;
 
    if(vkCreateDescriptorPool(vulkanDevice->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
    {
@@ -217,11 +445,42 @@ void Mesh::createDescriptorPool()
    }
 }
 
+// materials installed after this get their descriptor set right away
 void Mesh::createDescriptorSet()
 {
-   for(auto& mat : material)
+   for(uint32_t i = 0; i < material.size(); i++)
    {
-      VkDescriptorSet tDescriptorSet;
+      allocateDescriptorSet(getDescriptorSetId(i));
+   }
+}
+
+uint32_t Mesh::getDescriptorSetId(uint32_t materialId)
+{
+   int32_t textureId = material[materialId].diffuseTextureId;
+
+   return textureId < 0 ? Texture::PLACEHOLDER_ID : static_cast<uint32_t>(textureId);
+}
+
+void Mesh::allocateDescriptorSet(uint32_t descriptorSetId)
+{
+   if(descriptorSetId >= MAX_DESCRIPTOR_SETS)
+   {
+      throw std::runtime_error("too many textures for the Mesh Material descriptor pool!");
+   }
+
+   for(uint32_t frame = 0; frame < descriptorSet.size(); frame++)
+   {
+      if(descriptorSetId >= descriptorSet[frame].size())
+      {
+         descriptorSet[frame].resize(descriptorSetId + 1, VK_NULL_HANDLE);
+      }
+
+      // shared by every material with the texture. if the id belonged to an evicted texture the set is already
+      // marked as changed, and a texture with a reused id is the placeholder until it's installed as well
+      if(descriptorSet[frame][descriptorSetId] != VK_NULL_HANDLE)
+      {
+         continue;
+      }
 
       VkDescriptorSetAllocateInfo allocInfoSampler ={};
       allocInfoSampler.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -229,106 +488,54 @@ void Mesh::createDescriptorSet()
       allocInfoSampler.descriptorSetCount = 1;
       allocInfoSampler.pSetLayouts        = &descriptorSetLayout;
 
-      if(vkAllocateDescriptorSets(vulkanDevice->device, &allocInfoSampler, &tDescriptorSet) != VK_SUCCESS)
+      if(vkAllocateDescriptorSets(vulkanDevice->device, &allocInfoSampler, &descriptorSet[frame][descriptorSetId]) != VK_SUCCESS)
       {
          throw std::runtime_error("failed to allocate MatrixBuffer descriptor set!");
       }
 
-      VkDescriptorImageInfo samplerInfo={};
-      samplerInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      samplerInfo.imageView = texture->getImageView(mat.diffuseTextureId); // TODO: one for each material.
-      samplerInfo.sampler = texture->getSampler(mat.diffuseTextureId);
-
-      VkWriteDescriptorSet descriptorWritesSampler ={};
-      descriptorWritesSampler.sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptorWritesSampler.dstSet           = tDescriptorSet;
-      descriptorWritesSampler.dstBinding       = 2;
-      descriptorWritesSampler.dstArrayElement  = 0;
-      descriptorWritesSampler.descriptorType   = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      descriptorWritesSampler.descriptorCount  = 1;
-      descriptorWritesSampler.pBufferInfo      = nullptr;
-      descriptorWritesSampler.pImageInfo       = &samplerInfo;
-      descriptorWritesSampler.pTexelBufferView = nullptr;
-
-      vkUpdateDescriptorSets(vulkanDevice->device, 1, &descriptorWritesSampler, 0, nullptr);
-
-      descriptorSet.push_back(tDescriptorSet);
+      updateDescriptorSet(frame, descriptorSetId);
    }
 }
 
-// TODO: Merge to one method that takes argument about which type of buffer it is.
-void Mesh::createIndexBuffer()
+void Mesh::markDescriptorSetChanged(uint32_t descriptorSetId)
 {
-   VkDeviceSize bufferSize = sizeof(vertexData.back().indices[0]) * vertexData.back().indices.size();
-
-   VkBuffer stagingBuffer;
-   VkDeviceMemory stagingMemory;
-
-   vulkanDevice->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &stagingBuffer,
-      &stagingMemory);
-
-   void* data;
-   vkMapMemory(vulkanDevice->device, stagingMemory, 0, bufferSize, 0, &data);
-   memcpy(data, vertexData.back().indices.data(), (size_t)bufferSize);
-   vkUnmapMemory(vulkanDevice->device, stagingMemory);
-
-   VkBuffer temp;
-   VkDeviceMemory tempMem;
-   vulkanDevice->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      &temp,
-      &tempMem);
-
-   vulkanDevice->copyBuffer(stagingBuffer, temp, bufferSize);
-
-   indexBuffer.push_back(temp);
-   indexBufferMemory.push_back(tempMem);
-
-   vkDestroyBuffer(vulkanDevice->device, stagingBuffer, nullptr);
-   vkFreeMemory(vulkanDevice->device, stagingMemory, nullptr);
+   for(uint32_t frame = 0; frame < descriptorSet.size(); frame++)
+   {
+      if(descriptorSetId < descriptorSet[frame].size() && descriptorSet[frame][descriptorSetId] != VK_NULL_HANDLE)
+      {
+         changedDescriptorSets[frame].insert(descriptorSetId);
+      }
+   }
 }
 
-void Mesh::createVertexBuffer()
+void Mesh::updateDescriptorSets(uint32_t frame)
 {
-   VkDeviceSize bufferSize = sizeof(vertexData.back().vertices[0])*vertexData.back().vertices.size();
-
-   VkBuffer stagingBuffer;
-   VkDeviceMemory stagingBufferMemory;
-
-   vulkanDevice->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &stagingBuffer,
-      &stagingBufferMemory);
-
-   void *data;
-   vkMapMemory(vulkanDevice->device, stagingBufferMemory, 0, bufferSize, 0, &data);
-   memcpy(data, vertexData.back().vertices.data(), (size_t)bufferSize);
-   vkUnmapMemory(vulkanDevice->device, stagingBufferMemory);
-
-   VkBuffer temp;
-   VkDeviceMemory tempMem;
-   
-   vulkanDevice->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      &temp,
-      &tempMem);
-
-
-   vulkanDevice->copyBuffer(stagingBuffer, temp, bufferSize);
+   for(uint32_t descriptorSetId : changedDescriptorSets[frame])
+   {
+      updateDescriptorSet(frame, descriptorSetId);
+   }
 
-   vertexBuffer.push_back(temp);
-   vertexBufferMemory.push_back(tempMem);
+   changedDescriptorSets[frame].clear();
+}
 
-   vkDestroyBuffer(vulkanDevice->device, stagingBuffer, nullptr);
-   vkFreeMemory(vulkanDevice->device, stagingBufferMemory, nullptr);
-}
\ No newline at end of file
+// the set must not be in use by the GPU when this is called
+void Mesh::updateDescriptorSet(uint32_t frame, uint32_t descriptorSetId)
+{
+   VkDescriptorImageInfo samplerInfo={};
+   samplerInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+   samplerInfo.imageView = texture->getImageView(descriptorSetId);
+   samplerInfo.sampler = texture->getSampler(descriptorSetId);
+
+   VkWriteDescriptorSet descriptorWritesSampler ={};
+   descriptorWritesSampler.sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+   descriptorWritesSampler.dstSet           = descriptorSet[frame][descriptorSetId];
+   descriptorWritesSampler.dstBinding       = 2;
+   descriptorWritesSampler.dstArrayElement  = 0;
+   descriptorWritesSampler.descriptorType   = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+   descriptorWritesSampler.descriptorCount  = 1;
+   descriptorWritesSampler.pBufferInfo      = nullptr;
+   descriptorWritesSampler.pImageInfo       = &samplerInfo;
+   descriptorWritesSampler.pTexelBufferView = nullptr;
+
+   vkUpdateDescriptorSets(vulkanDevice->device, 1, &descriptorWritesSampler, 0, nullptr);
+}
@@ -1,14 +1,19 @@
 #pragma once
 
-#include <vulkan\vulkan.hpp>
+#include <vulkan/vulkan.hpp>
 #include <tiny_obj_loader.h>
 #include <string>
 #include <map>
+#include <memory>
+#include <set>
 
 #include "VulkanHelpers.hpp"
 #include "VulkanDevice.hpp"
+#include "GeometryArena.h"
+#include "Bounds.h"
 
 #include "stdafx.h"
+#include "MappedFile.h"
 #include "Texture.h"
 
 
@@ -18,20 +23,25 @@
 /// should be able so search for meshobject in some console or something
 
 
-// TODO: enable more that one model per buffer.
-// a vertex buffer should have some minimal amount of vertices
-// this optimizes things when having low poly meshes.
-
-// when drawing each buffer should only be loaded once.
-// use offsets when drawing.
+// All meshes share the vertex and index buffers of the geometry arena, draw with the vertexOffset/firstIndex of
+// getGeometry(). The buffers only have to be bound again when the arena index changes.
 // need to utilize some class or stucture that couples a mesh with a worldObject
 
-// will have to load the material somehow. one material per submesh. 
-// dynamic buffer? push constants? have to research best practices.
+// Every mesh has one sub mesh per material it uses, drawn with the descriptor set of the material. Materials with the
+// same diffuse texture share a set, loadMesh packs the small textures of a mesh into a TextureAtlas so its materials do.
+// There is a set per frame in flight, a set that changes while earlier frames might still use it is only rewritten for
+// a frame once its fence has passed (updateDescriptorSets), so installing a texture never waits for the GPU.
+// The mesh and every sub mesh have bounds in mesh space, WorldObject culls the instances with the ones of the mesh.
+
+// Meshes can be loaded in one go with loadMesh, or in steps so the slow parts can run on other threads:
+// parseMesh (any thread) -> createMeshBuffers (any thread, uploads) -> installMesh (main thread, when the upload is done).
+// A reserved mesh keeps its id but is not resident, so it should be skipped when drawing until it's installed.
+// Textures are shared between meshes by file name (see Texture), a material uses the placeholder texture until its texture
+// is installed. Every material holds a reference on its textures, they are evicted when the last mesh using them is unloaded.
 
 class Mesh
 {
-private:
+public:
    struct VertexData
    {
       std::vector<Vertex> vertices;
@@ -44,9 +54,83 @@ private:
       int32_t numberOfIndices = 0;
       int32_t materialId = -1;
       int32_t meshId = -1; // not needed, but might keep it for now.
+
+      // set when the mesh is installed, the sub meshes of all materials with the same diffuse texture have the same one
       int32_t descriptorSetId = -1;
+
+      // of the vertices of this sub mesh only
+      Bounds bounds;
+   };
+
+   // material as it is in the file, the textures are not loaded yet. empty name = no texture.
+   struct MaterialData
+   {
+      std::string diffuseTexture;
+      std::string specularTexture;
+      std::string bumpTexture;
+      glm::vec3 diffuseColour;
+      glm::vec3 specularColour;
+      glm::vec3 ambientColour;
+   };
+
+   // everything parseMesh gets out of a file, the material ids of the sub meshes index materials
+   struct MeshData
+   {
+      std::string fileName;
+
+      // filled when the mesh was parsed from the obj
+      VertexData vertexData;
+
+      // set when the mesh came from the mesh cache, the vertices and indices point straight into the mapped file
+      std::shared_ptr<MappedFile> mappedFile;
+      const Vertex* mappedVertices = nullptr;
+      const uint32_t* mappedIndices = nullptr;
+      uint32_t numberOfMappedVertices = 0;
+      uint32_t numberOfMappedIndices = 0;
+
+      std::vector<SubMesh> subMeshes;
+      std::vector<MaterialData> materials;
+
+      // of the whole mesh, computed by parseMesh/parseObj
+      Bounds bounds;
+
+      const Vertex* getVertices() const
+      {
+         return mappedFile ? mappedVertices : vertexData.vertices.data();
+      }
+
+      const uint32_t* getIndices() const
+      {
+         return mappedFile ? mappedIndices : vertexData.indices.data();
+      }
+
+      uint32_t getNumberOfVertices() const
+      {
+         return mappedFile ? numberOfMappedVertices : static_cast<uint32_t>(vertexData.vertices.size());
+      }
+
+      uint32_t getNumberOfIndices() const
+      {
+         return mappedFile ? numberOfMappedIndices : static_cast<uint32_t>(vertexData.indices.size());
+      }
    };
 
+   struct MeshBuffers
+   {
+      vks::GeometryAllocation geometry;
+
+      uint64_t uploadTicket = 0;
+   };
+
+   // which obj parser parseObj uses, see ObjLoader
+   enum class ObjParser
+   {
+      Automatic,
+      Reference,
+      Optimized
+   };
+
+private:
    struct Material
    {
       int32_t diffuseTextureId = -1;
@@ -57,31 +141,83 @@ private:
       glm::vec3 ambientColour;
    };
 
+   // the descriptor pool is created once, before all the textures are known. one set per diffuse texture and frame
+   static const uint32_t MAX_DESCRIPTOR_SETS = 256;
+
+   // meshes with more corners than this are welded on all hardware threads
+   static const size_t PARALLEL_WELD_CORNERS = 1024 * 1024;
+
+   // bounds of the mesh and of every sub mesh, from the welded vertices
+   static void computeBounds(MeshData& meshData);
+   static Bounds computeBounds(const MeshData& meshData, uint32_t firstIndex, uint32_t numberOfIndices);
+
 public:
    Mesh(vks::VulkanDevice* vulkanDevice);
    ~Mesh();
 
    // TODO: do so we can send in one or more objects? currently only one at a time
-   void loadMesh(const char* fileNames);
+   // loads the mesh and its textures right away, returns the mesh id
+   uint32_t loadMesh(const char* fileNames);
+
+   // has to be called after the upload manager is created and before any texture is loaded
+   void createPlaceholderTexture();
+
+   // thread safe. uses the mesh cache if it's up to date, otherwise parses the obj and writes the cache.
+   static MeshData parseMesh(const std::string& fileName);
+
+   // thread safe. always parses the obj, the mesh cache is neither read nor written.
+   static MeshData parseObj(const std::string& fileName, ObjParser parser = ObjParser::Automatic);
+
+   MeshBuffers createMeshBuffers(const MeshData& meshData);
+
+   // for buffers that never got installed
+   void freeMeshBuffers(MeshBuffers& meshBuffers);
+
+   // main thread only
+   uint32_t reserveMesh(const std::string& fileName);
+   void installMesh(uint32_t meshId, const MeshData& meshData, const MeshBuffers& meshBuffers);
+
+   // main thread only. releases the textures of the mesh's materials and frees its geometry, the mesh id stays reserved
+   // but isn't resident anymore. the GPU must be done with the mesh and the command buffers have to be re-recorded.
+   // returns the names of the textures that were evicted
+   std::vector<std::string> unloadMesh(uint32_t meshId);
+
+   // returns false if the texture was already installed or nothing uses it anymore, the resources are destroyed then
+   bool installTexture(const std::string& fileName, Texture::TextureResources& resources);
+
+   bool isResident(uint32_t meshId)
+   {
+      return meshResident[meshId];
+   }
+
+   bool isTextureResident(const std::string& fileName);
 
    void draw(int commandBufferIndex);
 
-   VkBuffer getVertexBuffer(int index)
+   const vks::GeometryAllocation& getGeometry(uint32_t meshId)
+   {
+      return geometry[meshId];
+   }
+
+   vks::GeometryArena* getGeometryArena()
    {
-      return vertexBuffer[index];
+      return &geometryArena;
    }
 
-   VkBuffer getIndexBuffer(int index)
+   // empty bounds until the mesh is installed
+   const Bounds& getBounds(uint32_t meshId)
    {
-      return indexBuffer[index];
+      return bounds[meshId];
    }
 
    uint32_t getNumIndices(int index)
    {
-      return static_cast<uint32_t>(vertexData[index].indices.size());
+      return geometry[index].numberOfIndices;
    }
 
-   std::vector<SubMesh> getSubMeshesForMesh(uint32_t meshId)
+   // one per material, every material of a mesh is a single index range relative to the first index of the mesh.
+   // the material ids are the ones of getDescriptorForMaterial
+   const std::vector<SubMesh>& getSubMeshesForMesh(uint32_t meshId)
    {
       return subMeshMap[meshId];
    }
@@ -91,22 +227,26 @@ public:
       return numberOfMeshes;
    }
 
-private:
+   Texture* getTexture()
+   {
+      return texture;
+   }
 
-   void createVertexBuffer();
-   void createIndexBuffer();
+private:
 
    vks::VulkanDevice* vulkanDevice;
 
-   std::vector<VertexData> vertexData;
-
    std::vector<Material> material;
 
-   // TODO: create struct/class that handles buffers. All types of buffers. 
-   std::vector<VkBuffer> vertexBuffer;
-   std::vector<VkDeviceMemory> vertexBufferMemory;
-   std::vector<VkBuffer> indexBuffer;
-   std::vector<VkDeviceMemory> indexBufferMemory;
+   // the vertices and indices are only kept on the GPU, in the arena
+   vks::GeometryArena geometryArena;
+   std::vector<vks::GeometryAllocation> geometry;
+   std::vector<bool> meshResident;
+   std::vector<Bounds> bounds;
+
+   // the materials of a mesh are next to each other
+   std::vector<uint32_t> firstMaterial;
+   std::vector<uint32_t> numberOfMaterials;
 
    std::map<int, std::vector<SubMesh>> subMeshMap;
 
@@ -117,31 +257,50 @@ private:
 
    std::vector<std::string> modelName;
 
-   inline void loadMaterials(std::vector<tinyobj::material_t>& materials);
-
-   inline void extractVertexFromAttrib(Vertex& vertex, tinyobj::attrib_t& attrib, tinyobj::index_t& index);
-
 
    // descriptorstuff
 
    // TODO: might need a vector of these to make sure that I can expand with more descriptors if needed.
    // for example have a decriptorPool for up to ~100 meshes, and then create a new descriptorPool if it's needed.
-   VkDescriptorPool descriptorPool;
+   VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
    VkDescriptorSetLayout descriptorSetLayout;
-   std::vector<VkDescriptorSet> descriptorSet;
+
+   // per frame in flight, by the id of the diffuse texture (see getDescriptorSetId). VK_NULL_HANDLE until the pool
+   // exists or if no material uses the texture. materials without a texture use the one of the placeholder
+   std::vector<std::vector<VkDescriptorSet>> descriptorSet;
+
+   // per frame in flight, the sets whose texture changed since the frame was last drawn
+   std::vector<std::set<uint32_t>> changedDescriptorSets;
+
+   // does nothing if the set is already there, a new one is written right away since nothing uses it yet
+   void allocateDescriptorSet(uint32_t descriptorSetId);
+   void updateDescriptorSet(uint32_t frame, uint32_t descriptorSetId);
+
+   // the sets of the texture are rewritten by updateDescriptorSets, frame by frame
+   void markDescriptorSetChanged(uint32_t descriptorSetId);
 public:
    void createDescriptorSetLayout();
-   void createDescriptorPool();
+   void createDescriptorPool(uint32_t framesInFlight);
    void createDescriptorSet();
 
+   // rewrites the sets of the frame that changed since it was last drawn. the GPU must be done with the frame
+   void updateDescriptorSets(uint32_t frame);
+
    VkDescriptorSetLayout getDescriptorSetLayout()
    {
       return descriptorSetLayout;
    }
 
-   // TODO: Change to look directly at submesh. material/submesh should have descriptorId?
-   VkDescriptorSet *getDescriptorForMesh(int meshId)
+   // materials share a set when they have the same diffuse texture, e.g. all materials packed into one TextureAtlas
+   uint32_t getDescriptorSetId(uint32_t materialId);
+
+   VkDescriptorSet *getDescriptorSet(uint32_t frame, uint32_t descriptorSetId)
+   {
+      return &descriptorSet[frame].at(descriptorSetId);
+   }
+
+   VkDescriptorSet *getDescriptorForMaterial(uint32_t frame, uint32_t materialId)
    {
-      return &descriptorSet.at(material.at(subMeshMap[meshId][0].materialId).diffuseTextureId);
+      return getDescriptorSet(frame, getDescriptorSetId(materialId));
    }
 };
\ No newline at end of file
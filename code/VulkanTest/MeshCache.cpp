@@ -0,0 +1,248 @@
+#include "MeshCache.h"
+#include "CacheFile.h"
+#include "ObjLoader.h"
+
+#include <cstring>
+
+namespace
+{
+   const char MAGIC[4] ={ 'V', 'T', 'M', 'C' };
+
+   // sections start on 16 bytes, so the vertices can be used straight from the mapped file
+   uint64_t alignSection(uint64_t offset)
+   {
+      return (offset + 15) & ~uint64_t(15);
+   }
+
+   bool sectionFits(uint64_t offset, uint64_t size, uint64_t fileSize)
+   {
+      return offset <= fileSize && size <= fileSize - offset;
+   }
+}
+
+bool MeshCache::load(const std::string& sourceFile, Mesh::MeshData& meshData)
+{
+   auto file = std::make_shared<MappedFile>();
+
+   if(!file->open(getCacheFileName(sourceFile)) || file->getSize() < sizeof(Header))
+   {
+      return false;
+   }
+
+   const uint8_t* data = file->getData();
+   uint64_t fileSize   = file->getSize();
+
+   Header header;
+   memcpy(&header, data, sizeof(Header));
+
+   if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION ||
+      header.vertexSize != sizeof(Vertex))
+   {
+      return false;
+   }
+
+   if(!sectionFits(header.verticesOffset, uint64_t(header.numberOfVertices) * sizeof(Vertex), fileSize) ||
+      !sectionFits(header.indicesOffset, uint64_t(header.numberOfIndices) * sizeof(uint32_t), fileSize) ||
+      !sectionFits(header.subMeshesOffset, uint64_t(header.numberOfSubMeshes) * sizeof(SubMeshRecord), fileSize) ||
+      !sectionFits(header.materialsOffset, uint64_t(header.numberOfMaterials) * sizeof(MaterialRecord), fileSize) ||
+      !sectionFits(header.materialFilesOffset, uint64_t(header.numberOfMaterialFiles) * sizeof(MaterialFileRecord), fileSize) ||
+      !sectionFits(header.stringsOffset, header.stringsSize, fileSize) ||
+      header.pathLength > header.stringsSize)
+   {
+      return false;
+   }
+
+   const char* strings = reinterpret_cast<const char*>(data + header.stringsOffset);
+
+   // two sources with the same path hash
+   if(std::string(strings, header.pathLength) != sourceFile)
+   {
+      return false;
+   }
+
+   if(!CacheFile::isUpToDate(sourceFile, header.sourceTime, header.sourceSize, header.sourceHash))
+   {
+      return false;
+   }
+
+   const MaterialFileRecord* materialFileRecords = reinterpret_cast<const MaterialFileRecord*>(data + header.materialFilesOffset);
+   for(uint32_t i = 0; i < header.numberOfMaterialFiles; i++)
+   {
+      const MaterialFileRecord& record = materialFileRecords[i];
+
+      if(!sectionFits(record.pathOffset, record.pathLength, header.stringsSize))
+      {
+         return false;
+      }
+
+      std::string materialFile(strings + record.pathOffset, record.pathLength);
+
+      uint64_t time, size;
+      bool upToDate = record.exists ?
+         CacheFile::isUpToDate(materialFile, record.time, record.size, record.hash) :
+         !CacheFile::getSourceInfo(materialFile, &time, &size);
+
+      if(!upToDate)
+      {
+         return false;
+      }
+   }
+
+   std::vector<Mesh::MaterialData> materials(header.numberOfMaterials);
+
+   const MaterialRecord* materialRecords = reinterpret_cast<const MaterialRecord*>(data + header.materialsOffset);
+   for(uint32_t i = 0; i < header.numberOfMaterials; i++)
+   {
+      const MaterialRecord& record = materialRecords[i];
+
+      std::string* textures[] ={ &materials[i].diffuseTexture, &materials[i].specularTexture, &materials[i].bumpTexture };
+      for(int j = 0; j < 3; j++)
+      {
+         if(!sectionFits(record.textureOffset[j], record.textureLength[j], header.stringsSize))
+         {
+            return false;
+         }
+
+         textures[j]->assign(strings + record.textureOffset[j], record.textureLength[j]);
+      }
+
+      materials[i].diffuseColour  = glm::vec3(record.diffuseColour[0], record.diffuseColour[1], record.diffuseColour[2]);
+      materials[i].specularColour = glm::vec3(record.specularColour[0], record.specularColour[1], record.specularColour[2]);
+      materials[i].ambientColour  = glm::vec3(record.ambientColour[0], record.ambientColour[1], record.ambientColour[2]);
+   }
+
+   std::vector<Mesh::SubMesh> subMeshes(header.numberOfSubMeshes);
+
+   const SubMeshRecord* subMeshRecords = reinterpret_cast<const SubMeshRecord*>(data + header.subMeshesOffset);
+   for(uint32_t i = 0; i < header.numberOfSubMeshes; i++)
+   {
+      const SubMeshRecord& record = subMeshRecords[i];
+
+      if(record.materialId < 0 || uint32_t(record.materialId) >= header.numberOfMaterials ||
+         record.startIndex < 0 || record.numberOfIndices < 0 ||
+         uint64_t(record.startIndex) + uint64_t(record.numberOfIndices) > header.numberOfIndices)
+      {
+         return false;
+      }
+
+      subMeshes[i].startIndex      = record.startIndex;
+      subMeshes[i].numberOfIndices = record.numberOfIndices;
+      subMeshes[i].materialId      = record.materialId;
+   }
+
+   meshData.fileName   = sourceFile;
+   meshData.vertexData = Mesh::VertexData();
+   meshData.subMeshes  = std::move(subMeshes);
+   meshData.materials  = std::move(materials);
+
+   meshData.mappedVertices         = reinterpret_cast<const Vertex*>(data + header.verticesOffset);
+   meshData.mappedIndices          = reinterpret_cast<const uint32_t*>(data + header.indicesOffset);
+   meshData.numberOfMappedVertices = header.numberOfVertices;
+   meshData.numberOfMappedIndices  = header.numberOfIndices;
+   meshData.mappedFile             = file;
+
+   return true;
+}
+
+void MeshCache::store(const std::string& sourceFile, const Mesh::MeshData& meshData)
+{
+   Header header ={};
+   memcpy(header.magic, MAGIC, sizeof(MAGIC));
+   header.version    = VERSION;
+   header.vertexSize = sizeof(Vertex);
+   header.pathLength = static_cast<uint32_t>(sourceFile.size());
+
+   if(!CacheFile::getSourceInfo(sourceFile, &header.sourceTime, &header.sourceSize) ||
+      !CacheFile::hashFile(sourceFile, &header.sourceHash))
+   {
+      return;
+   }
+
+   header.numberOfVertices  = meshData.getNumberOfVertices();
+   header.numberOfIndices   = meshData.getNumberOfIndices();
+   header.numberOfSubMeshes = static_cast<uint32_t>(meshData.subMeshes.size());
+   header.numberOfMaterials = static_cast<uint32_t>(meshData.materials.size());
+
+   std::string strings = sourceFile;
+   std::vector<MaterialRecord> materialRecords(header.numberOfMaterials);
+
+   for(uint32_t i = 0; i < header.numberOfMaterials; i++)
+   {
+      const Mesh::MaterialData& material = meshData.materials[i];
+      MaterialRecord& record = materialRecords[i];
+
+      const std::string* textures[] ={ &material.diffuseTexture, &material.specularTexture, &material.bumpTexture };
+      for(int j = 0; j < 3; j++)
+      {
+         record.textureOffset[j] = static_cast<uint32_t>(strings.size());
+         record.textureLength[j] = static_cast<uint32_t>(textures[j]->size());
+         strings += *textures[j];
+      }
+
+      for(int j = 0; j < 3; j++)
+      {
+         record.diffuseColour[j]  = material.diffuseColour[j];
+         record.specularColour[j] = material.specularColour[j];
+         record.ambientColour[j]  = material.ambientColour[j];
+      }
+   }
+
+   std::vector<std::string> materialFiles = ObjLoader::getMaterialFiles(sourceFile);
+   std::vector<MaterialFileRecord> materialFileRecords(materialFiles.size());
+
+   header.numberOfMaterialFiles = static_cast<uint32_t>(materialFiles.size());
+
+   for(size_t i = 0; i < materialFiles.size(); i++)
+   {
+      MaterialFileRecord& record = materialFileRecords[i];
+      record.pathOffset = static_cast<uint32_t>(strings.size());
+      record.pathLength = static_cast<uint32_t>(materialFiles[i].size());
+      strings += materialFiles[i];
+
+      if(CacheFile::getSourceInfo(materialFiles[i], &record.time, &record.size))
+      {
+         // it exists but can't be read, parse it again next time
+         if(!CacheFile::hashFile(materialFiles[i], &record.hash))
+         {
+            return;
+         }
+
+         record.exists = 1;
+      }
+   }
+
+   std::vector<SubMeshRecord> subMeshRecords(header.numberOfSubMeshes);
+   for(uint32_t i = 0; i < header.numberOfSubMeshes; i++)
+   {
+      subMeshRecords[i].startIndex      = meshData.subMeshes[i].startIndex;
+      subMeshRecords[i].numberOfIndices = meshData.subMeshes[i].numberOfIndices;
+      subMeshRecords[i].materialId      = meshData.subMeshes[i].materialId;
+   }
+
+   header.verticesOffset      = alignSection(sizeof(Header));
+   header.indicesOffset       = alignSection(header.verticesOffset + uint64_t(header.numberOfVertices) * sizeof(Vertex));
+   header.subMeshesOffset     = alignSection(header.indicesOffset + uint64_t(header.numberOfIndices) * sizeof(uint32_t));
+   header.materialsOffset     = alignSection(header.subMeshesOffset + subMeshRecords.size() * sizeof(SubMeshRecord));
+   header.materialFilesOffset = alignSection(header.materialsOffset + materialRecords.size() * sizeof(MaterialRecord));
+   header.stringsOffset       = alignSection(header.materialFilesOffset + materialFileRecords.size() * sizeof(MaterialFileRecord));
+   header.stringsSize         = strings.size();
+
+   std::vector<char> buffer(static_cast<size_t>(header.stringsOffset + header.stringsSize), 0);
+
+   memcpy(buffer.data(), &header, sizeof(Header));
+   memcpy(buffer.data() + header.verticesOffset, meshData.getVertices(), header.numberOfVertices * sizeof(Vertex));
+   memcpy(buffer.data() + header.indicesOffset, meshData.getIndices(), header.numberOfIndices * sizeof(uint32_t));
+   memcpy(buffer.data() + header.subMeshesOffset, subMeshRecords.data(), subMeshRecords.size() * sizeof(SubMeshRecord));
+   memcpy(buffer.data() + header.materialsOffset, materialRecords.data(), materialRecords.size() * sizeof(MaterialRecord));
+   memcpy(buffer.data() + header.materialFilesOffset, materialFileRecords.data(), materialFileRecords.size() * sizeof(MaterialFileRecord));
+   memcpy(buffer.data() + header.stringsOffset, strings.data(), strings.size());
+
+   // the same mesh might be stored from two threads at once, CacheFile takes care of that
+   CacheFile::write(getCacheFileName(sourceFile), buffer);
+}
+
+std::string MeshCache::getCacheFileName(const std::string& sourceFile)
+{
+   return CacheFile::getFileName(sourceFile, ".mesh");
+}
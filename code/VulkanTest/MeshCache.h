@@ -0,0 +1,90 @@
+#pragma once
+
+// Binary cache for parsed meshes, so the obj only has to be parsed once.
+//
+// The cache file holds the deduplicated vertices, the indices, the sub meshes and the materials, laid out so they can
+// be used straight from a memory mapped file. One file per source file in CacheFile::CACHE_DIRECTORY, named by a hash
+// of the source path. The header stores the source path, modification time, size and a hash of the contents; the cache
+// is used if the time and size match, or if the contents hash still matches (e.g. after a fresh checkout). The
+// materials come from the mtllib files of the obj, so the same is stored and checked for each of them.
+//
+// Writing is best effort, if the cache can't be written the mesh is just parsed again next time.
+
+#include "Mesh.h"
+
+class MeshCache
+{
+public:
+   // thread safe. returns false if there is no cache for the file or it's out of date.
+   static bool load(const std::string& sourceFile, Mesh::MeshData& meshData);
+
+   // thread safe
+   static void store(const std::string& sourceFile, const Mesh::MeshData& meshData);
+
+private:
+
+   // bump when the layout of the file or of Vertex changes
+   static const uint32_t VERSION = 3;
+
+   struct Header
+   {
+      char magic[4];
+      uint32_t version;
+      uint32_t vertexSize;
+      uint32_t pathLength;
+
+      uint64_t sourceTime;
+      uint64_t sourceSize;
+      uint64_t sourceHash;
+
+      uint32_t numberOfVertices;
+      uint32_t numberOfIndices;
+      uint32_t numberOfSubMeshes;
+      uint32_t numberOfMaterials;
+      uint32_t numberOfMaterialFiles;
+      uint32_t padding;
+
+      // from the start of the file
+      uint64_t verticesOffset;
+      uint64_t indicesOffset;
+      uint64_t subMeshesOffset;
+      uint64_t materialsOffset;
+      uint64_t materialFilesOffset;
+      uint64_t stringsOffset;
+      uint64_t stringsSize;
+   };
+
+   struct SubMeshRecord
+   {
+      int32_t startIndex;
+      int32_t numberOfIndices;
+      int32_t materialId;
+   };
+
+   // the texture names are in the string block, the source path is always first in it
+   struct MaterialRecord
+   {
+      float diffuseColour[3];
+      float specularColour[3];
+      float ambientColour[3];
+
+      uint32_t textureOffset[3];
+      uint32_t textureLength[3];
+   };
+
+   // an mtllib of the obj, the path is in the string block. a file the obj names but that doesn't exist has exists = 0,
+   // the cache is out of date when it shows up
+   struct MaterialFileRecord
+   {
+      uint32_t pathOffset;
+      uint32_t pathLength;
+      uint32_t exists;
+      uint32_t padding;
+
+      uint64_t time;
+      uint64_t size;
+      uint64_t hash;
+   };
+
+   static std::string getCacheFileName(const std::string& sourceFile);
+};
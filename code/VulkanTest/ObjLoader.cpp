@@ -0,0 +1,276 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/stat.h>
+
+// windows.h comes in with both of these
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+
+#define TINYOBJ_LOADER_OPT_IMPLEMENTATION
+#include <tinyobj_loader_opt.h>
+
+// the optimized parser allocates through ltalloc, which would replace the global operator new unless told not to.
+// has to come after the standard headers, its macros break <atomic>.
+#define LTALLOC_DISABLE_OPERATOR_NEW_OVERRIDE
+#include <ltalloc.cc>
+
+const char* ObjLoader::MODEL_DIRECTORY = "./models/";
+
+namespace
+{
+   bool getFileSize(const std::string& fileName, uint64_t* size)
+   {
+#ifdef _WIN32
+      struct _stat64 fileInfo;
+      if(_stat64(fileName.c_str(), &fileInfo) != 0)
+#else
+      struct stat fileInfo;
+      if(stat(fileName.c_str(), &fileInfo) != 0)
+#endif
+      {
+         return false;
+      }
+
+      *size = static_cast<uint64_t>(fileInfo.st_size);
+
+      return true;
+   }
+
+   // the attribs of both parsers store the same things, just in different vectors
+   template<typename FloatVector>
+   Vertex makeVertex(const FloatVector& positions, const FloatVector& texCoords, int positionIndex, int texCoordIndex)
+   {
+      Vertex vertex ={};
+
+      vertex.position =
+      {
+         positions[3 * positionIndex + 0],
+         positions[3 * positionIndex + 1],
+         positions[3 * positionIndex + 2]
+      };
+
+      // faces without texture coordinates get -1 from tinyobj and a negative index from tinyobj_opt
+      if(texCoordIndex >= 0)
+      {
+         vertex.texCoord =
+         {
+            texCoords[2 * texCoordIndex + 0],
+            1.0f - texCoords[2 * texCoordIndex + 1]
+         };
+      }
+      else
+      {
+         vertex.texCoord ={ 0.0f, 1.0f };
+      }
+
+      vertex.colour ={ 1.0f, 1.0f, 1.0f };
+
+      return vertex;
+   }
+}
+
+ObjLoader::ObjData ObjLoader::load(const std::string& fileName, Mesh::ObjParser parser)
+{
+   if(parser == Mesh::ObjParser::Automatic)
+   {
+      parser = pickParser(fileName);
+   }
+
+   ObjData objData;
+
+   if(parser == Mesh::ObjParser::Optimized)
+   {
+      loadOptimized(fileName, objData);
+   }
+   else
+   {
+      loadReference(fileName, objData);
+   }
+
+   return objData;
+}
+
+Mesh::ObjParser ObjLoader::pickParser(const std::string& fileName)
+{
+   uint64_t size;
+   if(getFileSize(fileName, &size) && size >= OPTIMIZED_MIN_FILE_SIZE)
+   {
+      return Mesh::ObjParser::Optimized;
+   }
+
+   return Mesh::ObjParser::Reference;
+}
+
+std::vector<std::string> ObjLoader::getMaterialFiles(const std::string& fileName)
+{
+   std::vector<std::string> materialFiles;
+
+   MappedFile file;
+   if(!file.open(fileName))
+   {
+      return materialFiles;
+   }
+
+   const char* data = reinterpret_cast<const char*>(file.getData());
+   const char* end  = data + file.getSize();
+
+   auto isSpace = [](char c) { return c == ' ' || c == '\t'; };
+
+   for(const char* line = data; line < end;)
+   {
+      const char* lineEnd = std::find(line, end, '\n');
+
+      while(line < lineEnd && isSpace(*line))
+      {
+         line++;
+      }
+
+      // the reference parser reads every name on the line, the optimized one the whole rest of the line as one
+      // name. usually there's just one, so every name is taken
+      if(lineEnd - line > 6 && strncmp(line, "mtllib", 6) == 0 && isSpace(line[6]))
+      {
+         const char* name = line + 7;
+         while(name < lineEnd)
+         {
+            while(name < lineEnd && (isSpace(*name) || *name == '\r'))
+            {
+               name++;
+            }
+
+            const char* nameEnd = name;
+            while(nameEnd < lineEnd && !isSpace(*nameEnd) && *nameEnd != '\r')
+            {
+               nameEnd++;
+            }
+
+            if(nameEnd > name)
+            {
+               materialFiles.push_back(MODEL_DIRECTORY + std::string(name, nameEnd));
+            }
+
+            name = nameEnd;
+         }
+      }
+
+      line = lineEnd + 1;
+   }
+
+   return materialFiles;
+}
+
+void ObjLoader::loadReference(const std::string& fileName, ObjData& objData)
+{
+   tinyobj::attrib_t attrib;
+   std::vector<tinyobj::shape_t> shapes;
+   std::vector<tinyobj::material_t> materials;
+   std::string err;
+
+   if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), MODEL_DIRECTORY))
+   {
+      throw std::runtime_error(err);
+   }
+
+   parseMaterials(materials, objData);
+
+   size_t numberOfCorners = 0;
+   for(const auto& shape : shapes)
+   {
+      numberOfCorners += shape.mesh.indices.size();
+   }
+
+   objData.corners.reserve(numberOfCorners);
+   objData.triangleMaterials.reserve(numberOfCorners / 3);
+
+   for(const auto& shape : shapes)
+   {
+      for(const auto& index : shape.mesh.indices)
+      {
+         objData.corners.push_back(makeVertex(attrib.vertices, attrib.texcoords, index.vertex_index, index.texcoord_index));
+      }
+
+      // LoadObj triangulates, so there is one material per 3 indices
+      objData.triangleMaterials.insert(objData.triangleMaterials.end(), shape.mesh.material_ids.begin(), shape.mesh.material_ids.end());
+   }
+}
+
+void ObjLoader::loadOptimized(const std::string& fileName, ObjData& objData)
+{
+   MappedFile file;
+   if(!file.open(fileName))
+   {
+      throw std::runtime_error("failed to open " + fileName);
+   }
+
+   tinyobj_opt::attrib_t attrib;
+   std::vector<tinyobj_opt::shape_t> shapes;
+   std::vector<tinyobj_opt::material_t> materials;
+
+   // a line that spans more than two chunks gets lost, and small chunks aren't worth a thread anyway
+   uint64_t maxThreads = std::max<uint64_t>(file.getSize() / MIN_BYTES_PER_THREAD, 1);
+
+   tinyobj_opt::LoadOption option;
+   option.req_num_threads = static_cast<int>(std::min<uint64_t>(std::max(std::thread::hardware_concurrency(), 1u), maxThreads));
+   option.triangulate     = true;
+   option.mtl_basedir     = MODEL_DIRECTORY;
+
+   if(!tinyobj_opt::parseObj(&attrib, &shapes, &materials, reinterpret_cast<const char*>(file.getData()), static_cast<size_t>(file.getSize()), option))
+   {
+      throw std::runtime_error("failed to parse " + fileName);
+   }
+
+   parseMaterials(materials, objData);
+
+   // the shapes of tinyobj_opt count faces before triangulation, all faces are used anyway so go through them directly
+   objData.corners.reserve(attrib.indices.size());
+   objData.triangleMaterials.reserve(attrib.face_num_verts.size());
+
+   size_t firstIndex = 0;
+   for(size_t face = 0; face < attrib.face_num_verts.size(); face++)
+   {
+      size_t numberOfVertices = static_cast<size_t>(attrib.face_num_verts[face]);
+
+      if(numberOfVertices == 3)
+      {
+         for(size_t i = firstIndex; i < firstIndex + 3; i++)
+         {
+            const tinyobj_opt::index_t& index = attrib.indices[i];
+            objData.corners.push_back(makeVertex(attrib.vertices, attrib.texcoords, index.vertex_index, index.texcoord_index));
+         }
+
+         objData.triangleMaterials.push_back(attrib.material_ids[face]);
+      }
+
+      firstIndex += numberOfVertices;
+   }
+}
+
+template<typename MaterialType>
+void ObjLoader::parseMaterials(const std::vector<MaterialType>& materials, ObjData& objData)
+{
+   for(const auto& material : materials)
+   {
+      Mesh::MaterialData tMaterial ={};
+
+      if(material.diffuse_texname != "")
+      {
+         tMaterial.diffuseTexture = "./textures/" + material.diffuse_texname;
+      }
+      if(material.specular_texname != "")
+      {
+         tMaterial.specularTexture = "./textures/" + material.specular_texname;
+      }
+      if(material.bump_texname != "")
+      {
+         tMaterial.bumpTexture = "./textures/" + material.bump_texname;
+      }
+
+      tMaterial.ambientColour  = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
+      tMaterial.diffuseColour  = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+      tMaterial.specularColour = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
+
+      objData.materials.push_back(tMaterial);
+   }
+}
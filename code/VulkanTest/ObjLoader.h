@@ -0,0 +1,54 @@
+#pragma once
+
+// Reads obj files for Mesh::parseObj: one vertex per triangle corner, the material of every triangle and the materials.
+//
+// Two backends:
+// Reference - tinyobj::LoadObj, reads the file through a stream on the calling thread.
+// Optimized - maps the file and parses it on all hardware threads with the experimental tinyobj_opt parser.
+//             Starting the threads costs more than it saves on small files, so Automatic only uses it for big ones.
+//
+// Both give the same corners in the same order.
+
+#include "Mesh.h"
+
+class ObjLoader
+{
+public:
+   struct ObjData
+   {
+      std::vector<Vertex> corners;
+
+      // one per triangle, -1 = no material
+      std::vector<int32_t> triangleMaterials;
+
+      std::vector<Mesh::MaterialData> materials;
+   };
+
+   // thread safe
+   static ObjData load(const std::string& fileName, Mesh::ObjParser parser = Mesh::ObjParser::Automatic);
+
+   // what Automatic ends up using for the file
+   static Mesh::ObjParser pickParser(const std::string& fileName);
+
+   // thread safe. the files of the mtllib lines of the obj, with the path the parsers open them with. files that don't
+   // exist are included as well
+   static std::vector<std::string> getMaterialFiles(const std::string& fileName);
+
+private:
+
+   // files at least this big are parsed with the optimized parser
+   static const uint64_t OPTIMIZED_MIN_FILE_SIZE = 256 * 1024;
+
+   // the optimized parser splits the file in one chunk per thread
+   static const uint64_t MIN_BYTES_PER_THREAD = 64 * 1024;
+
+   // the mtllib in the obj files is relative to this
+   static const char* MODEL_DIRECTORY;
+
+   static void loadReference(const std::string& fileName, ObjData& objData);
+   static void loadOptimized(const std::string& fileName, ObjData& objData);
+
+   // tinyobj::material_t or tinyobj_opt::material_t, they have the same members
+   template<typename MaterialType>
+   static void parseMaterials(const std::vector<MaterialType>& materials, ObjData& objData);
+};
@@ -0,0 +1,170 @@
+#include "SamplerCache.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace vks
+{
+   namespace
+   {
+      uint32_t floatBits(float value)
+      {
+         uint32_t bits;
+         memcpy(&bits, &value, sizeof(bits));
+
+         return bits;
+      }
+   }
+
+   bool SamplerCache::Key::operator==(const Key& other) const
+   {
+      return memcmp(this, &other, sizeof(Key)) == 0;
+   }
+
+   size_t SamplerCache::KeyHash::operator()(const Key& key) const
+   {
+      // FNV-1a over the words
+      const uint32_t* words = reinterpret_cast<const uint32_t*>(&key);
+
+      uint64_t hash = 14695981039346656037ull;
+      for(size_t i = 0; i < sizeof(Key) / sizeof(uint32_t); i++)
+      {
+         hash ^= words[i];
+         hash *= 1099511628211ull;
+      }
+
+      return static_cast<size_t>(hash);
+   }
+
+   void SamplerCache::init(VkDevice device, uint32_t maxSamplers)
+   {
+      this->device      = device;
+      this->maxSamplers = maxSamplers;
+   }
+
+   void SamplerCache::destroy()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for(auto& sampler : samplers)
+      {
+         vkDestroySampler(device, sampler.second.sampler, nullptr);
+      }
+
+      samplers.clear();
+      keys.clear();
+   }
+
+   VkSampler SamplerCache::getSampler(const VkSamplerCreateInfo& createInfo)
+   {
+      if(createInfo.pNext != nullptr)
+      {
+         throw std::runtime_error("the sampler cache can't look up samplers with a pNext chain!");
+      }
+
+      Key key = getKey(createInfo);
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto it = samplers.find(key);
+      if(it != samplers.end())
+      {
+         it->second.refCount++;
+         hits++;
+
+         return it->second.sampler;
+      }
+
+      if(samplers.size() >= maxSamplers)
+      {
+         throw std::runtime_error("too many different samplers, maxSamplerAllocationCount is reached!");
+      }
+
+      Entry entry;
+      entry.refCount = 1;
+
+      if(vkCreateSampler(device, &createInfo, nullptr, &entry.sampler) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to create texture sampler!");
+      }
+
+      samplers[key] = entry;
+      keys[entry.sampler] = key;
+      misses++;
+
+      return entry.sampler;
+   }
+
+   void SamplerCache::release(VkSampler sampler)
+   {
+      if(sampler == VK_NULL_HANDLE)
+      {
+         return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto key = keys.find(sampler);
+      if(key == keys.end())
+      {
+         throw std::runtime_error("released a sampler that isn't from the sampler cache!");
+      }
+
+      auto it = samplers.find(key->second);
+      if(--it->second.refCount > 0)
+      {
+         return;
+      }
+
+      vkDestroySampler(device, sampler, nullptr);
+
+      samplers.erase(it);
+      keys.erase(key);
+   }
+
+   SamplerStats SamplerCache::getStats()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      SamplerStats stats;
+      stats.liveCount = static_cast<uint32_t>(samplers.size());
+      stats.hits      = hits;
+      stats.misses    = misses;
+
+      return stats;
+   }
+
+   void SamplerCache::printStats()
+   {
+      SamplerStats stats = getStats();
+
+      std::cout
+         << "samplers: " << stats.liveCount << " live"
+         << ", hits: " << stats.hits
+         << ", created: " << stats.misses << std::endl;
+   }
+
+   SamplerCache::Key SamplerCache::getKey(const VkSamplerCreateInfo& createInfo)
+   {
+      Key key;
+      key.flags                   = createInfo.flags;
+      key.magFilter               = createInfo.magFilter;
+      key.minFilter               = createInfo.minFilter;
+      key.mipmapMode              = createInfo.mipmapMode;
+      key.addressModeU            = createInfo.addressModeU;
+      key.addressModeV            = createInfo.addressModeV;
+      key.addressModeW            = createInfo.addressModeW;
+      key.mipLodBias              = floatBits(createInfo.mipLodBias);
+      key.anisotropyEnable        = createInfo.anisotropyEnable;
+      key.maxAnisotropy           = floatBits(createInfo.maxAnisotropy);
+      key.compareEnable           = createInfo.compareEnable;
+      key.compareOp               = createInfo.compareOp;
+      key.minLod                  = floatBits(createInfo.minLod);
+      key.maxLod                  = floatBits(createInfo.maxLod);
+      key.borderColor             = createInfo.borderColor;
+      key.unnormalizedCoordinates = createInfo.unnormalizedCoordinates;
+
+      return key;
+   }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// Hands out one VkSampler per sampler state instead of one per texture. Drivers only guarantee
+// maxSamplerAllocationCount (sometimes 4000) samplers, and textures with the same sampler can share descriptors.
+//
+// Samplers are looked up by everything in VkSamplerCreateInfo (no pNext chains) and reference counted, a sampler is
+// destroyed when the last user releases it.
+
+#include "vulkan/vulkan.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace vks
+{
+   struct SamplerStats
+   {
+      uint32_t liveCount = 0; // samplers that exist right now
+      uint64_t hits = 0;      // getSampler calls that got an existing sampler
+      uint64_t misses = 0;    // getSampler calls that created one
+   };
+
+   class SamplerCache
+   {
+   public:
+      void init(VkDevice device, uint32_t maxSamplers);
+
+      // destroys all samplers, any sampler still in use is invalid after this
+      void destroy();
+
+      // thread safe. adds a reference, every call needs a release
+      VkSampler getSampler(const VkSamplerCreateInfo& createInfo);
+
+      // thread safe. the GPU must be done with the sampler if it was the last reference
+      void release(VkSampler sampler);
+
+      SamplerStats getStats();
+
+      void printStats();
+
+   private:
+
+      // the state of VkSamplerCreateInfo, floats by their bits. every field is 4 bytes, so there is no padding
+      struct Key
+      {
+         uint32_t flags;
+         uint32_t magFilter;
+         uint32_t minFilter;
+         uint32_t mipmapMode;
+         uint32_t addressModeU;
+         uint32_t addressModeV;
+         uint32_t addressModeW;
+         uint32_t mipLodBias;
+         uint32_t anisotropyEnable;
+         uint32_t maxAnisotropy;
+         uint32_t compareEnable;
+         uint32_t compareOp;
+         uint32_t minLod;
+         uint32_t maxLod;
+         uint32_t borderColor;
+         uint32_t unnormalizedCoordinates;
+
+         bool operator==(const Key& other) const;
+      };
+
+      struct KeyHash
+      {
+         size_t operator()(const Key& key) const;
+      };
+
+      struct Entry
+      {
+         VkSampler sampler;
+         uint32_t refCount;
+      };
+
+      static Key getKey(const VkSamplerCreateInfo& createInfo);
+
+      VkDevice device = VK_NULL_HANDLE;
+      uint32_t maxSamplers = 0;
+
+      std::mutex mutex;
+
+      std::unordered_map<Key, Entry, KeyHash> samplers;
+
+      // to find the entry on release
+      std::unordered_map<VkSampler, Key> keys;
+
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+   };
+}
@@ -1,4 +1,18 @@
 #include "Texture.h"
+#include "CacheFile.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include "UploadManager.h"
+
+#include <algorithm>
+#include <mutex>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+// only used in here, so it's implemented in here as well
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
 
 Texture::Texture(vks::VulkanDevice *vulkanDevice)
 { 
@@ -7,119 +21,598 @@ Texture::Texture(vks::VulkanDevice *vulkanDevice)
 
 Texture::~Texture()
 {
+   // textures that never became resident still point at the placeholder, the others might use the resources of a
+   // texture with the same contents
    for(size_t i = 0; i < image.size(); i++)
    {
-      vkFreeMemory(vulkanDevice->device, memory.at(i), nullptr);
-      vkDestroyImage(vulkanDevice->device, image.at(i), nullptr);
+      if(!resident[i] || owner[i] != static_cast<int>(i))
+      {
+         continue;
+      }
+
       vkDestroyImageView(vulkanDevice->device, imageView.at(i), nullptr);
-      vkDestroySampler(vulkanDevice->device, sampler.at(i), nullptr);
+      vulkanDevice->destroyImage(image.at(i), memory.at(i));
+      vulkanDevice->samplerCache.release(sampler.at(i));
    }
 
 }
 
 int Texture::loadTexture(std::string filename)
 {
+   int index = acquireTexture(filename);
 
-   bool success = createImage(filename);
-
-   if(success)
+   if(!resident[index])
    {
-      createImageView();
-      createSampler();
+      ImageData imageData = decodeImage(normalizePath(filename), isCompressionSupported());
+      TextureResources resources = createTextureResources(imageData);
+      freeImageData(imageData);
+
+      installTexture(index, resources);
+   }
 
-      name.push_back(filename);
+   return index;
+}
 
-      return (int)name.size() - 1;
+int Texture::createPlaceholder()
+{
+   if(!image.empty())
+   {
+      throw std::runtime_error("the placeholder has to be the first texture!");
    }
-   
-   return -1;
+
+   stbi_uc white[4] ={ 255, 255, 255, 255 };
+
+   ImageData imageData;
+   imageData.name   = "placeholder";
+   imageData.pixels = white;
+   imageData.width  = 1;
+   imageData.height = 1;
+
+   TextureResources resources = createTextureResources(imageData);
+
+   // never released, it's not in textureIds so nothing can acquire it
+   int index = reserveTexture(imageData.name);
+   refCount[index] = 1;
+   installTexture(index, resources);
+
+   return index;
 }
 
-bool Texture::createImage(std::string filename)
+Texture::ImageData Texture::decodeImage(const std::string& filename, bool compressed, JobSystem* jobSystem)
 {
-   int texWidth;
-   int texHeight;
-   int texChannels;
+   ImageData imageData;
+
+   // only the images in it are a file, it's cached by its name and the contents of the images
+   if(TextureAtlas::isAtlas(filename))
+   {
+      uint64_t contentHash;
+      if(compressed && TextureAtlas::hashContents(filename, &contentHash) &&
+         TextureCache::loadGenerated(filename, contentHash, TextureAtlas::MIP_LEVELS, imageData))
+      {
+         return imageData;
+      }
+
+      imageData = TextureAtlas::build(filename);
+
+      if(compressed)
+      {
+         compressImage(imageData, jobSystem);
+
+         stbi_image_free(imageData.pixels);
+         imageData.pixels = nullptr;
+
+         TextureCache::storeGenerated(filename, imageData);
+      }
+
+      return imageData;
+   }
 
-   stbi_uc* pixels = stbi_load(
-      filename.c_str(),
-      &texWidth,
-      &texHeight,
+   if(compressed && TextureCache::load(filename, imageData))
+   {
+      return imageData;
+   }
+
+   imageData.name = filename;
+
+   // decoded from the mapped file, so the contents only have to be read once for the hash
+   MappedFile file;
+   if(!file.open(filename))
+   {
+      throw std::runtime_error("failed to load texture image " + filename + "!");
+   }
+
+   imageData.contentHash = CacheFile::hash(file.getData(), file.getSize());
+
+   int texChannels;
+   imageData.pixels = stbi_load_from_memory(
+      file.getData(),
+      static_cast<int>(file.getSize()),
+      &imageData.width,
+      &imageData.height,
       &texChannels,
       STBI_rgb_alpha);
 
-   VkDeviceSize imageSize = texWidth * texHeight * 4;
+   if(!imageData.pixels)
+   {
+      throw std::runtime_error("failed to load texture image " + filename + "!");
+   }
 
-   if(!pixels)
+   if(compressed)
    {
-      throw std::runtime_error("failed to load texture image!");
+      compressImage(imageData, jobSystem);
+
+      stbi_image_free(imageData.pixels);
+      imageData.pixels = nullptr;
+
+      TextureCache::store(filename, imageData);
    }
 
-   VkBuffer stagingBuffer;
-   VkDeviceMemory stagingBufferMemory;
+   return imageData;
+}
 
-   // TODO: Create a helper h-file which have this function.
-   vulkanDevice->createBuffer(
-      imageSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &stagingBuffer,
-      &stagingBufferMemory);
+void Texture::freeImageData(ImageData& imageData)
+{
+   stbi_image_free(imageData.pixels);
+   imageData.pixels = nullptr;
 
-   void *data;
-   vkMapMemory(vulkanDevice->device, stagingBufferMemory, 0, imageSize, 0, &data);
-   memcpy(data, pixels, static_cast<size_t>(imageSize));
-   vkUnmapMemory(vulkanDevice->device, stagingBufferMemory);
+   std::vector<uint8_t>().swap(imageData.blocks);
+   imageData.mappedFile.reset();
+   imageData.mappedBlocks = nullptr;
+}
 
-   stbi_image_free(pixels);
+void Texture::compressImage(ImageData& imageData, JobSystem* jobSystem)
+{
+   uint32_t width  = static_cast<uint32_t>(imageData.width);
+   uint32_t height = static_cast<uint32_t>(imageData.height);
+
+   // BC1 could only keep 1 bit of alpha, so anything that isn't opaque goes to BC3
+   bool alpha = false;
+   for(size_t i = 0; i < size_t(width) * height && !alpha; i++)
+   {
+      alpha = imageData.pixels[i * 4 + 3] != 255;
+   }
+
+   VkFormat format    = alpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+   uint32_t blockSize = alpha ? 16 : 8;
+   uint32_t mipLevels = getMipLevels(imageData);
+
+   std::vector<stbi_uc> mipmaps = generateMipmaps(imageData.pixels, width, height);
+
+   // a row of blocks in a level, what the jobs are split by
+   struct BlockRow
+   {
+      uint32_t width;
+      uint32_t height;
+      uint32_t y;
+      const stbi_uc* pixels;
+      uint8_t* blocks;
+   };
+
+   VkDeviceSize size = 0;
+   for(uint32_t level = 0; level < mipLevels; level++)
+   {
+      size += getLevelSize(format, width, height, level);
+   }
+
+   std::vector<uint8_t> blocks(static_cast<size_t>(size));
+
+   std::vector<BlockRow> rows;
+
+   const stbi_uc* levelPixels = mipmaps.data();
+   uint8_t* levelBlocks = blocks.data();
+
+   for(uint32_t level = 0; level < mipLevels; level++)
+   {
+      uint32_t levelWidth  = std::max(width >> level, 1u);
+      uint32_t levelHeight = std::max(height >> level, 1u);
+      uint32_t blocksPerRow = (levelWidth + 3) / 4;
+
+      for(uint32_t y = 0; y < levelHeight; y += 4)
+      {
+         BlockRow row;
+         row.width  = levelWidth;
+         row.height = levelHeight;
+         row.y      = y;
+         row.pixels = levelPixels;
+         row.blocks = levelBlocks + size_t(y / 4) * blocksPerRow * blockSize;
+
+         rows.push_back(row);
+      }
+
+      levelPixels += size_t(levelWidth) * levelHeight * 4;
+      levelBlocks += getLevelSize(format, width, height, level);
+   }
+
+   // stb_dxt builds its tables on the first block, that isn't thread safe
+   static std::once_flag dxtInitialized;
+   std::call_once(dxtInitialized, []()
+   {
+      uint8_t block[64] ={};
+      uint8_t compressed[16];
+      stb_compress_dxt_block(compressed, block, 1, STB_DXT_NORMAL);
+   });
+
+   auto compressRows = [&](uint32_t firstRow, uint32_t lastRow)
+   {
+      uint8_t block[64];
+
+      for(uint32_t i = firstRow; i < lastRow; i++)
+      {
+         const BlockRow& row = rows[i];
+         uint8_t* destination = row.blocks;
+
+         for(uint32_t x = 0; x < row.width; x += 4)
+         {
+            for(uint32_t texelY = 0; texelY < 4; texelY++)
+            {
+               uint32_t sourceY = std::min(row.y + texelY, row.height - 1);
+
+               for(uint32_t texelX = 0; texelX < 4; texelX++)
+               {
+                  uint32_t sourceX = std::min(x + texelX, row.width - 1);
+                  memcpy(block + (texelY * 4 + texelX) * 4, row.pixels + (size_t(sourceY) * row.width + sourceX) * 4, 4);
+               }
+            }
+
+            // it's only done once per image, so the slower refinement is worth it
+            stb_compress_dxt_block(destination, block, alpha ? 1 : 0, STB_DXT_HIGHQUAL);
+            destination += blockSize;
+         }
+      }
+   };
+
+   uint32_t numberOfRows = static_cast<uint32_t>(rows.size());
+
+   if(jobSystem)
+   {
+      jobSystem->parallelFor(0, numberOfRows, ROWS_PER_COMPRESS_JOB, compressRows);
+   }
+   else
+   {
+      compressRows(0, numberOfRows);
+   }
+
+   imageData.format    = format;
+   imageData.mipLevels = mipLevels;
+   imageData.blocks    = std::move(blocks);
+}
+
+VkDeviceSize Texture::getLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level)
+{
+   VkDeviceSize levelWidth  = std::max(width >> level, 1u);
+   VkDeviceSize levelHeight = std::max(height >> level, 1u);
+
+   switch(format)
+   {
+   case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+   case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+      return (levelWidth + 3) / 4 * ((levelHeight + 3) / 4) * 8;
+   case VK_FORMAT_BC3_UNORM_BLOCK:
+      return (levelWidth + 3) / 4 * ((levelHeight + 3) / 4) * 16;
+   default:
+      return levelWidth * levelHeight * 4;
+   }
+}
+
+Texture::TextureResources Texture::createTextureResources(const ImageData& imageData)
+{
+   uint32_t width  = static_cast<uint32_t>(imageData.width);
+   uint32_t height = static_cast<uint32_t>(imageData.height);
+
+   if(imageData.isCompressed() && !isCompressionSupported())
+   {
+      throw std::runtime_error("the device can't sample compressed texture " + imageData.name + "!");
+   }
+
+   TextureResources resources;
+   resources.size      = glm::ivec2(imageData.width, imageData.height);
+   resources.mipLevels = imageData.isCompressed() ? imageData.mipLevels : getMipLevels(imageData);
+   resources.contentHash = imageData.contentHash;
+
+   // compressed images come with all their levels
+   bool blitMipmaps = !imageData.isCompressed() && resources.mipLevels > 1 && canBlitMipmaps(imageData.format);
+
+   VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+   if(blitMipmaps)
+   {
+      usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+   }
 
-   VkImage tempTexture;
-   VkDeviceMemory tempMemory;
    createVkImage(
-      texWidth, texHeight,
-      VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      &tempTexture, &tempMemory);
-
-   transitionImageLayout(
-      tempTexture,
-      VK_FORMAT_R8G8B8A8_UNORM,
-      VK_IMAGE_LAYOUT_PREINITIALIZED,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-   copyBufferToImage(
-      stagingBuffer,
-      tempTexture,
-      static_cast<uint32_t>(texWidth),
-      static_cast<uint32_t>(texHeight));
-
-   transitionImageLayout(
-      tempTexture,
-      VK_FORMAT_R8G8B8A8_UNORM,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-   image.push_back(tempTexture);
-   memory.push_back(tempMemory);
-
-   vkDestroyBuffer(vulkanDevice->device, stagingBuffer, nullptr);
-   vkFreeMemory(vulkanDevice->device, stagingBufferMemory, nullptr);
+      width, height, resources.mipLevels,
+      imageData.format, VK_IMAGE_TILING_OPTIMAL,
+      usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      &resources.image, &resources.memory);
+
+   // the pixels are copied to the staging ring right away, so they can be freed directly after.
+   if(blitMipmaps)
+   {
+      resources.uploadTicket = vulkanDevice->uploadManager->uploadImageAndBlitMipmaps(
+         resources.image,
+         width,
+         height,
+         resources.mipLevels,
+         imageData.pixels,
+         getLevelSize(imageData.format, width, height, 0));
+   }
+   else
+   {
+      std::vector<stbi_uc> mipmaps;
+      if(!imageData.isCompressed())
+      {
+         mipmaps = generateMipmaps(imageData.pixels, width, height);
+      }
+
+      std::vector<VkDeviceSize> levelSizes(resources.mipLevels);
+      for(uint32_t level = 0; level < resources.mipLevels; level++)
+      {
+         levelSizes[level] = getLevelSize(imageData.format, width, height, level);
+      }
+
+      resources.uploadTicket = vulkanDevice->uploadManager->uploadImage(
+         resources.image,
+         width,
+         height,
+         resources.mipLevels,
+         levelSizes.data(),
+         imageData.isCompressed() ? imageData.getBlocks() : mipmaps.data());
+   }
+
+   resources.imageView = createImageView(resources.image, imageData.format, resources.mipLevels);
+   resources.sampler   = acquireSampler();
+
+   return resources;
+}
+
+uint32_t Texture::getMipLevels(uint32_t width, uint32_t height)
+{
+   uint32_t mipLevels = 1;
+
+   for(uint32_t size = std::max(width, height); size > 1; size /= 2)
+   {
+      mipLevels++;
+   }
+
+   return mipLevels;
+}
+
+uint32_t Texture::getMipLevels(const ImageData& imageData)
+{
+   uint32_t mipLevels = getMipLevels(static_cast<uint32_t>(imageData.width), static_cast<uint32_t>(imageData.height));
+
+   return imageData.maxMipLevels > 0 ? std::min(mipLevels, imageData.maxMipLevels) : mipLevels;
+}
+
+std::vector<stbi_uc> Texture::generateMipmaps(const stbi_uc* pixels, uint32_t width, uint32_t height)
+{
+   uint32_t mipLevels = getMipLevels(width, height);
+
+   size_t size = 0;
+   for(uint32_t level = 0; level < mipLevels; level++)
+   {
+      size += size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+   }
+
+   std::vector<stbi_uc> mipmaps(size);
+   memcpy(mipmaps.data(), pixels, size_t(width) * height * 4);
+
+   size_t offset = 0;
+
+   for(uint32_t level = 1; level < mipLevels; level++)
+   {
+      uint32_t levelWidth  = std::max(width >> level, 1u);
+      uint32_t levelHeight = std::max(height >> level, 1u);
+      uint32_t aboveWidth  = std::max(width >> (level - 1), 1u);
+      uint32_t aboveHeight = std::max(height >> (level - 1), 1u);
+
+      size_t nextOffset = offset + size_t(aboveWidth) * aboveHeight * 4;
+
+      // made from the level above, not the image, that's a lot less to read and the same with a box filter
+      stbir_resize_uint8_generic(
+         mipmaps.data() + offset, aboveWidth, aboveHeight, 0,
+         mipmaps.data() + nextOffset, levelWidth, levelHeight, 0,
+         4, STBIR_ALPHA_CHANNEL_NONE, 0,
+         STBIR_EDGE_WRAP, STBIR_FILTER_BOX, STBIR_COLORSPACE_LINEAR,
+         nullptr);
+
+      offset = nextOffset;
+   }
+
+   return mipmaps;
+}
+
+void Texture::destroyTextureResources(TextureResources& resources)
+{
+   vkDestroyImageView(vulkanDevice->device, resources.imageView, nullptr);
+   vulkanDevice->destroyImage(resources.image, resources.memory);
+   vulkanDevice->samplerCache.release(resources.sampler);
+
+   resources = TextureResources();
+}
+
+std::string Texture::normalizePath(const std::string& path)
+{
+   std::vector<std::string> parts;
+   std::string part;
+
+   for(size_t i = 0; i <= path.size(); i++)
+   {
+      if(i < path.size() && path[i] != '/' && path[i] != '\\')
+      {
+         part += path[i];
+         continue;
+      }
+
+      if(part == ".." && !parts.empty() && parts.back() != "..")
+      {
+         parts.pop_back();
+      }
+      else if(!part.empty() && part != ".")
+      {
+         parts.push_back(part);
+      }
+
+      part.clear();
+   }
+
+   std::string result = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+   for(size_t i = 0; i < parts.size(); i++)
+   {
+      result += (i > 0 ? "/" : "") + parts[i];
+   }
+
+   return result;
+}
+
+int Texture::acquireTexture(const std::string& filename)
+{
+   std::string path = normalizePath(filename);
+
+   auto it = textureIds.find(path);
+   if(it != textureIds.end())
+   {
+      refCount[it->second]++;
+      return it->second;
+   }
+
+   int index = reserveTexture(path);
+   refCount[index] = 1;
+   textureIds[path] = index;
+
+   return index;
+}
+
+bool Texture::releaseTexture(int index)
+{
+   if(index < 0 || index == PLACEHOLDER_ID || refCount[index] == 0)
+   {
+      throw std::runtime_error("released a texture that isn't acquired!");
+   }
+
+   if(--refCount[index] > 0)
+   {
+      return false;
+   }
+
+   if(resident[index] && owner[index] == index)
+   {
+      vkDestroyImageView(vulkanDevice->device, imageView[index], nullptr);
+      vulkanDevice->destroyImage(image[index], memory[index]);
+      vulkanDevice->samplerCache.release(sampler[index]);
+
+      contentIds.erase(contentHash[index]);
+      numberOfImages--;
+   }
+   else if(resident[index])
+   {
+      // the texture with the same contents loses the reference this one had on it
+      releaseTexture(owner[index]);
+   }
+
+   textureIds.erase(name[index]);
+
+   image[index]     = image[PLACEHOLDER_ID];
+   memory[index]    = vks::Allocation();
+   imageView[index] = imageView[PLACEHOLDER_ID];
+   sampler[index]   = sampler[PLACEHOLDER_ID];
+   imageSize[index] = glm::ivec2(0);
+   resident[index]  = false;
+   name[index].clear();
+   contentHash[index] = 0;
+   owner[index]       = index;
+
+   freeIds.push_back(index);
 
    return true;
 }
 
-void Texture::createImageView()
+int Texture::findTexture(const std::string& filename)
+{
+   auto it = textureIds.find(normalizePath(filename));
+
+   return it != textureIds.end() ? it->second : -1;
+}
+
+int Texture::reserveTexture(const std::string& filename)
+{
+   // until the texture is installed it's drawn with the placeholder, if there is one
+   bool hasPlaceholder = !image.empty();
+
+   if(!freeIds.empty())
+   {
+      int index = freeIds.back();
+      freeIds.pop_back();
+
+      name[index] = filename;
+
+      return index;
+   }
+
+   image.push_back(hasPlaceholder ? image[PLACEHOLDER_ID] : VK_NULL_HANDLE);
+   memory.push_back(vks::Allocation());
+   imageView.push_back(hasPlaceholder ? imageView[PLACEHOLDER_ID] : VK_NULL_HANDLE);
+   sampler.push_back(hasPlaceholder ? sampler[PLACEHOLDER_ID] : VK_NULL_HANDLE);
+   imageSize.push_back(glm::ivec2(0));
+   resident.push_back(false);
+   name.push_back(filename);
+   refCount.push_back(0);
+   contentHash.push_back(0);
+   owner.push_back((int)name.size() - 1);
+
+   return (int)name.size() - 1;
+}
+
+void Texture::installTexture(int index, const TextureResources& resources)
+{
+   // the same image under another name, that one is used and keeps a reference for as long as this one lives
+   auto it = resources.contentHash != 0 ? contentIds.find(resources.contentHash) : contentIds.end();
+   if(it != contentIds.end() && it->second != index)
+   {
+      int original = it->second;
+
+      TextureResources duplicate = resources;
+      destroyTextureResources(duplicate);
+
+      image[index]     = image[original];
+      imageView[index] = imageView[original];
+      sampler[index]   = sampler[original];
+      imageSize[index] = imageSize[original];
+      owner[index]     = original;
+      resident[index]  = true;
+
+      refCount[original]++;
+
+      return;
+   }
+
+   image[index]     = resources.image;
+   memory[index]    = resources.memory;
+   imageView[index] = resources.imageView;
+   sampler[index]   = resources.sampler;
+   imageSize[index] = resources.size;
+   resident[index]  = true;
+
+   contentHash[index] = resources.contentHash;
+   if(resources.contentHash != 0)
+   {
+      contentIds[resources.contentHash] = index;
+   }
+
+   numberOfImages++;
+}
+
+VkImageView Texture::createImageView(VkImage image, VkFormat format, uint32_t mipLevels)
 {
    VkImageView tempImageView;
 
    VkImageViewCreateInfo viewInfo ={};
    viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-   viewInfo.image                           = image.back();
+   viewInfo.image                           = image;
    viewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-   viewInfo.format                          = VK_FORMAT_R8G8B8A8_UNORM;
+   viewInfo.format                          = format;
    viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
    viewInfo.subresourceRange.baseMipLevel   = 0;
-   viewInfo.subresourceRange.levelCount     = 1;
+   viewInfo.subresourceRange.levelCount     = mipLevels;
    viewInfo.subresourceRange.baseArrayLayer = 0;
    viewInfo.subresourceRange.layerCount     = 1;
 
@@ -128,11 +621,11 @@ void Texture::createImageView()
       throw std::runtime_error("failed to create texture image view!");
    }
 
-   imageView.push_back(tempImageView);
+   return tempImageView;
 }
 
 
-void Texture::createSampler()
+VkSampler Texture::acquireSampler()
 {
    VkSamplerCreateInfo samplerInfo ={};
    samplerInfo.sType     = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -154,23 +647,19 @@ void Texture::createSampler()
    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
    samplerInfo.mipLodBias = 0.0f;
    samplerInfo.minLod     = 0.0f;
-   samplerInfo.maxLod     = 0.0f;
 
-   VkSampler tempSampler;
-   if(vkCreateSampler(vulkanDevice->device, &samplerInfo, nullptr, &tempSampler) != VK_SUCCESS)
-   {
-      throw std::runtime_error("Failed to create texture sampler!");
-   }
+   // the image view already limits the levels, so textures of every size can share the sampler
+   samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-   sampler.push_back(tempSampler);
+   return vulkanDevice->samplerCache.getSampler(samplerInfo);
 }
 
 // TODO: Maybe this should be a helper function.
 void Texture::createVkImage(
-   uint32_t width, uint32_t height,
+   uint32_t width, uint32_t height, uint32_t mipLevels,
    VkFormat format, VkImageTiling tiling,
    VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-   VkImage *image, VkDeviceMemory* imageMemory)
+   VkImage *image, vks::Allocation* imageMemory)
 {
    VkImageCreateInfo imageInfo ={};
    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -178,7 +667,7 @@ void Texture::createVkImage(
    imageInfo.extent.width  = width;
    imageInfo.extent.height = height;
    imageInfo.extent.depth  = 1;
-   imageInfo.mipLevels     = 1;
+   imageInfo.mipLevels     = mipLevels;
    imageInfo.arrayLayers   = 1;
    imageInfo.format        = format;
    imageInfo.tiling        = tiling;
@@ -192,18 +681,15 @@ void Texture::createVkImage(
       throw std::runtime_error("failed to create image!");
    }
 
-   VkMemoryRequirements memRequirements;
-   vkGetImageMemoryRequirements(vulkanDevice->device, *image, &memRequirements);
+   *imageMemory = vulkanDevice->memoryAllocator.allocateImage(*image, properties);
+}
 
-   VkMemoryAllocateInfo allocInfo ={};
-   allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-   allocInfo.allocationSize  = memRequirements.size;
-   allocInfo.memoryTypeIndex = vulkanDevice->findMemoryType(memRequirements.memoryTypeBits, properties);
+bool Texture::canBlitMipmaps(VkFormat format)
+{
+   VkFormatProperties formatProperties;
+   vkGetPhysicalDeviceFormatProperties(vulkanDevice->physicalDevice, format, &formatProperties);
 
-   if(vkAllocateMemory(vulkanDevice->device, &allocInfo, nullptr, imageMemory) != VK_SUCCESS)
-   {
-      throw std::runtime_error("failed to allocate image memory!");
-   }
+   VkFormatFeatureFlags features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-   vkBindImageMemory(vulkanDevice->device, *image, *imageMemory, 0);
-}
\ No newline at end of file
+   return (formatProperties.optimalTilingFeatures & features) == features;
+}
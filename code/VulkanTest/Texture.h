@@ -1,44 +1,178 @@
 #pragma once
 
 // This class takes care of the entire texture creation process and holds the relevant texture data.
-// the texture can be identified by name or an id. 
-// the texture might or might not have a sampler. To start with, the sampler will just be null when a texture not have a sampler
+// the texture can be identified by name or an id.
+// the samplers come from the SamplerCache of the device, textures with the same sampler state share one.
 
-// TODO: Make it possible to get image by name, or to search on image name or something like that.
+// Textures can be loaded in one go with loadTexture, or in steps so the slow parts can run on other threads:
+// decodeImage (any thread) -> createTextureResources (any thread, uploads) -> installTexture (main thread, when the upload is done).
+// A reserved texture uses the placeholder image view and sampler until it's installed, so it can be drawn right away.
+
+// Every texture has a full mip chain. The levels are blitted on the GPU when the format can be blitted with linear
+// filtering, otherwise they are made on the CPU with stb_image_resize and uploaded with the image.
+
+// When the device can sample BC formats the images are block compressed on the CPU, every level is made and then
+// compressed with stb_dxt: BC1 for opaque images, BC3 if any texel isn't. That's an 8th or a 4th of the memory of
+// RGBA8. The compressed levels are written to the TextureCache, after that the image isn't decoded again, the levels
+// are uploaded straight from the mapped cache file.
+
+// Names made by TextureAtlas are not files, decodeImage builds the atlas from the images in it instead.
+
+// Textures are shared. acquireTexture looks the file up by its normalised path and adds a reference, the texture is
+// only reserved (and has to be loaded) the first time. When it's installed, a resident texture made from a file with
+// the same contents is used instead if there is one, so the same image under two names is only kept once. The texture
+// is evicted when the last reference is released, its id can be handed out again after that.
 
 #include "stdafx.h"
+#include <map>
 #include <math.h>
+#include <memory>
 #include <stb_image.h>
 
+#include "JobSystem.h"
+#include "MappedFile.h"
 #include "VulkanDevice.hpp"
 
 class Texture
 {
 public:
-   
+
+   // decoded pixels, always 4 channels. compressed images have all their levels in blocks instead
+   struct ImageData
+   {
+      std::string name;
+      stbi_uc* pixels = nullptr;
+      int width = 0;
+      int height = 0;
+
+      VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+      uint32_t mipLevels = 1;
+      std::vector<uint8_t> blocks;
+
+      // 0 = down to 1x1. a TextureAtlas stops before the images in it would run into each other
+      uint32_t maxMipLevels = 0;
+
+      // set when the image came from the texture cache, the blocks point straight into the mapped file
+      std::shared_ptr<MappedFile> mappedFile;
+      const uint8_t* mappedBlocks = nullptr;
+
+      // of the source file, 0 if unknown
+      uint64_t contentHash = 0;
+
+      bool isCompressed() const
+      {
+         return format != VK_FORMAT_R8G8B8A8_UNORM;
+      }
+
+      const uint8_t* getBlocks() const
+      {
+         return mappedFile ? mappedBlocks : blocks.data();
+      }
+   };
+
+   struct TextureResources
+   {
+      VkImage image = VK_NULL_HANDLE;
+      vks::Allocation memory;
+      VkImageView imageView = VK_NULL_HANDLE;
+      VkSampler sampler = VK_NULL_HANDLE;
+      glm::ivec2 size;
+      uint32_t mipLevels = 1;
+      uint64_t contentHash = 0;
+
+      uint64_t uploadTicket = 0;
+   };
+
+   // the placeholder is always the first texture
+   static const int PLACEHOLDER_ID = 0;
+
    Texture(vks::VulkanDevice *vulkanDevice);
    ~Texture();
 
-   int loadTexture(std::string filename); // returns the id of the texture
+   // acquires the texture and loads it if it isn't resident yet, returns the id. release it when done
+   int loadTexture(std::string filename);
 
-   size_t getNumImages()
+   // 1x1 white texture used for materials without a texture and textures that are still loading
+   int createPlaceholder();
+
+   // thread safe. compressed loads the image from the texture cache, or decodes and compresses it and stores it there.
+   // the levels are compressed in parallel on the job system if there is one
+   static ImageData decodeImage(const std::string& filename, bool compressed = false, JobSystem* jobSystem = nullptr);
+   static void freeImageData(ImageData& imageData);
+
+   // can the device sample the compressed formats, the images should be decoded compressed then
+   bool isCompressionSupported()
    {
-      return image.size();
+      return vulkanDevice->deviceFeatures.textureCompressionBC != VK_FALSE;
+   }
+
+   // Makes the mip chain of the decoded image and compresses every level into blocks, the pixels are left alone.
+   // Blocks that stick out of a level repeat its last row and column.
+   static void compressImage(ImageData& imageData, JobSystem* jobSystem = nullptr);
+
+   // in bytes, for RGBA8 and the block compressed formats
+   static VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level);
+
+   // down to 1x1
+   static uint32_t getMipLevels(uint32_t width, uint32_t height);
+
+   // the levels the image gets, down to 1x1 or maxMipLevels
+   static uint32_t getMipLevels(const ImageData& imageData);
+
+   // all levels of the 4 channel image one after the other, starting with a copy of the image. every level is half
+   // the size of the one before (rounded down) and made from it with a box filter, so on even sizes every texel is the
+   // average of the 2x2 texels above it. wraps around at the edges, like the sampler
+   static std::vector<stbi_uc> generateMipmaps(const stbi_uc* pixels, uint32_t width, uint32_t height);
+
+   TextureResources createTextureResources(const ImageData& imageData);
+   void destroyTextureResources(TextureResources& resources);
+
+   // thread safe. forward slashes, no "." or "dir/.." parts. textures are shared by this
+   static std::string normalizePath(const std::string& path);
+
+   // main thread only. adds a reference to the texture of the file, reserves it if it isn't known
+   int acquireTexture(const std::string& filename);
+
+   // main thread only. evicts the texture when it was the last reference, returns true then. the GPU must be done with
+   // it, the resources are destroyed right away
+   bool releaseTexture(int index);
+
+   // main thread only. -1 if nobody has acquired the file
+   int findTexture(const std::string& filename);
+
+   // main thread only. destroys the resources instead if a resident texture has the same contents, uses that one then
+   void installTexture(int index, const TextureResources& resources);
+
+   bool isResident(int index)
+   {
+      return index >= 0 && resident[index];
+   }
+
+   // acquired textures, including the placeholder
+   size_t getNumberOfTextures()
+   {
+      return textureIds.size() + 1;
+   }
+
+   // images that are actually allocated, textures with the same contents share one
+   size_t getNumberOfImages()
+   {
+      return numberOfImages;
    }
 
    VkImage getImage(int index)
    {
-      return image[index];
+      return image[index < 0 ? PLACEHOLDER_ID : index];
    }
 
    VkImageView getImageView(int index)
    {
-      return imageView[index];
+      return imageView[index < 0 ? PLACEHOLDER_ID : index];
    }
 
    VkSampler getSampler(int index)
    {
-      return sampler[index];
+      return sampler[index < 0 ? PLACEHOLDER_ID : index];
    }
 
    std::string getImageName(int index)
@@ -49,129 +183,41 @@ public:
 private:
 
    std::vector<VkImage> image;
-   std::vector<VkDeviceMemory> memory;
+   std::vector<vks::Allocation> memory;
    std::vector<VkSampler> sampler;
    std::vector<VkImageView> imageView;
    std::vector<glm::ivec2> imageSize;
+   std::vector<bool> resident;
 
    vks::VulkanDevice *vulkanDevice;
 
-   std::vector<std::string> name; 
+   std::vector<std::string> name;
+   std::vector<uint32_t> refCount;
+   std::vector<uint64_t> contentHash;
 
-   bool createImage(std::string filename);
-   void createVkImage(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage*, VkDeviceMemory*);
-   void createSampler();
-   void createImageView();
+   // the texture whose resources are used, the own index unless another texture had the same contents
+   std::vector<int> owner;
 
-   // TODO: helper function ?
-   void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
-   {
-      VkCommandBuffer commandBuffer = vulkanDevice->beginSingleTimeCommand();
-
-      VkImageMemoryBarrier barrier ={};
-      barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-      barrier.oldLayout                       = oldLayout;
-      barrier.newLayout                       = newLayout;
-      barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-      barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-      barrier.image                           = image;
-      barrier.subresourceRange.baseMipLevel   = 0;
-      barrier.subresourceRange.levelCount     = 1;
-      barrier.subresourceRange.baseArrayLayer = 0;
-      barrier.subresourceRange.layerCount     = 1;
-
-      if(newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-      {
-         barrier.subresourceRange.aspectMask=VK_IMAGE_ASPECT_DEPTH_BIT;
-         if(hasStencilComponent(format))
-         {
-            barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-         }
-      }
-      else
-      {
-         barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      }
+   // normalised path -> id, content hash -> id of the texture owning the resources
+   std::map<std::string, int> textureIds;
+   std::map<uint64_t, int> contentIds;
 
-      switch(oldLayout | newLayout)
-      {
-         case VK_IMAGE_LAYOUT_PREINITIALIZED | VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-         {
-            barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            break;
-         }
-         case VK_IMAGE_LAYOUT_PREINITIALIZED | VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-         {
-            barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            break;
-         }
-         case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL | VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-         {
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            break;
-         }
-         case VK_IMAGE_LAYOUT_UNDEFINED | VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-         {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            break;
-         }
-         default:
-         {
-            throw std::invalid_argument("unsupported layout transition!");
-         }
-      }
+   // ids of evicted textures, reused by reserveTexture
+   std::vector<int> freeIds;
 
-      vkCmdPipelineBarrier(
-         commandBuffer,
-         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-         0,
-         0, nullptr,
-         0, nullptr,
-         1, &barrier);
+   size_t numberOfImages = 0;
 
-      vulkanDevice->endSingleTimeCommand(commandBuffer);
-   }
+   // rows of 4x4 blocks compressed per job
+   static const uint32_t ROWS_PER_COMPRESS_JOB = 8;
 
-   // TODO: helper function ?
-   bool hasStencilComponent(VkFormat format)
-   {
-      return format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
-         format == VK_FORMAT_D24_UNORM_S8_UINT;
-   }
+   int reserveTexture(const std::string& filename);
 
+   void createVkImage(uint32_t, uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage*, vks::Allocation*);
+   // from the sampler cache, release it there
+   VkSampler acquireSampler();
+   VkImageView createImageView(VkImage image, VkFormat format, uint32_t mipLevels);
 
-   // TODO: helper function ?
-   void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-   {
-      VkCommandBuffer commandBuffer = vulkanDevice->beginSingleTimeCommand();
-
-      VkBufferImageCopy region ={};
-      region.bufferOffset      = 0;
-      region.bufferRowLength   = 0;
-      region.bufferImageHeight = 0;
-
-      region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-      region.imageSubresource.mipLevel       = 0;
-      region.imageSubresource.baseArrayLayer = 0;
-      region.imageSubresource.layerCount     = 1;
-
-      region.imageOffset ={ 0, 0, 0 };
-      region.imageExtent ={ width, height, 1 };
-
-      vkCmdCopyBufferToImage(
-         commandBuffer,
-         buffer,
-         image,
-         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-         1,
-         &region
-      );
-
-      vulkanDevice->endSingleTimeCommand(commandBuffer);
-   }
+   // can the mip levels be blitted on the GPU
+   bool canBlitMipmaps(VkFormat format);
 };
 
@@ -0,0 +1,384 @@
+#include "TextureAtlas.h"
+#include "CacheFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+// only used in here, so it's implemented in here as well
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <stb_rect_pack.h>
+
+const char* TextureAtlas::PREFIX = "atlas:";
+
+namespace
+{
+   int alignUp(int value, int alignment)
+   {
+      return (value + alignment - 1) / alignment * alignment;
+   }
+
+   bool isInsideUnitSquare(const glm::vec2& texCoord)
+   {
+      return texCoord.x >= 0.f && texCoord.x <= 1.f && texCoord.y >= 0.f && texCoord.y <= 1.f;
+   }
+}
+
+bool TextureAtlas::pack(Mesh::MeshData& meshData)
+{
+   const Vertex* vertices  = meshData.getVertices();
+   const uint32_t* indices = meshData.getIndices();
+
+   // a material that repeats its texture can't use a part of the atlas
+   std::vector<bool> repeats(meshData.materials.size(), false);
+   for(const auto& subMesh : meshData.subMeshes)
+   {
+      for(int32_t i = subMesh.startIndex; i < subMesh.startIndex + subMesh.numberOfIndices && !repeats[subMesh.materialId]; i++)
+      {
+         repeats[subMesh.materialId] = !isInsideUnitSquare(vertices[indices[i]].texCoord);
+      }
+   }
+
+   std::vector<stbrp_rect> rects;
+   std::vector<std::string> fileNames;
+   std::vector<glm::ivec2> sizes;
+
+   // file name -> rect, -1 if the texture is too large or can't be read
+   std::map<std::string, int> rectIds;
+   std::vector<int> materialRects(meshData.materials.size(), -1);
+
+   int area = 0;
+   int largestSide = 0;
+
+   for(size_t materialId = 0; materialId < meshData.materials.size(); materialId++)
+   {
+      const std::string& diffuseTexture = meshData.materials[materialId].diffuseTexture;
+      if(diffuseTexture.empty() || repeats[materialId])
+      {
+         continue;
+      }
+
+      std::string fileName = Texture::normalizePath(diffuseTexture);
+
+      auto it = rectIds.find(fileName);
+      if(it == rectIds.end())
+      {
+         // only reads the header
+         int width, height, channels;
+         if(!stbi_info(fileName.c_str(), &width, &height, &channels) || width > MAX_TEXTURE_SIZE || height > MAX_TEXTURE_SIZE)
+         {
+            rectIds[fileName] = -1;
+            continue;
+         }
+
+         stbrp_rect rect ={};
+         rect.id = static_cast<int>(rects.size());
+         rect.w  = static_cast<stbrp_coord>(alignUp(width + 2 * BORDER, ALIGNMENT));
+         rect.h  = static_cast<stbrp_coord>(alignUp(height + 2 * BORDER, ALIGNMENT));
+
+         area += rect.w * rect.h;
+         largestSide = std::max(largestSide, static_cast<int>(std::max(rect.w, rect.h)));
+
+         rects.push_back(rect);
+         fileNames.push_back(fileName);
+         sizes.push_back(glm::ivec2(width, height));
+
+         it = rectIds.emplace(fileName, rect.id).first;
+      }
+
+      materialRects[materialId] = it->second;
+   }
+
+   if(rects.size() < 2)
+   {
+      return false;
+   }
+
+   // the smallest square that could fit all of them, made larger until they do or it's as large as it gets. the
+   // ones that don't fit then keep their own texture
+   int size = ALIGNMENT;
+   while(size < MAX_ATLAS_SIZE && (size * size < area || size < largestSide))
+   {
+      size *= 2;
+   }
+
+   for(;;)
+   {
+      std::vector<stbrp_node> nodes(size);
+
+      stbrp_context context;
+      stbrp_init_target(&context, size, size, nodes.data(), static_cast<int>(nodes.size()));
+
+      if(stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size())) || size >= MAX_ATLAS_SIZE)
+      {
+         break;
+      }
+
+      size *= 2;
+   }
+
+   std::vector<Placement> placements;
+   std::vector<glm::ivec2> placementSizes;
+   std::vector<int> placementIds(rects.size(), -1);
+
+   for(const auto& rect : rects)
+   {
+      if(rect.was_packed)
+      {
+         placementIds[rect.id] = static_cast<int>(placements.size());
+
+         Placement placement;
+         placement.fileName = fileNames[rect.id];
+         placement.x        = rect.x + BORDER;
+         placement.y        = rect.y + BORDER;
+
+         placements.push_back(placement);
+         placementSizes.push_back(sizes[rect.id]);
+      }
+   }
+
+   if(placements.size() < 2)
+   {
+      return false;
+   }
+
+   std::string atlasName = getName(size, size, placements);
+
+   for(size_t materialId = 0; materialId < meshData.materials.size(); materialId++)
+   {
+      if(materialRects[materialId] >= 0 && placementIds[materialRects[materialId]] >= 0)
+      {
+         meshData.materials[materialId].diffuseTexture = atlasName;
+      }
+   }
+
+   // the vertices from the mesh cache are mapped read only, they are changed in a copy
+   if(meshData.mappedFile)
+   {
+      meshData.vertexData.vertices.assign(meshData.mappedVertices, meshData.mappedVertices + meshData.numberOfMappedVertices);
+      meshData.vertexData.indices.assign(meshData.mappedIndices, meshData.mappedIndices + meshData.numberOfMappedIndices);
+
+      meshData.mappedFile.reset();
+      meshData.mappedVertices = nullptr;
+      meshData.mappedIndices  = nullptr;
+      meshData.numberOfMappedVertices = 0;
+      meshData.numberOfMappedIndices  = 0;
+   }
+
+   std::vector<Vertex>& atlasVertices = meshData.vertexData.vertices;
+   std::vector<uint32_t>& atlasIndices = meshData.vertexData.indices;
+
+   const std::vector<Vertex> originalVertices = atlasVertices;
+
+   // where the texture coordinates of a vertex were moved to, the placement or -1 if they weren't moved. a vertex
+   // that is used by a material that moves it differently is copied
+   const int NOT_USED = -2;
+   std::vector<int> vertexPlacements(originalVertices.size(), NOT_USED);
+   std::map<std::pair<uint32_t, int>, uint32_t> copies;
+
+   auto moveTexCoord = [&](Vertex& vertex, int placementId)
+   {
+      if(placementId < 0)
+      {
+         return;
+      }
+
+      const Placement& placement = placements[placementId];
+
+      vertex.texCoord = (glm::vec2(placement.x, placement.y) + vertex.texCoord * glm::vec2(placementSizes[placementId])) / static_cast<float>(size);
+   };
+
+   for(const auto& subMesh : meshData.subMeshes)
+   {
+      int rectId = materialRects[subMesh.materialId];
+      int placementId = rectId >= 0 ? placementIds[rectId] : -1;
+
+      for(int32_t i = subMesh.startIndex; i < subMesh.startIndex + subMesh.numberOfIndices; i++)
+      {
+         uint32_t& index = atlasIndices[i];
+
+         if(vertexPlacements[index] == NOT_USED)
+         {
+            vertexPlacements[index] = placementId;
+            moveTexCoord(atlasVertices[index], placementId);
+            continue;
+         }
+
+         if(vertexPlacements[index] == placementId)
+         {
+            continue;
+         }
+
+         auto copy = copies.find(std::make_pair(index, placementId));
+         if(copy == copies.end())
+         {
+            Vertex vertex = originalVertices[index];
+            moveTexCoord(vertex, placementId);
+
+            atlasVertices.push_back(vertex);
+            copy = copies.emplace(std::make_pair(index, placementId), static_cast<uint32_t>(atlasVertices.size() - 1)).first;
+         }
+
+         index = copy->second;
+      }
+   }
+
+   return true;
+}
+
+bool TextureAtlas::isAtlas(const std::string& name)
+{
+   return name.compare(0, strlen(PREFIX), PREFIX) == 0;
+}
+
+Texture::ImageData TextureAtlas::build(const std::string& name)
+{
+   int width, height;
+   std::vector<Placement> placements;
+
+   if(!parseName(name, &width, &height, &placements))
+   {
+      throw std::runtime_error("not a texture atlas: " + name + "!");
+   }
+
+   Texture::ImageData atlas;
+   atlas.name         = name;
+   atlas.width        = width;
+   atlas.height       = height;
+   atlas.maxMipLevels = MIP_LEVELS;
+
+   // freed like a decoded image. opaque black between the images, so an atlas of opaque images can still be BC1
+   atlas.pixels = static_cast<stbi_uc*>(malloc(size_t(width) * height * 4));
+   for(size_t i = 0; i < size_t(width) * height; i++)
+   {
+      atlas.pixels[i * 4 + 0] = 0;
+      atlas.pixels[i * 4 + 1] = 0;
+      atlas.pixels[i * 4 + 2] = 0;
+      atlas.pixels[i * 4 + 3] = 255;
+   }
+
+   std::vector<uint64_t> hashes;
+
+   try
+   {
+      for(const auto& placement : placements)
+      {
+         Texture::ImageData image = Texture::decodeImage(placement.fileName);
+
+         if(placement.x < BORDER || placement.y < BORDER ||
+            placement.x + image.width + BORDER > width || placement.y + image.height + BORDER > height)
+         {
+            Texture::freeImageData(image);
+            throw std::runtime_error(placement.fileName + " doesn't fit in its place in the texture atlas!");
+         }
+
+         // the edges are repeated into the border
+         for(int y = -BORDER; y < image.height + BORDER; y++)
+         {
+            const stbi_uc* source = image.pixels + size_t(std::min(std::max(y, 0), image.height - 1)) * image.width * 4;
+            stbi_uc* destination = atlas.pixels + (size_t(placement.y + y) * width + placement.x - BORDER) * 4;
+
+            for(int x = -BORDER; x < image.width + BORDER; x++)
+            {
+               memcpy(destination, source + std::min(std::max(x, 0), image.width - 1) * 4, 4);
+               destination += 4;
+            }
+         }
+
+         hashes.push_back(image.contentHash);
+
+         Texture::freeImageData(image);
+      }
+   }
+   catch(...)
+   {
+      Texture::freeImageData(atlas);
+      throw;
+   }
+
+   atlas.contentHash = combineHashes(name, hashes);
+
+   return atlas;
+}
+
+bool TextureAtlas::hashContents(const std::string& name, uint64_t* hash)
+{
+   int width, height;
+   std::vector<Placement> placements;
+
+   if(!parseName(name, &width, &height, &placements))
+   {
+      return false;
+   }
+
+   // the same as the contentHash of the decoded image
+   std::vector<uint64_t> hashes(placements.size());
+   for(size_t i = 0; i < placements.size(); i++)
+   {
+      if(!CacheFile::hashFile(placements[i].fileName, &hashes[i]))
+      {
+         return false;
+      }
+   }
+
+   *hash = combineHashes(name, hashes);
+
+   return true;
+}
+
+std::string TextureAtlas::getName(int width, int height, const std::vector<Placement>& placements)
+{
+   std::string name = PREFIX + std::to_string(width) + "x" + std::to_string(height);
+
+   for(const auto& placement : placements)
+   {
+      name += "|" + std::to_string(placement.x) + "," + std::to_string(placement.y) + "," + placement.fileName;
+   }
+
+   return name;
+}
+
+uint64_t TextureAtlas::combineHashes(const std::string& name, const std::vector<uint64_t>& imageHashes)
+{
+   std::vector<uint64_t> hashes;
+   hashes.push_back(CacheFile::hash(name.data(), name.size()));
+   hashes.insert(hashes.end(), imageHashes.begin(), imageHashes.end());
+
+   return CacheFile::hash(hashes.data(), hashes.size() * sizeof(uint64_t));
+}
+
+bool TextureAtlas::parseName(const std::string& name, int* width, int* height, std::vector<Placement>* placements)
+{
+   if(!isAtlas(name) || sscanf(name.c_str() + strlen(PREFIX), "%dx%d", width, height) != 2 || *width <= 0 || *height <= 0)
+   {
+      return false;
+   }
+
+   // |x,y,file for every image
+   size_t start = name.find('|');
+   while(start != std::string::npos)
+   {
+      size_t end = name.find('|', start + 1);
+      std::string part = name.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+
+      size_t firstComma  = part.find(',');
+      size_t secondComma = firstComma == std::string::npos ? std::string::npos : part.find(',', firstComma + 1);
+      if(secondComma == std::string::npos)
+      {
+         return false;
+      }
+
+      Placement placement;
+      placement.x        = atoi(part.substr(0, firstComma).c_str());
+      placement.y        = atoi(part.substr(firstComma + 1, secondComma - firstComma - 1).c_str());
+      placement.fileName = part.substr(secondComma + 1);
+
+      placements->push_back(placement);
+
+      start = end;
+   }
+
+   return !placements->empty();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Packs the small textures of a mesh into one atlas, so its materials share a texture and with it a descriptor set, and
+// the sub meshes can be drawn together.
+//
+// pack() runs when the mesh is loaded, before it's uploaded: the small diffuse textures of materials that only sample
+// inside [0, 1] are packed with stb_rect_pack, those materials get the atlas as their texture and the texture
+// coordinates of their vertices are moved into their rectangle. Vertices shared with another material are copied.
+//
+// The atlas is named after its layout, the size and where each image goes, so it can be loaded like any other texture
+// (Texture::decodeImage builds it) and a mesh loaded twice gets the same atlas. Compressed atlases go to the texture
+// cache under that name, they are built again when the contents of an image in them changed (see hashContents).
+//
+// Every image is surrounded by a border that repeats its edges, and starts on a multiple of ALIGNMENT texels. The mip
+// chain stops at MIP_LEVELS, so a texel (or a 4x4 block once compressed) of any level only covers one image, and the
+// filter never reaches past the border.
+
+#include "Mesh.h"
+#include "Texture.h"
+
+class TextureAtlas
+{
+public:
+   // textures with a side larger than this are left alone
+   static const int MAX_TEXTURE_SIZE = 256;
+   static const int MAX_ATLAS_SIZE = 2048;
+
+   static const int ALIGNMENT = 32;
+   static const int BORDER = 8;
+   static const uint32_t MIP_LEVELS = 4;
+
+   // thread safe. returns false if there weren't at least two textures to pack
+   static bool pack(Mesh::MeshData& meshData);
+
+   static bool isAtlas(const std::string& name);
+
+   // thread safe. decodes the images and copies them in, throws if one is missing or doesn't fit anymore
+   static Texture::ImageData build(const std::string& name);
+
+   // thread safe. the contentHash build gives the atlas, from the files without decoding them. false if one is missing
+   static bool hashContents(const std::string& name, uint64_t* hash);
+
+private:
+
+   static const char* PREFIX;
+
+   struct Placement
+   {
+      std::string fileName;
+      int x;
+      int y;
+   };
+
+   static std::string getName(int width, int height, const std::vector<Placement>& placements);
+
+   // the atlas is the same if the layout and the images are
+   static uint64_t combineHashes(const std::string& name, const std::vector<uint64_t>& imageHashes);
+
+   static bool parseName(const std::string& name, int* width, int* height, std::vector<Placement>* placements);
+};
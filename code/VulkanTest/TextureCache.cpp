@@ -0,0 +1,191 @@
+#include "TextureCache.h"
+#include "CacheFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+   const char MAGIC[4] ={ 'V', 'T', 'T', 'C' };
+
+   // the levels start on 16 bytes, that's a multiple of the block size of every format
+   uint64_t alignSection(uint64_t offset)
+   {
+      return (offset + 15) & ~uint64_t(15);
+   }
+
+   bool isCompressedFormat(uint32_t format)
+   {
+      return format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || format == VK_FORMAT_BC3_UNORM_BLOCK;
+   }
+}
+
+bool TextureCache::load(const std::string& sourceFile, Texture::ImageData& imageData)
+{
+   Header header;
+   std::shared_ptr<MappedFile> file = open(sourceFile, 0, &header);
+
+   if(!file || !CacheFile::isUpToDate(sourceFile, header.sourceTime, header.sourceSize, header.sourceHash))
+   {
+      return false;
+   }
+
+   setImageData(sourceFile, header, file, imageData);
+
+   return true;
+}
+
+void TextureCache::store(const std::string& sourceFile, const Texture::ImageData& imageData)
+{
+   Header header ={};
+
+   // decodeImage already hashed the contents
+   header.sourceHash = imageData.contentHash;
+
+   if(!imageData.isCompressed() ||
+      !CacheFile::getSourceInfo(sourceFile, &header.sourceTime, &header.sourceSize) ||
+      (header.sourceHash == 0 && !CacheFile::hashFile(sourceFile, &header.sourceHash)))
+   {
+      return;
+   }
+
+   write(sourceFile, header, imageData);
+}
+
+bool TextureCache::loadGenerated(const std::string& name, uint64_t contentHash, uint32_t maxMipLevels, Texture::ImageData& imageData)
+{
+   Header header;
+   std::shared_ptr<MappedFile> file = open(name, maxMipLevels, &header);
+
+   if(!file || header.sourceHash != contentHash)
+   {
+      return false;
+   }
+
+   setImageData(name, header, file, imageData);
+   imageData.maxMipLevels = maxMipLevels;
+
+   return true;
+}
+
+void TextureCache::storeGenerated(const std::string& name, const Texture::ImageData& imageData)
+{
+   if(!imageData.isCompressed() || imageData.contentHash == 0)
+   {
+      return;
+   }
+
+   // no time and size, only the contents
+   Header header ={};
+   header.sourceHash = imageData.contentHash;
+
+   write(name, header, imageData);
+}
+
+std::shared_ptr<MappedFile> TextureCache::open(const std::string& name, uint32_t maxMipLevels, Header* header)
+{
+   auto file = std::make_shared<MappedFile>();
+
+   if(!file->open(getCacheFileName(name)) || file->getSize() < sizeof(Header))
+   {
+      return nullptr;
+   }
+
+   const uint8_t* data = file->getData();
+   uint64_t fileSize   = file->getSize();
+
+   memcpy(header, data, sizeof(Header));
+
+   if(memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->version != VERSION ||
+      !isCompressedFormat(header->format) ||
+      header->width == 0 || header->height == 0)
+   {
+      return nullptr;
+   }
+
+   // the full chain, unless the image stops earlier
+   uint32_t mipLevels = Texture::getMipLevels(header->width, header->height);
+   if(maxMipLevels > 0)
+   {
+      mipLevels = std::min(mipLevels, maxMipLevels);
+   }
+
+   if(header->mipLevels != mipLevels)
+   {
+      return nullptr;
+   }
+
+   VkFormat format = static_cast<VkFormat>(header->format);
+
+   uint64_t levelsSize = 0;
+   for(uint32_t level = 0; level < header->mipLevels; level++)
+   {
+      levelsSize += Texture::getLevelSize(format, header->width, header->height, level);
+   }
+
+   if(header->pathLength > fileSize - sizeof(Header) ||
+      header->levelsSize != levelsSize ||
+      header->levelsOffset > fileSize || header->levelsSize > fileSize - header->levelsOffset)
+   {
+      return nullptr;
+   }
+
+   // two sources with the same path hash
+   if(std::string(reinterpret_cast<const char*>(data + sizeof(Header)), header->pathLength) != name)
+   {
+      return nullptr;
+   }
+
+   return file;
+}
+
+void TextureCache::setImageData(const std::string& name, const Header& header, const std::shared_ptr<MappedFile>& file, Texture::ImageData& imageData)
+{
+   imageData = Texture::ImageData();
+   imageData.name         = name;
+   imageData.width        = static_cast<int>(header.width);
+   imageData.height       = static_cast<int>(header.height);
+   imageData.format       = static_cast<VkFormat>(header.format);
+   imageData.mipLevels    = header.mipLevels;
+   imageData.mappedBlocks = file->getData() + header.levelsOffset;
+   imageData.mappedFile   = file;
+
+   // the source is up to date, so this is still the hash of its contents
+   imageData.contentHash = header.sourceHash;
+}
+
+// the source time, size and hash have to be in the header already
+void TextureCache::write(const std::string& name, const Header& sourceHeader, const Texture::ImageData& imageData)
+{
+   Header header = sourceHeader;
+   memcpy(header.magic, MAGIC, sizeof(MAGIC));
+   header.version    = VERSION;
+   header.pathLength = static_cast<uint32_t>(name.size());
+   header.format     = static_cast<uint32_t>(imageData.format);
+
+   header.width     = static_cast<uint32_t>(imageData.width);
+   header.height    = static_cast<uint32_t>(imageData.height);
+   header.mipLevels = imageData.mipLevels;
+
+   for(uint32_t level = 0; level < header.mipLevels; level++)
+   {
+      header.levelsSize += Texture::getLevelSize(imageData.format, header.width, header.height, level);
+   }
+
+   header.levelsOffset = alignSection(sizeof(Header) + name.size());
+
+   std::vector<char> buffer(static_cast<size_t>(header.levelsOffset + header.levelsSize), 0);
+
+   memcpy(buffer.data(), &header, sizeof(Header));
+   memcpy(buffer.data() + sizeof(Header), name.data(), name.size());
+   memcpy(buffer.data() + header.levelsOffset, imageData.getBlocks(), static_cast<size_t>(header.levelsSize));
+
+   // the same texture might be stored from two threads at once, CacheFile takes care of that
+   CacheFile::write(getCacheFileName(name), buffer);
+}
+
+std::string TextureCache::getCacheFileName(const std::string& sourceFile)
+{
+   return CacheFile::getFileName(sourceFile, ".tex");
+}
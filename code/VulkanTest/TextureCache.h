@@ -0,0 +1,69 @@
+#pragma once
+
+// Cache for block compressed textures, so an image only has to be decoded and compressed once.
+//
+// The cache file is laid out like a KTX file: a header with the format, the size and the number of levels, then all
+// levels one after the other, from the largest down, ready to be copied to the image. One file per source image in
+// CacheFile::CACHE_DIRECTORY, it is up to date as long as the source is (see CacheFile).
+//
+// Images that aren't a file themselves, like a TextureAtlas, are cached by their name with loadGenerated and
+// storeGenerated. There is no time or size to compare, they are up to date as long as the hash of their contents matches.
+//
+// Writing is best effort, if the cache can't be written the image is just compressed again next time.
+
+#include "Texture.h"
+
+class TextureCache
+{
+public:
+   // thread safe. returns false if there is no cache for the file or it's out of date.
+   static bool load(const std::string& sourceFile, Texture::ImageData& imageData);
+
+   // thread safe, the image has to be compressed
+   static void store(const std::string& sourceFile, const Texture::ImageData& imageData);
+
+   // thread safe. returns false if there is no cache for the image or it was made from other contents. maxMipLevels as
+   // in ImageData
+   static bool loadGenerated(const std::string& name, uint64_t contentHash, uint32_t maxMipLevels, Texture::ImageData& imageData);
+
+   // thread safe, the image has to be compressed and have its contentHash
+   static void storeGenerated(const std::string& name, const Texture::ImageData& imageData);
+
+private:
+
+   // bump when the layout of the file or the compression changes
+   static const uint32_t VERSION = 1;
+
+   struct Header
+   {
+      char magic[4];
+      uint32_t version;
+      uint32_t pathLength;
+
+      // VkFormat
+      uint32_t format;
+
+      uint64_t sourceTime;
+      uint64_t sourceSize;
+      uint64_t sourceHash;
+
+      uint32_t width;
+      uint32_t height;
+      uint32_t mipLevels;
+      uint32_t padding;
+
+      // from the start of the file, the source path is right after the header
+      uint64_t levelsOffset;
+      uint64_t levelsSize;
+   };
+
+   // the mapped file if there is a valid cache for the name with the expected number of levels, nullptr otherwise. it's
+   // not checked if it's up to date
+   static std::shared_ptr<MappedFile> open(const std::string& name, uint32_t maxMipLevels, Header* header);
+
+   static void setImageData(const std::string& name, const Header& header, const std::shared_ptr<MappedFile>& file, Texture::ImageData& imageData);
+
+   static void write(const std::string& name, const Header& header, const Texture::ImageData& imageData);
+
+   static std::string getCacheFileName(const std::string& sourceFile);
+};
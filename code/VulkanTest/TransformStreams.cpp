@@ -0,0 +1,326 @@
+#include "TransformStreams.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+// SSE2 is always there on x64, the build doesn't enable AVX, so the kernel does 4 objects at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_STREAMS_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   const float DEGREES_TO_RADIANS = glm::pi<float>() / 180.f;
+
+#ifdef TRANSFORM_STREAMS_SSE
+   // sin and cos of 4 angles (radians). Reduced to [-pi/4, pi/4] by a multiple of pi/2, then the cephes sinf/cosf
+   // polynomials, the quadrant picks and negates the results. Accurate to a few ulp for the angles objects rotate by.
+   void sinCos(__m128 x, __m128& sinOut, __m128& cosOut)
+   {
+      // pi/2 split in 3 parts, so x - q * pi/2 doesn't lose precision
+      const __m128 PIO2_1 = _mm_set1_ps(1.5703125f);
+      const __m128 PIO2_2 = _mm_set1_ps(4.837512969970703125e-4f);
+      const __m128 PIO2_3 = _mm_set1_ps(7.54978995489188216e-8f);
+
+      __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(2.f / glm::pi<float>())));
+      __m128 q = _mm_cvtepi32_ps(quadrant);
+
+      __m128 r = _mm_sub_ps(x, _mm_mul_ps(q, PIO2_1));
+      r = _mm_sub_ps(r, _mm_mul_ps(q, PIO2_2));
+      r = _mm_sub_ps(r, _mm_mul_ps(q, PIO2_3));
+
+      __m128 z = _mm_mul_ps(r, r);
+
+      __m128 s = _mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z);
+      s = _mm_add_ps(s, _mm_set1_ps(8.3321608736e-3f));
+      s = _mm_mul_ps(s, z);
+      s = _mm_add_ps(s, _mm_set1_ps(-1.6666654611e-1f));
+      s = _mm_mul_ps(_mm_mul_ps(s, z), r);
+      s = _mm_add_ps(s, r);
+
+      __m128 c = _mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z);
+      c = _mm_add_ps(c, _mm_set1_ps(-1.388731625493765e-3f));
+      c = _mm_mul_ps(c, z);
+      c = _mm_add_ps(c, _mm_set1_ps(4.166664568298827e-2f));
+      c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+      c = _mm_sub_ps(c, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+      c = _mm_add_ps(c, _mm_set1_ps(1.f));
+
+      // odd quadrants swap sin and cos
+      __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+
+      __m128 sinValue = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+      __m128 cosValue = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+      // sin is negative in quadrant 2 and 3, cos in 1 and 2
+      __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+      __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+      sinOut = _mm_xor_ps(sinValue, sinSign);
+      cosOut = _mm_xor_ps(cosValue, cosSign);
+   }
+#endif
+}
+
+uint32_t TransformStreams::add(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale)
+{
+   // grow by a whole group of 4, the new padding objects don't move and have a valid matrix
+   if(count % 4 == 0)
+   {
+      size_t padded = count + 4;
+
+      for(auto* stream : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ,
+                           &velocityX, &velocityY, &velocityZ, &rotationSpeedX, &rotationSpeedY, &rotationSpeedZ })
+      {
+         stream->resize(padded, 0.f);
+      }
+
+      for(auto* stream : { &scaleX, &scaleY, &scaleZ })
+      {
+         stream->resize(padded, 1.f);
+      }
+
+      dirtyBits.resize((padded + BLOCK_SIZE - 1) / BLOCK_SIZE, 0);
+   }
+
+   uint32_t index = count++;
+
+   setPosition(index, position);
+   setRotation(index, rotation);
+   setScale(index, scale);
+
+   return index;
+}
+
+void TransformStreams::setPosition(uint32_t index, glm::vec3 position)
+{
+   positionX[index] = position.x;
+   positionY[index] = position.y;
+   positionZ[index] = position.z;
+
+   markDirty(index);
+}
+
+void TransformStreams::setRotation(uint32_t index, glm::vec3 rotation)
+{
+   rotationX[index] = rotation.x;
+   rotationY[index] = rotation.y;
+   rotationZ[index] = rotation.z;
+
+   markDirty(index);
+}
+
+void TransformStreams::setScale(uint32_t index, glm::vec3 scale)
+{
+   scaleX[index] = scale.x;
+   scaleY[index] = scale.y;
+   scaleZ[index] = scale.z;
+
+   markDirty(index);
+}
+
+void TransformStreams::setVelocity(uint32_t index, glm::vec3 velocity)
+{
+   velocityX[index] = velocity.x;
+   velocityY[index] = velocity.y;
+   velocityZ[index] = velocity.z;
+}
+
+void TransformStreams::setRotationSpeed(uint32_t index, glm::vec3 rotationSpeed)
+{
+   rotationSpeedX[index] = rotationSpeed.x;
+   rotationSpeedY[index] = rotationSpeed.y;
+   rotationSpeedZ[index] = rotationSpeed.z;
+}
+
+void TransformStreams::integrate(float dt, uint32_t firstBlock, uint32_t lastBlock)
+{
+   uint32_t first = firstBlock * BLOCK_SIZE;
+   uint32_t last = std::min(lastBlock * BLOCK_SIZE, static_cast<uint32_t>(positionX.size()));
+
+#ifdef TRANSFORM_STREAMS_SSE
+   const __m128 dt4 = _mm_set1_ps(dt);
+   const __m128 zero = _mm_setzero_ps();
+
+   for(uint32_t i = first; i < last; i += 4)
+   {
+      __m128 vx = _mm_loadu_ps(&velocityX[i]);
+      __m128 vy = _mm_loadu_ps(&velocityY[i]);
+      __m128 vz = _mm_loadu_ps(&velocityZ[i]);
+      __m128 rx = _mm_loadu_ps(&rotationSpeedX[i]);
+      __m128 ry = _mm_loadu_ps(&rotationSpeedY[i]);
+      __m128 rz = _mm_loadu_ps(&rotationSpeedZ[i]);
+
+      __m128 moving = _mm_or_ps(
+         _mm_or_ps(_mm_cmpneq_ps(vx, zero), _mm_or_ps(_mm_cmpneq_ps(vy, zero), _mm_cmpneq_ps(vz, zero))),
+         _mm_or_ps(_mm_cmpneq_ps(rx, zero), _mm_or_ps(_mm_cmpneq_ps(ry, zero), _mm_cmpneq_ps(rz, zero))));
+
+      int mask = _mm_movemask_ps(moving);
+
+      // static objects are not touched at all
+      if(mask == 0)
+      {
+         continue;
+      }
+
+      // adding 0 leaves the objects in the group that don't move as they are
+      _mm_storeu_ps(&positionX[i], _mm_add_ps(_mm_loadu_ps(&positionX[i]), _mm_mul_ps(vx, dt4)));
+      _mm_storeu_ps(&positionY[i], _mm_add_ps(_mm_loadu_ps(&positionY[i]), _mm_mul_ps(vy, dt4)));
+      _mm_storeu_ps(&positionZ[i], _mm_add_ps(_mm_loadu_ps(&positionZ[i]), _mm_mul_ps(vz, dt4)));
+      _mm_storeu_ps(&rotationX[i], _mm_add_ps(_mm_loadu_ps(&rotationX[i]), _mm_mul_ps(rx, dt4)));
+      _mm_storeu_ps(&rotationY[i], _mm_add_ps(_mm_loadu_ps(&rotationY[i]), _mm_mul_ps(ry, dt4)));
+      _mm_storeu_ps(&rotationZ[i], _mm_add_ps(_mm_loadu_ps(&rotationZ[i]), _mm_mul_ps(rz, dt4)));
+
+      dirtyBits[i / BLOCK_SIZE] |= uint64_t(mask) << (i % BLOCK_SIZE);
+   }
+#else
+   for(uint32_t i = first; i < last; i++)
+   {
+      if(velocityX[i] == 0.f && velocityY[i] == 0.f && velocityZ[i] == 0.f &&
+         rotationSpeedX[i] == 0.f && rotationSpeedY[i] == 0.f && rotationSpeedZ[i] == 0.f)
+      {
+         continue;
+      }
+
+      positionX[i] += velocityX[i] * dt;
+      positionY[i] += velocityY[i] * dt;
+      positionZ[i] += velocityZ[i] * dt;
+      rotationX[i] += rotationSpeedX[i] * dt;
+      rotationY[i] += rotationSpeedY[i] * dt;
+      rotationZ[i] += rotationSpeedZ[i] * dt;
+
+      markDirty(i);
+   }
+#endif
+}
+
+void TransformStreams::updateMatrices(glm::mat4* matrices, std::vector<uint32_t>& updated, uint32_t firstBlock, uint32_t lastBlock, bool simd)
+{
+   for(uint32_t word = firstBlock; word < lastBlock; word++)
+   {
+      uint64_t bits = dirtyBits[word];
+
+      if(bits == 0)
+      {
+         continue;
+      }
+
+      dirtyBits[word] = 0;
+
+      // 16 groups of 4 objects per word
+      for(uint32_t first = word * BLOCK_SIZE; bits != 0; first += 4, bits >>= 4)
+      {
+         uint32_t mask = static_cast<uint32_t>(bits & 0xF);
+
+         if(mask == 0)
+         {
+            continue;
+         }
+
+         if(simd)
+         {
+            composeSimd(first, mask, matrices);
+         }
+
+         for(uint32_t lane = 0; lane < 4; lane++)
+         {
+            if(mask & (1u << lane))
+            {
+               if(!simd)
+               {
+                  composeScalar(first + lane, matrices[first + lane]);
+               }
+
+               updated.push_back(first + lane);
+            }
+         }
+      }
+   }
+}
+
+void TransformStreams::composeSimd(uint32_t first, uint32_t mask, glm::mat4* matrices) const
+{
+#ifdef TRANSFORM_STREAMS_SSE
+   const __m128 degreesToRadians = _mm_set1_ps(DEGREES_TO_RADIANS);
+
+   __m128 sx, cx, sy, cy, sz, cz;
+   sinCos(_mm_mul_ps(_mm_loadu_ps(&rotationX[first]), degreesToRadians), sx, cx);
+   sinCos(_mm_mul_ps(_mm_loadu_ps(&rotationY[first]), degreesToRadians), sy, cy);
+   sinCos(_mm_mul_ps(_mm_loadu_ps(&rotationZ[first]), degreesToRadians), sz, cz);
+
+   __m128 scaleX4 = _mm_loadu_ps(&scaleX[first]);
+   __m128 scaleY4 = _mm_loadu_ps(&scaleY[first]);
+   __m128 scaleZ4 = _mm_loadu_ps(&scaleZ[first]);
+
+   // Rz * Ry * Rx, rRC = row R column C
+   __m128 sysx = _mm_mul_ps(sy, sx);
+   __m128 sycx = _mm_mul_ps(sy, cx);
+
+   __m128 r00 = _mm_mul_ps(cz, cy);
+   __m128 r10 = _mm_mul_ps(sz, cy);
+   __m128 r20 = _mm_sub_ps(_mm_setzero_ps(), sy);
+
+   __m128 r01 = _mm_sub_ps(_mm_mul_ps(cz, sysx), _mm_mul_ps(sz, cx));
+   __m128 r11 = _mm_add_ps(_mm_mul_ps(sz, sysx), _mm_mul_ps(cz, cx));
+   __m128 r21 = _mm_mul_ps(cy, sx);
+
+   __m128 r02 = _mm_add_ps(_mm_mul_ps(cz, sycx), _mm_mul_ps(sz, sx));
+   __m128 r12 = _mm_sub_ps(_mm_mul_ps(sz, sycx), _mm_mul_ps(cz, sx));
+   __m128 r22 = _mm_mul_ps(cy, cx);
+
+   // one register per column and component, every lane is an object. transposed, every register is a column of one object
+   __m128 columns[4][4] =
+   {
+      { _mm_mul_ps(r00, scaleX4), _mm_mul_ps(r10, scaleX4), _mm_mul_ps(r20, scaleX4), _mm_setzero_ps() },
+      { _mm_mul_ps(r01, scaleY4), _mm_mul_ps(r11, scaleY4), _mm_mul_ps(r21, scaleY4), _mm_setzero_ps() },
+      { _mm_mul_ps(r02, scaleZ4), _mm_mul_ps(r12, scaleZ4), _mm_mul_ps(r22, scaleZ4), _mm_setzero_ps() },
+      { _mm_loadu_ps(&positionX[first]), _mm_loadu_ps(&positionY[first]), _mm_loadu_ps(&positionZ[first]), _mm_set1_ps(1.f) },
+   };
+
+   for(uint32_t column = 0; column < 4; column++)
+   {
+      _MM_TRANSPOSE4_PS(columns[column][0], columns[column][1], columns[column][2], columns[column][3]);
+   }
+
+   // the other objects in the group are not dirty, or padding past the end of matrices
+   for(uint32_t lane = 0; lane < 4; lane++)
+   {
+      if(mask & (1u << lane))
+      {
+         float* matrix = &matrices[first + lane][0][0];
+
+         for(uint32_t column = 0; column < 4; column++)
+         {
+            _mm_storeu_ps(matrix + column * 4, columns[column][lane]);
+         }
+      }
+   }
+#else
+   for(uint32_t lane = 0; lane < 4; lane++)
+   {
+      if(mask & (1u << lane))
+      {
+         composeScalar(first + lane, matrices[first + lane]);
+      }
+   }
+#endif
+}
+
+void TransformStreams::composeScalar(uint32_t index, glm::mat4& matrix) const
+{
+   float sx = std::sin(rotationX[index] * DEGREES_TO_RADIANS);
+   float cx = std::cos(rotationX[index] * DEGREES_TO_RADIANS);
+   float sy = std::sin(rotationY[index] * DEGREES_TO_RADIANS);
+   float cy = std::cos(rotationY[index] * DEGREES_TO_RADIANS);
+   float sz = std::sin(rotationZ[index] * DEGREES_TO_RADIANS);
+   float cz = std::cos(rotationZ[index] * DEGREES_TO_RADIANS);
+
+   // same as composeSimd
+   matrix[0] = glm::vec4(cz * cy, sz * cy, -sy, 0.f) * scaleX[index];
+   matrix[1] = glm::vec4(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx, 0.f) * scaleY[index];
+   matrix[2] = glm::vec4(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx, 0.f) * scaleZ[index];
+   matrix[3] = glm::vec4(positionX[index], positionY[index], positionZ[index], 1.f);
+}
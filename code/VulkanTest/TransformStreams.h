@@ -0,0 +1,111 @@
+#pragma once
+
+// Position, rotation (euler angles in degrees) and scale of all objects, stored as separate float streams (SoA),
+// so the matrices of 4 objects can be built at once with SSE.
+//
+// The matrix is T * Rz * Ry * Rx * S, written out directly instead of the translate/rotate/rotate/rotate/scale chain
+// (4 matrix multiplies). Only objects with their bit set in the dirty bitset are rebuilt, updateMatrices clears the bits.
+//
+// The streams are padded to a multiple of 4 objects. The padding objects never move and are never dirty.
+//
+// integrate and updateMatrices can run on several threads at once for different blocks of BLOCK_SIZE objects
+// (one word of the dirty bitset), as long as nothing else changes the streams meanwhile.
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class TransformStreams
+{
+public:
+   static const uint32_t BLOCK_SIZE = 64;
+
+   // returns the index of the new object, it starts out dirty
+   uint32_t add(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+
+   uint32_t size() const
+   {
+      return count;
+   }
+
+   uint32_t getNumberOfBlocks() const
+   {
+      return static_cast<uint32_t>(dirtyBits.size());
+   }
+
+   void setPosition(uint32_t index, glm::vec3 position);
+   void setRotation(uint32_t index, glm::vec3 rotation);
+   void setScale(uint32_t index, glm::vec3 scale);
+
+   glm::vec3 getPosition(uint32_t index) const
+   {
+      return glm::vec3(positionX[index], positionY[index], positionZ[index]);
+   }
+
+   glm::vec3 getRotation(uint32_t index) const
+   {
+      return glm::vec3(rotationX[index], rotationY[index], rotationZ[index]);
+   }
+
+   glm::vec3 getScale(uint32_t index) const
+   {
+      return glm::vec3(scaleX[index], scaleY[index], scaleZ[index]);
+   }
+
+   // units per second
+   void setVelocity(uint32_t index, glm::vec3 velocity);
+
+   glm::vec3 getVelocity(uint32_t index) const
+   {
+      return glm::vec3(velocityX[index], velocityY[index], velocityZ[index]);
+   }
+
+   // degrees per second
+   void setRotationSpeed(uint32_t index, glm::vec3 rotationSpeed);
+
+   void markDirty(uint32_t index)
+   {
+      dirtyBits[index / BLOCK_SIZE] |= uint64_t(1) << (index % BLOCK_SIZE);
+   }
+
+   bool isDirty(uint32_t index) const
+   {
+      return (dirtyBits[index / BLOCK_SIZE] >> (index % BLOCK_SIZE)) & 1;
+   }
+
+   // moves and rotates everything with a speed, those objects become dirty
+   void integrate(float dt)
+   {
+      integrate(dt, 0, getNumberOfBlocks());
+   }
+
+   void integrate(float dt, uint32_t firstBlock, uint32_t lastBlock);
+
+   // Rebuilds the matrices of the dirty objects, appends their indices to updated and clears their bits.
+   // matrices has one entry per object. simd = false uses the scalar version of the kernel, for comparison.
+   void updateMatrices(glm::mat4* matrices, std::vector<uint32_t>& updated, bool simd = true)
+   {
+      updateMatrices(matrices, updated, 0, getNumberOfBlocks(), simd);
+   }
+
+   void updateMatrices(glm::mat4* matrices, std::vector<uint32_t>& updated, uint32_t firstBlock, uint32_t lastBlock, bool simd = true);
+
+private:
+
+   uint32_t count = 0;
+
+   std::vector<float> positionX, positionY, positionZ;
+   std::vector<float> rotationX, rotationY, rotationZ;
+   std::vector<float> scaleX, scaleY, scaleZ;
+
+   std::vector<float> velocityX, velocityY, velocityZ;
+   std::vector<float> rotationSpeedX, rotationSpeedY, rotationSpeedZ;
+
+   // one bit per object, covers the padding as well
+   std::vector<uint64_t> dirtyBits;
+
+   // builds the matrices of the 4 objects starting at first, stores the ones in mask (bit per object)
+   void composeSimd(uint32_t first, uint32_t mask, glm::mat4* matrices) const;
+   void composeScalar(uint32_t index, glm::mat4& matrix) const;
+};
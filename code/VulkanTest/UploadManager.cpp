@@ -0,0 +1,766 @@
+#include "UploadManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace vks
+{
+   void UploadManager::init(VulkanDevice* vulkanDevice, VkDeviceSize stagingSize)
+   {
+      this->vulkanDevice = vulkanDevice;
+
+      const QueueFamilyIndices& indices = vulkanDevice->queueFamilyIndices;
+
+      graphicsFamily        = static_cast<uint32_t>(indices.graphicsFamily);
+      separateTransferQueue = indices.transferFamily >= 0;
+      transferFamily        = separateTransferQueue ? static_cast<uint32_t>(indices.transferFamily) : graphicsFamily;
+
+      VkCommandPoolCreateInfo poolInfo ={};
+      poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      poolInfo.queueFamilyIndex = transferFamily;
+      poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+      if(vkCreateCommandPool(vulkanDevice->device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to create upload command pool!");
+      }
+
+      if(separateTransferQueue)
+      {
+         poolInfo.queueFamilyIndex = graphicsFamily;
+
+         if(vkCreateCommandPool(vulkanDevice->device, &poolInfo, nullptr, &acquireCommandPool) != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to create upload acquire command pool!");
+         }
+      }
+
+      // image copies need the buffer offset to be a multiple of the texel size (and 4)
+      stagingAlignment = std::max<VkDeviceSize>(16, vulkanDevice->deviceProperties.limits.optimalBufferCopyOffsetAlignment);
+
+      this->stagingSize = (stagingSize + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+
+      vulkanDevice->createBuffer(
+         this->stagingSize,
+         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+         &stagingBuffer,
+         &stagingMemory,
+         AllocationStrategy::Linear);
+   }
+
+   void UploadManager::destroy()
+   {
+      waitIdle();
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(hasOpenBatch)
+      {
+         vkEndCommandBuffer(openBatch.commandBuffer);
+         freeBatches.push_back(openBatch);
+         hasOpenBatch = false;
+      }
+
+      for(auto& batch : freeBatches)
+      {
+         vkDestroyFence(vulkanDevice->device, batch.fence, nullptr);
+
+         if(batch.transferComplete != VK_NULL_HANDLE)
+         {
+            vkDestroySemaphore(vulkanDevice->device, batch.transferComplete, nullptr);
+         }
+      }
+      freeBatches.clear();
+
+      vkDestroyCommandPool(vulkanDevice->device, commandPool, nullptr);
+
+      if(acquireCommandPool != VK_NULL_HANDLE)
+      {
+         vkDestroyCommandPool(vulkanDevice->device, acquireCommandPool, nullptr);
+      }
+      vulkanDevice->destroyBuffer(stagingBuffer, stagingMemory);
+   }
+
+   uint64_t UploadManager::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      VkBuffer srcBuffer;
+      VkDeviceSize srcOffset;
+      copyToStaging(data, size, &srcBuffer, &srcOffset);
+
+      Batch& batch = getOpenBatch();
+
+      VkBufferCopy bufferCopy ={};
+      bufferCopy.srcOffset = srcOffset;
+      bufferCopy.dstOffset = offset;
+      bufferCopy.size      = size;
+
+      vkCmdCopyBuffer(batch.commandBuffer, srcBuffer, buffer, 1, &bufferCopy);
+
+      batch.bufferCopyCount++;
+
+      if(separateTransferQueue)
+      {
+         VkBufferMemoryBarrier barrier ={};
+         barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+         barrier.srcQueueFamilyIndex = transferFamily;
+         barrier.dstQueueFamilyIndex = graphicsFamily;
+         barrier.buffer              = buffer;
+         barrier.offset              = offset;
+         barrier.size                = size;
+
+         batch.bufferOwnershipBarriers.push_back(barrier);
+      }
+
+      return batch.ticket;
+   }
+
+   uint64_t UploadManager::uploadImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize* levelSizes, const void* data)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      Batch& batch = recordImageCopy(image, width, height, mipLevels, levelSizes, data);
+
+      VkImageMemoryBarrier barrier = getImageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+      if(separateTransferQueue)
+      {
+         // the layout transition happens as part of the release/acquire pair when the batch is submitted
+         barrier.srcQueueFamilyIndex = transferFamily;
+         barrier.dstQueueFamilyIndex = graphicsFamily;
+
+         batch.imageOwnershipBarriers.push_back(barrier);
+
+         return batch.ticket;
+      }
+
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+      vkCmdPipelineBarrier(
+         batch.commandBuffer,
+         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+         0,
+         0, nullptr,
+         0, nullptr,
+         1, &barrier);
+
+
+      return batch.ticket;
+   }
+
+   uint64_t UploadManager::uploadImageAndBlitMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const void* data, VkDeviceSize size)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      Batch& batch = recordImageCopy(image, width, height, 1, &size, data);
+
+      MipmapBlit blit ={};
+      blit.image     = image;
+      blit.width     = width;
+      blit.height    = height;
+      blit.mipLevels = mipLevels;
+
+      if(separateTransferQueue)
+      {
+         // transfer only families can't blit, the graphics queue does it after the acquire
+         batch.mipmapBlits.push_back(blit);
+
+         return batch.ticket;
+      }
+
+      recordMipmapBlits(batch.commandBuffer, blit);
+
+      return batch.ticket;
+   }
+
+   uint64_t UploadManager::flush()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(!hasOpenBatch)
+      {
+         // nothing recorded since the last flush, that batch is the latest one.
+         return nextTicket - 1;
+      }
+
+      return submitOpenBatch();
+   }
+
+   bool UploadManager::isComplete(uint64_t ticket)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(hasOpenBatch && openBatch.ticket <= ticket)
+      {
+         return false;
+      }
+
+      retire(false);
+
+      // batches retire in order, so anything older than the oldest batch still in flight is done
+      return inFlight.empty() || inFlight.front().ticket > ticket;
+   }
+
+   void UploadManager::wait(uint64_t ticket)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(hasOpenBatch && openBatch.ticket <= ticket)
+      {
+         submitOpenBatch();
+      }
+
+      while(!inFlight.empty() && inFlight.front().ticket <= ticket)
+      {
+         retire(true);
+      }
+   }
+
+   void UploadManager::waitIdle()
+   {
+      uint64_t ticket = flush();
+      wait(ticket);
+   }
+
+   void UploadManager::update()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      retire(false);
+   }
+
+   VkDeviceSize UploadManager::reserveStaging(VkDeviceSize size)
+   {
+      for(;;)
+      {
+         // nothing in the ring, start over at the beginning of the buffer
+         if(!hasOpenBatch && inFlight.empty())
+         {
+            stagingHead = (stagingHead + stagingSize - 1) / stagingSize * stagingSize;
+            stagingTail = stagingHead;
+         }
+
+         uint64_t start = (stagingHead + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+
+         // don't split an upload over the end of the buffer, skip the rest of it instead
+         if(start % stagingSize + size > stagingSize)
+         {
+            start = (start / stagingSize + 1) * stagingSize;
+         }
+
+         if(start + size - stagingTail <= stagingSize)
+         {
+            stagingHead = start + size;
+            return static_cast<VkDeviceSize>(start % stagingSize);
+         }
+
+         // ring is full. make sure what we've got so far is on its way and wait for the oldest batch to finish.
+         if(inFlight.empty())
+         {
+            submitOpenBatch();
+         }
+         retire(true);
+      }
+   }
+
+   void UploadManager::copyToStaging(const void* data, VkDeviceSize size, VkBuffer* srcBuffer, VkDeviceSize* srcOffset)
+   {
+      if(size > stagingSize)
+      {
+         Batch& batch = getOpenBatch();
+
+         VkBuffer buffer;
+         Allocation memory;
+
+         vulkanDevice->createBuffer(
+            size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &buffer,
+            &memory,
+            AllocationStrategy::Linear);
+
+         memcpy(memory.mapped, data, static_cast<size_t>(size));
+
+         batch.temporaryBuffers.push_back(buffer);
+         batch.temporaryMemory.push_back(memory);
+
+         *srcBuffer = buffer;
+         *srcOffset = 0;
+
+         return;
+      }
+
+      *srcOffset = reserveStaging(size);
+      *srcBuffer = stagingBuffer;
+
+      memcpy(static_cast<char*>(stagingMemory.mapped) + *srcOffset, data, static_cast<size_t>(size));
+   }
+
+   UploadManager::Batch& UploadManager::getOpenBatch()
+   {
+      if(hasOpenBatch)
+      {
+         return openBatch;
+      }
+
+      if(!freeBatches.empty())
+      {
+         openBatch = freeBatches.back();
+         freeBatches.pop_back();
+      }
+      else
+      {
+         openBatch = Batch();
+
+         VkCommandBufferAllocateInfo allocInfo ={};
+         allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+         allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+         allocInfo.commandPool        = commandPool;
+         allocInfo.commandBufferCount = 1;
+
+         if(vkAllocateCommandBuffers(vulkanDevice->device, &allocInfo, &openBatch.commandBuffer) != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+         }
+
+         VkFenceCreateInfo fenceInfo ={};
+         fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+         if(vkCreateFence(vulkanDevice->device, &fenceInfo, nullptr, &openBatch.fence) != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to create upload fence!");
+         }
+
+         if(separateTransferQueue)
+         {
+            allocInfo.commandPool = acquireCommandPool;
+
+            if(vkAllocateCommandBuffers(vulkanDevice->device, &allocInfo, &openBatch.acquireCommandBuffer) != VK_SUCCESS)
+            {
+               throw std::runtime_error("failed to allocate upload acquire command buffer!");
+            }
+
+            VkSemaphoreCreateInfo semaphoreInfo ={};
+            semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+            if(vkCreateSemaphore(vulkanDevice->device, &semaphoreInfo, nullptr, &openBatch.transferComplete) != VK_SUCCESS)
+            {
+               throw std::runtime_error("failed to create upload semaphore!");
+            }
+         }
+      }
+
+      openBatch.ticket = nextTicket++;
+
+      VkCommandBufferBeginInfo beginInfo ={};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+      vkBeginCommandBuffer(openBatch.commandBuffer, &beginInfo);
+
+      hasOpenBatch = true;
+
+      return openBatch;
+   }
+
+   uint64_t UploadManager::submitOpenBatch()
+   {
+      if(separateTransferQueue)
+      {
+         submitOwnershipTransfer();
+      }
+      else
+      {
+         if(openBatch.bufferCopyCount > 0)
+         {
+            // make the buffer copies visible to everything that could read from them in later submits
+            VkMemoryBarrier barrier ={};
+            barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(
+               openBatch.commandBuffer,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+               0,
+               1, &barrier,
+               0, nullptr,
+               0, nullptr);
+         }
+
+         vkEndCommandBuffer(openBatch.commandBuffer);
+
+         VkSubmitInfo submitInfo ={};
+         submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+         submitInfo.commandBufferCount = 1;
+         submitInfo.pCommandBuffers    = &openBatch.commandBuffer;
+
+         VkResult result;
+         {
+            std::lock_guard<std::mutex> lock(vulkanDevice->queueMutex);
+            result = vkQueueSubmit(vulkanDevice->graphicsQueue, 1, &submitInfo, openBatch.fence);
+         }
+
+         if(result != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to submit upload command buffer!");
+         }
+      }
+
+      submitCount++;
+
+      openBatch.stagingEnd = stagingHead;
+      inFlight.push_back(openBatch);
+      hasOpenBatch = false;
+
+      return inFlight.back().ticket;
+   }
+
+   void UploadManager::submitOwnershipTransfer()
+   {
+      // release on the transfer queue. dstStageMask/dstAccessMask are ignored for a release.
+      for(auto& barrier : openBatch.bufferOwnershipBarriers)
+      {
+         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+         barrier.dstAccessMask = 0;
+      }
+      for(auto& barrier : openBatch.imageOwnershipBarriers)
+      {
+         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+         barrier.dstAccessMask = 0;
+      }
+
+      // the images that still need their mipmaps are handed over as they are, in TRANSFER_DST
+      std::vector<VkImageMemoryBarrier> mipmapBarriers;
+
+      for(const auto& blit : openBatch.mipmapBlits)
+      {
+         VkImageMemoryBarrier barrier = getImageBarrier(blit.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+         barrier.srcQueueFamilyIndex = transferFamily;
+         barrier.dstQueueFamilyIndex = graphicsFamily;
+         barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+         barrier.dstAccessMask       = 0;
+
+         mipmapBarriers.push_back(barrier);
+      }
+
+      vkCmdPipelineBarrier(
+         openBatch.commandBuffer,
+         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+         0,
+         0, nullptr,
+         static_cast<uint32_t>(openBatch.bufferOwnershipBarriers.size()), openBatch.bufferOwnershipBarriers.data(),
+         static_cast<uint32_t>(openBatch.imageOwnershipBarriers.size()), openBatch.imageOwnershipBarriers.data());
+
+      if(!mipmapBarriers.empty())
+      {
+         vkCmdPipelineBarrier(
+            openBatch.commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(mipmapBarriers.size()), mipmapBarriers.data());
+      }
+
+      vkEndCommandBuffer(openBatch.commandBuffer);
+
+      VkSubmitInfo submitInfo ={};
+      submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount   = 1;
+      submitInfo.pCommandBuffers      = &openBatch.commandBuffer;
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores    = &openBatch.transferComplete;
+
+      VkResult result;
+      {
+         std::lock_guard<std::mutex> lock(vulkanDevice->queueMutex);
+         result = vkQueueSubmit(vulkanDevice->transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+      }
+
+      if(result != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to submit upload command buffer!");
+      }
+
+      // acquire on the graphics queue, the barriers have to match the release ones (including the layouts).
+      // srcStageMask/srcAccessMask are ignored for an acquire, the semaphore takes care of the ordering.
+      for(auto& barrier : openBatch.bufferOwnershipBarriers)
+      {
+         barrier.srcAccessMask = 0;
+         barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+      }
+      for(auto& barrier : openBatch.imageOwnershipBarriers)
+      {
+         barrier.srcAccessMask = 0;
+         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      }
+
+      for(auto& barrier : mipmapBarriers)
+      {
+         barrier.srcAccessMask = 0;
+         barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+      }
+
+      VkCommandBufferBeginInfo beginInfo ={};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+      vkBeginCommandBuffer(openBatch.acquireCommandBuffer, &beginInfo);
+
+      vkCmdPipelineBarrier(
+         openBatch.acquireCommandBuffer,
+         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+         0,
+         0, nullptr,
+         static_cast<uint32_t>(openBatch.bufferOwnershipBarriers.size()), openBatch.bufferOwnershipBarriers.data(),
+         static_cast<uint32_t>(openBatch.imageOwnershipBarriers.size()), openBatch.imageOwnershipBarriers.data());
+
+      if(!mipmapBarriers.empty())
+      {
+         vkCmdPipelineBarrier(
+            openBatch.acquireCommandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(mipmapBarriers.size()), mipmapBarriers.data());
+
+         for(const auto& blit : openBatch.mipmapBlits)
+         {
+            recordMipmapBlits(openBatch.acquireCommandBuffer, blit);
+         }
+      }
+
+      vkEndCommandBuffer(openBatch.acquireCommandBuffer);
+
+      VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+      VkSubmitInfo acquireInfo ={};
+      acquireInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      acquireInfo.waitSemaphoreCount = 1;
+      acquireInfo.pWaitSemaphores    = &openBatch.transferComplete;
+      acquireInfo.pWaitDstStageMask  = &waitStage;
+      acquireInfo.commandBufferCount = 1;
+      acquireInfo.pCommandBuffers    = &openBatch.acquireCommandBuffer;
+
+      // the fence is on the acquire, a batch is not done before the graphics queue owns the resources
+      {
+         std::lock_guard<std::mutex> lock(vulkanDevice->queueMutex);
+         result = vkQueueSubmit(vulkanDevice->graphicsQueue, 1, &acquireInfo, openBatch.fence);
+      }
+
+      if(result != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to submit upload acquire command buffer!");
+      }
+   }
+
+   UploadManager::Batch& UploadManager::recordImageCopy(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize* levelSizes, const void* data)
+   {
+      VkDeviceSize size = 0;
+      for(uint32_t level = 0; level < mipLevels; level++)
+      {
+         size += levelSizes[level];
+      }
+
+      VkBuffer srcBuffer;
+      VkDeviceSize srcOffset;
+      copyToStaging(data, size, &srcBuffer, &srcOffset);
+
+      Batch& batch = getOpenBatch();
+
+      VkImageMemoryBarrier barrier = getImageBarrier(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+      vkCmdPipelineBarrier(
+         batch.commandBuffer,
+         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+         0,
+         0, nullptr,
+         0, nullptr,
+         1, &barrier);
+
+      // one region per level, the levels are one after the other in the data
+      std::vector<VkBufferImageCopy> regions(mipLevels);
+
+      for(uint32_t level = 0; level < mipLevels; level++)
+      {
+         VkBufferImageCopy& region = regions[level];
+         region.bufferOffset      = srcOffset;
+         region.bufferRowLength   = 0;
+         region.bufferImageHeight = 0;
+
+         region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+         region.imageSubresource.mipLevel       = level;
+         region.imageSubresource.baseArrayLayer = 0;
+         region.imageSubresource.layerCount     = 1;
+
+         // always a whole mip level, so minImageTransferGranularity of transfer only families is never a problem
+         region.imageOffset ={ 0, 0, 0 };
+         region.imageExtent ={ std::max(width >> level, 1u), std::max(height >> level, 1u), 1 };
+
+         srcOffset += levelSizes[level];
+      }
+
+      vkCmdCopyBufferToImage(
+         batch.commandBuffer,
+         srcBuffer,
+         image,
+         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+         mipLevels,
+         regions.data());
+
+      batch.imageCopyCount++;
+
+      return batch;
+   }
+
+   void UploadManager::recordMipmapBlits(VkCommandBuffer commandBuffer, const MipmapBlit& blit)
+   {
+      // every level is blitted from the one before, which is moved to TRANSFER_SRC for it and is done after that
+      VkImageMemoryBarrier barrier = getImageBarrier(blit.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+      barrier.subresourceRange.levelCount = 1;
+
+      int32_t width  = static_cast<int32_t>(blit.width);
+      int32_t height = static_cast<int32_t>(blit.height);
+
+      for(uint32_t level = 1; level < blit.mipLevels; level++)
+      {
+         barrier.subresourceRange.baseMipLevel = level - 1;
+         barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+         barrier.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+         barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+         vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+         int32_t nextWidth  = std::max(width / 2, 1);
+         int32_t nextHeight = std::max(height / 2, 1);
+
+         VkImageBlit region ={};
+         region.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+         region.srcSubresource.mipLevel       = level - 1;
+         region.srcSubresource.baseArrayLayer = 0;
+         region.srcSubresource.layerCount     = 1;
+         region.srcOffsets[1]                 ={ width, height, 1 };
+         region.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+         region.dstSubresource.mipLevel       = level;
+         region.dstSubresource.baseArrayLayer = 0;
+         region.dstSubresource.layerCount     = 1;
+         region.dstOffsets[1]                 ={ nextWidth, nextHeight, 1 };
+
+         vkCmdBlitImage(
+            commandBuffer,
+            blit.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            blit.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &region,
+            VK_FILTER_LINEAR);
+
+         barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+         barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+         barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+         vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+         width  = nextWidth;
+         height = nextHeight;
+      }
+
+      // the last level was only written to
+      barrier.subresourceRange.baseMipLevel = blit.mipLevels - 1;
+      barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+      vkCmdPipelineBarrier(
+         commandBuffer,
+         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+         0,
+         0, nullptr,
+         0, nullptr,
+         1, &barrier);
+   }
+
+   VkImageMemoryBarrier UploadManager::getImageBarrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
+   {
+      VkImageMemoryBarrier barrier ={};
+      barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.oldLayout                       = oldLayout;
+      barrier.newLayout                       = newLayout;
+      barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image                           = image;
+      barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+      barrier.subresourceRange.baseMipLevel   = 0;
+      barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
+      barrier.subresourceRange.baseArrayLayer = 0;
+      barrier.subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+      return barrier;
+   }
+
+   void UploadManager::retire(bool waitForOldest)
+   {
+      if(waitForOldest && !inFlight.empty())
+      {
+         vkWaitForFences(vulkanDevice->device, 1, &inFlight.front().fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+      }
+
+      while(!inFlight.empty() && vkGetFenceStatus(vulkanDevice->device, inFlight.front().fence) == VK_SUCCESS)
+      {
+         retireBatch(inFlight.front());
+         inFlight.pop_front();
+      }
+   }
+
+   void UploadManager::retireBatch(Batch& batch)
+   {
+      stagingTail = batch.stagingEnd;
+
+      for(size_t i = 0; i < batch.temporaryBuffers.size(); i++)
+      {
+         vulkanDevice->destroyBuffer(batch.temporaryBuffers[i], batch.temporaryMemory[i]);
+      }
+      batch.temporaryBuffers.clear();
+      batch.temporaryMemory.clear();
+
+      batch.bufferCopyCount = 0;
+      batch.imageCopyCount  = 0;
+
+      batch.bufferOwnershipBarriers.clear();
+      batch.imageOwnershipBarriers.clear();
+      batch.mipmapBlits.clear();
+
+      vkResetFences(vulkanDevice->device, 1, &batch.fence);
+      vkResetCommandBuffer(batch.commandBuffer, 0);
+
+      if(batch.acquireCommandBuffer != VK_NULL_HANDLE)
+      {
+         vkResetCommandBuffer(batch.acquireCommandBuffer, 0);
+      }
+
+      freeBatches.push_back(batch);
+   }
+}
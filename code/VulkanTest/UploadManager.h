@@ -0,0 +1,147 @@
+#pragma once
+
+// Batches buffer and image uploads into as few submits as possible.
+//
+// Data is copied into a persistently mapped staging ring right away, so the caller can free its memory as soon
+// as the upload call returns. The copy commands are recorded into the current batch, which is submitted when
+// flush() is called or when the staging ring runs full. Every batch has a fence, so staging space is reused as
+// soon as the GPU is done with it, without ever calling vkQueueWaitIdle.
+//
+// Each upload returns a ticket (the id of the batch it went into) that can be polled with isComplete() or waited
+// for with wait().
+//
+// When the device has a separate transfer family the copies run on the transfer queue, so they don't compete with
+// rendering. The resources are then released from the transfer family and acquired by the graphics family in a small
+// command buffer submitted to the graphics queue, waiting on a semaphore signalled by the transfer submit. Without a
+// transfer family everything is submitted on the graphics queue. Either way the resources are ready for any draw
+// submitted after flush(), the renderer does not have to wait for them.
+
+#include "VulkanDevice.hpp"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+   class UploadManager
+   {
+   public:
+      void init(VulkanDevice* vulkanDevice, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+      void destroy();
+
+      uint64_t uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+      // transitions the whole image to TRANSFER_DST, copies the data to the first mipLevels levels and transitions it to
+      // SHADER_READ_ONLY. the levels are one after the other in data, levelSizes has the size of each
+      uint64_t uploadImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize* levelSizes, const void* data);
+
+      // copies the data to mip level 0 and blits every other level from the one before on the GPU. the format has to
+      // support BLIT_SRC, BLIT_DST and linear filtering, and the image needs TRANSFER_SRC usage. with a separate transfer
+      // queue the blits are recorded on the graphics queue, after the acquire
+      uint64_t uploadImageAndBlitMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const void* data, VkDeviceSize size);
+
+      // submits the current batch, returns its ticket
+      uint64_t flush();
+
+      bool isComplete(uint64_t ticket);
+      void wait(uint64_t ticket);
+      void waitIdle();
+
+      // retires finished batches, call once per frame
+      void update();
+
+      uint64_t getSubmitCount()
+      {
+         return submitCount;
+      }
+
+   private:
+
+      static const VkDeviceSize DEFAULT_STAGING_SIZE = 32 * 1024 * 1024;
+
+      // an image that gets its mipmaps blitted after the copy
+      struct MipmapBlit
+      {
+         VkImage image;
+         uint32_t width;
+         uint32_t height;
+         uint32_t mipLevels;
+      };
+
+      struct Batch
+      {
+         uint64_t ticket = 0;
+         VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+         VkFence fence = VK_NULL_HANDLE;
+
+         // only used with a separate transfer queue
+         VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+         VkSemaphore transferComplete = VK_NULL_HANDLE;
+         std::vector<VkBufferMemoryBarrier> bufferOwnershipBarriers;
+         std::vector<VkImageMemoryBarrier> imageOwnershipBarriers;
+         std::vector<MipmapBlit> mipmapBlits;
+
+         // end of this batch in the staging ring, everything before it can be reused when the batch is done
+         uint64_t stagingEnd = 0;
+
+         uint32_t bufferCopyCount = 0;
+         uint32_t imageCopyCount = 0;
+
+         // uploads larger than the whole staging ring get their own staging buffer
+         std::vector<VkBuffer> temporaryBuffers;
+         std::vector<Allocation> temporaryMemory;
+      };
+
+      VulkanDevice* vulkanDevice = nullptr;
+
+      std::mutex mutex;
+
+      VkCommandPool commandPool = VK_NULL_HANDLE;
+
+      // graphics family pool for the acquire command buffers
+      VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+
+      bool separateTransferQueue = false;
+      uint32_t transferFamily = 0;
+      uint32_t graphicsFamily = 0;
+
+      VkBuffer stagingBuffer = VK_NULL_HANDLE;
+      Allocation stagingMemory;
+      VkDeviceSize stagingSize = 0;
+      VkDeviceSize stagingAlignment = 16;
+
+      // positions in the ring only ever grow, the offset in the buffer is position % stagingSize
+      uint64_t stagingHead = 0;
+      uint64_t stagingTail = 0;
+
+      bool hasOpenBatch = false;
+      Batch openBatch;
+      std::deque<Batch> inFlight;
+      std::vector<Batch> freeBatches;
+
+      uint64_t nextTicket = 1;
+      uint64_t submitCount = 0;
+
+      // returns the offset in the staging buffer, the data can be written to stagingMemory.mapped + offset
+      VkDeviceSize reserveStaging(VkDeviceSize size);
+
+      void copyToStaging(const void* data, VkDeviceSize size, VkBuffer* srcBuffer, VkDeviceSize* srcOffset);
+
+      // copies the levels to the image in the open batch, leaves the whole image in TRANSFER_DST
+      Batch& recordImageCopy(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize* levelSizes, const void* data);
+
+      // all levels have to be in TRANSFER_DST, level 0 filled in. leaves them in SHADER_READ_ONLY
+      void recordMipmapBlits(VkCommandBuffer commandBuffer, const MipmapBlit& blit);
+
+      // for all levels and layers, without access masks
+      static VkImageMemoryBarrier getImageBarrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+      Batch& getOpenBatch();
+      uint64_t submitOpenBatch();
+      void submitOwnershipTransfer();
+
+      void retire(bool waitForOldest);
+      void retireBatch(Batch& batch);
+   };
+}
@@ -0,0 +1,245 @@
+#include "VertexWelder.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+   inline uint64_t rotateLeft(uint64_t value, int bits)
+   {
+      return (value << bits) | (value >> (64 - bits));
+   }
+
+   // the slot count for a table that stays below 3/4 full with this many vertices
+   size_t slotsFor(size_t numberOfVertices)
+   {
+      size_t slots = 16;
+      while(slots * 3 < numberOfVertices * 4 + 4)
+      {
+         slots *= 2;
+      }
+      return slots;
+   }
+
+   template<typename Function>
+   void runOnThreads(uint32_t numberOfThreads, Function function)
+   {
+      std::vector<std::thread> threads;
+      for(uint32_t i = 1; i < numberOfThreads; i++)
+      {
+         threads.emplace_back(function, i);
+      }
+
+      function(0);
+
+      for(auto& thread : threads)
+      {
+         thread.join();
+      }
+   }
+}
+
+uint64_t VertexWelder::hash(const Vertex& vertex)
+{
+   static_assert(sizeof(Vertex) == 8 * sizeof(float), "VertexWelder::hash expects 8 floats per vertex");
+
+   // + 0.0f turns -0 into 0, they compare equal so they have to hash the same
+   const float components[8] =
+   {
+      vertex.position.x + 0.0f, vertex.position.y + 0.0f, vertex.position.z + 0.0f,
+      vertex.colour.x + 0.0f, vertex.colour.y + 0.0f, vertex.colour.z + 0.0f,
+      vertex.texCoord.x + 0.0f, vertex.texCoord.y + 0.0f
+   };
+
+   uint64_t words[4];
+   memcpy(words, components, sizeof(words));
+
+   uint64_t result = 0x9E3779B97F4A7C15ull;
+   for(uint64_t word : words)
+   {
+      result ^= word * 0x87C37B91114253D5ull;
+      result = rotateLeft(result, 31) * 0x4CF5AD432745937Full;
+   }
+
+   // splitmix64 finalizer, so every bit of the input affects the low bits used for the slot
+   result ^= result >> 30;
+   result *= 0xBF58476D1CE4E5B9ull;
+   result ^= result >> 27;
+   result *= 0x94D049BB133111EBull;
+   result ^= result >> 31;
+
+   return result;
+}
+
+void VertexWelder::reserve(size_t numberOfVertices)
+{
+   vertices.reserve(numberOfVertices);
+
+   size_t numberOfSlots = slotsFor(numberOfVertices);
+   if(numberOfSlots > slots.size())
+   {
+      resize(numberOfSlots);
+   }
+}
+
+uint32_t VertexWelder::insert(const Vertex& vertex, uint64_t hash)
+{
+   if(slots.empty() || (vertices.size() + 1) * 4 > slots.size() * 3)
+   {
+      resize(std::max<size_t>(slots.size() * 2, 16));
+   }
+
+   uint32_t tag = static_cast<uint32_t>(hash >> 32);
+   size_t slot  = static_cast<size_t>(hash) & mask;
+
+   for(;;)
+   {
+      Slot& current = slots[slot];
+
+      if(current.index == EMPTY)
+      {
+         current.hash  = tag;
+         current.index = static_cast<uint32_t>(vertices.size());
+
+         vertices.push_back(vertex);
+
+         return current.index;
+      }
+
+      if(current.hash == tag && vertices[current.index] == vertex)
+      {
+         return current.index;
+      }
+
+      slot = (slot + 1) & mask;
+   }
+}
+
+void VertexWelder::resize(size_t numberOfSlots)
+{
+   std::vector<Slot> oldSlots(numberOfSlots, Slot{ 0, EMPTY });
+   oldSlots.swap(slots);
+
+   mask = numberOfSlots - 1;
+
+   for(const Slot& oldSlot : oldSlots)
+   {
+      if(oldSlot.index == EMPTY)
+      {
+         continue;
+      }
+
+      // only the top half of the hash is stored, so the slot has to come from the vertex again
+      size_t slot = static_cast<size_t>(hash(vertices[oldSlot.index])) & mask;
+      while(slots[slot].index != EMPTY)
+      {
+         slot = (slot + 1) & mask;
+      }
+
+      slots[slot] = oldSlot;
+   }
+}
+
+void VertexWelder::weld(
+   const Vertex* corners,
+   size_t count,
+   std::vector<Vertex>& vertices,
+   std::vector<uint32_t>& indices,
+   uint32_t numberOfThreads)
+{
+   if(numberOfThreads == 0)
+   {
+      numberOfThreads = std::max(std::thread::hardware_concurrency(), 1u);
+   }
+
+   indices.resize(count);
+
+   // not worth starting threads for
+   if(numberOfThreads == 1 || count < 64 * 1024)
+   {
+      VertexWelder welder;
+      welder.reserve(count);
+
+      for(size_t i = 0; i < count; i++)
+      {
+         indices[i] = welder.insert(corners[i]);
+      }
+
+      vertices.swap(welder.vertices);
+      return;
+   }
+
+   // power of two shards, so the shard is just the top bits of the hash
+   uint32_t shardBits = 0;
+   while((1u << shardBits) < numberOfThreads)
+   {
+      shardBits++;
+   }
+   uint32_t numberOfShards = 1u << shardBits;
+
+   auto shardOf = [shardBits](uint64_t hash) -> uint32_t
+   {
+      return shardBits == 0 ? 0 : static_cast<uint32_t>(hash >> (64 - shardBits));
+   };
+
+   std::vector<uint64_t> hashes(count);
+
+   // hash every corner once
+   runOnThreads(numberOfThreads, [&](uint32_t thread)
+   {
+      size_t begin = count * thread / numberOfThreads;
+      size_t end   = count * (thread + 1) / numberOfThreads;
+
+      for(size_t i = begin; i < end; i++)
+      {
+         hashes[i] = hash(corners[i]);
+      }
+   });
+
+   // every thread welds its own shards, indices holds the index within the shard for now
+   std::vector<VertexWelder> shards(numberOfShards);
+
+   runOnThreads(numberOfThreads, [&](uint32_t thread)
+   {
+      for(uint32_t shard = thread; shard < numberOfShards; shard += numberOfThreads)
+      {
+         VertexWelder& welder = shards[shard];
+         welder.reserve(count / numberOfShards + count / (numberOfShards * 8));
+
+         for(size_t i = 0; i < count; i++)
+         {
+            if(shardOf(hashes[i]) == shard)
+            {
+               indices[i] = welder.insert(corners[i], hashes[i]);
+            }
+         }
+      }
+   });
+
+   std::vector<uint32_t> shardOffsets(numberOfShards);
+
+   size_t numberOfVertices = 0;
+   for(uint32_t shard = 0; shard < numberOfShards; shard++)
+   {
+      shardOffsets[shard] = static_cast<uint32_t>(numberOfVertices);
+      numberOfVertices += shards[shard].vertices.size();
+   }
+
+   vertices.resize(numberOfVertices);
+
+   runOnThreads(numberOfThreads, [&](uint32_t thread)
+   {
+      for(uint32_t shard = thread; shard < numberOfShards; shard += numberOfThreads)
+      {
+         std::copy(shards[shard].vertices.begin(), shards[shard].vertices.end(), vertices.begin() + shardOffsets[shard]);
+      }
+
+      size_t begin = count * thread / numberOfThreads;
+      size_t end   = count * (thread + 1) / numberOfThreads;
+
+      for(size_t i = begin; i < end; i++)
+      {
+         indices[i] += shardOffsets[shardOf(hashes[i])];
+      }
+   });
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Merges identical vertices, used when building the index buffer of a mesh.
+//
+// Flat open addressing table (linear probing) of { hash, vertex index } slots, so there is no allocation per vertex
+// and most mismatches are rejected on the stored hash without touching the vertex. Vertices compare with
+// Vertex::operator==, like the std::unordered_map it replaces.
+//
+// weld() can split the work over several threads: every corner is hashed once, the top bits of the hash pick a
+// shard, and each thread welds the corners of its own shards into its own table. The vertices end up grouped by
+// shard, so the order differs from the single threaded version, but the result is deterministic.
+
+#include "stdafx.h"
+
+class VertexWelder
+{
+public:
+   // the table is sized so it doesn't have to grow if every vertex is unique
+   void reserve(size_t numberOfVertices);
+
+   // returns the index of the vertex, adds it if it's not in the table yet
+   uint32_t insert(const Vertex& vertex)
+   {
+      return insert(vertex, hash(vertex));
+   }
+
+   const std::vector<Vertex>& getVertices() const
+   {
+      return vertices;
+   }
+
+   std::vector<Vertex>& getVertices()
+   {
+      return vertices;
+   }
+
+   // welds count corners into vertices and one index per corner. 0 threads = one per hardware thread.
+   static void weld(
+      const Vertex* corners,
+      size_t count,
+      std::vector<Vertex>& vertices,
+      std::vector<uint32_t>& indices,
+      uint32_t numberOfThreads = 1);
+
+   static uint64_t hash(const Vertex& vertex);
+
+private:
+
+   struct Slot
+   {
+      uint32_t hash;
+      uint32_t index;
+   };
+
+   static const uint32_t EMPTY = ~0u;
+
+   std::vector<Slot> slots;
+   size_t mask = 0;
+
+   std::vector<Vertex> vertices;
+
+   uint32_t insert(const Vertex& vertex, uint64_t hash);
+
+   void resize(size_t numberOfSlots);
+};
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
 #include <set>
 
-#include "vulkan\vulkan.h"
+#include "vulkan/vulkan.h"
+
+#include "SamplerCache.h"
+#include "VulkanMemoryAllocator.h"
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -13,6 +17,8 @@ const bool enableValidationLayers = true;
 
 namespace vks
 {
+   class UploadManager;
+
    const std::vector<const char*> deviceExtensions =
    {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -27,6 +33,11 @@ namespace vks
    {
       int graphicsFamily = -1;
       int presentFamily = -1;
+
+      // a family without graphics (and preferably without compute), i.e. the DMA engine. -1 if there is none,
+      // uploads go through the graphics queue then.
+      int transferFamily = -1;
+
       bool isComplete()
       {
          return graphicsFamily >= 0 && presentFamily >= 0;
@@ -42,7 +53,8 @@ namespace vks
       // TODO: find out best practice of how to handle instance...
       VkInstance instance;
 
-      VkSurfaceKHR surface;
+      // VK_NULL_HANDLE when running headless, no presentation will happen then.
+      VkSurfaceKHR surface = VK_NULL_HANDLE;
 
       VkPhysicalDeviceProperties deviceProperties;
 
@@ -53,6 +65,24 @@ namespace vks
       VkQueue graphicsQueue;
       VkQueue presentQueue;
 
+      // same as graphicsQueue if there is no separate transfer family
+      VkQueue transferQueue;
+
+      QueueFamilyIndices queueFamilyIndices;
+
+      // queues are externally synchronized, lock this around every vkQueueSubmit, vkQueuePresentKHR,
+      // vkQueueWaitIdle and vkDeviceWaitIdle. Uploads are submitted from the asset loader thread.
+      std::mutex queueMutex;
+
+      // all buffers and images should get their memory from here
+      MemoryAllocator memoryAllocator;
+
+      // all samplers should come from here, textures with the same sampler state share one
+      SamplerCache samplerCache;
+
+      // owned by the application, use this for all buffer and image uploads
+      UploadManager* uploadManager = nullptr;
+
       void createLogicalDevice()
       {
          QueueFamilyIndices indices = findQueueFamilies();
@@ -64,6 +94,11 @@ namespace vks
             indices.presentFamily
          };
 
+         if(indices.transferFamily >= 0)
+         {
+            uniqueQueueFamilies.insert(indices.transferFamily);
+         }
+
          float queuePriority = 1.0f;
          for(int queueFamily : uniqueQueueFamilies)
          {
@@ -77,16 +112,32 @@ namespace vks
             queueCreateInfos.push_back(queueCreateInfo);
          }
 
-         VkPhysicalDeviceFeatures deviceFeatures ={};
-         deviceFeatures.samplerAnisotropy = VK_TRUE;
+         VkPhysicalDeviceFeatures enabledFeatures ={};
+         enabledFeatures.samplerAnisotropy = VK_TRUE;
+
+         // indirect draws for GpuCulling, when they are there
+         enabledFeatures.multiDrawIndirect         = deviceFeatures.multiDrawIndirect;
+         enabledFeatures.drawIndirectFirstInstance = deviceFeatures.drawIndirectFirstInstance;
+
+         // block compressed textures, Texture falls back to RGBA8 without it
+         enabledFeatures.textureCompressionBC = deviceFeatures.textureCompressionBC;
 
          VkDeviceCreateInfo createInfo ={};
          createInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
          createInfo.pQueueCreateInfos       = queueCreateInfos.data();
          createInfo.queueCreateInfoCount    = static_cast<uint32_t>(queueCreateInfos.size());
-         createInfo.pEnabledFeatures        = &deviceFeatures;
-         createInfo.enabledExtensionCount   = static_cast<uint32_t>(deviceExtensions.size());
-         createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+         createInfo.pEnabledFeatures        = &enabledFeatures;
+
+         // the swapchain extension is only needed (and might only be available) when we present to a surface
+         if(surface != VK_NULL_HANDLE)
+         {
+            createInfo.enabledExtensionCount   = static_cast<uint32_t>(deviceExtensions.size());
+            createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+         }
+         else
+         {
+            createInfo.enabledExtensionCount = 0;
+         }
 
          if(enableValidationLayers)
          {
@@ -106,6 +157,20 @@ namespace vks
          // TODO: here? not sure if I want the queues here or somewhere else... I'll keep them heere for now. 
          vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
          vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+
+         if(indices.transferFamily >= 0)
+         {
+            vkGetDeviceQueue(device, indices.transferFamily, 0, &transferQueue);
+         }
+         else
+         {
+            transferQueue = graphicsQueue;
+         }
+
+         queueFamilyIndices = indices;
+
+         memoryAllocator.init(physicalDevice, device);
+         samplerCache.init(device, deviceProperties.limits.maxSamplerAllocationCount);
       }
 
       QueueFamilyIndices findQueueFamilies()
@@ -121,35 +186,64 @@ namespace vks
          VkBool32 presentSupport = false;
          int i = 0;
 
+         // transfer only families don't count against isComplete, so look through all of them
+         bool transferHasCompute = true;
+
          for(const auto& queueFamily : queueFamilies)
          {
             // this should be moved too code related to swapchain, creation of present surface.
-            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-
-            if(queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            if(surface != VK_NULL_HANDLE)
             {
-               indices.graphicsFamily = i;
+               vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
             }
-            if(queueFamily.queueCount > 0 && presentSupport)
+
+            if(!indices.isComplete())
             {
-               indices.presentFamily = i;
+               if(queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+               {
+                  indices.graphicsFamily = i;
+
+                  // headless, nothing is presented. Use the graphics queue so the present queue is still valid.
+                  if(surface == VK_NULL_HANDLE)
+                  {
+                     indices.presentFamily = i;
+                  }
+               }
+               if(queueFamily.queueCount > 0 && presentSupport)
+               {
+                  indices.presentFamily = i;
+               }
             }
-            if(indices.isComplete())
+
+            // prefer a pure transfer family (DMA engine) over an async compute family
+            if(queueFamily.queueCount > 0 &&
+               queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+               !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
             {
-               break;
+               bool hasCompute = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+
+               if(indices.transferFamily < 0 || (transferHasCompute && !hasCompute))
+               {
+                  indices.transferFamily = i;
+                  transferHasCompute     = hasCompute;
+               }
             }
+
             i++;
          }
 
          return indices;
       }
 
+      // the memory is sub-allocated, so use allocation.offset / allocation.mapped and destroy with destroyBuffer.
+      // staging and other short lived buffers should use AllocationStrategy::Linear
       void createBuffer(
          VkDeviceSize size,
          VkBufferUsageFlags usage,
          VkMemoryPropertyFlags properties,
          VkBuffer *buffer,
-         VkDeviceMemory *bufferMemory)
+         Allocation *allocation,
+         AllocationStrategy strategy = AllocationStrategy::Buddy)
       {
          // use vkn::inits::bufferCreateInfo()
          VkBufferCreateInfo bufferInfo ={};
@@ -163,23 +257,19 @@ namespace vks
             throw std::runtime_error("failed to create buffer!");
          }
 
-         VkMemoryRequirements memoryRequirements;
-         vkGetBufferMemoryRequirements(device, *buffer, &memoryRequirements);
-
-         VkMemoryAllocateInfo allocateInfo ={};
-         allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-         allocateInfo.allocationSize  = memoryRequirements.size;
-         allocateInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties);
+         *allocation = memoryAllocator.allocateBuffer(*buffer, properties, strategy);
+      }
 
-         if(vkAllocateMemory(device, &allocateInfo, nullptr, bufferMemory) != VK_SUCCESS)
-         {
-            throw std::runtime_error("failed to allocate buffer memory!");
-         }
+      void destroyBuffer(VkBuffer buffer, Allocation& allocation)
+      {
+         vkDestroyBuffer(device, buffer, nullptr);
+         memoryAllocator.free(allocation);
+      }
 
-         if(vkBindBufferMemory(device, *buffer, *bufferMemory, 0) != VK_SUCCESS)
-         {
-            throw std::runtime_error("failed to bind buffer memory!");
-         }
+      void destroyImage(VkImage image, Allocation& allocation)
+      {
+         vkDestroyImage(device, image, nullptr);
+         memoryAllocator.free(allocation);
       }
 
       uint32_t findMemoryType(uint32_t typeFiter, VkMemoryPropertyFlags properties)
@@ -243,9 +333,13 @@ namespace vks
          submitInfo.commandBufferCount = 1;
          submitInfo.pCommandBuffers    = &commandBuffer;
 
-         vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+         {
+            std::lock_guard<std::mutex> lock(queueMutex);
 
-         vkQueueWaitIdle(queue);
+            vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+
+            vkQueueWaitIdle(queue);
+         }
 
          vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
       }
@@ -0,0 +1,630 @@
+#include "VulkanMemoryAllocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace vks
+{
+   static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+   {
+      return (value + alignment - 1) / alignment * alignment;
+   }
+
+   void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device)
+   {
+      this->device = device;
+
+      vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+      nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+      pools.resize(memoryProperties.memoryTypeCount * 4);
+
+      for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+      {
+         VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+
+         for(uint32_t isImage = 0; isImage < 2; isImage++)
+         {
+            for(AllocationStrategy strategy : { AllocationStrategy::Buddy, AllocationStrategy::Linear })
+            {
+               MemoryPool& pool = pools[getPoolIndex(i, isImage == 1, strategy)];
+               pool.memoryTypeIndex = i;
+               pool.strategy        = strategy;
+               pool.hostVisible     = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+               pool.blockSize       = strategy == AllocationStrategy::Buddy ? DEFAULT_BLOCK_SIZE : DEFAULT_RING_SIZE;
+
+               // small heaps (e.g. the 256MB device local + host visible heap on some AMD cards) should not be eaten by a few blocks.
+               // keep it a power of two so the buddy allocator can split it all the way down.
+               while(pool.blockSize > heapSize / 8 && pool.blockSize > MIN_BUDDY_SIZE * 16)
+               {
+                  pool.blockSize /= 2;
+               }
+            }
+         }
+      }
+   }
+
+   void MemoryAllocator::destroy()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for(auto& pool : pools)
+      {
+         for(auto& block : pool.blocks)
+         {
+            if(block.memory != VK_NULL_HANDLE)
+            {
+               vkFreeMemory(device, block.memory, nullptr);
+            }
+         }
+         pool.blocks.clear();
+      }
+
+      for(auto& dedicated : dedicatedAllocations)
+      {
+         vkFreeMemory(device, dedicated.memory, nullptr);
+      }
+      dedicatedAllocations.clear();
+   }
+
+   Allocation MemoryAllocator::allocate(
+      const VkMemoryRequirements& memoryRequirements,
+      VkMemoryPropertyFlags properties,
+      bool isImage,
+      AllocationStrategy strategy)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      uint32_t memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties);
+
+      Allocation allocation;
+      allocation.poolIndex = getPoolIndex(memoryTypeIndex, isImage, strategy);
+      allocation.size      = memoryRequirements.size;
+
+      MemoryPool& pool = pools[allocation.poolIndex];
+
+      // big resources would waste most of a block (or not fit at all), give them their own memory.
+      if(memoryRequirements.size > pool.blockSize / 2)
+      {
+         allocation.memory    = allocateDeviceMemory(memoryTypeIndex, memoryRequirements.size, &allocation.mapped);
+         allocation.offset    = 0;
+         allocation.dedicated = true;
+
+         dedicatedAllocations.push_back({ allocation.memory, memoryRequirements.size });
+
+         return allocation;
+      }
+
+      VkDeviceSize offset   = 0;
+      VkDeviceSize reserved = 0;
+      bool found = false;
+
+      for(uint32_t i = 0; i < pool.blocks.size() && !found; i++)
+      {
+         MemoryBlock& block = pool.blocks[i];
+         if(block.memory == VK_NULL_HANDLE)
+         {
+            continue;
+         }
+
+         found = strategy == AllocationStrategy::Buddy ?
+            allocateBuddy(block, memoryRequirements.size, memoryRequirements.alignment, &offset, &reserved) :
+            allocateRing(block, memoryRequirements.size, memoryRequirements.alignment, &offset, &reserved);
+
+         if(found)
+         {
+            allocation.blockIndex = i;
+         }
+      }
+
+      if(!found)
+      {
+         allocation.blockIndex = createBlock(pool);
+         MemoryBlock& block = pool.blocks[allocation.blockIndex];
+
+         found = strategy == AllocationStrategy::Buddy ?
+            allocateBuddy(block, memoryRequirements.size, memoryRequirements.alignment, &offset, &reserved) :
+            allocateRing(block, memoryRequirements.size, memoryRequirements.alignment, &offset, &reserved);
+
+         if(!found)
+         {
+            throw std::runtime_error("failed to sub-allocate memory from a new block!");
+         }
+      }
+
+      MemoryBlock& block = pool.blocks[allocation.blockIndex];
+      block.allocationCount++;
+      block.bytesUsed     += memoryRequirements.size;
+      block.bytesReserved += reserved;
+
+      allocation.memory = block.memory;
+      allocation.offset = offset;
+      allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+
+      return allocation;
+   }
+
+   Allocation MemoryAllocator::allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, AllocationStrategy strategy)
+   {
+      VkMemoryRequirements memoryRequirements;
+      vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+      Allocation allocation = allocate(memoryRequirements, properties, false, strategy);
+
+      if(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to bind buffer memory!");
+      }
+
+      return allocation;
+   }
+
+   Allocation MemoryAllocator::allocateImage(VkImage image, VkMemoryPropertyFlags properties)
+   {
+      VkMemoryRequirements memoryRequirements;
+      vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+      Allocation allocation = allocate(memoryRequirements, properties, true, AllocationStrategy::Buddy);
+
+      if(vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to bind image memory!");
+      }
+
+      return allocation;
+   }
+
+   void MemoryAllocator::free(Allocation& allocation)
+   {
+      if(allocation.memory == VK_NULL_HANDLE)
+      {
+         return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(allocation.dedicated)
+      {
+         vkFreeMemory(device, allocation.memory, nullptr);
+
+         auto it = std::find_if(dedicatedAllocations.begin(), dedicatedAllocations.end(),
+            [&allocation](const DedicatedAllocation& dedicated) { return dedicated.memory == allocation.memory; });
+
+         if(it != dedicatedAllocations.end())
+         {
+            dedicatedAllocations.erase(it);
+         }
+      }
+      else
+      {
+         MemoryPool& pool = pools[allocation.poolIndex];
+         MemoryBlock& block = pool.blocks[allocation.blockIndex];
+
+         VkDeviceSize reserved = pool.strategy == AllocationStrategy::Buddy ?
+            freeBuddy(block, allocation.offset) :
+            freeRing(block, allocation.offset);
+
+         block.allocationCount--;
+         block.bytesUsed     -= allocation.size;
+         block.bytesReserved -= reserved;
+
+         if(block.allocationCount == 0)
+         {
+            releaseBlock(pool, allocation.blockIndex);
+         }
+      }
+
+      allocation = Allocation();
+   }
+
+   void MemoryAllocator::flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+   {
+      VkDeviceSize memorySize = allocation.size;
+      if(!allocation.dedicated)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         memorySize = pools[allocation.poolIndex].blocks[allocation.blockIndex].size;
+      }
+
+      VkDeviceSize start = allocation.offset + offset;
+      VkDeviceSize end   = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : start + size;
+
+      start = start / nonCoherentAtomSize * nonCoherentAtomSize;
+      end   = alignUp(end, nonCoherentAtomSize);
+
+      VkMappedMemoryRange mappedMemoryRange ={};
+      mappedMemoryRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+      mappedMemoryRange.memory = allocation.memory;
+      mappedMemoryRange.offset = start;
+      mappedMemoryRange.size   = end >= memorySize ? VK_WHOLE_SIZE : end - start;
+
+      vkFlushMappedMemoryRanges(device, 1, &mappedMemoryRange);
+   }
+
+   void MemoryAllocator::flush(const Allocation& allocation, const std::vector<MappedRange>& ranges)
+   {
+      if(ranges.empty() || isHostCoherent(allocation))
+      {
+         return;
+      }
+
+      VkDeviceSize memorySize = allocation.size;
+      if(!allocation.dedicated)
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         memorySize = pools[allocation.poolIndex].blocks[allocation.blockIndex].size;
+      }
+
+      std::vector<VkMappedMemoryRange> mappedMemoryRanges;
+
+      for(const auto& range : ranges)
+      {
+         VkDeviceSize start = (allocation.offset + range.offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+         VkDeviceSize end   = std::min(alignUp(allocation.offset + range.offset + range.size, nonCoherentAtomSize), memorySize);
+
+         // touches or overlaps the previous one
+         if(!mappedMemoryRanges.empty() && start <= mappedMemoryRanges.back().offset + mappedMemoryRanges.back().size)
+         {
+            VkMappedMemoryRange& previous = mappedMemoryRanges.back();
+            previous.size = std::max(previous.offset + previous.size, end) - previous.offset;
+            continue;
+         }
+
+         VkMappedMemoryRange mappedMemoryRange ={};
+         mappedMemoryRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+         mappedMemoryRange.memory = allocation.memory;
+         mappedMemoryRange.offset = start;
+         mappedMemoryRange.size   = end - start;
+
+         mappedMemoryRanges.push_back(mappedMemoryRange);
+      }
+
+      vkFlushMappedMemoryRanges(device, static_cast<uint32_t>(mappedMemoryRanges.size()), mappedMemoryRanges.data());
+   }
+
+   bool MemoryAllocator::isHostCoherent(const Allocation& allocation)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      uint32_t memoryTypeIndex = pools[allocation.poolIndex].memoryTypeIndex;
+
+      return (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+   }
+
+   MemoryStats MemoryAllocator::getStats()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      MemoryStats stats;
+
+      VkDeviceSize totalFree   = 0;
+      VkDeviceSize largestFree = 0;
+
+      for(const auto& pool : pools)
+      {
+         for(const auto& block : pool.blocks)
+         {
+            if(block.memory == VK_NULL_HANDLE)
+            {
+               continue;
+            }
+
+            stats.blockCount++;
+            stats.allocationCount += block.allocationCount;
+            stats.bytesAllocated  += block.size;
+            stats.bytesUsed       += block.bytesUsed;
+            stats.bytesReserved   += block.bytesReserved;
+
+            totalFree   += block.size - block.bytesReserved;
+            largestFree += largestFreeRange(pool, block);
+         }
+      }
+
+      for(const auto& dedicated : dedicatedAllocations)
+      {
+         stats.dedicatedAllocationCount++;
+         stats.allocationCount++;
+         stats.bytesAllocated += dedicated.size;
+         stats.bytesUsed      += dedicated.size;
+         stats.bytesReserved  += dedicated.size;
+      }
+
+      // how much of the free memory in each block can not be handed out as one piece
+      if(totalFree > 0)
+      {
+         stats.fragmentation = 1.f - static_cast<float>(largestFree) / static_cast<float>(totalFree);
+      }
+
+      return stats;
+   }
+
+   void MemoryAllocator::printStats()
+   {
+      MemoryStats stats = getStats();
+
+      std::cout
+         << "memory blocks: " << stats.blockCount
+         << ", dedicated: " << stats.dedicatedAllocationCount
+         << ", allocations: " << stats.allocationCount << std::endl
+         << "allocated: " << stats.bytesAllocated / 1024 << " KB"
+         << ", used: " << stats.bytesUsed / 1024 << " KB"
+         << ", reserved: " << stats.bytesReserved / 1024 << " KB"
+         << ", fragmentation: " << stats.fragmentation << std::endl;
+   }
+
+   uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+   {
+      for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+      {
+         if(typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+         {
+            return i;
+         }
+      }
+
+      throw std::runtime_error("failed to find suitable memory type!");
+   }
+
+   VkDeviceMemory MemoryAllocator::allocateDeviceMemory(uint32_t memoryTypeIndex, VkDeviceSize size, void** mapped)
+   {
+      VkMemoryAllocateInfo allocateInfo ={};
+      allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocateInfo.allocationSize  = size;
+      allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+      VkDeviceMemory memory;
+      if(vkAllocateMemory(device, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to allocate device memory!");
+      }
+
+      *mapped = nullptr;
+      if(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+      {
+         if(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to map device memory!");
+         }
+      }
+
+      return memory;
+   }
+
+   uint32_t MemoryAllocator::createBlock(MemoryPool& pool)
+   {
+      uint32_t blockIndex = 0;
+      while(blockIndex < pool.blocks.size() && pool.blocks[blockIndex].memory != VK_NULL_HANDLE)
+      {
+         blockIndex++;
+      }
+
+      if(blockIndex == pool.blocks.size())
+      {
+         pool.blocks.emplace_back();
+      }
+
+      MemoryBlock& block = pool.blocks[blockIndex];
+      block = MemoryBlock();
+      block.size   = pool.blockSize;
+      block.memory = allocateDeviceMemory(pool.memoryTypeIndex, pool.blockSize, &block.mapped);
+
+      if(pool.strategy == AllocationStrategy::Buddy)
+      {
+         while((MIN_BUDDY_SIZE << block.maxOrder) < block.size)
+         {
+            block.maxOrder++;
+         }
+
+         block.freeLists.resize(block.maxOrder + 1);
+         block.freeLists[block.maxOrder].insert(0);
+      }
+
+      return blockIndex;
+   }
+
+   void MemoryAllocator::releaseBlock(MemoryPool& pool, uint32_t blockIndex)
+   {
+      // keep one empty block around, so a single resource that is created and destroyed over
+      // and over again does not allocate and free a whole block each time.
+      for(uint32_t i = 0; i < pool.blocks.size(); i++)
+      {
+         if(i != blockIndex && pool.blocks[i].memory != VK_NULL_HANDLE && pool.blocks[i].allocationCount == 0)
+         {
+            vkFreeMemory(device, pool.blocks[blockIndex].memory, nullptr);
+            pool.blocks[blockIndex] = MemoryBlock();
+            return;
+         }
+      }
+   }
+
+   bool MemoryAllocator::allocateBuddy(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* reserved)
+   {
+      // every node of a given order starts at a multiple of its size, so rounding up to the alignment
+      // (always a power of two) is enough to get a correctly aligned offset.
+      VkDeviceSize needed = std::max(size, alignment);
+
+      uint32_t order = 0;
+      while((MIN_BUDDY_SIZE << order) < needed)
+      {
+         order++;
+      }
+
+      if(order > block.maxOrder)
+      {
+         return false;
+      }
+
+      uint32_t freeOrder = order;
+      while(freeOrder <= block.maxOrder && block.freeLists[freeOrder].empty())
+      {
+         freeOrder++;
+      }
+
+      if(freeOrder > block.maxOrder)
+      {
+         return false;
+      }
+
+      VkDeviceSize nodeOffset = *block.freeLists[freeOrder].begin();
+      block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+      // split down to the wanted size, the upper halves go into the free lists
+      while(freeOrder > order)
+      {
+         freeOrder--;
+         block.freeLists[freeOrder].insert(nodeOffset + (MIN_BUDDY_SIZE << freeOrder));
+      }
+
+      block.allocatedOrder[nodeOffset] = order;
+
+      *offset   = nodeOffset;
+      *reserved = MIN_BUDDY_SIZE << order;
+
+      return true;
+   }
+
+   VkDeviceSize MemoryAllocator::freeBuddy(MemoryBlock& block, VkDeviceSize offset)
+   {
+      auto it = block.allocatedOrder.find(offset);
+      if(it == block.allocatedOrder.end())
+      {
+         throw std::runtime_error("trying to free memory that was not allocated!");
+      }
+
+      uint32_t order = it->second;
+      block.allocatedOrder.erase(it);
+
+      VkDeviceSize reserved = MIN_BUDDY_SIZE << order;
+
+      // merge with the buddy as long as it is free as well
+      while(order < block.maxOrder)
+      {
+         VkDeviceSize buddy = offset ^ (MIN_BUDDY_SIZE << order);
+
+         auto buddyIt = block.freeLists[order].find(buddy);
+         if(buddyIt == block.freeLists[order].end())
+         {
+            break;
+         }
+
+         block.freeLists[order].erase(buddyIt);
+         offset = std::min(offset, buddy);
+         order++;
+      }
+
+      block.freeLists[order].insert(offset);
+
+      return reserved;
+   }
+
+   bool MemoryAllocator::allocateRing(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* reserved)
+   {
+      if(block.ringEntries.empty())
+      {
+         block.head = 0;
+         block.tail = 0;
+      }
+
+      // wrapped means head has gone past the end and started over in front of tail
+      bool wrapped = !block.ringEntries.empty() && block.head <= block.tail;
+
+      VkDeviceSize start = alignUp(block.head, alignment);
+
+      if(!wrapped)
+      {
+         if(start + size <= block.size)
+         {
+            *reserved = start - block.head + size;
+         }
+         else if(size <= block.tail)
+         {
+            // the end of the block is wasted until tail has passed it
+            start     = 0;
+            *reserved = block.size - block.head + size;
+         }
+         else
+         {
+            return false;
+         }
+      }
+      else if(start + size > block.tail)
+      {
+         return false;
+      }
+      else
+      {
+         *reserved = start - block.head + size;
+      }
+
+      block.ringEntries.push_back({ start, *reserved, false });
+      block.head = start + size;
+
+      *offset = start;
+
+      return true;
+   }
+
+   VkDeviceSize MemoryAllocator::freeRing(MemoryBlock& block, VkDeviceSize offset)
+   {
+      auto it = std::find_if(block.ringEntries.begin(), block.ringEntries.end(),
+         [offset](const RingEntry& entry) { return entry.offset == offset && !entry.freed; });
+
+      if(it == block.ringEntries.end())
+      {
+         throw std::runtime_error("trying to free memory that was not allocated!");
+      }
+
+      it->freed = true;
+      VkDeviceSize reserved = it->size;
+
+      // space can only be reclaimed from the oldest allocation onwards
+      while(!block.ringEntries.empty() && block.ringEntries.front().freed)
+      {
+         block.ringEntries.pop_front();
+      }
+
+      if(block.ringEntries.empty())
+      {
+         block.head = 0;
+         block.tail = 0;
+      }
+      else
+      {
+         block.tail = block.ringEntries.front().offset;
+      }
+
+      return reserved;
+   }
+
+   VkDeviceSize MemoryAllocator::largestFreeRange(const MemoryPool& pool, const MemoryBlock& block)
+   {
+      if(pool.strategy == AllocationStrategy::Buddy)
+      {
+         for(int32_t order = static_cast<int32_t>(block.maxOrder); order >= 0; order--)
+         {
+            if(!block.freeLists[order].empty())
+            {
+               return MIN_BUDDY_SIZE << order;
+            }
+         }
+
+         return 0;
+      }
+
+      if(block.ringEntries.empty())
+      {
+         return block.size;
+      }
+
+      if(block.head <= block.tail)
+      {
+         return block.tail - block.head;
+      }
+
+      return std::max(block.size - block.head, block.tail);
+   }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+// Sub-allocates buffers and images from a few large VkDeviceMemory blocks instead of calling
+// vkAllocateMemory for every resource. Drivers only guarantee maxMemoryAllocationCount (often 4096)
+// allocations, and every allocation is a kernel call.
+//
+// There is one pool per memory type and resource kind. Buffers and (optimal tiling) images never share a
+// block, so bufferImageGranularity never has to be taken into account.
+//
+// Long lived resources (meshes, textures, render targets) use a buddy allocator: cheap, no external
+// fragmentation between blocks of the same size and freed neighbours merge back together.
+// Transient resources (staging) use a ring, allocations are handed out in order and the space is
+// reclaimed once the oldest allocation is freed.
+// Requests larger than half a block get their own dedicated VkDeviceMemory.
+//
+// Host visible blocks are mapped once when created and stay mapped, use Allocation::mapped instead
+// of vkMapMemory (mapping the same memory twice is not allowed).
+
+#include "vulkan/vulkan.h"
+
+#include <deque>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace vks
+{
+   enum class AllocationStrategy
+   {
+      Buddy, // long lived resources
+      Linear // transient resources, e.g. staging. freed (roughly) in the order they were allocated
+   };
+
+   struct Allocation
+   {
+      VkDeviceMemory memory = VK_NULL_HANDLE;
+      VkDeviceSize offset   = 0;
+      VkDeviceSize size     = 0;
+
+      // pointer to offset in the persistently mapped block, nullptr if the memory is not host visible
+      void* mapped = nullptr;
+
+      // where the allocation came from, only used by the allocator
+      uint32_t poolIndex  = 0;
+      uint32_t blockIndex = 0;
+      bool dedicated      = false;
+   };
+
+   // a range inside an allocation
+   struct MappedRange
+   {
+      VkDeviceSize offset;
+      VkDeviceSize size;
+   };
+
+   struct MemoryStats
+   {
+      uint32_t blockCount = 0;
+      uint32_t dedicatedAllocationCount = 0;
+      uint32_t allocationCount = 0;
+
+      VkDeviceSize bytesAllocated = 0; // device memory allocated from the driver
+      VkDeviceSize bytesUsed = 0;      // requested by the resources
+      VkDeviceSize bytesReserved = 0;  // bytesUsed + alignment/rounding
+
+      // 0 = all free memory in one piece, close to 1 = free memory spread out in lots of small pieces
+      float fragmentation = 0.f;
+   };
+
+   class MemoryAllocator
+   {
+   public:
+      void init(VkPhysicalDevice physicalDevice, VkDevice device);
+
+      // frees all blocks. Any allocation still alive after this is invalid.
+      void destroy();
+
+      Allocation allocate(
+         const VkMemoryRequirements& memoryRequirements,
+         VkMemoryPropertyFlags properties,
+         bool isImage,
+         AllocationStrategy strategy = AllocationStrategy::Buddy);
+
+      // allocates and binds memory for the resource
+      Allocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, AllocationStrategy strategy = AllocationStrategy::Buddy);
+      Allocation allocateImage(VkImage image, VkMemoryPropertyFlags properties);
+
+      void free(Allocation& allocation);
+
+      // only needed for memory without VK_MEMORY_PROPERTY_HOST_COHERENT_BIT.
+      // the range is expanded to nonCoherentAtomSize as required by the spec.
+      void flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+      // flushes several ranges (sorted by offset) with one call. Ranges that touch after rounding to
+      // nonCoherentAtomSize are merged. Does nothing for coherent memory.
+      void flush(const Allocation& allocation, const std::vector<MappedRange>& ranges);
+
+      bool isHostCoherent(const Allocation& allocation);
+
+      MemoryStats getStats();
+
+      void printStats();
+
+      uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+   private:
+
+      struct RingEntry
+      {
+         VkDeviceSize offset;
+         VkDeviceSize size;
+         bool freed;
+      };
+
+      struct MemoryBlock
+      {
+         VkDeviceMemory memory = VK_NULL_HANDLE;
+         VkDeviceSize size = 0;
+         void* mapped = nullptr;
+
+         uint32_t allocationCount = 0;
+         VkDeviceSize bytesUsed = 0;
+         VkDeviceSize bytesReserved = 0;
+
+         // buddy, one free list per order. order 0 is MIN_BUDDY_SIZE, maxOrder the whole block.
+         uint32_t maxOrder = 0;
+         std::vector<std::set<VkDeviceSize>> freeLists;
+         std::unordered_map<VkDeviceSize, uint32_t> allocatedOrder;
+
+         // ring
+         VkDeviceSize head = 0;
+         VkDeviceSize tail = 0;
+         std::deque<RingEntry> ringEntries;
+      };
+
+      struct MemoryPool
+      {
+         uint32_t memoryTypeIndex = 0;
+         AllocationStrategy strategy = AllocationStrategy::Buddy;
+         VkDeviceSize blockSize = 0;
+         bool hostVisible = false;
+         std::vector<MemoryBlock> blocks;
+      };
+
+      static const VkDeviceSize MIN_BUDDY_SIZE = 256;
+      static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+      static const VkDeviceSize DEFAULT_RING_SIZE = 16 * 1024 * 1024;
+
+      VkDevice device = VK_NULL_HANDLE;
+      VkPhysicalDeviceMemoryProperties memoryProperties;
+      VkDeviceSize nonCoherentAtomSize = 1;
+
+      std::mutex mutex;
+
+      // index = (memoryTypeIndex * 2 + isImage) * 2 + strategy
+      std::vector<MemoryPool> pools;
+
+      struct DedicatedAllocation
+      {
+         VkDeviceMemory memory;
+         VkDeviceSize size;
+      };
+      std::vector<DedicatedAllocation> dedicatedAllocations;
+
+      uint32_t getPoolIndex(uint32_t memoryTypeIndex, bool isImage, AllocationStrategy strategy)
+      {
+         return (memoryTypeIndex * 2 + (isImage ? 1 : 0)) * 2 + (strategy == AllocationStrategy::Linear ? 1 : 0);
+      }
+
+      VkDeviceMemory allocateDeviceMemory(uint32_t memoryTypeIndex, VkDeviceSize size, void** mapped);
+
+      uint32_t createBlock(MemoryPool& pool);
+      void releaseBlock(MemoryPool& pool, uint32_t blockIndex);
+
+      // these return/take the number of bytes actually reserved in the block
+      bool allocateBuddy(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* reserved);
+      VkDeviceSize freeBuddy(MemoryBlock& block, VkDeviceSize offset);
+
+      bool allocateRing(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* reserved);
+      VkDeviceSize freeRing(MemoryBlock& block, VkDeviceSize offset);
+
+      VkDeviceSize largestFreeRange(const MemoryPool& pool, const MemoryBlock& block);
+   };
+}
@@ -5,7 +5,8 @@ enum ShaderType
 {
 	VERTEX		= VK_SHADER_STAGE_VERTEX_BIT,
 	FRAGMENT	= VK_SHADER_STAGE_FRAGMENT_BIT,
-	GEOMETRY	= VK_SHADER_STAGE_GEOMETRY_BIT
+	GEOMETRY	= VK_SHADER_STAGE_GEOMETRY_BIT,
+	COMPUTE		= VK_SHADER_STAGE_COMPUTE_BIT
 };
 
 class VulkanShader
@@ -1,6 +1,7 @@
 ﻿#include "VulkanTestApplication.h"
 #include <set>
 #include <algorithm>
+#include <cmath>
 #include <unordered_map>
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -24,12 +25,28 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 
 void HelloTriangleApplication::run()
 {
-   initWindow();
+   if(headless)
+   {
+      if(frameLimit == 0)
+      {
+         frameLimit = DEFAULT_HEADLESS_FRAMES;
+      }
+
+      camera.setWindowSize(WIDTH, HEIGHT);
+   }
+   else
+   {
+      initWindow();
+   }
+
    initVulkan();
    mainLoop();
 
-   glfwDestroyWindow(window);
-   glfwTerminate();
+   if(window != nullptr)
+   {
+      glfwDestroyWindow(window);
+      glfwTerminate();
+   }
 
    cleanUp();
 
@@ -41,6 +58,9 @@ void HelloTriangleApplication::run()
 
    delete worldObjectToMeshMapper;
    worldObjectToMeshMapper = nullptr;
+
+   vulkanDevice.samplerCache.destroy();
+   vulkanDevice.memoryAllocator.destroy();
 }
 
 void HelloTriangleApplication::initWindow()
@@ -77,36 +97,80 @@ void HelloTriangleApplication::initVulkan()
    mesh = new Mesh(&vulkanDevice);
 
    worldObjectToMeshMapper = new WorldObjectToMeshMapper();
-   worldObject = new WorldObject(worldObjectToMeshMapper, &vulkanDevice);
+   worldObject = new WorldObject(worldObjectToMeshMapper, &vulkanDevice, &frameJobSystem);
+   worldObject->setHierarchicalCulling(hierarchicalCulling);
 
    createInstance();
    setupDebugCallback();
-   createSurface();
+   if(!headless)
+   {
+      createSurface();
+   }
    pickPhysicalDevice();
    createLogicalDevice();
-   createSwapChain();
+   if(headless)
+   {
+      createOffscreenTarget();
+   }
+   else
+   {
+      createSwapChain();
+   }
    createImageViews();
    createRenderPass();
    createDescriptorSetLayout();
    createGraphicsPipeline();
    createCommandPool();
+   uploadManager.init(&vulkanDevice);
+   vulkanDevice.uploadManager = &uploadManager;
+   mesh->createPlaceholderTexture();
+   assetLoader = new AssetLoader(&vulkanDevice, mesh, &jobSystem);
    createDepthResources();
    createFrameBuffers();
    loadModel();
+   // submitted before the first frame on the same queue, so there's no need to wait for it here
+   uploadManager.flush();
+   if(headless)
+   {
+      // the benchmark should render the whole scene from the first frame
+      assetLoader->waitIdle();
+      assetLoader->processCompleted();
+   }
+   createFrameResources();
    createUniformBuffer();
    createDescriptorPool();
-   worldObject->createDescriptorPool();
+   worldObject->createDescriptorPool(framesInFlight);
    createDescriptorSet();
    worldObject->createDescriptorSet();
+   updateMeshBounds();
+
+   if(gpuCullingRequested)
+   {
+      if(GpuCulling::isSupported(&vulkanDevice))
+      {
+         gpuCulling = new GpuCulling(&vulkanDevice);
+         gpuCulling->createPipeline(framesInFlight);
+
+         gpuCullingUsed = true;
+      }
+      else
+      {
+         std::cout << "culling on the GPU is not supported, culling on the CPU" << std::endl;
+      }
+   }
 
    int index = worldObject->addInstance(1, glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f), glm::vec3(.3f));
    worldObject->setRotationSpeed(index, 0.0f, 0.0f, 0.0f);
 
-   // TODO: automatically call this from add instance, using a boolean: if true -> do
-   worldObject->updateDescriptorSet();
+   if(printStats)
+   {
+      // after the scene is loaded, the arena would be nearly empty before
+      assetLoader->waitIdle();
 
-   createCommandBuffers();
-   createSemaphores();
+      vulkanDevice.memoryAllocator.printStats();
+      mesh->getGeometryArena()->printStats();
+      vulkanDevice.samplerCache.printStats();
+   }
 }
 
 // TODO : Save all available devices in some sort of list, so that the user could choose device in options if necessary
@@ -209,7 +273,7 @@ void HelloTriangleApplication::createRenderPass()
    colorAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
    colorAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-   colorAttachment.finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+   colorAttachment.finalLayout    = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
    VkAttachmentReference colorAttachmentRef ={};
    colorAttachmentRef.attachment = 0;
@@ -235,13 +299,17 @@ void HelloTriangleApplication::createRenderPass()
    subpass.pColorAttachments       = &colorAttachmentRef;
    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+   // the frames in flight share the depth image (and headless the colour image), so the clear and the writes of this
+   // frame have to wait for the writes of the previous one
+   VkPipelineStageFlags attachmentStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
    VkSubpassDependency dependency ={};
    dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
    dependency.dstSubpass    = 0;
-   dependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-   dependency.srcAccessMask = 0;
-   dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-   dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+   dependency.srcStageMask  = attachmentStages;
+   dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+   dependency.dstStageMask  = attachmentStages;
+   dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
    std::array<VkAttachmentDescription, 2> attachments ={ colorAttachment, depthAttachment };
    VkRenderPassCreateInfo renderPassInfo ={};
@@ -513,7 +581,7 @@ void HelloTriangleApplication::createImage(
    uint32_t width, uint32_t height,
    VkFormat format, VkImageTiling tiling,
    VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-   VkImage *image, VkDeviceMemory* imageMemory)
+   VkImage *image, vks::Allocation* imageMemory)
 {
    VkImageCreateInfo imageInfo ={};
    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -535,20 +603,7 @@ void HelloTriangleApplication::createImage(
       throw std::runtime_error("failed to create image!");
    }
 
-   VkMemoryRequirements memRequirements;
-   vkGetImageMemoryRequirements(vulkanDevice.device, *image, &memRequirements);
-
-   VkMemoryAllocateInfo allocInfo ={};
-   allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-   allocInfo.allocationSize  = memRequirements.size;
-   allocInfo.memoryTypeIndex = vulkanDevice.findMemoryType(memRequirements.memoryTypeBits, properties);
-
-   if(vkAllocateMemory(vulkanDevice.device, &allocInfo, nullptr, imageMemory) != VK_SUCCESS)
-   {
-      throw std::runtime_error("failed to allocate image memory!");
-   }
-
-   vkBindImageMemory(vulkanDevice.device, *image, *imageMemory, 0);
+   *imageMemory = vulkanDevice.memoryAllocator.allocateImage(*image, properties);
 }
 
 VkImageView HelloTriangleApplication::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
@@ -576,8 +631,8 @@ VkImageView HelloTriangleApplication::createImageView(VkImage image, VkFormat fo
 
 void HelloTriangleApplication::loadModel()
 {
-   mesh->loadMesh(MODEL_PATH_CUBE.c_str());
-   mesh->loadMesh(MODEL_PATH_CUBE.c_str());
+   assetLoader->loadMesh(MODEL_PATH_CUBE);
+   assetLoader->loadMesh(MODEL_PATH_CUBE);
 
    worldObject->addInstance(0, glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.3f));
    worldObject->addInstance(1, glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f), glm::vec3(0.3f));
@@ -585,34 +640,61 @@ void HelloTriangleApplication::loadModel()
 
    worldObject->setRotationSpeed(1, 0.f, 0.f, 20.f);
    worldObject->setRotationSpeed(2, 0.f, 20.f, 20.f);
+
+   // grid of extra cubes in front of the camera (it looks along +z), alternating between the two meshes. big grids
+   // reach past the sides and the far plane, so they are partly culled
+   uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(float(extraInstances))));
+   for(uint32_t i = 0; i < extraInstances; i++)
+   {
+      glm::vec3 position((float(i % gridSize) - gridSize * 0.5f) * 0.5f, -1.f, float(i / gridSize) * 0.5f);
+      uint32_t index = worldObject->addInstance(i % 2, position, glm::vec3(0.f), glm::vec3(0.1f));
+
+      // the cubes in every row of the grid move towards their neighbours and bounce back and forth
+      if(collisions)
+      {
+         worldObject->setMovingDirection(index, glm::vec3(i % 2 == 0 ? 1.f : -1.f, 0.f, 0.f));
+         worldObject->setMovingSpeed(index, 0.5f);
+      }
+   }
+
+   if(collisions)
+   {
+      for(uint32_t index = 0; index < worldObject->getNumberOfObjects(); index++)
+      {
+         worldObject->setCollider(index, ColliderShape::Obb);
+      }
+   }
 }
 
 // Since this is the camera buffer, this should probably be moved into the camera class
 void HelloTriangleApplication::createUniformBuffer()
 {
-   // camera buffer (view & projection matrices)
+   // camera buffer (view & projection matrices), one per frame in flight
    size_t bufferSize = sizeof(camera.getCameraData());
 
-   vulkanDevice.createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &uniformBuffers.cameraBuffer,
-      &uniformBuffers.cameraBufferMemory);
+   for(auto& frame : frames)
+   {
+      vulkanDevice.createBuffer(
+         bufferSize,
+         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+         &frame.cameraBuffer,
+         &frame.cameraBufferMemory);
+   }
 }
 
 void HelloTriangleApplication::createDescriptorPool()
 {
-   mesh->createDescriptorPool();
+   mesh->createDescriptorPool(framesInFlight);
    std::array<VkDescriptorPoolSize, 1> poolSizes ={};
    poolSizes[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-   poolSizes[0].descriptorCount = 1;
+   poolSizes[0].descriptorCount = framesInFlight;
  
    VkDescriptorPoolCreateInfo poolInfo ={};
    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
    poolInfo.pPoolSizes    = poolSizes.data();
-   poolInfo.maxSets       = 1;
+   poolInfo.maxSets       = framesInFlight;
 
    if(vkCreateDescriptorPool(vulkanDevice.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
    {
@@ -623,59 +705,194 @@ void HelloTriangleApplication::createDescriptorPool()
 // TODO: These should be moved to respective class.  texture class and camera class.
 void HelloTriangleApplication::createDescriptorSet()
 {
-   VkDescriptorBufferInfo uboBufferInfo ={};
-   uboBufferInfo.buffer = uniformBuffers.cameraBuffer;
-   uboBufferInfo.offset = 0;
-   uboBufferInfo.range  = VK_WHOLE_SIZE;
-   
-   VkDescriptorSetLayout layoutsMatrixBuffer[] ={ descriptorSetLayoutMatrixBuffer };
+   for(auto& frame : frames)
+   {
+      VkDescriptorBufferInfo uboBufferInfo ={};
+      uboBufferInfo.buffer = frame.cameraBuffer;
+      uboBufferInfo.offset = 0;
+      uboBufferInfo.range  = VK_WHOLE_SIZE;
+
+      VkDescriptorSetLayout layoutsMatrixBuffer[] ={ descriptorSetLayoutMatrixBuffer };
+
+      VkDescriptorSetAllocateInfo allocInfoMatrixBuffer ={};
+      allocInfoMatrixBuffer.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocInfoMatrixBuffer.descriptorPool     = descriptorPool;
+      allocInfoMatrixBuffer.descriptorSetCount = 1;
+      allocInfoMatrixBuffer.pSetLayouts        = layoutsMatrixBuffer;
+
+      if(vkAllocateDescriptorSets(vulkanDevice.device, &allocInfoMatrixBuffer, &frame.descriptorSetMatrixBuffer) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to allocate MatrixBuffer descriptor set!");
+      }
+
+      std::array<VkWriteDescriptorSet, 1> descriptorWritesMatrixBuffer ={};
+      descriptorWritesMatrixBuffer[0].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWritesMatrixBuffer[0].dstSet           = frame.descriptorSetMatrixBuffer;
+      descriptorWritesMatrixBuffer[0].dstBinding       = 0;
+      descriptorWritesMatrixBuffer[0].dstArrayElement  = 0;
+      descriptorWritesMatrixBuffer[0].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      descriptorWritesMatrixBuffer[0].descriptorCount  = 1;
+      descriptorWritesMatrixBuffer[0].pBufferInfo      = &uboBufferInfo;
+      descriptorWritesMatrixBuffer[0].pImageInfo       = nullptr;
+      descriptorWritesMatrixBuffer[0].pTexelBufferView = nullptr;
+
+      vkUpdateDescriptorSets(vulkanDevice.device, static_cast<uint32_t>(descriptorWritesMatrixBuffer.size()), descriptorWritesMatrixBuffer.data(), 0, nullptr);
+   }
+
+   mesh->createDescriptorSet();
+}
+
+void HelloTriangleApplication::createFrameResources()
+{
+   vks::QueueFamilyIndices queueFamilyIndices = vulkanDevice.findQueueFamilies();
+
+   // the pools are reset as a whole every frame, instead of the command buffers one by one
+   VkCommandPoolCreateInfo poolInfo ={};
+   poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+   poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+   // signalled, so the first frame doesn't wait for it
+   VkFenceCreateInfo fenceInfo ={};
+   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+   VkSemaphoreCreateInfo semaphoreInfo ={};
+   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+   // the main thread records a slice as well
+   uint32_t numberOfSlices = frameJobSystem.getNumberOfWorkers() + 1;
 
-   VkDescriptorSetAllocateInfo allocInfoMatrixBuffer ={};
-   allocInfoMatrixBuffer.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-   allocInfoMatrixBuffer.descriptorPool     = descriptorPool;
-   allocInfoMatrixBuffer.descriptorSetCount = 1;
-   allocInfoMatrixBuffer.pSetLayouts        = layoutsMatrixBuffer;
+   frames.resize(framesInFlight);
 
-   if(vkAllocateDescriptorSets(vulkanDevice.device, &allocInfoMatrixBuffer, &descriptorSetMatrixBuffer) != VK_SUCCESS)
+   for(auto& frame : frames)
    {
-      throw std::runtime_error("failed to allocate MatrixBuffer descriptor set!");
+      VkCommandBufferAllocateInfo allocInfo ={};
+      allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandBufferCount = 1;
+
+      if(vkCreateCommandPool(vulkanDevice.device, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to create frame command pool!");
+      }
+
+      allocInfo.commandPool = frame.commandPool;
+
+      if(vkAllocateCommandBuffers(vulkanDevice.device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to create command buffers!");
+      }
+
+      frame.secondaryCommandPools.resize(numberOfSlices);
+      frame.secondaryCommandBuffers.resize(numberOfSlices);
+
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+      for(uint32_t i = 0; i < numberOfSlices; i++)
+      {
+         if(vkCreateCommandPool(vulkanDevice.device, &poolInfo, nullptr, &frame.secondaryCommandPools[i]) != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to create secondary command pool!");
+         }
+
+         allocInfo.commandPool = frame.secondaryCommandPools[i];
+
+         if(vkAllocateCommandBuffers(vulkanDevice.device, &allocInfo, &frame.secondaryCommandBuffers[i]) != VK_SUCCESS)
+         {
+            throw std::runtime_error("failed to create secondary command buffers!");
+         }
+      }
+
+      if(vkCreateFence(vulkanDevice.device, &fenceInfo, nullptr, &frame.fence) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to create frame fence!");
+      }
+
+      if(vkCreateSemaphore(vulkanDevice.device, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+         vkCreateSemaphore(vulkanDevice.device, &semaphoreInfo, nullptr, &frame.renderFinishedSemaphore) != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to create semaphores!");
+      }
    }
+}
 
-   std::array<VkWriteDescriptorSet, 1> descriptorWritesMatrixBuffer ={};
-   descriptorWritesMatrixBuffer[0].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-   descriptorWritesMatrixBuffer[0].dstSet           = descriptorSetMatrixBuffer;
-   descriptorWritesMatrixBuffer[0].dstBinding       = 0;
-   descriptorWritesMatrixBuffer[0].dstArrayElement  = 0;
-   descriptorWritesMatrixBuffer[0].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-   descriptorWritesMatrixBuffer[0].descriptorCount  = 1;
-   descriptorWritesMatrixBuffer[0].pBufferInfo      = &uboBufferInfo;
-   descriptorWritesMatrixBuffer[0].pImageInfo       = nullptr;
-   descriptorWritesMatrixBuffer[0].pTexelBufferView = nullptr;
+void HelloTriangleApplication::destroyFrameResources()
+{
+   for(auto& frame : frames)
+   {
+      // destroying a pool frees its command buffers
+      for(auto commandPool : frame.secondaryCommandPools)
+      {
+         vkDestroyCommandPool(vulkanDevice.device, commandPool, nullptr);
+      }
 
-   vkUpdateDescriptorSets(vulkanDevice.device, static_cast<uint32_t>(descriptorWritesMatrixBuffer.size()), descriptorWritesMatrixBuffer.data(), 0, nullptr);
+      vkDestroyCommandPool(vulkanDevice.device, frame.commandPool, nullptr);
 
-   mesh->createDescriptorSet();
+      vkDestroyFence(vulkanDevice.device, frame.fence, nullptr);
+
+      vkDestroySemaphore(vulkanDevice.device, frame.imageAvailableSemaphore, nullptr);
+      vkDestroySemaphore(vulkanDevice.device, frame.renderFinishedSemaphore, nullptr);
+
+      vulkanDevice.destroyBuffer(frame.cameraBuffer, frame.cameraBufferMemory);
+   }
+
+   frames.clear();
 }
 
-void HelloTriangleApplication::createCommandBuffers()
+void HelloTriangleApplication::recordCommandBuffer(uint32_t imageIndex)
 {
-   vulkanStuff.commandBuffers.resize(swapChainFrameBuffers.size());
+   std::vector<DrawCommand> drawCommands = buildDrawCommands();
 
-   VkCommandBufferAllocateInfo allocInfo ={};
-   allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-   allocInfo.commandPool        = vulkanDevice.commandPool;
-   allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-   allocInfo.commandBufferCount = (uint32_t)vulkanStuff.commandBuffers.size();
+   drawCount = static_cast<uint32_t>(drawCommands.size());
 
-   if(vkAllocateCommandBuffers(vulkanDevice.device, &allocInfo, vulkanStuff.commandBuffers.data()) != VK_SUCCESS)
+   // the indirect buffer gets the draws in the same order, so the slices can use runs of it
+   if(gpuCulling != nullptr)
    {
-      throw std::runtime_error("failed to create command buffers!");
+      std::vector<GpuCulling::Draw> gpuDraws(drawCommands.size());
+
+      for(size_t i = 0; i < drawCommands.size(); i++)
+      {
+         gpuDraws[i].batch           = drawCommands[i].batch;
+         gpuDraws[i].firstIndex      = drawCommands[i].firstIndex;
+         gpuDraws[i].numberOfIndices = drawCommands[i].numberOfIndices;
+         gpuDraws[i].vertexOffset    = drawCommands[i].vertexOffset;
+      }
+
+      gpuCulling->update(currentFrame, worldObject, gpuDraws);
    }
 
+   FrameResources& frameResources = frames[currentFrame];
+
+   vkResetCommandPool(vulkanDevice.device, frameResources.commandPool, 0);
+
+   for(auto commandPool : frameResources.secondaryCommandPools)
+   {
+      vkResetCommandPool(vulkanDevice.device, commandPool, 0);
+   }
+
+   size_t numberOfSlices = std::min(
+      frameResources.secondaryCommandPools.size(),
+      (drawCommands.size() + MIN_DRAWS_PER_SLICE - 1) / MIN_DRAWS_PER_SLICE);
+
+   size_t drawsPerSlice = numberOfSlices > 0 ? (drawCommands.size() + numberOfSlices - 1) / numberOfSlices : 0;
+
+   // a slice per job, the first one is recorded on this thread. a failing slice throws here, so a half recorded
+   // command buffer is never submitted
+   frameJobSystem.parallelFor(0, static_cast<uint32_t>(numberOfSlices), 1, [this, imageIndex, &drawCommands, drawsPerSlice](uint32_t firstSlice, uint32_t lastSlice)
+   {
+      for(uint32_t slice = firstSlice; slice < lastSlice; slice++)
+      {
+         size_t firstDraw = slice * drawsPerSlice;
+         size_t numberOfDraws = std::min(drawsPerSlice, drawCommands.size() - firstDraw);
+
+         recordSecondaryCommandBuffer(slice, imageIndex, drawCommands, firstDraw, numberOfDraws);
+      }
+   });
+
    VkCommandBufferBeginInfo beginInfo ={};
-   beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-   beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-   beginInfo.pInheritanceInfo = nullptr;
+   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
    std::array<VkClearValue, 2> clearValues ={};
    clearValues[0].color ={ 0.0f, 0.0f, 0.0f, 0.0f };
@@ -684,81 +901,209 @@ void HelloTriangleApplication::createCommandBuffers()
    VkRenderPassBeginInfo renderPassBeginInfo ={};
    renderPassBeginInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
    renderPassBeginInfo.renderPass        = renderPass;
+   renderPassBeginInfo.framebuffer       = swapChainFrameBuffers[imageIndex];
    renderPassBeginInfo.renderArea.offset ={ 0,0 };
    renderPassBeginInfo.renderArea.extent = swapChainExtent;
    renderPassBeginInfo.clearValueCount   = static_cast<uint32_t>(clearValues.size());
    renderPassBeginInfo.pClearValues      = clearValues.data();
 
-   for(size_t i = 0; i < vulkanStuff.commandBuffers.size(); i++)
+   VkCommandBuffer commandBuffer = frameResources.commandBuffer;
+
+   if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
    {
-      renderPassBeginInfo.framebuffer = swapChainFrameBuffers[i];
+      throw std::runtime_error("failed to begin command buffer recording!");
+   }
+
+   // fills in the instance counts of the indirect draws, it can't be inside the render pass
+   if(gpuCulling != nullptr)
+   {
+      gpuCulling->recordCulling(commandBuffer, currentFrame, frustum);
+   }
+
+   vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+   if(numberOfSlices > 0)
+   {
+      vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(numberOfSlices), frameResources.secondaryCommandBuffers.data());
+   }
+
+   vkCmdEndRenderPass(commandBuffer);
+
+   if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to record command buffer!");
+   }
+}
+
+void HelloTriangleApplication::recordSecondaryCommandBuffer(uint32_t slice, uint32_t imageIndex, const std::vector<DrawCommand>& drawCommands, size_t firstDraw, size_t numberOfDraws)
+{
+   const FrameResources& frameResources = frames[currentFrame];
+
+   VkCommandBuffer commandBuffer = frameResources.secondaryCommandBuffers[slice];
+
+   VkCommandBufferInheritanceInfo inheritanceInfo ={};
+   inheritanceInfo.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+   inheritanceInfo.renderPass  = renderPass;
+   inheritanceInfo.subpass     = 0;
+   inheritanceInfo.framebuffer = swapChainFrameBuffers[imageIndex];
+
+   VkCommandBufferBeginInfo beginInfo ={};
+   beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+   if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to begin secondary command buffer recording!");
+   }
 
-      if(vkBeginCommandBuffer(vulkanStuff.commandBuffers[i], &beginInfo) != VK_SUCCESS)
+   // nothing is inherited from the primary command buffer or the other slices
+   vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+   VkDeviceSize offsets[] ={ 0 };
+
+   // the camera and the model matrices of all objects are the same for every draw
+   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameResources.descriptorSetMatrixBuffer, 0, nullptr);
+   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, worldObject->getDescriptorSet(currentFrame), 0, nullptr);
+
+   // all meshes usually live in the same arena, so the buffers are bound once
+   uint32_t boundArena = UINT32_MAX;
+   uint32_t boundDescriptorSet = UINT32_MAX;
+
+   size_t lastDraw = firstDraw + numberOfDraws;
+
+   for(size_t i = firstDraw; i < lastDraw; i++)
+   {
+      const DrawCommand& draw = drawCommands[i];
+
+      if(draw.arenaIndex != boundArena)
       {
-         throw std::runtime_error("failed to begin command buffer recording!");
+         VkBuffer vertexBuffers[] ={ mesh->getGeometryArena()->getVertexBuffer(draw.arenaIndex) };
+         vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+         vkCmdBindIndexBuffer(commandBuffer, mesh->getGeometryArena()->getIndexBuffer(draw.arenaIndex), 0, VK_INDEX_TYPE_UINT32);
+
+         boundArena = draw.arenaIndex;
       }
 
-      vkCmdBeginRenderPass(vulkanStuff.commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+      if(draw.descriptorSetId != boundDescriptorSet)
+      {
+         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, mesh->getDescriptorSet(currentFrame, draw.descriptorSetId), 0, nullptr);
 
-      vkCmdSetViewport(vulkanStuff.commandBuffers[i], 0, 1, &viewport);
+         boundDescriptorSet = draw.descriptorSetId;
+      }
 
-      vkCmdBindPipeline(vulkanStuff.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+      if(gpuCulling == nullptr)
+      {
+         vkCmdDrawIndexed(commandBuffer, draw.numberOfIndices, draw.numberOfInstances, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+         continue;
+      }
 
-      VkDeviceSize offsets[] ={ 0 };
+      // all draws with the same descriptor set and buffers in one call, if the device can draw more than one
+      size_t runEnd = i + 1;
 
-      for(uint32_t j = 0; j < worldObject->getNumberOfObjects(); j++)
+      if(vulkanDevice.deviceFeatures.multiDrawIndirect)
       {
-         uint32_t meshId = worldObject->getMeshId(j);
-         VkBuffer vertexBuffers[] ={ mesh->getVertexBuffer(meshId) };
-         vkCmdBindVertexBuffers(vulkanStuff.commandBuffers[i], 0, 1, vertexBuffers, offsets);
+         while(runEnd < lastDraw &&
+            runEnd - i < vulkanDevice.deviceProperties.limits.maxDrawIndirectCount &&
+            drawCommands[runEnd].descriptorSetId == draw.descriptorSetId &&
+            drawCommands[runEnd].arenaIndex == draw.arenaIndex)
+         {
+            runEnd++;
+         }
+      }
 
-         vkCmdBindIndexBuffer(vulkanStuff.commandBuffers[i], mesh->getIndexBuffer(meshId), 0, VK_INDEX_TYPE_UINT32);
+      vkCmdDrawIndexedIndirect(
+         commandBuffer,
+         gpuCulling->getDrawBuffer(currentFrame),
+         i * sizeof(VkDrawIndexedIndirectCommand),
+         static_cast<uint32_t>(runEnd - i),
+         sizeof(VkDrawIndexedIndirectCommand));
 
-         uint32_t dynamicOffset = j * static_cast<uint32_t>(worldObject->getDynamicAlignment());
+      i = runEnd - 1;
+   }
 
-         vkCmdBindDescriptorSets(vulkanStuff.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSetMatrixBuffer, 0, nullptr);
-         vkCmdBindDescriptorSets(vulkanStuff.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, worldObject->getDescriptorSet(), 1, &dynamicOffset);
-         vkCmdBindDescriptorSets(vulkanStuff.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, mesh->getDescriptorForMesh(meshId), 0, nullptr);
-         
-         vkCmdDrawIndexed(vulkanStuff.commandBuffers[i], mesh->getNumIndices(meshId), 1, 0, 0, 0);
-      }
+   if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+   {
+      throw std::runtime_error("failed to record secondary command buffer!");
+   }
+}
+
+std::vector<HelloTriangleApplication::DrawCommand> HelloTriangleApplication::buildDrawCommands()
+{
+   std::vector<DrawCommand> drawCommands;
 
+   // culled on the GPU every mesh gets its draws, the shader sets how many of its instances are drawn
+   const std::vector<WorldObject::InstanceBatch>& batches = gpuCulling != nullptr ?
+      worldObject->getInstanceBatches() :
+      worldObject->getVisibleBatches(currentFrame);
 
-      // new draw procedure for when descriptors have been fixed
+   // one instanced draw per sub mesh, the visible instances of a mesh are next to each other in the visible buffer
+   for(uint32_t batchIndex = 0; batchIndex < batches.size(); batchIndex++)
+   {
+      const WorldObject::InstanceBatch& batch = batches[batchIndex];
 
-      //for(uint32_t j=0; j < mesh->getNumberOfMeshes(); j++)
-      //{
-      //   // bind vertex and index buffers here
-      //   for(uint32_t k=0; k < worldObjectToMeshMapper->getWorldObjectIdsForMesh(j).size(); k++)
-      //   {
-      //      // calculate dynamic offset here or set uniform buffer here, by binding a descriptor from the descriptorset
-      //      for(uint32_t l = 0; l < mesh->getSubMeshesForMesh(j).size(); l++)
-      //      {
-      //         // bind descriptor set here or bind the part with textures 
-      //
-      //         // draw indexed using the submesh data to get start index and num indices
-      //      }
-      //   }
-      //}
+      // still loading, it will be drawn when the command buffers are recorded again
+      if(!mesh->isResident(batch.meshId))
+      {
+         continue;
+      }
 
-      vkCmdEndRenderPass(vulkanStuff.commandBuffers[i]);
+      const vks::GeometryAllocation& geometry = mesh->getGeometry(batch.meshId);
 
-      if(vkEndCommandBuffer(vulkanStuff.commandBuffers[i]) != VK_SUCCESS)
+      size_t firstDraw = drawCommands.size();
+
+      for(const auto& subMesh : mesh->getSubMeshesForMesh(batch.meshId))
       {
-         throw std::runtime_error("failed to record command buffer!");
+         uint32_t firstIndex = geometry.firstIndex + static_cast<uint32_t>(subMesh.startIndex);
+
+         // sub meshes whose materials share a descriptor set (e.g. a texture atlas) are drawn together if their
+         // indices follow each other, which they do unless another material is in between
+         if(drawCommands.size() > firstDraw)
+         {
+            DrawCommand& last = drawCommands.back();
+
+            if(last.descriptorSetId == static_cast<uint32_t>(subMesh.descriptorSetId) &&
+               last.firstIndex + last.numberOfIndices == firstIndex)
+            {
+               last.numberOfIndices += static_cast<uint32_t>(subMesh.numberOfIndices);
+               continue;
+            }
+         }
+
+         DrawCommand draw;
+         draw.batch             = batchIndex;
+         draw.descriptorSetId   = static_cast<uint32_t>(subMesh.descriptorSetId);
+         draw.arenaIndex        = geometry.arenaIndex;
+         draw.firstIndex        = firstIndex;
+         draw.numberOfIndices   = static_cast<uint32_t>(subMesh.numberOfIndices);
+         draw.vertexOffset      = static_cast<int32_t>(geometry.vertexOffset);
+         draw.firstInstance     = batch.firstInstance;
+         draw.numberOfInstances = batch.numberOfInstances;
+
+         drawCommands.push_back(draw);
       }
    }
+
+   // grouped by descriptor set so it's bound once, the arena buffers are (almost) always the same anyway
+   std::sort(drawCommands.begin(), drawCommands.end(), [](const DrawCommand& a, const DrawCommand& b)
+   {
+      return a.descriptorSetId != b.descriptorSetId ? a.descriptorSetId < b.descriptorSetId : a.arenaIndex < b.arenaIndex;
+   });
+
+   return drawCommands;
 }
 
-void HelloTriangleApplication::createSemaphores()
+void HelloTriangleApplication::updateMeshBounds()
 {
-   VkSemaphoreCreateInfo semaphoreInfo ={};
-   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-   if(vkCreateSemaphore(vulkanDevice.device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-      vkCreateSemaphore(vulkanDevice.device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS)
+   for(uint32_t meshId = 0; meshId < mesh->getNumberOfMeshes(); meshId++)
    {
-      throw std::runtime_error("failed to create semaphores!");
+      if(mesh->isResident(meshId))
+      {
+         worldObject->setMeshBounds(meshId, mesh->getBounds(meshId));
+      }
    }
 }
 
@@ -903,10 +1248,6 @@ void HelloTriangleApplication::cleanupSwapChain()
    {
       vkDestroyFramebuffer(vulkanDevice.device, swapChainFrameBuffers[i], nullptr);
    }
-   vkFreeCommandBuffers(vulkanDevice.device, 
-      vulkanDevice.commandPool, 
-      static_cast<uint32_t>(vulkanStuff.commandBuffers.size()), 
-      vulkanStuff.commandBuffers.data());
 
    vkDestroyPipeline(vulkanDevice.device, graphicsPipeline, nullptr);
    vkDestroyPipelineLayout(vulkanDevice.device, pipelineLayout, nullptr);
@@ -917,12 +1258,25 @@ void HelloTriangleApplication::cleanupSwapChain()
       vkDestroyImageView(vulkanDevice.device, swapChainImageViews[i], nullptr);
    }
 
-   vkDestroySwapchainKHR(vulkanDevice.device, swapChain, nullptr);
+   vkDestroyImageView(vulkanDevice.device, depthImageView, nullptr);
+   vulkanDevice.destroyImage(depthImage, depthImageMemory);
+
+   if(headless)
+   {
+      vulkanDevice.destroyImage(swapChainImages[0], offscreenImageMemory);
+   }
+   else
+   {
+      vkDestroySwapchainKHR(vulkanDevice.device, swapChain, nullptr);
+   }
 }
 
 void HelloTriangleApplication::recreateSwapChain()
 {
-   vkDeviceWaitIdle(vulkanDevice.device);
+   {
+      std::lock_guard<std::mutex> lock(vulkanDevice.queueMutex);
+      vkDeviceWaitIdle(vulkanDevice.device);
+   }
    cleanupSwapChain();
    
    createSwapChain();
@@ -931,7 +1285,6 @@ void HelloTriangleApplication::recreateSwapChain()
    createGraphicsPipeline();
    createDepthResources();
    createFrameBuffers();
-   createCommandBuffers();
 }
 
 void HelloTriangleApplication::createImageViews()
@@ -946,8 +1299,36 @@ void HelloTriangleApplication::createImageViews()
 
 void HelloTriangleApplication::cleanUp()
 {
-   vkFreeMemory(vulkanDevice.device, uniformBuffers.cameraBufferMemory, nullptr);
-   vkDestroyBuffer(vulkanDevice.device, uniformBuffers.cameraBuffer, nullptr);
+   delete gpuCulling;
+   gpuCulling = nullptr;
+
+   // stops the loader thread, has to go before the upload manager
+   delete assetLoader;
+   assetLoader = nullptr;
+
+   uploadManager.destroy();
+
+   destroyFrameResources();
+}
+
+void HelloTriangleApplication::createOffscreenTarget()
+{
+   swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+   swapChainExtent      ={ static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT) };
+
+   VkImage offscreenImage;
+   createImage(
+      swapChainExtent.width, swapChainExtent.height,
+      swapChainImageFormat,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      &offscreenImage,
+      &offscreenImageMemory);
+
+   // pretend it's a swapchain with one image, that way image views, framebuffers and
+   // command buffers are created the same way for both paths.
+   swapChainImages ={ offscreenImage };
 }
 
 void HelloTriangleApplication::createSwapChain()
@@ -1020,10 +1401,11 @@ bool HelloTriangleApplication::isDeviceSuitable(VkPhysicalDevice device)
 
    vks::QueueFamilyIndices indices = vulkanDevice.findQueueFamilies();
 
-   bool extensionsSupported = checkDeviceExtensionSupport(device);
+   // headless needs neither the swapchain extension nor a surface
+   bool extensionsSupported = headless || checkDeviceExtensionSupport(device);
 
-   bool swapChainAdequate = false;
-   if(extensionsSupported)
+   bool swapChainAdequate = headless;
+   if(!headless && extensionsSupported)
    {
       SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 
@@ -1032,9 +1414,14 @@ bool HelloTriangleApplication::isDeviceSuitable(VkPhysicalDevice device)
          !swapChainSupport.presentModes.empty();
    }
 
+   // software implementations like lavapipe are CPU devices, accept them when running headless.
+   bool deviceTypeSuitable =
+      headless ||
+      vulkanDevice.deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+
    return
       indices.isComplete() &&
-      vulkanDevice.deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
+      deviceTypeSuitable &&
       vulkanDevice.deviceFeatures.geometryShader &&
       vulkanDevice.deviceFeatures.samplerAnisotropy &&
       extensionsSupported &&
@@ -1149,50 +1536,104 @@ VkExtent2D HelloTriangleApplication::chooseSwapExtent(const VkSurfaceCapabilitie
 void HelloTriangleApplication::mainLoop()
 {
    int frame = 0;
+   uint32_t totalFrames = 0;
    long long timediff = 0;
    long long dt = 0;
-   while(!glfwWindowShouldClose(window))
+   while(window == nullptr || !glfwWindowShouldClose(window))
    {
+      if(frameLimit > 0 && totalFrames >= frameLimit)
+      {
+         break;
+      }
+
       auto t1 = std::chrono::high_resolution_clock::now();
 
-      glfwPollEvents();
+      if(window != nullptr)
+      {
+         glfwPollEvents();
+      }
+
+      // the buffers and command buffers of this frame are about to change, the GPU has to be done with them.
+      // with more than one frame in flight this is the frame before the last one, so usually it's done already
+      auto fenceWaitStart = std::chrono::high_resolution_clock::now();
 
-      worldObject->update(float((double)dt / 1e9f));
+      vkWaitForFences(vulkanDevice.device, 1, &frames[currentFrame].fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
 
-      if(glfwGetKey(window, GLFW_KEY_W))
+      if(frameLimit > 0)
       {
-         camera.moveForwardsBackwards(float((double)dt / 1e9f), true);
+         auto fenceWaitEnd = std::chrono::high_resolution_clock::now();
+         fenceWaitTimes.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(fenceWaitEnd - fenceWaitStart).count() / 1e6);
       }
-      else if(glfwGetKey(window, GLFW_KEY_S))
+
+      // the objects are moved on the workers while this thread takes care of the camera and the loaded assets,
+      // neither touches the objects
+      float frameDt = float((double)dt / 1e9f);
+      JobSystem::JobHandle objectsUpdated = frameJobSystem.schedule([this, frameDt]() { worldObject->update(frameDt); });
+
+      // no window, no input
+      if(window != nullptr)
       {
-         camera.moveForwardsBackwards(float((double)dt / 1e9f), false);
+         handleInput(frameDt);
       }
-      if(glfwGetKey(window, GLFW_KEY_D))
+
+      updateUniformBuffer();
+
+      // meshes that finished loading are drawn from this frame on, the command buffer is recorded every frame.
+      // the material sets of this frame are rewritten here, its fence has passed
+      bool assetsInstalled = assetLoader->processCompleted();
+      mesh->updateDescriptorSets(currentFrame);
+
+      frameJobSystem.wait(objectsUpdated);
+
+      contactCount = static_cast<uint32_t>(worldObject->getContacts().size());
+
+      if(assetsInstalled)
       {
-         camera.moveRightLeft(float((double)dt / 1e9f), true);
+         updateMeshBounds();
       }
-      else if(glfwGetKey(window, GLFW_KEY_A))
+
+      worldObject->updateInstanceBuffer(currentFrame);
+
+      frustum = Frustum(uboVS.projection * uboVS.view);
+
+      if(gpuCulling != nullptr)
       {
-         camera.moveRightLeft(float((double)dt / 1e9f), false);
+         // counted by the GPU the last time this frame was drawn
+         visibleCount = gpuCulling->getNumberOfVisible(currentFrame);
+         culledCount = worldObject->getNumberOfInstances() - visibleCount;
       }
-      if(glfwGetKey(window, GLFW_KEY_R))
+      else
       {
-         camera.moveUpDown(float((double)dt / 1e9f), true);
+         // only the instances in view end up in the draws of this frame
+         worldObject->cullInstances(currentFrame, frustum);
+
+         visibleCount = worldObject->getNumberOfVisible();
+         culledCount = worldObject->getNumberOfCulled();
       }
-      else if(glfwGetKey(window, GLFW_KEY_F))
+
+      if(pickRequested)
       {
-         camera.moveUpDown(float((double)dt / 1e9f), false);
+         pickObject();
+         pickRequested = false;
       }
 
-      updateUniformBuffer();
-
       drawFrame();
 
+      uploadManager.update();
+
+      currentFrame = (currentFrame + 1) % framesInFlight;
+
       auto t2 = std::chrono::high_resolution_clock::now();
 
       dt = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
       timediff += dt;
       frame++;
+      totalFrames++;
+
+      if(frameLimit > 0)
+      {
+         frameTimes.push_back((double)dt / 1e6);
+      }
 
       if(timediff > 1000000000)
       {
@@ -1202,7 +1643,82 @@ void HelloTriangleApplication::mainLoop()
       }
    }
 
-   vkDeviceWaitIdle(vulkanDevice.device);
+   {
+      std::lock_guard<std::mutex> lock(vulkanDevice.queueMutex);
+      vkDeviceWaitIdle(vulkanDevice.device);
+   }
+}
+
+void HelloTriangleApplication::handleInput(float dt)
+{
+   if(glfwGetKey(window, GLFW_KEY_W))
+   {
+      camera.moveForwardsBackwards(dt, true);
+   }
+   else if(glfwGetKey(window, GLFW_KEY_S))
+   {
+      camera.moveForwardsBackwards(dt, false);
+   }
+   if(glfwGetKey(window, GLFW_KEY_D))
+   {
+      camera.moveRightLeft(dt, true);
+   }
+   else if(glfwGetKey(window, GLFW_KEY_A))
+   {
+      camera.moveRightLeft(dt, false);
+   }
+   if(glfwGetKey(window, GLFW_KEY_R))
+   {
+      camera.moveUpDown(dt, true);
+   }
+   else if(glfwGetKey(window, GLFW_KEY_F))
+   {
+      camera.moveUpDown(dt, false);
+   }
+
+   // the objects are being updated right now, the pick has to wait for them
+   bool mouseDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+
+   if(mouseDown && !mouseWasDown)
+   {
+      pickRequested = true;
+   }
+
+   mouseWasDown = mouseDown;
+}
+
+void HelloTriangleApplication::pickObject()
+{
+   double cursorX, cursorY;
+   glfwGetCursorPos(window, &cursorX, &cursorY);
+
+   int width, height;
+   glfwGetWindowSize(window, &width, &height);
+
+   if(width == 0 || height == 0)
+   {
+      return;
+   }
+
+   // the projection is flipped for Vulkan, so y goes down like the cursor
+   glm::vec2 ndc(2.f * float(cursorX) / width - 1.f, 2.f * float(cursorY) / height - 1.f);
+
+   glm::mat4 inverseViewProjection = glm::inverse(uboVS.projection * uboVS.view);
+
+   glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.f, 1.f);
+   glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.f, 1.f);
+
+   glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+   glm::vec3 end = glm::vec3(farPoint) / farPoint.w;
+
+   // from the near to the far plane
+   float distance;
+   uint32_t object = worldObject->raycast(origin, end - origin, 1.f, &distance);
+
+   if(object != UINT32_MAX)
+   {
+      std::cout << "picked object " << object << " at " << distance * glm::length(end - origin) << std::endl;
+   }
 }
 
 void HelloTriangleApplication::updateUniformBuffer()
@@ -1211,27 +1727,52 @@ void HelloTriangleApplication::updateUniformBuffer()
 
    camera.updateMatrices(); // TODO: Should only bew camera->update(), and not called in this method.
 
-   Camera::MatrixBufferObject *mbo = &camera.getCameraData();
+   Camera::MatrixBufferObject mbo = camera.getCameraData();
 
-   uboVS.projection = mbo->projectionMatrix;
-   uboVS.view = mbo->viewMatrix;
+   uboVS.projection = mbo.projectionMatrix;
+   uboVS.view = mbo.viewMatrix;
 
-   void *data;
-   vkMapMemory(vulkanDevice.device, uniformBuffers.cameraBufferMemory, 0, sizeof(uboVS), 0, &data);
-   memcpy(data, &uboVS, sizeof(uboVS));
-   vkUnmapMemory(vulkanDevice.device, uniformBuffers.cameraBufferMemory);
+   memcpy(frames[currentFrame].cameraBufferMemory.mapped, &uboVS, sizeof(uboVS));
 
 }
 
 
 void HelloTriangleApplication::drawFrame()
 {
+   FrameResources& frameResources = frames[currentFrame];
+
+   if(headless)
+   {
+      vkResetFences(vulkanDevice.device, 1, &frameResources.fence);
+
+      recordCommandBuffer(0);
+
+      VkSubmitInfo submitInfo ={};
+      submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers    = &frameResources.commandBuffer;
+
+      VkResult result;
+      {
+         std::lock_guard<std::mutex> lock(vulkanDevice.queueMutex);
+         result = vkQueueSubmit(vulkanDevice.graphicsQueue, 1, &submitInfo, frameResources.fence);
+      }
+
+      if(result != VK_SUCCESS)
+      {
+         throw std::runtime_error("failed to submit offscreen command buffer");
+      }
+
+      // there is no present to pace us, the fence wait at the start of the frame does that
+      return;
+   }
+
    uint32_t imageIndex;
    VkResult result = vkAcquireNextImageKHR(
       vulkanDevice.device,
       swapChain,
       std::numeric_limits<uint64_t>::max(),
-      imageAvailableSemaphore,
+      frameResources.imageAvailableSemaphore,
       VK_NULL_HANDLE,
       &imageIndex);
 
@@ -1246,10 +1787,15 @@ void HelloTriangleApplication::drawFrame()
       throw std::runtime_error("failed to acquire swap chain image!");
    }
 
+   // only now, a frame that's skipped above must not leave the fence unsignalled
+   vkResetFences(vulkanDevice.device, 1, &frameResources.fence);
+
+   recordCommandBuffer(imageIndex);
+
    VkSubmitInfo submitInfo ={};
    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-   VkSemaphore waitSemaphores[] ={ imageAvailableSemaphore };
+   VkSemaphore waitSemaphores[] ={ frameResources.imageAvailableSemaphore };
 
    VkPipelineStageFlags waitStages[] ={ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
@@ -1257,13 +1803,16 @@ void HelloTriangleApplication::drawFrame()
    submitInfo.pWaitSemaphores    = waitSemaphores;
    submitInfo.pWaitDstStageMask  = waitStages;
    submitInfo.commandBufferCount = 1;
-   submitInfo.pCommandBuffers    = &vulkanStuff.commandBuffers[imageIndex];
+   submitInfo.pCommandBuffers    = &frameResources.commandBuffer;
 
-   VkSemaphore signalSemaphores[] ={ renderFinishedSemaphore };
+   VkSemaphore signalSemaphores[] ={ frameResources.renderFinishedSemaphore };
    submitInfo.signalSemaphoreCount = 1;
    submitInfo.pSignalSemaphores    = signalSemaphores;
 
-   if(vkQueueSubmit(vulkanDevice.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+   // the asset loader submits uploads to the same queue from its own thread
+   std::unique_lock<std::mutex> queueLock(vulkanDevice.queueMutex);
+
+   if(vkQueueSubmit(vulkanDevice.graphicsQueue, 1, &submitInfo, frameResources.fence) != VK_SUCCESS)
    {
       throw std::runtime_error("failed to submit draw command buffer");
    }
@@ -1281,6 +1830,8 @@ void HelloTriangleApplication::drawFrame()
 
    result = vkQueuePresentKHR(vulkanDevice.presentQueue, &presentInfo);
 
+   queueLock.unlock();
+
    if(result == VK_ERROR_OUT_OF_DATE_KHR ||
       result == VK_SUBOPTIMAL_KHR)
    {
@@ -1359,15 +1910,19 @@ std::vector<const char*> HelloTriangleApplication::getRequiredExtensions()
 {
    std::vector<const char*> extensions;
 
-   unsigned int glfwExtensionCount = 0;
+   // surface extensions are only needed when we have a window
+   if(!headless)
+   {
+      unsigned int glfwExtensionCount = 0;
 
-   const char** glfwExtensions;
+      const char** glfwExtensions;
 
-   glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+      glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-   for(unsigned int i = 0; i < glfwExtensionCount; i++)
-   {
-      extensions.push_back(glfwExtensions[i]);
+      for(unsigned int i = 0; i < glfwExtensionCount; i++)
+      {
+         extensions.push_back(glfwExtensions[i]);
+      }
    }
 
    if(enableValidationLayers)
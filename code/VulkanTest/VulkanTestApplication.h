@@ -1,11 +1,15 @@
 #pragma once
 
 #include "stdafx.h"
+#include "AssetLoader.h"
 #include "VulkanShader.h"
 #include "Camera.h"
+#include "GpuCulling.h"
+#include "JobSystem.h"
 #include "Mesh.h"
 #include "WorldObject.h"
 #include "VulkanDevice.hpp"
+#include "UploadManager.h"
 
 /// TODO: fix proper cleanup. currently lots of stuff that is not deleted correctly/at all
 class HelloTriangleApplication
@@ -25,6 +29,103 @@ protected:
 public:
    void run();
 
+   // Headless renders into an offscreen colour + depth image instead of a swapchain.
+   // No window or surface is created, so this also works on machines without a display (CI, render farm).
+   void setHeadless(bool headless)
+   {
+      this->headless = headless;
+   }
+
+   // Stop after this many frames. 0 means run until the window is closed.
+   // Headless runs always need a limit, so they default to DEFAULT_HEADLESS_FRAMES.
+   void setFrameLimit(uint32_t frameLimit)
+   {
+      this->frameLimit = frameLimit;
+   }
+
+   // How many frames the CPU may be ahead of the GPU. Every frame in flight has its own command buffers, camera
+   // buffer and instance buffer, so the CPU can record the next frame while the GPU renders the previous one.
+   // 1 waits for the GPU every frame. Has to be set before run().
+   void setFramesInFlight(uint32_t framesInFlight)
+   {
+      this->framesInFlight = framesInFlight > 0 ? framesInFlight : 1;
+   }
+
+   // Culls the instances in a compute shader and draws them with indirect draws, see GpuCulling. Falls back to culling
+   // on the CPU if the device can't do it. Has to be set before run().
+   void setGpuCulling(bool gpuCulling)
+   {
+      this->gpuCullingRequested = gpuCulling;
+   }
+
+   // false if it wasn't asked for or isn't supported, only known after run()
+   bool isGpuCulling()
+   {
+      return gpuCullingUsed;
+   }
+
+   // Culls on the CPU by walking the AabbTree of the objects instead of testing all of them. Has to be set before run().
+   void setHierarchicalCulling(bool hierarchicalCulling)
+   {
+      this->hierarchicalCulling = hierarchicalCulling;
+   }
+
+   // Adds this many cubes to the default scene, for benchmarking. Has to be set before run().
+   void setExtraInstances(uint32_t extraInstances)
+   {
+      this->extraInstances = extraInstances;
+   }
+
+   // Gives every object a box collider and sends the extra cubes into each other. Has to be set before run().
+   void setCollisions(bool collisions)
+   {
+      this->collisions = collisions;
+   }
+
+   // Prints the statistics of the memory allocator, the geometry arenas and the sampler cache once the scene is
+   // loaded. Has to be set before run().
+   void setPrintStats(bool printStats)
+   {
+      this->printStats = printStats;
+   }
+
+   // draw calls in the recorded command buffers
+   uint32_t getDrawCount()
+   {
+      return drawCount;
+   }
+
+   // instances inside and outside of the camera frustum in the last frame. culled on the GPU the counts are read back
+   // after the frame is done, so they are framesInFlight frames old
+   uint32_t getVisibleCount()
+   {
+      return visibleCount;
+   }
+
+   uint32_t getCulledCount()
+   {
+      return culledCount;
+   }
+
+   // contacts between objects in the last frame
+   uint32_t getContactCount()
+   {
+      return contactCount;
+   }
+
+   // CPU time (in milliseconds) for each frame, only recorded when a frame limit is set.
+   const std::vector<double>& getFrameTimes()
+   {
+      return frameTimes;
+   }
+
+   // Time (in milliseconds) the CPU waited for the GPU at the start of each frame, only recorded when a frame limit is set.
+   // Close to 0 means the CPU is the bottleneck, close to the frame time means the GPU is.
+   const std::vector<double>& getFenceWaitTimes()
+   {
+      return fenceWaitTimes;
+   }
+
    void cleanupSwapChain();
    void recreateSwapChain();
 
@@ -34,39 +135,76 @@ public:
       glm::mat4 projection;
    } uboVS;
 
-   struct
-   {
-      //TODO: Create Buffer class that takes care of buffers creation/memory handling etc.
-      VkBuffer cameraBuffer;
-      VkDeviceMemory cameraBufferMemory;
-   } uniformBuffers;
-
    // TODO: move this into the mesh/object class .
    float animationTimer = 0.0f;
 
 private:
 
+   static const uint32_t DEFAULT_HEADLESS_FRAMES = 100;
+   static const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+   // the frame job system already has a worker per core, loading only gets a few more threads next to it
+   static const uint32_t ASSET_LOADER_WORKERS = 2;
+
+   bool headless = false;
+   uint32_t frameLimit = 0;
+   uint32_t extraInstances = 0;
+   uint32_t drawCount = 0;
+   uint32_t visibleCount = 0;
+   uint32_t culledCount = 0;
+   uint32_t contactCount = 0;
+   uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+   bool gpuCullingRequested = false;
+   bool gpuCullingUsed = false;
+   bool hierarchicalCulling = false;
+   bool collisions = false;
+   bool printStats = false;
+   std::vector<double> frameTimes;
+   std::vector<double> fenceWaitTimes;
+
    void mainLoop();
 
+   void handleInput(float dt);
+
+   // a click picks the object under the cursor, after the objects are updated
+   bool pickRequested = false;
+   bool mouseWasDown = false;
+
+   // prints the object under the cursor
+   void pickObject();
+
    void updateUniformBuffer();
 
    void drawFrame();
 
    // glfw stuff
-   GLFWwindow* window;
+   GLFWwindow* window = nullptr;
    void initWindow();
 
    // vulkan stuff
-   VulkanStuff vulkanStuff;
-
    vks::VulkanDevice vulkanDevice;
 
+   vks::UploadManager uploadManager;
+
+   JobSystem jobSystem{ ASSET_LOADER_WORKERS };
+   AssetLoader* assetLoader = nullptr;
+
+   // the per frame work: transforms and recording the secondary command buffers.
+   // separate from jobSystem, so a frame never waits behind a model being parsed
+   JobSystem frameJobSystem;
+
    VkDebugReportCallbackEXT callback;
    
    Mesh *mesh;
    WorldObject *worldObject;
    WorldObjectToMeshMapper *worldObjectToMeshMapper;
 
+   // nullptr when culling on the CPU
+   GpuCulling* gpuCulling = nullptr;
+
+   // of the camera in the current frame
+   Frustum frustum;
+
    // list of these, mesh needs to point at it. 
    VulkanShader vertShader;
    VulkanShader fragShader;
@@ -81,20 +219,47 @@ private:
 
    std::vector<VkFramebuffer> swapChainFrameBuffers;
 
-   
-   VkSemaphore imageAvailableSemaphore;
-   VkSemaphore renderFinishedSemaphore;
+   // The command buffers are recorded every frame. The draws are split in slices that are recorded into secondary
+   // command buffers on the recording threads, the primary command buffer begins the render pass and executes them.
+   // A command pool can only be used by one thread at a time, so every slice has its own.
+   // Everything the CPU writes during a frame is in here once per frame in flight, and is only touched after the fence.
+   struct FrameResources
+   {
+      VkCommandPool commandPool = VK_NULL_HANDLE;
+      VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+      std::vector<VkCommandPool> secondaryCommandPools;
+      std::vector<VkCommandBuffer> secondaryCommandBuffers;
+
+      // signalled when the GPU is done with the frame
+      VkFence fence = VK_NULL_HANDLE;
+
+      VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+      VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+
+      //TODO: Create Buffer class that takes care of buffers creation/memory handling etc.
+      VkBuffer cameraBuffer = VK_NULL_HANDLE;
+      vks::Allocation cameraBufferMemory;
+
+      VkDescriptorSet descriptorSetMatrixBuffer = VK_NULL_HANDLE;
+   };
+
+   std::vector<FrameResources> frames;
+
+   // the frame the CPU is working on
+   uint32_t currentFrame = 0;
+
+   // fewer draws than this are not worth handing to another thread
+   static const uint32_t MIN_DRAWS_PER_SLICE = 64;
 
    Camera camera;
 
    VkImage depthImage;
-   VkDeviceMemory depthImageMemory;
+   vks::Allocation depthImageMemory;
    VkImageView depthImageView;
 
    VkDescriptorPool descriptorPool;
 
-   VkDescriptorSet descriptorSetMatrixBuffer;
-
    VkViewport viewport ={};
 
    void initVulkan();
@@ -123,7 +288,7 @@ private:
 
    // These two are used for depth resource and swapchain. So I should probably make them helper functions, so I can use them from texture as well. 
    // or make them accessible from texture by changing the architecture.
-   void createImage(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage*, VkDeviceMemory*);
+   void createImage(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage*, vks::Allocation*);
 
    VkImageView createImageView(VkImage, VkFormat, VkImageAspectFlags);
 
@@ -135,9 +300,35 @@ private:
 
    void createDescriptorSet();
 
-   void createCommandBuffers();
+   // a sub mesh drawn for all instances of its mesh
+   struct DrawCommand
+   {
+      // in the instance batches, for culling on the GPU
+      uint32_t batch;
+      uint32_t descriptorSetId;
+      uint32_t arenaIndex;
+      uint32_t firstIndex;
+      uint32_t numberOfIndices;
+      int32_t vertexOffset;
+      uint32_t firstInstance;
+      uint32_t numberOfInstances;
+   };
+
+   // for the visible instances of all resident meshes, sorted by descriptor set. culled on the GPU these are for all
+   // instances, the instance counts come from the compute shader
+   std::vector<DrawCommand> buildDrawCommands();
+
+   // hands the bounds of the installed meshes to the world objects for culling
+   void updateMeshBounds();
 
-   void createSemaphores();
+   void createFrameResources();
+   void destroyFrameResources();
+
+   // the GPU has to be done with the current frame
+   void recordCommandBuffer(uint32_t imageIndex);
+
+   // firstDraw is the index of the first draw in drawCommands, and in the indirect buffer when culling on the GPU
+   void recordSecondaryCommandBuffer(uint32_t slice, uint32_t imageIndex, const std::vector<DrawCommand>& drawCommands, size_t firstDraw, size_t numberOfDraws);
 
    VkFormat findSupportedFormat(const std::vector<VkFormat>&, VkImageTiling, VkFormatFeatureFlags);
 
@@ -178,6 +369,11 @@ private:
 
    void createImageViews();
 
+   // headless "swapchain", a single colour image we render into and that can be copied out afterwards.
+   vks::Allocation offscreenImageMemory;
+
+   void createOffscreenTarget();
+
    // cleanup of vulkan stuff
    void cleanUp();
 };
\ No newline at end of file
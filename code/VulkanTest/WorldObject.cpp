@@ -1,85 +1,362 @@
 #include "WorldObject.h"
+#include <algorithm>
+#include <cstring>
 
 
-//TODO: add collision box and collision detections. Object vs object, and object vs ray to start
-
-
-WorldObject::WorldObject(WorldObjectToMeshMapper *worldObjectToMeshMapper, vks::VulkanDevice* vulkanDevice)
+WorldObject::WorldObject(WorldObjectToMeshMapper *worldObjectToMeshMapper, vks::VulkanDevice* vulkanDevice, JobSystem* jobSystem)
+   : collisions(jobSystem)
 {
    this->worldObjectToMeshMapper = worldObjectToMeshMapper;
 
    this->vulkanDevice = vulkanDevice;
 
+   this->jobSystem = jobSystem;
+
    numberOfObjects = 0;
 }
 
 WorldObject::~WorldObject()
 {
-   vkDestroyBuffer(vulkanDevice->device, worldMatrixUBO.buffer, nullptr);
-   vkFreeMemory(vulkanDevice->device, worldMatrixUBO.memory, nullptr);
+   for(auto& instances : frameInstances)
+   {
+      vulkanDevice->destroyBuffer(instances.buffer, instances.memory);
+      vulkanDevice->destroyBuffer(instances.visibleBuffer, instances.visibleMemory);
+   }
 
    vkDestroyDescriptorSetLayout(vulkanDevice->device, descriptorSetLayout, nullptr);
 
    vkDestroyDescriptorPool(vulkanDevice->device, descriptorPool, nullptr);
+}
+
+void WorldObject::update(float dt)
+{
+   uint32_t numberOfBlocks = transforms.getNumberOfBlocks();
+
+   // a few ranges per thread, so a thread that finishes early can steal the rest
+   uint32_t blocksPerJob = std::max(MIN_BLOCKS_PER_JOB, numberOfBlocks / ((jobSystem->getNumberOfWorkers() + 1) * 4));
+
+   updatedObjects.resize((numberOfBlocks + blocksPerJob - 1) / blocksPerJob);
+
+   // every block is moved and its matrices are rebuilt by the same job, while they are in the cache
+   jobSystem->parallelFor(0, numberOfBlocks, blocksPerJob, [this, dt, blocksPerJob](uint32_t firstBlock, uint32_t lastBlock)
+   {
+      std::vector<uint32_t>& updated = updatedObjects[firstBlock / blocksPerJob];
+      updated.clear();
+
+      transforms.integrate(dt, firstBlock, lastBlock);
+      updateMatrices(updated, firstBlock, lastBlock);
+   });
+
+   if(collisions.getNumberOfColliders() > 0)
+   {
+      collisions.resolve(transforms, modelMatrix.data(), dt);
 
-   if(uboDataDynamic.model != nullptr)
+      // the objects that were pushed apart get their matrices again, they can be in the lists twice now
+      jobSystem->parallelFor(0, numberOfBlocks, blocksPerJob, [this, blocksPerJob](uint32_t firstBlock, uint32_t lastBlock)
+      {
+         updateMatrices(updatedObjects[firstBlock / blocksPerJob], firstBlock, lastBlock);
+      });
+
+      for(uint32_t index : collisions.getResolvedObjects())
+      {
+         glm::vec3 velocity = transforms.getVelocity(index);
+
+         movingSpeed[index] = glm::length(velocity);
+
+         if(movingSpeed[index] > 0.f)
+         {
+            movingDirection[index] = velocity / movingSpeed[index];
+         }
+      }
+   }
+
+   markUpdatedInstancesDirty();
+}
+
+void WorldObject::updateMatrices(std::vector<uint32_t>& updated, uint32_t firstBlock, uint32_t lastBlock)
+{
+   size_t firstUpdated = updated.size();
+
+   transforms.updateMatrices(modelMatrix.data(), updated, firstBlock, lastBlock);
+
+   // otherwise they are all rebuilt before culling anyway
+   if(!worldBoundsInvalid)
    {
-      alignedFree(uboDataDynamic.model);
+      for(size_t i = firstUpdated; i < updated.size(); i++)
+      {
+         updateWorldBounds(updated[i]);
+      }
    }
 }
 
-void WorldObject::update(float dt)
+void WorldObject::markUpdatedInstancesDirty()
+{
+   size_t numberOfUpdated = 0;
+   for(const auto& updated : updatedObjects)
+   {
+      numberOfUpdated += updated.size();
+   }
+
+   // nobody asked the tree for a while, going through all objects is cheaper than the list by now
+   if(!treeInvalid && treeDirtyObjects.size() + numberOfUpdated > numberOfObjects)
+   {
+      treeInvalid = true;
+      treeDirtyObjects.clear();
+   }
+
+   if(!treeInvalid)
+   {
+      for(const auto& updated : updatedObjects)
+      {
+         treeDirtyObjects.insert(treeDirtyObjects.end(), updated.begin(), updated.end());
+      }
+   }
+
+   // lots of changes, every buffer is rewritten anyway
+   if(numberOfUpdated >= instanceOrder.size() / 2 && !instanceOrder.empty())
+   {
+      for(auto& instances : frameInstances)
+      {
+         instances.rewriteAll = true;
+         instances.dirtySlots.clear();
+      }
+
+      return;
+   }
+
+   for(const auto& updated : updatedObjects)
+   {
+      for(uint32_t index : updated)
+      {
+         markInstanceDirty(index);
+      }
+   }
+}
+
+void WorldObject::markInstanceDirty(uint32_t index)
+{
+   // not in the instance buffers yet, all of them are rewritten when the batches are built
+   if(index >= instanceSlot.size() || instanceSlot[index] == UINT32_MAX)
+   {
+      return;
+   }
+
+   for(auto& instances : frameInstances)
+   {
+      if(instances.rewriteAll)
+      {
+         continue;
+      }
+
+      // lots of changes, writing everything is cheaper than going through the list
+      if(instances.dirtySlots.size() >= instanceOrder.size() / 2)
+      {
+         instances.rewriteAll = true;
+         instances.dirtySlots.clear();
+         continue;
+      }
+
+      instances.dirtySlots.push_back(instanceSlot[index]);
+   }
+}
+
+void WorldObject::updateWorldBounds(uint32_t index)
+{
+   // not in the instance buffers yet
+   if(index >= instanceSlot.size() || instanceSlot[index] == UINT32_MAX)
+   {
+      return;
+   }
+
+   worldBounds.set(instanceSlot[index], getMeshBounds(meshId[index]), modelMatrix[index]);
+}
+
+void WorldObject::rebuildWorldBounds()
 {
-   for(uint32_t i = 0; i < position.size(); i++)
+   if(!worldBoundsInvalid)
+   {
+      return;
+   }
+
+   uint32_t numberOfSlots = static_cast<uint32_t>(instanceOrder.size());
+   uint32_t slotsPerJob = std::max(MIN_SLOTS_PER_CULL_JOB, numberOfSlots / ((jobSystem->getNumberOfWorkers() + 1) * 4));
+
+   jobSystem->parallelFor(0, numberOfSlots, slotsPerJob, [this](uint32_t firstSlot, uint32_t lastSlot)
    {
-      if(movingSpeed[i] != 0.f)
+      for(uint32_t slot = firstSlot; slot < lastSlot; slot++)
       {
-         position[i] += dt * movingSpeed[i] * movingDirection[i];
-         invalidateModelMatrix(i);
+         updateWorldBounds(instanceOrder[slot]);
       }
+   });
+
+   worldBoundsInvalid = false;
+
+   // every box may have changed
+   treeInvalid = true;
+   treeDirtyObjects.clear();
+}
+
+void WorldObject::updateTreeProxy(uint32_t index)
+{
+   // not in the instance buffers yet
+   if(index >= instanceSlot.size() || instanceSlot[index] == UINT32_MAX)
+   {
+      return;
+   }
+
+   uint32_t slot = instanceSlot[index];
+
+   glm::vec3 center(worldBounds.centerX[slot], worldBounds.centerY[slot], worldBounds.centerZ[slot]);
+   glm::vec3 extent(worldBounds.extentX[slot], worldBounds.extentY[slot], worldBounds.extentZ[slot]);
+
+   Aabb aabb(center - extent, center + extent);
+
+   if(treeProxy[index] == AabbTree::NULL_NODE)
+   {
+      treeProxy[index] = tree.createProxy(aabb, index);
    }
-   for(uint32_t i = 0; i < rotation.size(); i++)
+   else
    {
-      if(rotationSpeed[i] != glm::vec3(0.f))
+      tree.moveProxy(treeProxy[index], aabb);
+   }
+}
+
+void WorldObject::updateTree()
+{
+   rebuildWorldBounds();
+
+   treeProxy.resize(instanceSlot.size(), AabbTree::NULL_NODE);
+
+   if(treeInvalid)
+   {
+      for(uint32_t index = 0; index < treeProxy.size(); index++)
+      {
+         updateTreeProxy(index);
+      }
+
+      // inserting them one by one gives a worse tree
+      tree.rebuild();
+
+      treeInvalid = false;
+   }
+   else
+   {
+      for(uint32_t index : treeDirtyObjects)
       {
-         rotation[i] += dt * rotationSpeed[i];
-         invalidateModelMatrix(i);
+         updateTreeProxy(index);
       }
    }
 
-   updateModelMatrix();
+   treeDirtyObjects.clear();
 }
 
-void WorldObject::updateModelMatrix()
+uint32_t WorldObject::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float* distance)
 {
-   for(size_t i = 0; i < modelMatrix.size(); i++)
+   updateTree();
+
+   uint32_t closestObject = UINT32_MAX;
+   float closestDistance = maxDistance;
+
+   // only hits closer than the closest one so far are reported
+   tree.raycast(origin, direction, maxDistance, [this, &closestObject, &closestDistance](int32_t proxy, float hitDistance)
    {
-      if(isModelMatrixInvalid[i])
+      closestObject = tree.getUserData(proxy);
+      closestDistance = hitDistance;
+
+      return hitDistance;
+   });
+
+   if(distance != nullptr)
+   {
+      *distance = closestDistance;
+   }
+
+   return closestObject;
+}
+
+void WorldObject::queryOverlaps(const Aabb& aabb, std::vector<uint32_t>& objects)
+{
+   updateTree();
+
+   tree.query(aabb, [this, &objects](int32_t proxy)
+   {
+      objects.push_back(tree.getUserData(proxy));
+      return true;
+   });
+}
+
+void WorldObject::findOverlappingPairs(std::vector<std::pair<uint32_t, uint32_t>>& pairs)
+{
+   updateTree();
+
+   uint32_t numberOfTasks = (jobSystem->getNumberOfWorkers() + 1) * 4;
+   numberOfTasks = std::max(1u, std::min(numberOfTasks, tree.getNumberOfProxies() / MIN_PROXIES_PER_PAIR_JOB));
+
+   tree.splitPairs(numberOfTasks, pairTasks);
+
+   pairsInJob.resize(pairTasks.size());
+
+   jobSystem->parallelFor(0, static_cast<uint32_t>(pairTasks.size()), 1, [this](uint32_t first, uint32_t last)
+   {
+      for(uint32_t task = first; task < last; task++)
       {
-         modelMatrix[i] = glm::translate(glm::mat4(), position[i]);
+         pairsInJob[task].clear();
+         tree.findPairs(pairTasks[task], pairsInJob[task]);
+      }
+   });
 
-         modelMatrix[i] = glm::rotate(modelMatrix[i], glm::radians(rotation[i].z), glm::vec3(0.0f, 0.0f, 1.0f));
-         modelMatrix[i] = glm::rotate(modelMatrix[i], glm::radians(rotation[i].y), glm::vec3(0.0f, 1.0f, 0.0f));
-         modelMatrix[i] = glm::rotate(modelMatrix[i], glm::radians(rotation[i].x), glm::vec3(1.0f, 0.0f, 0.0f));
+   pairs.clear();
 
-         modelMatrix[i] = glm::scale(modelMatrix[i], scale[i]);
+   for(const auto& found : pairsInJob)
+   {
+      pairs.insert(pairs.end(), found.begin(), found.end());
+   }
+
+   // the shape of the tree depends on the order things were moved in
+   std::sort(pairs.begin(), pairs.end());
+}
+
+void WorldObject::setMeshBounds(uint32_t meshId, const Bounds& bounds)
+{
+   if(meshId >= meshBounds.size())
+   {
+      meshBounds.resize(meshId + 1);
+   }
+
+   if(meshBounds[meshId] != bounds)
+   {
+      meshBounds[meshId] = bounds;
+      worldBoundsInvalid = true;
+
+      for(uint32_t index = 0; index < numberOfObjects; index++)
+      {
+         if(this->meshId[index] == meshId)
+         {
+            collisions.setColliderBounds(index, bounds);
+         }
       }
    }
+}
 
-   updateDynamicUniformBuffer();
+void WorldObject::setCollider(uint32_t index, ColliderShape shape, bool movable)
+{
+   collisions.setCollider(index, shape, getMeshBounds(meshId[index]), movable);
 }
 
-void WorldObject::createDescriptorPool()
+void WorldObject::createDescriptorPool(uint32_t framesInFlight)
 {
+   frameInstances.resize(framesInFlight);
+
+   // the matrices and the visible slots
    VkDescriptorPoolSize poolSize ={};
-   poolSize.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-   poolSize.descriptorCount = 1;
+   poolSize.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+   poolSize.descriptorCount = framesInFlight * 2;
 
    VkDescriptorPoolCreateInfo poolInfo ={};
    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
    poolInfo.poolSizeCount = 1;
    poolInfo.pPoolSizes    = &poolSize;
-   poolInfo.maxSets       = 1;
+   poolInfo.maxSets       = framesInFlight;
 
    if(vkCreateDescriptorPool(vulkanDevice->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
    {
@@ -89,15 +366,23 @@ void WorldObject::createDescriptorPool()
 
 void WorldObject::createDescriptorSetLayout()
 {
-   auto descriptorSetLayoutBinding = vkn::inits::
-      descriptorSetLayoutBinding(
+   std::array<VkDescriptorSetLayoutBinding, 2> descriptorSetLayoutBindings ={
+      // model matrices
+      vkn::inits::descriptorSetLayoutBinding(
          1,
-         VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-         VK_SHADER_STAGE_VERTEX_BIT);
+         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         VK_SHADER_STAGE_VERTEX_BIT),
+      // visible slots
+      vkn::inits::descriptorSetLayoutBinding(
+         2,
+         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         VK_SHADER_STAGE_VERTEX_BIT)
+   };
 
    auto layoutCreateInfo = vkn::inits::
       descriptorSetLayoutCreateInfo(
-         descriptorSetLayoutBinding);
+         descriptorSetLayoutBindings.data(),
+         static_cast<uint32_t>(descriptorSetLayoutBindings.size()));
 
    if(vkCreateDescriptorSetLayout(vulkanDevice->device, &layoutCreateInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
    {
@@ -107,74 +392,42 @@ void WorldObject::createDescriptorSetLayout()
 
 void WorldObject::createDescriptorSet()
 {
-   // TODO: not the responsibility of this function to do this. 
-   // We should however have a check that makes sure that UBO and descriptor pool is initialized
-   createUniformBuffer();
+   std::vector<VkDescriptorSetLayout> layouts(frameInstances.size(), descriptorSetLayout);
+   std::vector<VkDescriptorSet> descriptorSets(frameInstances.size());
 
    VkDescriptorSetAllocateInfo allocInfoMatrixBuffer ={};
    allocInfoMatrixBuffer.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
    allocInfoMatrixBuffer.descriptorPool     = descriptorPool;
-   allocInfoMatrixBuffer.descriptorSetCount = 1;
-   allocInfoMatrixBuffer.pSetLayouts        = &descriptorSetLayout;
+   allocInfoMatrixBuffer.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+   allocInfoMatrixBuffer.pSetLayouts        = layouts.data();
 
-   if(vkAllocateDescriptorSets(vulkanDevice->device, &allocInfoMatrixBuffer, &descriptorSet) != VK_SUCCESS)
+   if(vkAllocateDescriptorSets(vulkanDevice->device, &allocInfoMatrixBuffer, descriptorSets.data()) != VK_SUCCESS)
    {
       throw std::runtime_error("failed to allocate MatrixBuffer descriptor set!");
    }
 
+   buildInstanceBatches();
+   instancesAdded = false;
 
-   VkDescriptorBufferInfo dynamicBufferInfo ={};
-   dynamicBufferInfo.buffer = worldMatrixUBO.buffer;
-   dynamicBufferInfo.offset = 0;
-   dynamicBufferInfo.range  = VK_WHOLE_SIZE;
-
-   VkWriteDescriptorSet descriptorWritesMatrixBuffer ={};
-
-   descriptorWritesMatrixBuffer.sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-   descriptorWritesMatrixBuffer.dstSet           = descriptorSet;
-   descriptorWritesMatrixBuffer.dstBinding       = 1;
-   descriptorWritesMatrixBuffer.dstArrayElement  = 0;
-   descriptorWritesMatrixBuffer.descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-   descriptorWritesMatrixBuffer.descriptorCount  = 1;
-   descriptorWritesMatrixBuffer.pBufferInfo      = &dynamicBufferInfo;
-   descriptorWritesMatrixBuffer.pImageInfo       = nullptr;
-   descriptorWritesMatrixBuffer.pTexelBufferView = nullptr;
+   for(uint32_t i = 0; i < frameInstances.size(); i++)
+   {
+      frameInstances[i].descriptorSet = descriptorSets[i];
 
-   vkUpdateDescriptorSets(vulkanDevice->device, 1, &descriptorWritesMatrixBuffer, 0, nullptr);
+      createInstanceBuffer(i);
+   }
 }
 
 uint32_t WorldObject::addInstance(uint32_t meshId)
 {
-   this->meshId.push_back(meshId);
-   position.push_back(glm::vec3(0.f));
-   rotation.push_back(glm::vec3(0.f));
-   scale.push_back(glm::vec3(1.f));
-   rotationSpeed.push_back(glm::vec3(0.f, 0.f, 10.f));
-   movingSpeed.push_back(0.f);
-   isModelMatrixInvalid.push_back(true);
-   isChangingPosition.push_back(false);
-   isChangingRotation.push_back(false);
-   isChangingScale.push_back(false);
-   modelMatrix.push_back(glm::mat4());
-   movingDirection.push_back(glm::vec3(0.f));
-   targetPosition.push_back(glm::vec3(0.f));
-   targetRotation.push_back(glm::vec3(0.f));
-   targetScale.push_back(glm::vec3(0.f));
-
-   worldObjectToMeshMapper->addWorldObject(meshId, numberOfObjects);
-
-   return static_cast<uint32_t>(numberOfObjects++);
+   return addInstance(meshId, glm::vec3(0.f), glm::vec3(0.f), glm::vec3(1.f));
 }
 
 uint32_t WorldObject::addInstance(uint32_t meshId, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale)
 {
    this->meshId.push_back(meshId);
-   this->position.push_back(position);
-   this->rotation.push_back(rotation);
-   this->scale.push_back(scale);
-   rotationSpeed.push_back(glm::vec3(0.f, 0.f, 10.f));
+   transforms.add(position, rotation, scale);
+   transforms.setRotationSpeed(numberOfObjects, glm::vec3(0.f, 0.f, 10.f));
    movingSpeed.push_back(0.f);
-   isModelMatrixInvalid.push_back(true);
    isChangingPosition.push_back(false);
    isChangingRotation.push_back(false);
    isChangingScale.push_back(false);
@@ -186,6 +439,8 @@ uint32_t WorldObject::addInstance(uint32_t meshId, glm::vec3 position, glm::vec3
 
    worldObjectToMeshMapper->addWorldObject(meshId, numberOfObjects);
 
+   instancesAdded = true;
+
    return static_cast<uint32_t>(numberOfObjects++);
 }
 
@@ -209,100 +464,279 @@ void WorldObject::setScale(uint32_t index, glm::vec3 scale)
 
 void WorldObject::setRotationSpeed(uint32_t index, float yaw, float pitch, float roll)
 {
-   rotationSpeed[index].x = yaw;
-   rotationSpeed[index].y = pitch;
-   rotationSpeed[index].z = roll;
+   transforms.setRotationSpeed(index, glm::vec3(yaw, pitch, roll));
 }
 
 void WorldObject::setMovingSpeed(uint32_t index, float movingSpeed)
 {
    this->movingSpeed[index] = movingSpeed;
+
+   transforms.setVelocity(index, movingSpeed * movingDirection[index]);
 }
 
 void WorldObject::setMovingDirection(uint32_t index, glm::vec3 movingDirection)
 {
    this->movingDirection[index] = movingDirection;
+
+   transforms.setVelocity(index, movingSpeed[index] * movingDirection);
 }
 
 void WorldObject::invalidateModelMatrix(uint32_t index)
 {
-   isModelMatrixInvalid[index] = true;
+   transforms.markDirty(index);
 }
 
-void WorldObject::createUniformBuffer()
+void WorldObject::createInstanceBuffer(uint32_t frame)
 {
-   if(uboDataDynamic.model != nullptr)
+   FrameInstances& instances = frameInstances[frame];
+
+   if(instances.buffer != VK_NULL_HANDLE)
    {
-      alignedFree(uboDataDynamic.model);
+      vulkanDevice->destroyBuffer(instances.buffer, instances.memory);
+      vulkanDevice->destroyBuffer(instances.visibleBuffer, instances.visibleMemory);
    }
-   size_t uboAlignment = (size_t)vulkanDevice->deviceProperties.limits.minUniformBufferOffsetAlignment;
-   dynamicAlignment = (sizeof(glm::mat4) / uboAlignment) * uboAlignment + ((sizeof(glm::mat4) % uboAlignment) > 0 ? uboAlignment : 0);
 
-   size_t bufferSize = this->getNumberOfObjects() * dynamicAlignment;
-   dynamicBufferSize = bufferSize;
-   uboDataDynamic.model = (glm::mat4*)alignedAlloc(bufferSize, dynamicAlignment);
-   assert(uboDataDynamic.model);
+   instances.rewriteAll = true;
+   instances.dirtySlots.clear();
+
+   // room to grow, so adding objects one by one doesn't create a new buffer every frame. a buffer can't be empty
+   instances.capacity = std::max({ static_cast<uint32_t>(instanceOrder.size()), instances.capacity * 2, 1u });
 
-   std::cout << "minUniformBufferOffsetAlignment = " << uboAlignment << std::endl;
-   std::cout << "dynamicAlignment = " << dynamicAlignment << std::endl;
-   std::cout << "bufferSize = " << bufferSize << std::endl;
+   // storage buffers are tightly packed, no per object alignment like the dynamic uniform buffer needed
+   vulkanDevice->createBuffer(
+      instances.capacity * sizeof(glm::mat4),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      &instances.buffer,
+      &instances.memory);
 
+   // every instance can be visible
    vulkanDevice->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      instances.capacity * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-      &worldMatrixUBO.buffer,
-      &worldMatrixUBO.memory);
+      &instances.visibleBuffer,
+      &instances.visibleMemory);
+
+   std::array<VkDescriptorBufferInfo, 2> bufferInfos ={};
+   bufferInfos[0].buffer = instances.buffer;
+   bufferInfos[0].offset = 0;
+   bufferInfos[0].range  = VK_WHOLE_SIZE;
+   bufferInfos[1].buffer = instances.visibleBuffer;
+   bufferInfos[1].offset = 0;
+   bufferInfos[1].range  = VK_WHOLE_SIZE;
+
+   std::array<VkWriteDescriptorSet, 2> descriptorWritesMatrixBuffer ={};
+
+   for(uint32_t i = 0; i < descriptorWritesMatrixBuffer.size(); i++)
+   {
+      descriptorWritesMatrixBuffer[i].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWritesMatrixBuffer[i].dstSet           = instances.descriptorSet;
+      descriptorWritesMatrixBuffer[i].dstBinding       = 1 + i;
+      descriptorWritesMatrixBuffer[i].dstArrayElement  = 0;
+      descriptorWritesMatrixBuffer[i].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptorWritesMatrixBuffer[i].descriptorCount  = 1;
+      descriptorWritesMatrixBuffer[i].pBufferInfo      = &bufferInfos[i];
+      descriptorWritesMatrixBuffer[i].pImageInfo       = nullptr;
+      descriptorWritesMatrixBuffer[i].pTexelBufferView = nullptr;
+   }
+
+   vkUpdateDescriptorSets(vulkanDevice->device, static_cast<uint32_t>(descriptorWritesMatrixBuffer.size()), descriptorWritesMatrixBuffer.data(), 0, nullptr);
+}
+
+void WorldObject::buildInstanceBatches()
+{
+   instanceOrder.clear();
+   instanceBatches.clear();
+
+   for(const auto& meshObjects : worldObjectToMeshMapper->getMeshObjectMap())
+   {
+      if(meshObjects.second.empty())
+      {
+         continue;
+      }
+
+      InstanceBatch batch;
+      batch.meshId            = static_cast<uint32_t>(meshObjects.first);
+      batch.firstInstance     = static_cast<uint32_t>(instanceOrder.size());
+      batch.numberOfInstances = static_cast<uint32_t>(meshObjects.second.size());
+
+      for(int objectId : meshObjects.second)
+      {
+         instanceOrder.push_back(static_cast<uint32_t>(objectId));
+      }
+
+      instanceBatches.push_back(batch);
+   }
+
+   instanceSlot.assign(numberOfObjects, UINT32_MAX);
+
+   for(uint32_t slot = 0; slot < instanceOrder.size(); slot++)
+   {
+      instanceSlot[instanceOrder[slot]] = slot;
+   }
 
-   // TODO: make so map can be persistent. no need to map/unmap everytime we copy 
-   // data in dynamic buffers.
+   // every object may have moved to another slot
+   for(auto& instances : frameInstances)
+   {
+      instances.rewriteAll = true;
+      instances.dirtySlots.clear();
+   }
 
-   updateDynamicUniformBuffer();
+   worldBounds.resize(static_cast<uint32_t>(instanceOrder.size()));
+   worldBoundsInvalid = true;
 }
 
-void WorldObject::updateDynamicUniformBuffer()
+void WorldObject::updateInstanceBuffer(uint32_t frame)
 {
-   for(uint32_t i = 0; i < this->getNumberOfObjects(); i++)
+   // the frames still in flight keep drawing with the old batches, they match the matrices in their buffers
+   if(instancesAdded)
+   {
+      buildInstanceBatches();
+      instancesAdded = false;
+   }
+
+   if(instanceOrder.empty())
+   {
+      return;
+   }
+
+   FrameInstances& instances = frameInstances[frame];
+
+   if(instances.capacity < instanceOrder.size())
+   {
+      createInstanceBuffer(frame);
+   }
+
+   // written straight into the mapped memory, no copy of the whole buffer
+   glm::mat4* matrices = static_cast<glm::mat4*>(instances.memory.mapped);
+
+   if(instances.rewriteAll)
    {
-      glm::mat4* modelMat = (glm::mat4*)(((uint64_t)uboDataDynamic.model + (i * dynamicAlignment)));
+      for(size_t slot = 0; slot < instanceOrder.size(); slot++)
+      {
+         matrices[slot] = modelMatrix[instanceOrder[slot]];
+      }
+
+      vulkanDevice->memoryAllocator.flush(instances.memory, 0, instanceOrder.size() * sizeof(glm::mat4));
 
-      *modelMat = this->getModelMatrix(i);
+      instances.rewriteAll = false;
+      instances.dirtySlots.clear();
+
+      return;
+   }
+
+   if(instances.dirtySlots.empty())
+   {
+      return;
    }
 
-   void *data;
-   vkMapMemory(vulkanDevice->device, worldMatrixUBO.memory, 0, dynamicBufferSize, 0, &data);
+   // sorted, so neighbouring slots end up in one flush range
+   std::sort(instances.dirtySlots.begin(), instances.dirtySlots.end());
+   instances.dirtySlots.erase(std::unique(instances.dirtySlots.begin(), instances.dirtySlots.end()), instances.dirtySlots.end());
 
-   memcpy(data, uboDataDynamic.model, dynamicBufferSize);
+   std::vector<vks::MappedRange> flushRanges;
 
-   VkMappedMemoryRange mappedMemoryRange{};
-   mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+   for(uint32_t slot : instances.dirtySlots)
+   {
+      matrices[slot] = modelMatrix[instanceOrder[slot]];
+
+      VkDeviceSize offset = slot * sizeof(glm::mat4);
+
+      if(!flushRanges.empty() && flushRanges.back().offset + flushRanges.back().size == offset)
+      {
+         flushRanges.back().size += sizeof(glm::mat4);
+      }
+      else
+      {
+         flushRanges.push_back({ offset, sizeof(glm::mat4) });
+      }
+   }
 
-   mappedMemoryRange.memory = worldMatrixUBO.memory;
-   mappedMemoryRange.size = dynamicBufferSize;
-   vkFlushMappedMemoryRanges(vulkanDevice->device, 1, &mappedMemoryRange);
+   vulkanDevice->memoryAllocator.flush(instances.memory, flushRanges);
 
-   vkUnmapMemory(vulkanDevice->device, worldMatrixUBO.memory);
+   instances.dirtySlots.clear();
 }
 
-void WorldObject::updateDescriptorSet()
+void WorldObject::cullInstances(uint32_t frame, const Frustum& frustum)
 {
-   createUniformBuffer();
-
-   VkDescriptorBufferInfo uboBufferInfo ={};
-   uboBufferInfo.buffer = worldMatrixUBO.buffer;
-   uboBufferInfo.offset = 0;
-   uboBufferInfo.range  = VK_WHOLE_SIZE;
-
-   std::array<VkWriteDescriptorSet, 1> descriptorWritesMatrix ={};
-   descriptorWritesMatrix[0].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-   descriptorWritesMatrix[0].dstSet           = descriptorSet;
-   descriptorWritesMatrix[0].dstBinding       = 1;
-   descriptorWritesMatrix[0].dstArrayElement  = 0;
-   descriptorWritesMatrix[0].descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-   descriptorWritesMatrix[0].descriptorCount  = 1;
-   descriptorWritesMatrix[0].pBufferInfo      = &uboBufferInfo;
-   descriptorWritesMatrix[0].pImageInfo       = nullptr;
-   descriptorWritesMatrix[0].pTexelBufferView = nullptr;
-
-   vkUpdateDescriptorSets(vulkanDevice->device, static_cast<uint32_t>(descriptorWritesMatrix.size()), descriptorWritesMatrix.data(), 0, nullptr);
+   FrameInstances& instances = frameInstances[frame];
+
+   instances.visibleBatches.clear();
+   numberOfVisible = 0;
+
+   if(instanceOrder.empty())
+   {
+      return;
+   }
+
+   visibleSlots.clear();
+
+   if(hierarchicalCulling)
+   {
+      updateTree();
+
+      tree.query(frustum, [this](int32_t proxy)
+      {
+         visibleSlots.push_back(instanceSlot[tree.getUserData(proxy)]);
+      });
+
+      // in the order of the tree, the batches need them by slot
+      std::sort(visibleSlots.begin(), visibleSlots.end());
+   }
+   else
+   {
+      rebuildWorldBounds();
+
+      uint32_t numberOfSlots = static_cast<uint32_t>(instanceOrder.size());
+
+      // a few ranges per thread like update, a multiple of 4 for the SSE test
+      uint32_t slotsPerJob = std::max(MIN_SLOTS_PER_CULL_JOB, numberOfSlots / ((jobSystem->getNumberOfWorkers() + 1) * 4));
+      slotsPerJob = (slotsPerJob + 3) & ~3u;
+
+      visibleInJob.resize((numberOfSlots + slotsPerJob - 1) / slotsPerJob);
+
+      jobSystem->parallelFor(0, numberOfSlots, slotsPerJob, [this, &frustum, slotsPerJob](uint32_t firstSlot, uint32_t lastSlot)
+      {
+         std::vector<uint32_t>& visible = visibleInJob[firstSlot / slotsPerJob];
+         visible.clear();
+
+         frustum.cull(worldBounds, firstSlot, lastSlot, visible);
+      });
+
+      for(const auto& visible : visibleInJob)
+      {
+         visibleSlots.insert(visibleSlots.end(), visible.begin(), visible.end());
+      }
+   }
+
+   numberOfVisible = static_cast<uint32_t>(visibleSlots.size());
+
+   if(visibleSlots.empty())
+   {
+      return;
+   }
+
+   // the whole list changes with every camera move, so it's written in one go
+   memcpy(instances.visibleMemory.mapped, visibleSlots.data(), visibleSlots.size() * sizeof(uint32_t));
+   vulkanDevice->memoryAllocator.flush(instances.visibleMemory, 0, visibleSlots.size() * sizeof(uint32_t));
+
+   // the slots are in order, so the visible instances of a mesh are next to each other
+   for(const auto& batch : instanceBatches)
+   {
+      auto first = std::lower_bound(visibleSlots.begin(), visibleSlots.end(), batch.firstInstance);
+      auto last = std::lower_bound(first, visibleSlots.end(), batch.firstInstance + batch.numberOfInstances);
+
+      if(first == last)
+      {
+         continue;
+      }
+
+      InstanceBatch visibleBatch;
+      visibleBatch.meshId            = batch.meshId;
+      visibleBatch.firstInstance     = static_cast<uint32_t>(first - visibleSlots.begin());
+      visibleBatch.numberOfInstances = static_cast<uint32_t>(last - first);
+
+      instances.visibleBatches.push_back(visibleBatch);
+   }
 }
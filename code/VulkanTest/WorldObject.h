@@ -1,21 +1,56 @@
 #pragma once
 
 #include <vector>
-#include <glm\gtc\matrix_transform.hpp>
-#include <glm\glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/glm.hpp>
 
 #include "stdafx.h"
 
+#include "AabbTree.h"
+#include "Bounds.h"
+#include "CollisionSystem.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "TransformStreams.h"
 #include "WorldObjectToMeshMapper.h"
 #include "VulkanHelpers.hpp"
 #include "VulkanDevice.hpp"
 
 
+// The model matrices of all objects are in one storage buffer, grouped by mesh (in the order of the
+// WorldObjectToMeshMapper), so every mesh can be drawn with a single instanced draw. The vertex shader reads
+// its matrix with gl_InstanceIndex, which starts at the firstInstance of the draw.
+//
+// Every frame in flight has its own instance buffer and descriptor set, updateInstanceBuffer only writes the one
+// of the frame that is being recorded, so the frames the GPU is still working on are left alone.
+// The buffers stay mapped and only the matrices that changed since the frame was last written are copied into them,
+// so objects that don't move cost nothing.
+//
+// cullInstances tests the bounds of every instance against the frustum and writes the slots of the visible ones into
+// a second buffer of the frame, grouped by mesh like the matrices. The vertex shader looks its matrix up through it,
+// so the matrices don't have to move when the visible set changes. The world bounds are kept in slot order and
+// rebuilt together with the matrices. GpuCulling fills the visible buffer in a compute shader instead.
+//
+// The world boxes of the instances are also in an AabbTree for picking and collision queries. It's brought up to date
+// by the first query after update, only the objects that moved out of their fat box are moved in the tree.
+// With hierarchical culling cullInstances walks the tree instead of testing every instance.
+//
+// Objects with a collider bounce off each other, update moves them and then lets the CollisionSystem push apart the
+// ones that ran into each other. Its shape comes from the bounds of the mesh.
+
 class WorldObject
 {
 public:
+   // the instances of one mesh, firstInstance is the index of the first matrix in the instance buffer
+   struct InstanceBatch
+   {
+      uint32_t meshId;
+      uint32_t firstInstance;
+      uint32_t numberOfInstances;
+   };
 
-   WorldObject(WorldObjectToMeshMapper* worldObjectToMeshMapper, vks::VulkanDevice* vulkanDevice);
+   // update() splits the transforms over the job system
+   WorldObject(WorldObjectToMeshMapper* worldObjectToMeshMapper, vks::VulkanDevice* vulkanDevice, JobSystem* jobSystem);
    ~WorldObject();
 
    // could also do it by name?
@@ -32,6 +67,16 @@ public:
    void setMovingSpeed(uint32_t index, float movingSpeed);
    void setMovingDirection(uint32_t index, glm::vec3 movingDirection);
 
+   // An object that isn't movable stops the others but isn't pushed itself. ColliderShape::None removes the collider.
+   // Not while update is running
+   void setCollider(uint32_t index, ColliderShape shape, bool movable = true);
+
+   // found by the last update
+   const std::vector<CollisionSystem::Contact>& getContacts()
+   {
+      return collisions.getContacts();
+   }
+
    glm::mat4 getModelMatrix(uint32_t index)
    {
       return modelMatrix[index];
@@ -47,74 +92,200 @@ public:
       return meshId[index];
    }
 
-private:
+   // only up to date after updateInstanceBuffer
+   const std::vector<InstanceBatch>& getInstanceBatches()
+   {
+      return instanceBatches;
+   }
+
+   // the visible instances of every mesh that has any, firstInstance is the index in the visible buffer of the frame.
+   // only up to date after cullInstances
+   const std::vector<InstanceBatch>& getVisibleBatches(uint32_t frame)
+   {
+      return frameInstances[frame].visibleBatches;
+   }
+
+   // of the last cullInstances
+   uint32_t getNumberOfVisible()
+   {
+      return numberOfVisible;
+   }
+
+   uint32_t getNumberOfCulled()
+   {
+      return static_cast<uint32_t>(instanceOrder.size()) - numberOfVisible;
+   }
 
-   size_t dynamicBufferSize = 0;
-   struct UboDataDynamic
+   // the bounds of the mesh in mesh space, instances of meshes without bounds are culled unless their origin is in view.
+   // not while update is running
+   void setMeshBounds(uint32_t meshId, const Bounds& bounds);
+
+   // empty bounds if they were never set
+   const Bounds& getMeshBounds(uint32_t meshId)
    {
-      glm::mat4 *model = nullptr;
-   } uboDataDynamic;
+      static const Bounds noBounds;
+
+      return meshId < meshBounds.size() ? meshBounds[meshId] : noBounds;
+   }
+
+   // The closest object whose box is hit by the ray before maxDistance, UINT32_MAX if there is none. The distance is
+   // in units of direction. Only objects in the instance buffers are found (after updateInstanceBuffer).
+   // Not while update is running, the same goes for the other queries
+   uint32_t raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float* distance = nullptr);
+
+   // appends the objects whose box overlaps the box
+   void queryOverlaps(const Aabb& aabb, std::vector<uint32_t>& objects);
+
+   // every pair of objects whose boxes overlap, the smaller index first and sorted. split over the job system
+   void findOverlappingPairs(std::vector<std::pair<uint32_t, uint32_t>>& pairs);
 
+   // cullInstances walks the tree, skipping the nodes that are completely outside or inside of the frustum,
+   // instead of testing all instances
+   void setHierarchicalCulling(bool hierarchicalCulling)
+   {
+      this->hierarchicalCulling = hierarchicalCulling;
+   }
 
-   void* alignedAlloc(size_t size, size_t alignment)
+   // instances in the instance buffers, only up to date after updateInstanceBuffer
+   uint32_t getNumberOfInstances()
    {
-      void *data = nullptr;
-#if defined(_MSC_VER) || defined(__MINGW32__)
-      data = _aligned_malloc(size, alignment);
-#else 
-      int res = posix_memalign(&data, alignment, size);
-      if(res != 0)
-         data = nullptr;
-#endif
-      return data;
+      return static_cast<uint32_t>(instanceOrder.size());
    }
 
-   void alignedFree(void* data)
+   // for culling on the GPU. the buffers are replaced when the instances outgrow them
+   VkBuffer getInstanceBuffer(uint32_t frame)
    {
-#if	defined(_MSC_VER) || defined(__MINGW32__)
-      _aligned_free(data);
-#else 
-      free(data);
-#endif
+      return frameInstances[frame].buffer;
    }
 
-   struct
+   VkBuffer getVisibleBuffer(uint32_t frame)
    {
-      VkBuffer buffer;
-      VkDeviceMemory memory;
-   } worldMatrixUBO;
+      return frameInstances[frame].visibleBuffer;
+   }
 
-   float animationTimer = 0.0f;
+private:
+
+   bool instancesAdded = false;
+
+   struct FrameInstances
+   {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      vks::Allocation memory;
 
-   size_t dynamicAlignment;
+      // in matrices
+      uint32_t capacity = 0;
+
+      // slots of the visible instances, same capacity
+      VkBuffer visibleBuffer = VK_NULL_HANDLE;
+      vks::Allocation visibleMemory;
+      std::vector<InstanceBatch> visibleBatches;
+
+      VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+      // slots that changed since this buffer was written, can contain duplicates
+      std::vector<uint32_t> dirtySlots;
+
+      // new buffer or new instance order
+      bool rewriteAll = true;
+   };
+
+   std::vector<FrameInstances> frameInstances;
+
+   // instance buffer slot -> object index
+   std::vector<uint32_t> instanceOrder;
+   // object index -> instance buffer slot, UINT32_MAX until the next buildInstanceBatches
+   std::vector<uint32_t> instanceSlot;
+   std::vector<InstanceBatch> instanceBatches;
+
+   float animationTimer = 0.0f;
 
    void invalidateModelMatrix(uint32_t index);
-   void updateModelMatrix();
 
-   void createUniformBuffer();
+   // the instance buffers have to get the matrices rebuilt by update
+   void markUpdatedInstancesDirty();
+
+   // objects whose matrix was rebuilt by the last update, one list per job
+   std::vector<std::vector<uint32_t>> updatedObjects;
+
+   // the matrices and world bounds of the dirty objects in the blocks, appends them to updated
+   void updateMatrices(std::vector<uint32_t>& updated, uint32_t firstBlock, uint32_t lastBlock);
+
+   CollisionSystem collisions;
+
+   // fewer are not worth a job
+   static const uint32_t MIN_BLOCKS_PER_JOB = 16;
+   static const uint32_t MIN_SLOTS_PER_CULL_JOB = 1024;
+   static const uint32_t MIN_PROXIES_PER_PAIR_JOB = 1024;
+
+   // mesh id -> bounds in mesh space
+   std::vector<Bounds> meshBounds;
+
+   // world bounds by instance buffer slot
+   BoundsStreams worldBounds;
+
+   // new slots or new mesh bounds, all world bounds are rebuilt before culling
+   bool worldBoundsInvalid = true;
+
+   void updateWorldBounds(uint32_t index);
+
+   // all of them, if they are invalid
+   void rebuildWorldBounds();
+
+   // object index -> proxy in the tree, NULL_NODE until it's in the instance buffers
+   AabbTree tree;
+   std::vector<int32_t> treeProxy;
+
+   // moved since the tree was last brought up to date, can contain duplicates
+   std::vector<uint32_t> treeDirtyObjects;
+
+   // every proxy is moved the next time, the world bounds were rebuilt
+   bool treeInvalid = true;
+
+   bool hierarchicalCulling = false;
+
+   // before every query
+   void updateTree();
+   void updateTreeProxy(uint32_t index);
+
+   // per job in findOverlappingPairs
+   std::vector<AabbTree::PairTask> pairTasks;
+   std::vector<std::vector<std::pair<uint32_t, uint32_t>>> pairsInJob;
+
+   // visible slots found by every cull job, and all of them in order
+   std::vector<std::vector<uint32_t>> visibleInJob;
+   std::vector<uint32_t> visibleSlots;
+
+   uint32_t numberOfVisible = 0;
+
+   // the matrix has to be written into the instance buffers of all frames
+   void markInstanceDirty(uint32_t index);
+
+   // grows the buffer of the frame to fit all instances, and points the descriptor set of the frame at it
+   void createInstanceBuffer(uint32_t frame);
+   void buildInstanceBatches();
 
    WorldObjectToMeshMapper* worldObjectToMeshMapper;
 
    vks::VulkanDevice* vulkanDevice;
 
+   JobSystem* jobSystem;
+
    uint32_t numberOfObjects;
    std::vector<uint32_t> meshId;
-   std::vector<glm::vec3> position;
-   std::vector<glm::vec3> rotation;
-   std::vector<glm::vec3> scale;
+
+   // position, rotation and scale, and which model matrices have to be rebuilt
+   TransformStreams transforms;
 
    std::vector<glm::mat4> modelMatrix;
-   std::vector<bool> isModelMatrixInvalid;
 
    VkDescriptorPool descriptorPool;
    VkDescriptorSetLayout descriptorSetLayout;
-   VkDescriptorSet descriptorSet;
 
    // these are only for movable objects.
    // should maybe break out static objects to another class
+   // the transforms only have the velocity, movingSpeed * movingDirection
    std::vector<glm::vec3> movingDirection;
    std::vector<float> movingSpeed;
-   std::vector<glm::vec3> rotationSpeed;
 
    // When setting pos/rot/scale
    // we use these to make nice transitions ? not yet really implemented
@@ -127,25 +298,24 @@ private:
 
 public:
    void createDescriptorSetLayout();
-   void createDescriptorPool();
+   void createDescriptorPool(uint32_t framesInFlight);
    void createDescriptorSet();
 
-   // TODO call this from add instance ? maybe using a boolean to say if it shall update?
-   void updateDescriptorSet();
+   // Copies the changed model matrices into the instance buffer of the frame. The GPU must be done with the frame.
+   // Instances added since the last call get their batches here, the buffer of the frame grows if needed.
+   void updateInstanceBuffer(uint32_t frame);
 
-   void updateDynamicUniformBuffer();
+   // Fills the visible buffer and the visible batches of the frame with the instances inside the frustum.
+   // Has to come after updateInstanceBuffer, the GPU must be done with the frame.
+   void cullInstances(uint32_t frame, const Frustum& frustum);
 
    VkDescriptorSetLayout getDescriptorSetLayout()
    {
       return descriptorSetLayout;
    }
-   VkDescriptorSet *getDescriptorSet()
-   {
-      return &descriptorSet;
-   }
-   size_t getDynamicAlignment()
+   VkDescriptorSet *getDescriptorSet(uint32_t frame)
    {
-      return dynamicAlignment;
+      return &frameInstances[frame].descriptorSet;
    }
 };
 
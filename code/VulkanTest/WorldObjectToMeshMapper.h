@@ -17,6 +17,12 @@ public:
       return meshObjectMap[meshId];
    }
 
+   // mesh id -> world object ids, sorted by mesh id
+   const std::map<int, std::vector<int>>& getMeshObjectMap()
+   {
+      return meshObjectMap;
+   }
+
 private:
 
    std::map<int, std::vector<int>> meshObjectMap;
@@ -0,0 +1,454 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include "CacheFile.h"
+#include "TextureAtlas.h"
+
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+
+// Packs the textures of a mesh with lots of small materials into a TextureAtlas and checks the result: the materials
+// that should be in the atlas are and the others aren't, every texel of every image (and its border) is where the moved
+// texture coordinates of its quad point to, and every level of the atlas up to MIP_LEVELS has the same texels in the
+// place of an image as the mip chain of the image has. Then counts the descriptor sets and draws before and after.
+// The compressed atlas has to come from the texture cache the second time, and be built again once an image changed.
+//
+// The images are noise of random sizes (multiples of 8), written to the cache folder. The quads of the materials are
+// a strip, neighbours share two vertices, so the vertices have to be copied. One material has a large texture and
+// one repeats its texture, those two stay out of the atlas.
+//
+// usage: vulkantest_atlas_bench [--materials <n>] [--runs <n>]
+
+namespace
+{
+   const uint32_t LARGE_SIZE = 512;
+
+   struct Image
+   {
+      std::string fileName;
+      int width;
+      int height;
+      std::vector<stbi_uc> pixels;
+   };
+
+   Image makeImage(const std::string& fileName, int width, int height, uint32_t seed)
+   {
+      std::mt19937 random(seed);
+
+      Image image;
+      image.fileName = fileName;
+      image.width    = width;
+      image.height   = height;
+      image.pixels.resize(size_t(width) * height * 4);
+
+      for(size_t i = 0; i < image.pixels.size(); i++)
+      {
+         image.pixels[i] = i % 4 == 3 ? 255 : static_cast<stbi_uc>(random() & 0xff);
+      }
+
+      std::vector<char> png;
+      stbi_write_png_to_func([](void* context, void* data, int size)
+      {
+         std::vector<char>* buffer = static_cast<std::vector<char>*>(context);
+         buffer->insert(buffer->end(), static_cast<char*>(data), static_cast<char*>(data) + size);
+      }, &png, width, height, 4, image.pixels.data(), width * 4);
+
+      if(!CacheFile::write(fileName, png))
+      {
+         throw std::runtime_error("failed to write " + fileName + "!");
+      }
+
+      return image;
+   }
+
+   // a strip of quads, one per material, with the corners of the shared edges shared. the odd quads are mirrored so
+   // the shared corners have the same texture coordinates for both
+   Mesh::MeshData makeMesh(const std::vector<Image>& images, uint32_t repeatingMaterial)
+   {
+      Mesh::MeshData meshData;
+      meshData.fileName = "atlas_bench";
+
+      for(uint32_t i = 0; i <= images.size(); i++)
+      {
+         for(uint32_t y = 0; y < 2; y++)
+         {
+            Vertex vertex ={};
+            vertex.position = glm::vec3(float(i), float(y), 0.f);
+            vertex.colour   = glm::vec3(1.f);
+            vertex.texCoord = glm::vec2(float(i % 2), float(y));
+
+            meshData.vertexData.vertices.push_back(vertex);
+         }
+      }
+
+      for(uint32_t i = 0; i < images.size(); i++)
+      {
+         Mesh::SubMesh subMesh;
+         subMesh.startIndex      = static_cast<int32_t>(meshData.vertexData.indices.size());
+         subMesh.numberOfIndices = 6;
+         subMesh.materialId      = static_cast<int32_t>(i);
+
+         for(uint32_t corner : { 0, 1, 2, 2, 1, 3 })
+         {
+            meshData.vertexData.indices.push_back(i * 2 + corner);
+         }
+
+         meshData.subMeshes.push_back(subMesh);
+
+         Mesh::MaterialData material;
+         material.diffuseTexture = "./" + images[i].fileName;
+         material.diffuseColour  = glm::vec3(1.f);
+
+         meshData.materials.push_back(material);
+      }
+
+      // its own corners, 0 to 2
+      Mesh::SubMesh& repeating = meshData.subMeshes[repeatingMaterial];
+      for(int32_t i = repeating.startIndex; i < repeating.startIndex + repeating.numberOfIndices; i++)
+      {
+         Vertex vertex = meshData.vertexData.vertices[meshData.vertexData.indices[i]];
+         vertex.texCoord *= 2.f;
+
+         meshData.vertexData.indices[i] = static_cast<uint32_t>(meshData.vertexData.vertices.size());
+         meshData.vertexData.vertices.push_back(vertex);
+      }
+
+      return meshData;
+   }
+
+   // consecutive sub meshes with the same texture are one draw, like HelloTriangleApplication::buildDrawCommands
+   uint32_t countDraws(const Mesh::MeshData& meshData)
+   {
+      uint32_t draws = 0;
+
+      for(size_t i = 0; i < meshData.subMeshes.size(); i++)
+      {
+         if(i == 0 || meshData.materials[meshData.subMeshes[i].materialId].diffuseTexture != meshData.materials[meshData.subMeshes[i - 1].materialId].diffuseTexture)
+         {
+            draws++;
+         }
+      }
+
+      return draws;
+   }
+
+   uint32_t countTextures(const Mesh::MeshData& meshData)
+   {
+      std::set<std::string> textures;
+      for(const auto& material : meshData.materials)
+      {
+         textures.insert(material.diffuseTexture);
+      }
+
+      return static_cast<uint32_t>(textures.size());
+   }
+
+   // texture coordinates of the corner of the quad of the material that had these before packing
+   glm::vec2 getCorner(const Mesh::MeshData& original, const Mesh::MeshData& packed, uint32_t materialId, glm::vec2 texCoord)
+   {
+      const Mesh::SubMesh& subMesh = packed.subMeshes[materialId];
+
+      for(int32_t i = subMesh.startIndex; i < subMesh.startIndex + subMesh.numberOfIndices; i++)
+      {
+         if(original.vertexData.vertices[original.vertexData.indices[i]].texCoord == texCoord)
+         {
+            return packed.vertexData.vertices[packed.vertexData.indices[i]].texCoord;
+         }
+      }
+
+      return glm::vec2(-1.f);
+   }
+
+   // prints what is wrong and returns false if the image isn't where its quad points to
+   bool checkImage(const Image& image, const Texture::ImageData& atlas, const std::vector<stbi_uc>& atlasMipmaps, glm::vec2 first, glm::vec2 last)
+   {
+      glm::vec2 atlasSize(atlas.width, atlas.height);
+
+      // the texel the image starts at, it has to be a whole one and a multiple of the texels of the last level
+      glm::vec2 origin = first * atlasSize;
+      glm::vec2 extent = (last - first) * atlasSize;
+
+      int originX = static_cast<int>(std::lround(origin.x));
+      int originY = static_cast<int>(std::lround(origin.y));
+
+      if(std::abs(origin.x - originX) > 0.01f || std::abs(origin.y - originY) > 0.01f ||
+         std::abs(extent.x - image.width) > 0.01f || std::abs(extent.y - image.height) > 0.01f)
+      {
+         std::cout << image.fileName << ": placed at (" << origin.x << ", " << origin.y << ") with a size of (" << extent.x << ", " << extent.y << ")" << std::endl;
+         return false;
+      }
+
+      if(originX % (1 << (TextureAtlas::MIP_LEVELS - 1)) != 0 || originY % (1 << (TextureAtlas::MIP_LEVELS - 1)) != 0)
+      {
+         std::cout << image.fileName << ": at (" << originX << ", " << originY << "), that isn't a texel in every level" << std::endl;
+         return false;
+      }
+
+      // the image and its border, which repeats the edges
+      for(int y = -TextureAtlas::BORDER; y < image.height + TextureAtlas::BORDER; y++)
+      {
+         for(int x = -TextureAtlas::BORDER; x < image.width + TextureAtlas::BORDER; x++)
+         {
+            int imageX = std::min(std::max(x, 0), image.width - 1);
+            int imageY = std::min(std::max(y, 0), image.height - 1);
+
+            const stbi_uc* expected = image.pixels.data() + (size_t(imageY) * image.width + imageX) * 4;
+            const stbi_uc* texel = atlas.pixels + (size_t(originY + y) * atlas.width + originX + x) * 4;
+
+            if(memcmp(expected, texel, 4) != 0)
+            {
+               std::cout << image.fileName << ": texel (" << x << ", " << y << ") is wrong in the atlas" << std::endl;
+               return false;
+            }
+         }
+      }
+
+      std::vector<stbi_uc> imageMipmaps = Texture::generateMipmaps(image.pixels.data(), image.width, image.height);
+
+      const stbi_uc* imageLevel = imageMipmaps.data();
+      const stbi_uc* atlasLevel = atlasMipmaps.data();
+
+      for(uint32_t level = 0; level < TextureAtlas::MIP_LEVELS; level++)
+      {
+         int levelWidth  = image.width >> level;
+         int levelHeight = image.height >> level;
+         int atlasWidth  = atlas.width >> level;
+
+         for(int y = 0; y < levelHeight; y++)
+         {
+            for(int x = 0; x < levelWidth; x++)
+            {
+               for(int channel = 0; channel < 4; channel++)
+               {
+                  int expected = imageLevel[(size_t(y) * levelWidth + x) * 4 + channel];
+                  int texel = atlasLevel[(size_t((originY >> level) + y) * atlasWidth + (originX >> level) + x) * 4 + channel];
+
+                  // the same texels are averaged, but the edges of the image wrap around in its own chain
+                  bool edge = x == 0 || y == 0 || x == levelWidth - 1 || y == levelHeight - 1;
+
+                  if(!edge && std::abs(expected - texel) > 1)
+                  {
+                     std::cout << image.fileName << ": level " << level << " (" << x << ", " << y << ") channel " << channel << " is " << texel << " in the atlas, " << expected << " in the image" << std::endl;
+                     return false;
+                  }
+               }
+            }
+         }
+
+         imageLevel += size_t(levelWidth) * levelHeight * 4;
+         atlasLevel += size_t(atlasWidth) * (atlas.height >> level) * 4;
+      }
+
+      return true;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   uint32_t numberOfMaterials = 64;
+   uint32_t runs = 5;
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--materials") == 0 && i + 1 < argc)
+      {
+         numberOfMaterials = std::max(static_cast<uint32_t>(atoi(argv[++i])), 4u);
+      }
+      else if(strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+      {
+         runs = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   std::cout << std::fixed << std::setprecision(3);
+
+   // the last one is too large for the atlas, the one before repeats its texture
+   uint32_t largeMaterial = numberOfMaterials - 1;
+   uint32_t repeatingMaterial = numberOfMaterials - 2;
+
+   std::mt19937 random(42);
+   std::uniform_int_distribution<int> side(2, TextureAtlas::MAX_TEXTURE_SIZE / 8);
+
+   std::vector<Image> images;
+   for(uint32_t i = 0; i < numberOfMaterials; i++)
+   {
+      int width  = i == largeMaterial ? LARGE_SIZE : side(random) * 8;
+      int height = i == largeMaterial ? LARGE_SIZE : side(random) * 8;
+
+      images.push_back(makeImage(std::string(CacheFile::CACHE_DIRECTORY).substr(2) + "atlas_bench_" + std::to_string(i) + ".png", width, height, i));
+   }
+
+   Mesh::MeshData original = makeMesh(images, repeatingMaterial);
+   Mesh::MeshData packed;
+
+   double bestPack = std::numeric_limits<double>::max();
+   bool wasPacked = false;
+
+   for(uint32_t run = 0; run < runs; run++)
+   {
+      packed = original;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      wasPacked = TextureAtlas::pack(packed);
+      bestPack = std::min(bestPack, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+   }
+
+   bool ok = wasPacked;
+   std::string atlasName;
+
+   for(uint32_t i = 0; i < numberOfMaterials && ok; i++)
+   {
+      const std::string& texture = packed.materials[i].diffuseTexture;
+      bool inAtlas = TextureAtlas::isAtlas(texture);
+
+      if(inAtlas != (i != largeMaterial && i != repeatingMaterial) || (inAtlas && !atlasName.empty() && texture != atlasName))
+      {
+         std::cout << "material " << i << " has " << texture << std::endl;
+         ok = false;
+      }
+
+      if(inAtlas)
+      {
+         atlasName = texture;
+      }
+   }
+
+   if(!ok)
+   {
+      std::cout << "FAILED: the materials weren't packed" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   double bestBuild = std::numeric_limits<double>::max();
+   Texture::ImageData atlas;
+
+   for(uint32_t run = 0; run < runs; run++)
+   {
+      Texture::freeImageData(atlas);
+
+      auto start = std::chrono::high_resolution_clock::now();
+      atlas = Texture::decodeImage(atlasName);
+      bestBuild = std::min(bestBuild, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+   }
+
+   if(Texture::getMipLevels(atlas) != TextureAtlas::MIP_LEVELS)
+   {
+      std::cout << "the atlas has " << Texture::getMipLevels(atlas) << " levels" << std::endl;
+      ok = false;
+   }
+
+   std::vector<stbi_uc> atlasMipmaps = Texture::generateMipmaps(atlas.pixels, atlas.width, atlas.height);
+
+   uint64_t usedTexels = 0;
+
+   for(uint32_t i = 0; i < numberOfMaterials; i++)
+   {
+      if(i == largeMaterial || i == repeatingMaterial)
+      {
+         continue;
+      }
+
+      // the even quads go from 0 to 1, the odd ones are mirrored
+      glm::vec2 first = getCorner(original, packed, i, glm::vec2(float(i % 2), 0.f));
+      glm::vec2 last  = getCorner(original, packed, i, glm::vec2(float((i + 1) % 2), 1.f));
+
+      if(i % 2 == 1)
+      {
+         std::swap(first.x, last.x);
+      }
+
+      ok &= checkImage(images[i], atlas, atlasMipmaps, first, last);
+
+      usedTexels += uint64_t(images[i].width) * images[i].height;
+   }
+
+   // the positions don't change, and every corner of the other two is untouched
+   for(uint32_t i : { largeMaterial, repeatingMaterial })
+   {
+      const Mesh::SubMesh& subMesh = packed.subMeshes[i];
+      for(int32_t index = subMesh.startIndex; index < subMesh.startIndex + subMesh.numberOfIndices; index++)
+      {
+         const Vertex& before = original.vertexData.vertices[original.vertexData.indices[index]];
+         const Vertex& after  = packed.vertexData.vertices[packed.vertexData.indices[index]];
+
+         if(!(before == after))
+         {
+            std::cout << "material " << i << " isn't in the atlas, but its vertices changed" << std::endl;
+            ok = false;
+         }
+      }
+   }
+
+   // the images are the same every run, so it might be in the cache from the last one already
+   auto start = std::chrono::high_resolution_clock::now();
+   Texture::ImageData compressed = Texture::decodeImage(atlasName, true);
+   double compressTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+   bool wasCached = compressed.mappedFile != nullptr;
+
+   start = std::chrono::high_resolution_clock::now();
+   Texture::ImageData cached = Texture::decodeImage(atlasName, true);
+   double cachedTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+   size_t blocksSize = 0;
+   for(uint32_t level = 0; level < compressed.mipLevels; level++)
+   {
+      blocksSize += static_cast<size_t>(Texture::getLevelSize(compressed.format, compressed.width, compressed.height, level));
+   }
+
+   if(!cached.mappedFile || cached.format != compressed.format || cached.mipLevels != TextureAtlas::MIP_LEVELS ||
+      compressed.mipLevels != TextureAtlas::MIP_LEVELS || cached.contentHash != atlas.contentHash ||
+      memcmp(cached.getBlocks(), compressed.getBlocks(), blocksSize) != 0)
+   {
+      std::cout << "the compressed atlas didn't come back from the texture cache" << std::endl;
+      ok = false;
+   }
+
+   Texture::freeImageData(compressed);
+   Texture::freeImageData(cached);
+
+   // a changed image makes it out of date
+   makeImage(images[0].fileName, images[0].width, images[0].height, numberOfMaterials);
+
+   Texture::ImageData changed = Texture::decodeImage(atlasName, true);
+   if(changed.mappedFile || changed.contentHash == atlas.contentHash)
+   {
+      std::cout << "the compressed atlas came from the texture cache after an image in it changed" << std::endl;
+      ok = false;
+   }
+
+   Texture::freeImageData(changed);
+
+   std::cout
+      << numberOfMaterials << " materials, atlas " << atlas.width << "x" << atlas.height << " ("
+      << std::setprecision(1) << 100.0 * double(usedTexels) / (double(atlas.width) * atlas.height) << "% used), "
+      << original.vertexData.vertices.size() << " -> " << packed.vertexData.vertices.size() << " vertices" << std::endl
+      << std::setprecision(3)
+      << "pack:   " << std::setw(8) << bestPack << " ms" << std::endl
+      << "build:  " << std::setw(8) << bestBuild << " ms" << std::endl
+      << "compressed: " << std::setw(8) << compressTime << " ms" << (wasCached ? " (from the cache of the last run)" : "") << std::endl
+      << "cached:     " << std::setw(8) << cachedTime << " ms" << std::endl
+      << "descriptor sets: " << countTextures(original) << " -> " << countTextures(packed) << std::endl
+      << "draws:           " << countDraws(original) << " -> " << countDraws(packed) << std::endl;
+
+   Texture::freeImageData(atlas);
+
+   for(const auto& image : images)
+   {
+      std::remove(image.fileName.c_str());
+   }
+
+   std::cout << (ok ? "ok: " : "FAILED: ") << numberOfMaterials - 2 << " images checked in the atlas" << std::endl;
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
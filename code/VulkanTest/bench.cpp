@@ -0,0 +1,148 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define TINYOBJLOADER_IMPLEMENTATION
+
+#include "VulkanTestApplication.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+// Renders a fixed number of frames of the default scene and reports CPU frame times.
+// Runs headless unless --windowed is given, so it can be used on CI and render farm nodes.
+//
+// --objects adds that many cubes to the scene, to measure the cost of lots of objects.
+// --frames-in-flight sets how far the CPU may get ahead of the GPU, 1 waits for every frame.
+// The fence wait is the part of the frame time the CPU spent waiting for the GPU.
+// The extra cubes are in a grid in front of the camera, the bigger the grid the more of it is outside of the view and culled.
+// --gpu-culling culls them in a compute shader instead, the CPU time should hardly change with --objects then.
+// --tree-culling culls them on the CPU by walking the bounding volume tree of the objects.
+// --collisions gives the objects colliders and makes the extra cubes run into each other.
+// --stats prints the statistics of the memory allocator, the geometry arenas and the sampler cache before the first frame.
+//
+// usage: vulkantest_bench [--frames <n>] [--warmup <n>] [--objects <n>] [--frames-in-flight <n>] [--gpu-culling] [--tree-culling] [--collisions] [--stats] [--windowed]
+
+int main(int argc, char** argv)
+{
+   uint32_t frames = 1000;
+   uint32_t warmup = 20;
+   uint32_t objects = 0;
+   uint32_t framesInFlight = 2;
+   bool headless = true;
+   bool gpuCulling = false;
+   bool treeCulling = false;
+   bool collisions = false;
+   bool stats = false;
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      {
+         frames = static_cast<uint32_t>(atoi(argv[++i]));
+      }
+      else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+      {
+         warmup = static_cast<uint32_t>(atoi(argv[++i]));
+      }
+      else if(strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+      {
+         objects = static_cast<uint32_t>(atoi(argv[++i]));
+      }
+      else if(strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+      {
+         framesInFlight = static_cast<uint32_t>(atoi(argv[++i]));
+      }
+      else if(strcmp(argv[i], "--gpu-culling") == 0)
+      {
+         gpuCulling = true;
+      }
+      else if(strcmp(argv[i], "--tree-culling") == 0)
+      {
+         treeCulling = true;
+      }
+      else if(strcmp(argv[i], "--collisions") == 0)
+      {
+         collisions = true;
+      }
+      else if(strcmp(argv[i], "--stats") == 0)
+      {
+         stats = true;
+      }
+      else if(strcmp(argv[i], "--windowed") == 0)
+      {
+         headless = false;
+      }
+   }
+
+   if(frames == 0)
+   {
+      std::cerr << "--frames must be larger than 0" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   HelloTriangleApplication app;
+   app.setHeadless(headless);
+   app.setFrameLimit(warmup + frames);
+   app.setExtraInstances(objects);
+   app.setFramesInFlight(framesInFlight);
+   app.setGpuCulling(gpuCulling);
+   app.setHierarchicalCulling(treeCulling);
+   app.setCollisions(collisions);
+   app.setPrintStats(stats);
+
+   try
+   {
+      app.run();
+   }
+   catch(const std::runtime_error& e)
+   {
+      std::cerr
+         << e.what()
+         << std::endl;
+
+      return EXIT_FAILURE;
+   }
+
+   // the first frames include pipeline warmup, first touch of memory etc.
+   std::vector<double> frameTimes(app.getFrameTimes().begin() + std::min<size_t>(warmup, app.getFrameTimes().size()), app.getFrameTimes().end());
+
+   if(frameTimes.empty())
+   {
+      std::cerr << "no frames were rendered" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::sort(frameTimes.begin(), frameTimes.end());
+
+   double total = 0.0;
+   for(double frameTime : frameTimes)
+   {
+      total += frameTime;
+   }
+
+   double totalFenceWait = 0.0;
+   size_t fenceWaits = 0;
+   for(size_t i = warmup; i < app.getFenceWaitTimes().size(); i++)
+   {
+      totalFenceWait += app.getFenceWaitTimes()[i];
+      fenceWaits++;
+   }
+
+   size_t p99Index = static_cast<size_t>(std::ceil(0.99 * frameTimes.size())) - 1;
+
+   std::cout
+      << std::fixed << std::setprecision(3)
+      << "draws:  " << app.getDrawCount() << " per frame" << std::endl
+      << "culled: " << app.getCulledCount() << " of " << app.getVisibleCount() + app.getCulledCount() << " instances in the last frame, on the " << (app.isGpuCulling() ? "GPU" : "CPU") << std::endl
+      << "contacts: " << app.getContactCount() << " in the last frame" << std::endl
+      << "frames: " << frameTimes.size() << " (" << warmup << " warmup frames skipped)" << std::endl
+      << "min:    " << frameTimes.front() << " ms" << std::endl
+      << "avg:    " << total / frameTimes.size() << " ms" << std::endl
+      << "p99:    " << frameTimes[p99Index] << " ms" << std::endl
+      << "max:    " << frameTimes.back() << " ms" << std::endl
+      << "fence:  " << (fenceWaits > 0 ? totalFenceWait / fenceWaits : 0.0) << " ms avg wait, " << framesInFlight << " frames in flight" << std::endl;
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+#include "CollisionSystem.h"
+#include "JobSystem.h"
+#include "TransformStreams.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+// Stress test for the collisions of WorldObject: cubes flying around in a closed room, stepped the way
+// WorldObject::update does it. The transforms are moved and rebuilt on the job system, the CollisionSystem pushes
+// apart the cubes that ran into each other and the matrices of those are rebuilt again. Every tenth cube is fast
+// enough to pass through another one in a step. The walls are boxes that aren't movable.
+//
+// The scene is run a second time with a different number of threads, the cubes have to end up in the same place.
+// Cubes outside of the walls at the end went through them.
+//
+// usage: vulkantest_collision_bench [--objects <n>] [--steps <n>] [--shape aabb|obb|sphere] [--threads <n>]
+
+namespace
+{
+   const float DT = 1.f / 60.f;
+
+   struct Result
+   {
+      double moveTime = 0.0;
+      double collideTime = 0.0;
+      double rebuildTime = 0.0;
+
+      uint32_t pairs = 0;
+      uint32_t contacts = 0;
+      uint32_t maxContacts = 0;
+      uint32_t escaped = 0;
+
+      std::vector<glm::vec3> positions;
+   };
+
+   double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+   {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+   }
+
+   Result simulate(uint32_t numberOfCubes, uint32_t steps, ColliderShape shape, JobSystem& jobSystem)
+   {
+      // a unit cube
+      Bounds bounds;
+      bounds.min = glm::vec3(-0.5f);
+      bounds.max = glm::vec3(0.5f);
+      bounds.radius = std::sqrt(0.75f);
+
+      // a cell of 2 units for every cube, so they start apart and fill an eighth of the room
+      uint32_t cellsPerSide = static_cast<uint32_t>(std::ceil(std::cbrt(float(numberOfCubes))));
+      float halfSize = float(cellsPerSide);
+
+      std::mt19937 random(1234);
+      std::uniform_real_distribution<float> jitter(-0.4f, 0.4f);
+      std::uniform_real_distribution<float> direction(-1.f, 1.f);
+      std::uniform_real_distribution<float> speed(1.f, 4.f);
+      std::uniform_real_distribution<float> rotationSpeed(-90.f, 90.f);
+
+      TransformStreams transforms;
+      CollisionSystem collisions(&jobSystem);
+
+      for(uint32_t i = 0; i < numberOfCubes; i++)
+      {
+         glm::vec3 cell(float(i % cellsPerSide), float(i / cellsPerSide % cellsPerSide), float(i / (cellsPerSide * cellsPerSide)));
+         glm::vec3 position = cell * 2.f - glm::vec3(halfSize - 1.f) + glm::vec3(jitter(random), jitter(random), jitter(random));
+
+         uint32_t index = transforms.add(position, glm::vec3(0.f), glm::vec3(1.f));
+
+         glm::vec3 velocity = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)) + glm::vec3(1e-3f));
+
+         transforms.setVelocity(index, velocity * (i % 10 == 0 ? 60.f : speed(random)));
+         transforms.setRotationSpeed(index, glm::vec3(rotationSpeed(random), rotationSpeed(random), rotationSpeed(random)));
+
+         collisions.setCollider(index, shape, bounds);
+      }
+
+      // the walls, 2 units thick all around
+      for(int axis = 0; axis < 3; axis++)
+      {
+         for(float side : { -1.f, 1.f })
+         {
+            glm::vec3 position(0.f);
+            position[axis] = side * (halfSize + 1.f);
+
+            glm::vec3 scale(2.f * halfSize + 4.f);
+            scale[axis] = 2.f;
+
+            uint32_t index = transforms.add(position, glm::vec3(0.f), scale);
+            collisions.setCollider(index, ColliderShape::Aabb, bounds, false);
+         }
+      }
+
+      std::vector<glm::mat4> matrices(transforms.size());
+
+      uint32_t numberOfBlocks = transforms.getNumberOfBlocks();
+      uint32_t blocksPerJob = std::max(16u, numberOfBlocks / ((jobSystem.getNumberOfWorkers() + 1) * 4));
+      std::vector<std::vector<uint32_t>> updated((numberOfBlocks + blocksPerJob - 1) / blocksPerJob);
+
+      Result result;
+
+      for(uint32_t step = 0; step < steps; step++)
+      {
+         auto start = std::chrono::high_resolution_clock::now();
+
+         jobSystem.parallelFor(0, numberOfBlocks, blocksPerJob, [&](uint32_t firstBlock, uint32_t lastBlock)
+         {
+            std::vector<uint32_t>& updatedInJob = updated[firstBlock / blocksPerJob];
+            updatedInJob.clear();
+
+            transforms.integrate(DT, firstBlock, lastBlock);
+            transforms.updateMatrices(matrices.data(), updatedInJob, firstBlock, lastBlock);
+         });
+
+         result.moveTime += millisecondsSince(start);
+         start = std::chrono::high_resolution_clock::now();
+
+         collisions.resolve(transforms, matrices.data(), DT);
+
+         result.collideTime += millisecondsSince(start);
+         start = std::chrono::high_resolution_clock::now();
+
+         jobSystem.parallelFor(0, numberOfBlocks, blocksPerJob, [&](uint32_t firstBlock, uint32_t lastBlock)
+         {
+            transforms.updateMatrices(matrices.data(), updated[firstBlock / blocksPerJob], firstBlock, lastBlock);
+         });
+
+         result.rebuildTime += millisecondsSince(start);
+
+         result.maxContacts = std::max(result.maxContacts, static_cast<uint32_t>(collisions.getContacts().size()));
+      }
+
+      result.moveTime /= steps;
+      result.collideTime /= steps;
+      result.rebuildTime /= steps;
+
+      result.pairs = collisions.getNumberOfPairs();
+      result.contacts = static_cast<uint32_t>(collisions.getContacts().size());
+
+      for(uint32_t i = 0; i < numberOfCubes; i++)
+      {
+         glm::vec3 position = transforms.getPosition(i);
+         result.positions.push_back(position);
+
+         if(glm::any(glm::greaterThan(glm::abs(position), glm::vec3(halfSize + 0.5f))))
+         {
+            result.escaped++;
+         }
+      }
+
+      return result;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   uint32_t numberOfCubes = 50000;
+   uint32_t steps = 300;
+   uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+   ColliderShape shape = ColliderShape::Obb;
+   std::string shapeName = "obb";
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+      {
+         numberOfCubes = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+      {
+         steps = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      {
+         threads = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--shape") == 0 && i + 1 < argc)
+      {
+         shapeName = argv[++i];
+
+         if(shapeName == "aabb")
+         {
+            shape = ColliderShape::Aabb;
+         }
+         else if(shapeName == "obb")
+         {
+            shape = ColliderShape::Obb;
+         }
+         else if(shapeName == "sphere")
+         {
+            shape = ColliderShape::Sphere;
+         }
+         else
+         {
+            std::cerr << "unknown shape " << shapeName << std::endl;
+            return EXIT_FAILURE;
+         }
+      }
+   }
+
+   // the calling thread takes part as well
+   JobSystem jobSystem(std::max(threads, 2u) - 1);
+   threads = jobSystem.getNumberOfWorkers() + 1;
+
+   // splits the work differently
+   JobSystem otherJobSystem(threads == 2 ? 3 : 1);
+
+   std::cout << numberOfCubes << " cubes (" << shapeName << "), " << steps << " steps" << std::endl;
+   std::cout << std::fixed << std::setprecision(3);
+
+   Result result = simulate(numberOfCubes, steps, shape, jobSystem);
+   Result otherResult = simulate(numberOfCubes, steps, shape, otherJobSystem);
+
+   bool deterministic = result.positions == otherResult.positions;
+
+   std::cout
+      << "move:     " << std::setw(8) << result.moveTime << " ms per step, x" << threads << std::endl
+      << "collide:  " << std::setw(8) << result.collideTime << " ms per step (" << result.pairs << " pairs, " << result.contacts << " contacts in the last step, " << result.maxContacts << " at most)" << std::endl
+      << "rebuild:  " << std::setw(8) << result.rebuildTime << " ms per step" << std::endl
+      << "total:    " << std::setw(8) << result.moveTime + result.collideTime + result.rebuildTime << " ms per step" << std::endl
+      << "x" << otherJobSystem.getNumberOfWorkers() + 1 << " threads: " << std::setw(8) << otherResult.moveTime + otherResult.collideTime + otherResult.rebuildTime << " ms per step, "
+      << (deterministic ? "same" : "DIFFERENT") << " positions" << std::endl
+      << "escaped:  " << result.escaped << " cubes went through the walls" << std::endl;
+
+   return deterministic ? EXIT_SUCCESS : EXIT_FAILURE;
+}
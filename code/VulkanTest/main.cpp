@@ -1,6 +1,8 @@
+#ifdef _MSC_VER
 #define _CRTDBG_MAP_ALLOC  
 #include <stdlib.h>  
 #include <crtdbg.h> 
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -8,14 +10,57 @@
 #include "VulkanTestApplication.h"
 
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
 
-int main()
+int main(int argc, char** argv)
 {
+#ifdef _MSC_VER
    _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
    _CrtSetReportMode(_CRT_ERROR, _CRTDBG_MODE_DEBUG);
+#endif
 
    HelloTriangleApplication app;
 
+   // --headless       render offscreen, no window or swapchain
+   // --frames <n>     quit after n frames
+   // --frames-in-flight <n>   how far the CPU may get ahead of the GPU (default 2)
+   // --gpu-culling    cull in a compute shader and draw with indirect draws
+   // --tree-culling   cull on the CPU by walking the bounding volume tree of the objects
+   // --collisions     the objects bounce off each other
+   // --stats          print the statistics of the memory allocator, the geometry arenas and the sampler cache
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--headless") == 0)
+      {
+         app.setHeadless(true);
+      }
+      else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      {
+         app.setFrameLimit(static_cast<uint32_t>(atoi(argv[++i])));
+      }
+      else if(strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+      {
+         app.setFramesInFlight(static_cast<uint32_t>(atoi(argv[++i])));
+      }
+      else if(strcmp(argv[i], "--gpu-culling") == 0)
+      {
+         app.setGpuCulling(true);
+      }
+      else if(strcmp(argv[i], "--tree-culling") == 0)
+      {
+         app.setHierarchicalCulling(true);
+      }
+      else if(strcmp(argv[i], "--collisions") == 0)
+      {
+         app.setCollisions(true);
+      }
+      else if(strcmp(argv[i], "--stats") == 0)
+      {
+         app.setPrintStats(true);
+      }
+   }
+
    try
    {
       app.run();
@@ -30,4 +75,4 @@ int main()
    }
 
    return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
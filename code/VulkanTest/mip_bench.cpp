@@ -0,0 +1,236 @@
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "Texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Times the mip chains Texture makes on the CPU when the format can't be blitted, and checks every level of them:
+// the number of levels and their sizes, that the first level is the image, that every texel of a level that is half
+// the size of the one above is the average of the texels above it, that a flat image stays flat and that the average
+// colour of every level is the same as the one of the level above.
+//
+// usage: vulkantest_mip_bench [--size <n>] [--runs <n>]
+
+namespace
+{
+   std::vector<stbi_uc> makeNoise(uint32_t width, uint32_t height, uint32_t seed)
+   {
+      std::mt19937 random(seed);
+      std::vector<stbi_uc> pixels(size_t(width) * height * 4);
+
+      for(auto& pixel : pixels)
+      {
+         pixel = static_cast<stbi_uc>(random() & 0xff);
+      }
+
+      return pixels;
+   }
+
+   std::vector<stbi_uc> makeFlat(uint32_t width, uint32_t height)
+   {
+      std::vector<stbi_uc> pixels(size_t(width) * height * 4);
+
+      for(size_t i = 0; i < pixels.size(); i += 4)
+      {
+         pixels[i + 0] = 200;
+         pixels[i + 1] = 100;
+         pixels[i + 2] = 30;
+         pixels[i + 3] = 255;
+      }
+
+      return pixels;
+   }
+
+   double getAverage(const stbi_uc* pixels, uint32_t width, uint32_t height, uint32_t channel)
+   {
+      double sum = 0.0;
+
+      for(size_t i = 0; i < size_t(width) * height; i++)
+      {
+         sum += pixels[i * 4 + channel];
+      }
+
+      return sum / (double(width) * height);
+   }
+
+   // prints what is wrong and returns false if a level is wrong
+   bool checkMipmaps(const std::string& name, const std::vector<stbi_uc>& pixels, uint32_t width, uint32_t height, bool flat)
+   {
+      std::vector<stbi_uc> mipmaps = Texture::generateMipmaps(pixels.data(), width, height);
+      uint32_t mipLevels = Texture::getMipLevels(width, height);
+
+      uint32_t expectedLevels = static_cast<uint32_t>(std::floor(std::log2(double(std::max(width, height))))) + 1;
+
+      if(mipLevels != expectedLevels)
+      {
+         std::cout << name << ": " << mipLevels << " levels, should be " << expectedLevels << std::endl;
+         return false;
+      }
+
+      size_t size = 0;
+      for(uint32_t level = 0; level < mipLevels; level++)
+      {
+         size += size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+      }
+
+      if(mipmaps.size() != size)
+      {
+         std::cout << name << ": " << mipmaps.size() << " bytes, should be " << size << std::endl;
+         return false;
+      }
+
+      if(memcmp(mipmaps.data(), pixels.data(), pixels.size()) != 0)
+      {
+         std::cout << name << ": level 0 isn't the image" << std::endl;
+         return false;
+      }
+
+      const stbi_uc* above = mipmaps.data();
+      const stbi_uc* current = above + size_t(width) * height * 4;
+
+      for(uint32_t level = 1; level < mipLevels; level++)
+      {
+         uint32_t levelWidth  = std::max(width >> level, 1u);
+         uint32_t levelHeight = std::max(height >> level, 1u);
+         uint32_t aboveWidth  = std::max(width >> (level - 1), 1u);
+         uint32_t aboveHeight = std::max(height >> (level - 1), 1u);
+
+         // how many texels above make up one in this level, only when that's a whole number
+         uint32_t stepX = aboveWidth / levelWidth;
+         uint32_t stepY = aboveHeight / levelHeight;
+         bool exact = stepX * levelWidth == aboveWidth && stepY * levelHeight == aboveHeight;
+
+         for(uint32_t y = 0; y < levelHeight; y++)
+         {
+            for(uint32_t x = 0; x < levelWidth; x++)
+            {
+               for(uint32_t channel = 0; channel < 4; channel++)
+               {
+                  int texel = current[(size_t(y) * levelWidth + x) * 4 + channel];
+
+                  if(flat && texel != pixels[channel])
+                  {
+                     std::cout << name << ": level " << level << " (" << x << ", " << y << ") is " << texel << ", the image is flat " << int(pixels[channel]) << std::endl;
+                     return false;
+                  }
+
+                  if(!exact)
+                  {
+                     continue;
+                  }
+
+                  int sum = 0;
+                  for(uint32_t aboveY = y * stepY; aboveY < (y + 1) * stepY; aboveY++)
+                  {
+                     for(uint32_t aboveX = x * stepX; aboveX < (x + 1) * stepX; aboveX++)
+                     {
+                        sum += above[(size_t(aboveY) * aboveWidth + aboveX) * 4 + channel];
+                     }
+                  }
+
+                  float average = float(sum) / float(stepX * stepY);
+
+                  if(std::abs(float(texel) - average) > 1.f)
+                  {
+                     std::cout << name << ": level " << level << " (" << x << ", " << y << ") channel " << channel << " is " << texel << ", the average above is " << average << std::endl;
+                     return false;
+                  }
+               }
+            }
+         }
+
+         // against the level above, the rounding adds up a bit over the levels
+         for(uint32_t channel = 0; channel < 4; channel++)
+         {
+            double aboveAverage = getAverage(above, aboveWidth, aboveHeight, channel);
+            double levelAverage = getAverage(current, levelWidth, levelHeight, channel);
+
+            // the last levels of a noise image are only a few texels, their average is off a bit more when the image
+            // isn't a power of 2 and texels are left out
+            double allowed = exact ? 0.5 : 4.0 + 64.0 / std::sqrt(double(levelWidth) * levelHeight);
+
+            if(std::abs(aboveAverage - levelAverage) > allowed)
+            {
+               std::cout << name << ": level " << level << " channel " << channel << " averages " << levelAverage << ", the level above " << aboveAverage << std::endl;
+               return false;
+            }
+         }
+
+         above = current;
+         current += size_t(levelWidth) * levelHeight * 4;
+      }
+
+      return true;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   uint32_t size = 2048;
+   uint32_t runs = 5;
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+      {
+         size = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+      {
+         runs = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   std::cout << std::fixed << std::setprecision(3);
+
+   std::vector<stbi_uc> pixels = makeNoise(size, size, 1234);
+
+   double bestTime = std::numeric_limits<double>::max();
+   size_t mipmapSize = 0;
+
+   for(uint32_t run = 0; run < runs; run++)
+   {
+      auto start = std::chrono::high_resolution_clock::now();
+
+      std::vector<stbi_uc> mipmaps = Texture::generateMipmaps(pixels.data(), size, size);
+
+      bestTime = std::min(bestTime, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+      mipmapSize = mipmaps.size();
+   }
+
+   std::cout
+      << size << "x" << size << ": " << Texture::getMipLevels(size, size) << " levels, "
+      << std::setw(8) << bestTime << " ms, " << mipmapSize / 1024 << " KiB ("
+      << std::setprecision(1) << 100.0 * double(mipmapSize) / double(pixels.size()) << "% of the image)" << std::endl;
+
+   // powers of 2, not square, not a power of 2, and lines
+   const uint32_t sizes[][2] ={ { 256, 256 }, { 512, 64 }, { 1, 1 }, { 300, 170 }, { 129, 255 }, { 1, 1024 }, { 1000, 1 } };
+
+   uint32_t images = 0;
+   uint32_t levels = 0;
+   bool ok = true;
+
+   for(const auto& imageSize : sizes)
+   {
+      uint32_t width = imageSize[0];
+      uint32_t height = imageSize[1];
+      std::string name = std::to_string(width) + "x" + std::to_string(height);
+
+      ok &= checkMipmaps(name + " noise", makeNoise(width, height, width * 31 + height), width, height, false);
+      ok &= checkMipmaps(name + " flat", makeFlat(width, height), width, height, true);
+
+      images += 2;
+      levels += 2 * Texture::getMipLevels(width, height);
+   }
+
+   std::cout << (ok ? "ok: " : "FAILED: ") << levels << " levels of " << images << " images checked" << std::endl;
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
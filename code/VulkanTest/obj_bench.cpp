@@ -0,0 +1,147 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define TINYOBJLOADER_IMPLEMENTATION
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+// Compares the two obj parsers behind Mesh::parseObj, including building the vertices, indices and sub meshes.
+// Without --obj it runs on the sample models.
+//
+// usage: vulkantest_obj_bench [--obj <file>]... [--repeat <n>]
+
+namespace
+{
+   bool equal(const Mesh::MeshData& a, const Mesh::MeshData& b)
+   {
+      if(a.getNumberOfVertices() != b.getNumberOfVertices() ||
+         a.getNumberOfIndices() != b.getNumberOfIndices() ||
+         a.subMeshes.size() != b.subMeshes.size() ||
+         a.materials.size() != b.materials.size())
+      {
+         return false;
+      }
+
+      for(uint32_t i = 0; i < a.getNumberOfVertices(); i++)
+      {
+         if(!(a.getVertices()[i] == b.getVertices()[i]))
+         {
+            return false;
+         }
+      }
+
+      if(memcmp(a.getIndices(), b.getIndices(), a.getNumberOfIndices() * sizeof(uint32_t)) != 0)
+      {
+         return false;
+      }
+
+      for(size_t i = 0; i < a.subMeshes.size(); i++)
+      {
+         if(a.subMeshes[i].startIndex != b.subMeshes[i].startIndex ||
+            a.subMeshes[i].numberOfIndices != b.subMeshes[i].numberOfIndices ||
+            a.subMeshes[i].materialId != b.subMeshes[i].materialId)
+         {
+            return false;
+         }
+      }
+
+      for(size_t i = 0; i < a.materials.size(); i++)
+      {
+         if(a.materials[i].diffuseTexture != b.materials[i].diffuseTexture ||
+            a.materials[i].specularTexture != b.materials[i].specularTexture ||
+            a.materials[i].bumpTexture != b.materials[i].bumpTexture ||
+            a.materials[i].diffuseColour != b.materials[i].diffuseColour)
+         {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
+   template<typename Function>
+   double bestOf(uint32_t repeat, Function function)
+   {
+      double best = std::numeric_limits<double>::max();
+
+      for(uint32_t i = 0; i < repeat; i++)
+      {
+         auto t1 = std::chrono::high_resolution_clock::now();
+         function();
+         auto t2 = std::chrono::high_resolution_clock::now();
+
+         best = std::min(best, std::chrono::duration<double, std::milli>(t2 - t1).count());
+      }
+
+      return best;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   std::vector<std::string> objFiles;
+   uint32_t repeat = 10;
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--obj") == 0 && i + 1 < argc)
+      {
+         objFiles.push_back(argv[++i]);
+      }
+      else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+      {
+         repeat = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   if(objFiles.empty())
+   {
+      objFiles ={ "./models/cube.obj", "./models/Stormtrooper.obj" };
+   }
+
+   bool valid = true;
+
+   std::cout << std::fixed << std::setprecision(2);
+
+   for(const auto& objFile : objFiles)
+   {
+      Mesh::MeshData reference;
+      Mesh::MeshData optimized;
+      double referenceTime;
+      double optimizedTime;
+
+      try
+      {
+         referenceTime = bestOf(repeat, [&]() { reference = Mesh::parseObj(objFile, Mesh::ObjParser::Reference); });
+         optimizedTime = bestOf(repeat, [&]() { optimized = Mesh::parseObj(objFile, Mesh::ObjParser::Optimized); });
+      }
+      catch(const std::runtime_error& e)
+      {
+         std::cerr << objFile << ": " << e.what() << std::endl;
+         valid = false;
+         continue;
+      }
+
+      bool same = equal(reference, optimized);
+      bool automaticIsOptimized = ObjLoader::pickParser(objFile) == Mesh::ObjParser::Optimized;
+
+      std::cout
+         << objFile << ": " << reference.getNumberOfIndices() << " indices, "
+         << reference.getNumberOfVertices() << " vertices, best of " << repeat
+         << ", automatic = " << (automaticIsOptimized ? "optimized" : "reference") << std::endl
+         << "   reference " << std::setw(10) << referenceTime << " ms" << std::endl
+         << "   optimized " << std::setw(10) << optimizedTime << " ms  "
+         << std::setw(6) << referenceTime / optimizedTime << "x"
+         << (same ? "" : "  DIFFERENT") << std::endl;
+
+      valid = valid && same;
+   }
+
+   return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,3 +1,4 @@
 C:\VulkanSDK\1.0.51.0\Bin32\glslangValidator.exe -V shader.vert
 C:\VulkanSDK\1.0.51.0\Bin32\glslangValidator.exe -V shader.frag
+C:\VulkanSDK\1.0.51.0\Bin32\glslangValidator.exe -V cull.comp
 pause
\ No newline at end of file
@@ -12,10 +12,17 @@ layout(set = 0, binding = 0) uniform UboView
 	mat4 proj;
 } uboView;
 
-layout(set = 1, binding = 1) uniform UboInstance 
+// model matrices of all objects, grouped by mesh, one instanced draw per mesh
+layout(set = 1, binding = 1) readonly buffer InstanceData 
 {
-	mat4 model; 
-} uboInstance;
+	mat4 model[]; 
+} instanceData;
+
+// slots of the visible objects in instanceData, grouped by mesh like the matrices
+layout(set = 1, binding = 2) readonly buffer VisibleInstances
+{
+	uint slot[];
+} visibleInstances;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -27,7 +34,7 @@ layout(location = 1) out vec2 fragTexCoord;
 
 void main() 
 {
-    gl_Position = uboView.proj * uboView.view * uboInstance.model * vec4(inPosition, 1.0);
+    gl_Position = uboView.proj * uboView.view * instanceData.model[visibleInstances.slot[gl_InstanceIndex]] * vec4(inPosition, 1.0);
     fragColor = inColor;
 	fragTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -4,14 +4,17 @@
 
 #include <GLFW/glfw3.h>
 
-#include <glm\glm.hpp>
-#include <glm\gtc\matrix_transform.hpp>
-#include <glm\gtx\hash.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
 
 #include <vector>
 #include <iostream>
 #include <array>
 #include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 
 const std::string MODEL_PATH_CUBE = "models/cube.obj";
@@ -21,16 +24,6 @@ const std::string TEXTURE_PATH_CHALET = "textures/chalet.jpg";
 const std::string MODEL_PATH_STORMTROOPER = "models/stormtrooper.obj";
 const std::string TEXTURE_PATH_STORMTROOPER = "textures/stormtrooper_D.tga";
 
-
-// somewhere else.. Vulkan_helper_stuff.h?
-// TODO: we now have VulkanDevice, which will replace most of this.
-// Might want to have another structure for other VulkanApplication related things, like the queues
-// and command buffers, swapchains ? maybe, just maybe.. we'll see how we do that.. 
-struct VulkanStuff
-{
-   std::vector<VkCommandBuffer> commandBuffers;
-};
-
 struct Vertex
 {
    glm::vec3 position;
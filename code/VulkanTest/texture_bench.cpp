@@ -0,0 +1,356 @@
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "JobSystem.h"
+#include "Texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Times decoding the sample textures, compressing their mip chains to BC1/BC3 on one thread and on the job system,
+// and loading them from the texture cache. The compressed levels are decoded again and compared with the RGBA8 levels:
+// the first level has to stay above a PSNR that BC1 easily makes on photos, the small levels are mostly edges and get
+// a lower bound. The compression has to give the same blocks on any number of threads, and the cache the same blocks
+// as the compression.
+//
+// Two generated images check the edges and BC3: one with alpha, both with sizes that aren't a multiple of 4.
+//
+// usage: vulkantest_texture_bench [--texture <file>]... [--threads <n>]
+
+namespace
+{
+   // worse than this isn't the compression losing detail, it's broken
+   const double MIN_PSNR = 32.0;
+   const double MIN_LEVEL_PSNR = 20.0;
+
+   double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+   {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+   }
+
+   void decodeColour(uint16_t colour, int* rgb)
+   {
+      rgb[0] = ((colour >> 11) & 31) * 255 / 31;
+      rgb[1] = ((colour >> 5) & 63) * 255 / 63;
+      rgb[2] = (colour & 31) * 255 / 31;
+   }
+
+   // the colour half of a BC1/BC3 block to 16 RGBA texels
+   void decodeColourBlock(const uint8_t* block, bool alwaysFourColours, uint8_t* texels)
+   {
+      uint16_t colour0 = uint16_t(block[0] | (block[1] << 8));
+      uint16_t colour1 = uint16_t(block[2] | (block[3] << 8));
+
+      int palette[4][4] ={};
+      decodeColour(colour0, palette[0]);
+      decodeColour(colour1, palette[1]);
+
+      bool fourColours = alwaysFourColours || colour0 > colour1;
+
+      for(int channel = 0; channel < 3; channel++)
+      {
+         if(fourColours)
+         {
+            palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+            palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+         }
+         else
+         {
+            palette[2][channel] = (palette[0][channel] + palette[1][channel]) / 2;
+            palette[3][channel] = 0;
+         }
+      }
+
+      uint32_t indices = uint32_t(block[4]) | (uint32_t(block[5]) << 8) | (uint32_t(block[6]) << 16) | (uint32_t(block[7]) << 24);
+
+      for(int i = 0; i < 16; i++)
+      {
+         const int* colour = palette[(indices >> (i * 2)) & 3];
+
+         texels[i * 4 + 0] = uint8_t(colour[0]);
+         texels[i * 4 + 1] = uint8_t(colour[1]);
+         texels[i * 4 + 2] = uint8_t(colour[2]);
+         texels[i * 4 + 3] = 255;
+      }
+   }
+
+   // the alpha half of a BC3 block
+   void decodeAlphaBlock(const uint8_t* block, uint8_t* texels)
+   {
+      int palette[8];
+      palette[0] = block[0];
+      palette[1] = block[1];
+
+      if(palette[0] > palette[1])
+      {
+         for(int i = 1; i < 7; i++)
+         {
+            palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+         }
+      }
+      else
+      {
+         for(int i = 1; i < 5; i++)
+         {
+            palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+         }
+         palette[6] = 0;
+         palette[7] = 255;
+      }
+
+      uint64_t indices = 0;
+      for(int i = 0; i < 6; i++)
+      {
+         indices |= uint64_t(block[2 + i]) << (i * 8);
+      }
+
+      for(int i = 0; i < 16; i++)
+      {
+         texels[i * 4 + 3] = uint8_t(palette[(indices >> (i * 3)) & 7]);
+      }
+   }
+
+   // PSNR of every level of the compressed image against the RGBA8 levels
+   std::vector<double> getPsnr(const stbi_uc* pixels, const Texture::ImageData& compressed)
+   {
+      uint32_t width  = static_cast<uint32_t>(compressed.width);
+      uint32_t height = static_cast<uint32_t>(compressed.height);
+
+      std::vector<stbi_uc> mipmaps = Texture::generateMipmaps(pixels, width, height);
+
+      bool alpha = compressed.format == VK_FORMAT_BC3_UNORM_BLOCK;
+      uint32_t blockSize = alpha ? 16 : 8;
+
+      const stbi_uc* levelPixels = mipmaps.data();
+      const uint8_t* levelBlocks = compressed.getBlocks();
+
+      std::vector<double> psnr;
+
+      for(uint32_t level = 0; level < compressed.mipLevels; level++)
+      {
+         uint32_t levelWidth  = std::max(width >> level, 1u);
+         uint32_t levelHeight = std::max(height >> level, 1u);
+         uint32_t blocksPerRow = (levelWidth + 3) / 4;
+
+         double squaredError = 0.0;
+
+         for(uint32_t y = 0; y < levelHeight; y += 4)
+         {
+            for(uint32_t x = 0; x < levelWidth; x += 4)
+            {
+               const uint8_t* block = levelBlocks + (size_t(y / 4) * blocksPerRow + x / 4) * blockSize;
+
+               uint8_t texels[64];
+               decodeColourBlock(alpha ? block + 8 : block, alpha, texels);
+
+               if(alpha)
+               {
+                  decodeAlphaBlock(block, texels);
+               }
+
+               for(uint32_t texelY = y; texelY < std::min(y + 4, levelHeight); texelY++)
+               {
+                  for(uint32_t texelX = x; texelX < std::min(x + 4, levelWidth); texelX++)
+                  {
+                     const uint8_t* decoded = texels + ((texelY - y) * 4 + texelX - x) * 4;
+                     const stbi_uc* original = levelPixels + (size_t(texelY) * levelWidth + texelX) * 4;
+
+                     for(int channel = 0; channel < 4; channel++)
+                     {
+                        double difference = double(decoded[channel]) - double(original[channel]);
+                        squaredError += difference * difference;
+                     }
+                  }
+               }
+            }
+         }
+
+         double meanSquaredError = squaredError / (double(levelWidth) * levelHeight * 4);
+         psnr.push_back(meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : 99.0);
+
+         levelPixels += size_t(levelWidth) * levelHeight * 4;
+         levelBlocks += Texture::getLevelSize(compressed.format, width, height, level);
+      }
+
+      return psnr;
+   }
+
+   size_t getSize(const Texture::ImageData& imageData)
+   {
+      size_t size = 0;
+      for(uint32_t level = 0; level < Texture::getMipLevels(imageData.width, imageData.height); level++)
+      {
+         size += static_cast<size_t>(Texture::getLevelSize(imageData.format, imageData.width, imageData.height, level));
+      }
+
+      return size;
+   }
+
+   bool sameBlocks(const Texture::ImageData& a, const Texture::ImageData& b)
+   {
+      return a.format == b.format && a.mipLevels == b.mipLevels && getSize(a) == getSize(b) &&
+         memcmp(a.getBlocks(), b.getBlocks(), getSize(a)) == 0;
+   }
+
+   // compresses the image on one thread and on the job system, prints how it went and returns false if it's wrong
+   bool compress(const std::string& name, Texture::ImageData& imageData, JobSystem& jobSystem)
+   {
+      Texture::ImageData serial = imageData;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      Texture::compressImage(serial, nullptr);
+      double serialTime = millisecondsSince(start);
+
+      Texture::ImageData parallel = imageData;
+
+      start = std::chrono::high_resolution_clock::now();
+      Texture::compressImage(parallel, &jobSystem);
+      double parallelTime = millisecondsSince(start);
+
+      size_t uncompressedSize = getSize(imageData);
+      std::vector<double> psnr = getPsnr(imageData.pixels, parallel);
+      double worstPsnr = *std::min_element(psnr.begin(), psnr.end());
+      bool deterministic = sameBlocks(serial, parallel);
+
+      std::cout
+         << "  compress: " << std::setw(9) << serialTime << " ms, " << std::setw(9) << parallelTime << " ms x" << jobSystem.getNumberOfWorkers() + 1
+         << ", " << (parallel.format == VK_FORMAT_BC3_UNORM_BLOCK ? "BC3" : "BC1") << " " << getSize(parallel) / 1024 << " KiB of "
+         << uncompressedSize / 1024 << " KiB, " << std::setprecision(1) << psnr[0] << " dB (" << worstPsnr << " dB worst level)" << std::setprecision(3)
+         << (deterministic ? "" : ", DIFFERENT blocks on one thread") << std::endl;
+
+      imageData.format    = parallel.format;
+      imageData.mipLevels = parallel.mipLevels;
+      imageData.blocks    = std::move(parallel.blocks);
+
+      if(psnr[0] < MIN_PSNR || worstPsnr < MIN_LEVEL_PSNR)
+      {
+         std::cout << name << ": worse than " << MIN_PSNR << " dB, or " << MIN_LEVEL_PSNR << " dB on a level" << std::endl;
+         return false;
+      }
+
+      return deterministic;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   std::vector<std::string> textures;
+   uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--texture") == 0 && i + 1 < argc)
+      {
+         textures.push_back(argv[++i]);
+      }
+      else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      {
+         threads = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   if(textures.empty())
+   {
+      textures ={ TEXTURE_PATH_CHALET, "textures/Stormtrooper_D.tga", "textures/texture.jpg" };
+   }
+
+   // the calling thread takes part as well
+   JobSystem jobSystem(std::max(threads, 2u) - 1);
+
+   std::cout << std::fixed << std::setprecision(3);
+
+   bool ok = true;
+
+   for(const auto& texture : textures)
+   {
+      Texture::ImageData imageData;
+
+      auto start = std::chrono::high_resolution_clock::now();
+
+      try
+      {
+         imageData = Texture::decodeImage(texture);
+      }
+      catch(const std::exception& e)
+      {
+         std::cout << e.what() << std::endl;
+         ok = false;
+         continue;
+      }
+
+      double decodeTime = millisecondsSince(start);
+
+      std::cout << texture << " (" << imageData.width << "x" << imageData.height << ")" << std::endl;
+      std::cout << "  decode:   " << std::setw(9) << decodeTime << " ms" << std::endl;
+
+      ok &= compress(texture, imageData, jobSystem);
+
+      // the first one might have to write the cache, the second one has to read it
+      Texture::ImageData cached = Texture::decodeImage(texture, true, &jobSystem);
+      Texture::freeImageData(cached);
+
+      start = std::chrono::high_resolution_clock::now();
+      cached = Texture::decodeImage(texture, true, &jobSystem);
+      double cacheTime = millisecondsSince(start);
+
+      bool sameAsCache = cached.mappedFile && sameBlocks(imageData, cached);
+
+      std::cout << "  cache:    " << std::setw(9) << cacheTime << " ms, " << (sameAsCache ? "same blocks" : "DIFFERENT blocks or not cached") << std::endl;
+
+      ok &= sameAsCache;
+
+      Texture::freeImageData(cached);
+      Texture::freeImageData(imageData);
+   }
+
+   // a gradient with alpha and a flat image, both with blocks sticking out of every level
+   for(uint32_t i = 0; i < 2; i++)
+   {
+      bool alpha = i == 0;
+      uint32_t width = alpha ? 150 : 37;
+      uint32_t height = alpha ? 37 : 19;
+
+      std::vector<stbi_uc> pixels(size_t(width) * height * 4);
+      for(uint32_t y = 0; y < height; y++)
+      {
+         for(uint32_t x = 0; x < width; x++)
+         {
+            stbi_uc* texel = &pixels[(size_t(y) * width + x) * 4];
+            texel[0] = alpha ? stbi_uc(x * 255 / width) : 90;
+            texel[1] = alpha ? stbi_uc(y * 255 / height) : 180;
+            texel[2] = alpha ? 128 : 40;
+            texel[3] = alpha ? stbi_uc((x + y) * 255 / (width + height)) : 255;
+         }
+      }
+
+      std::string name = std::string(alpha ? "gradient" : "flat") + " (" + std::to_string(width) + "x" + std::to_string(height) + ")";
+
+      Texture::ImageData imageData;
+      imageData.name   = name;
+      imageData.pixels = pixels.data();
+      imageData.width  = int(width);
+      imageData.height = int(height);
+
+      std::cout << name << std::endl;
+
+      bool compressed = compress(name, imageData, jobSystem);
+
+      if(imageData.format != (alpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK))
+      {
+         std::cout << name << ": wrong format" << std::endl;
+         compressed = false;
+      }
+
+      ok &= compressed;
+   }
+
+   std::cout << (ok ? "ok" : "FAILED") << std::endl;
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,255 @@
+#include "JobSystem.h"
+#include "TransformStreams.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+
+// Compares the transform update of WorldObject (TransformStreams) against the translate/rotate/rotate/rotate/scale
+// chain over vec3 arrays it replaced, for every object moving and for 1% of them moving. The last column splits the
+// SSE kernel over the job system like WorldObject::update does.
+//
+// usage: vulkantest_transform_bench [--objects <n>]... [--repeat <n>] [--threads <n>]
+
+namespace
+{
+   const float DT = 1.f / 60.f;
+
+   struct Scene
+   {
+      std::vector<glm::vec3> position;
+      std::vector<glm::vec3> rotation;
+      std::vector<glm::vec3> scale;
+      std::vector<glm::vec3> velocity;
+      std::vector<glm::vec3> rotationSpeed;
+   };
+
+   // every movingEvery-th object moves and rotates
+   Scene generateScene(uint32_t numberOfObjects, uint32_t movingEvery)
+   {
+      std::mt19937 random(1234);
+      std::uniform_real_distribution<float> position(-500.f, 500.f);
+      std::uniform_real_distribution<float> angle(-360.f, 360.f);
+      std::uniform_real_distribution<float> scale(0.1f, 2.f);
+
+      Scene scene;
+
+      for(uint32_t i = 0; i < numberOfObjects; i++)
+      {
+         bool moving = i % movingEvery == 0;
+
+         scene.position.push_back(glm::vec3(position(random), position(random), position(random)));
+         scene.rotation.push_back(glm::vec3(angle(random), angle(random), angle(random)));
+         scene.scale.push_back(glm::vec3(scale(random), scale(random), scale(random)));
+         scene.velocity.push_back(moving ? glm::vec3(1.f, 0.f, -1.f) : glm::vec3(0.f));
+         scene.rotationSpeed.push_back(moving ? glm::vec3(0.f, 20.f, 10.f) : glm::vec3(0.f));
+      }
+
+      return scene;
+   }
+
+   // what WorldObject::update did, including the flags that were never cleared
+   void updateGlmChain(Scene& scene, std::vector<bool>& isModelMatrixInvalid, std::vector<glm::mat4>& modelMatrix)
+   {
+      for(size_t i = 0; i < scene.position.size(); i++)
+      {
+         if(scene.velocity[i] != glm::vec3(0.f))
+         {
+            scene.position[i] += DT * scene.velocity[i];
+            isModelMatrixInvalid[i] = true;
+         }
+         if(scene.rotationSpeed[i] != glm::vec3(0.f))
+         {
+            scene.rotation[i] += DT * scene.rotationSpeed[i];
+            isModelMatrixInvalid[i] = true;
+         }
+      }
+
+      for(size_t i = 0; i < modelMatrix.size(); i++)
+      {
+         if(isModelMatrixInvalid[i])
+         {
+            modelMatrix[i] = glm::translate(glm::mat4(), scene.position[i]);
+
+            modelMatrix[i] = glm::rotate(modelMatrix[i], glm::radians(scene.rotation[i].z), glm::vec3(0.0f, 0.0f, 1.0f));
+            modelMatrix[i] = glm::rotate(modelMatrix[i], glm::radians(scene.rotation[i].y), glm::vec3(0.0f, 1.0f, 0.0f));
+            modelMatrix[i] = glm::rotate(modelMatrix[i], glm::radians(scene.rotation[i].x), glm::vec3(1.0f, 0.0f, 0.0f));
+
+            modelMatrix[i] = glm::scale(modelMatrix[i], scene.scale[i]);
+         }
+      }
+   }
+
+   TransformStreams createStreams(const Scene& scene)
+   {
+      TransformStreams transforms;
+
+      for(size_t i = 0; i < scene.position.size(); i++)
+      {
+         uint32_t index = transforms.add(scene.position[i], scene.rotation[i], scene.scale[i]);
+         transforms.setVelocity(index, scene.velocity[i]);
+         transforms.setRotationSpeed(index, scene.rotationSpeed[i]);
+      }
+
+      return transforms;
+   }
+
+   float maxDifference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b)
+   {
+      float difference = 0.f;
+
+      for(size_t i = 0; i < a.size(); i++)
+      {
+         for(int column = 0; column < 4; column++)
+         {
+            for(int row = 0; row < 4; row++)
+            {
+               difference = std::max(difference, std::abs(a[i][column][row] - b[i][column][row]));
+            }
+         }
+      }
+
+      return difference;
+   }
+
+   template<typename Function>
+   double bestOf(uint32_t repeat, Function function)
+   {
+      double best = std::numeric_limits<double>::max();
+
+      for(uint32_t i = 0; i < repeat; i++)
+      {
+         auto t1 = std::chrono::high_resolution_clock::now();
+         function();
+         auto t2 = std::chrono::high_resolution_clock::now();
+
+         best = std::min(best, std::chrono::duration<double, std::milli>(t2 - t1).count());
+      }
+
+      return best;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   std::vector<uint32_t> sizes;
+   uint32_t repeat = 10;
+   uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+      {
+         sizes.push_back(std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u));
+      }
+      else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+      {
+         repeat = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      {
+         threads = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   if(sizes.empty())
+   {
+      sizes ={ 1000, 100000, 1000000 };
+   }
+
+   // the calling thread takes part as well
+   JobSystem jobSystem(std::max(threads, 2u) - 1);
+   threads = jobSystem.getNumberOfWorkers() + 1;
+
+   std::cout << "one frame of moving and rebuilding matrices, best of " << repeat << std::endl;
+   std::cout << std::fixed << std::setprecision(3);
+
+   bool valid = true;
+
+   for(uint32_t numberOfObjects : sizes)
+   {
+      for(uint32_t movingEvery : { 1u, 100u })
+      {
+         Scene scene = generateScene(numberOfObjects, movingEvery);
+
+         std::vector<bool> isModelMatrixInvalid(numberOfObjects, true);
+         std::vector<glm::mat4> glmMatrices(numberOfObjects);
+
+         double glmTime = bestOf(repeat, [&]()
+         {
+            updateGlmChain(scene, isModelMatrixInvalid, glmMatrices);
+         });
+
+         TransformStreams scalarTransforms = createStreams(generateScene(numberOfObjects, movingEvery));
+         std::vector<glm::mat4> scalarMatrices(numberOfObjects);
+         std::vector<uint32_t> updated;
+
+         double scalarTime = bestOf(repeat, [&]()
+         {
+            updated.clear();
+            scalarTransforms.integrate(DT);
+            scalarTransforms.updateMatrices(scalarMatrices.data(), updated, false);
+         });
+
+         TransformStreams simdTransforms = createStreams(generateScene(numberOfObjects, movingEvery));
+         std::vector<glm::mat4> simdMatrices(numberOfObjects);
+
+         double simdTime = bestOf(repeat, [&]()
+         {
+            updated.clear();
+            simdTransforms.integrate(DT);
+            simdTransforms.updateMatrices(simdMatrices.data(), updated, true);
+         });
+
+         TransformStreams threadedTransforms = createStreams(generateScene(numberOfObjects, movingEvery));
+         std::vector<glm::mat4> threadedMatrices(numberOfObjects);
+
+         uint32_t numberOfBlocks = threadedTransforms.getNumberOfBlocks();
+         uint32_t blocksPerJob = std::max(16u, numberOfBlocks / (threads * 4));
+         std::vector<std::vector<uint32_t>> threadedUpdated((numberOfBlocks + blocksPerJob - 1) / blocksPerJob);
+
+         double threadedTime = bestOf(repeat, [&]()
+         {
+            jobSystem.parallelFor(0, numberOfBlocks, blocksPerJob, [&](uint32_t firstBlock, uint32_t lastBlock)
+            {
+               std::vector<uint32_t>& updatedInJob = threadedUpdated[firstBlock / blocksPerJob];
+               updatedInJob.clear();
+
+               threadedTransforms.integrate(DT, firstBlock, lastBlock);
+               threadedTransforms.updateMatrices(threadedMatrices.data(), updatedInJob, firstBlock, lastBlock);
+            });
+         });
+
+         // all of them went through the same number of frames, positions are up to 500 so allow some rounding
+         float scalarDifference = maxDifference(glmMatrices, scalarMatrices);
+         float simdDifference = maxDifference(glmMatrices, simdMatrices);
+         float threadedDifference = maxDifference(glmMatrices, threadedMatrices);
+         bool matches = scalarDifference < 1e-3f && simdDifference < 1e-3f && threadedDifference < 1e-3f;
+
+         std::cout
+            << std::setw(8) << numberOfObjects << " objects, " << std::setw(3) << 100 / movingEvery << "% moving:  "
+            << "glm chain " << std::setw(9) << glmTime << " ms  "
+            << "scalar " << std::setw(9) << scalarTime << " ms (" << std::setprecision(2) << glmTime / scalarTime << "x)  "
+            << std::setprecision(3)
+            << "simd " << std::setw(9) << simdTime << " ms (" << std::setprecision(2) << glmTime / simdTime << "x)  "
+            << std::setprecision(3)
+            << "simd x" << threads << " " << std::setw(9) << threadedTime << " ms (" << std::setprecision(2) << glmTime / threadedTime << "x)"
+            << std::setprecision(3)
+            << (matches ? "" : "  MISMATCH")
+            << std::endl;
+
+         valid = valid && matches;
+      }
+   }
+
+   return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,377 @@
+#include "AabbTree.h"
+#include "Bounds.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+
+// The queries WorldObject runs on its AabbTree, on random boxes: building the tree, moving a part of the boxes a
+// little every frame, ray casts, box queries, all overlapping pairs (split over the job system like WorldObject does)
+// and culling the tree against a frustum next to testing every box with Frustum::cull. The ray casts, box queries
+// and pairs are checked against testing every box.
+//
+// usage: vulkantest_tree_bench [--objects <n>]... [--repeat <n>] [--threads <n>]
+
+namespace
+{
+   const uint32_t NUMBER_OF_RAYS = 10000;
+   const uint32_t NUMBER_OF_QUERIES = 10000;
+   const uint32_t NUMBER_OF_CHECKS = 200;
+   const uint32_t MAX_OBJECTS_FOR_ALL_PAIRS = 10000;
+
+   // the boxes are about as dense as the default scene, whatever their number
+   float getWorldSize(uint32_t numberOfObjects)
+   {
+      return 4.f * std::cbrt(static_cast<float>(numberOfObjects));
+   }
+
+   std::vector<Aabb> generateBoxes(uint32_t numberOfObjects, std::mt19937& random)
+   {
+      float worldSize = getWorldSize(numberOfObjects);
+
+      std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+      std::uniform_real_distribution<float> size(0.2f, 2.f);
+
+      std::vector<Aabb> boxes;
+
+      for(uint32_t i = 0; i < numberOfObjects; i++)
+      {
+         glm::vec3 center(position(random), position(random), position(random));
+         glm::vec3 extent(size(random), size(random), size(random));
+
+         boxes.push_back(Aabb(center - extent * 0.5f, center + extent * 0.5f));
+      }
+
+      return boxes;
+   }
+
+   bool intersectRay(const Aabb& aabb, glm::vec3 origin, glm::vec3 direction, float maxDistance, float& distance)
+   {
+      glm::vec3 inverseDirection = 1.f / direction;
+      glm::vec3 t1 = (aabb.min - origin) * inverseDirection;
+      glm::vec3 t2 = (aabb.max - origin) * inverseDirection;
+
+      glm::vec3 tNear = glm::min(t1, t2);
+      glm::vec3 tFar = glm::max(t1, t2);
+
+      distance = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+
+      return distance <= std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+   }
+
+   template<typename Function>
+   double bestOf(uint32_t repeat, Function function)
+   {
+      double best = std::numeric_limits<double>::max();
+
+      for(uint32_t i = 0; i < repeat; i++)
+      {
+         auto t1 = std::chrono::high_resolution_clock::now();
+         function();
+         auto t2 = std::chrono::high_resolution_clock::now();
+
+         best = std::min(best, std::chrono::duration<double, std::milli>(t2 - t1).count());
+      }
+
+      return best;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   std::vector<uint32_t> sizes;
+   uint32_t repeat = 10;
+   uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+      {
+         sizes.push_back(std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u));
+      }
+      else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+      {
+         repeat = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      {
+         threads = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   if(sizes.empty())
+   {
+      sizes ={ 1000, 100000 };
+   }
+
+   // the calling thread takes part as well
+   JobSystem jobSystem(std::max(threads, 2u) - 1);
+   threads = jobSystem.getNumberOfWorkers() + 1;
+
+   std::cout << "best of " << repeat << ", " << threads << " threads for the pairs" << std::endl;
+   std::cout << std::fixed << std::setprecision(3);
+
+   bool valid = true;
+
+   for(uint32_t numberOfObjects : sizes)
+   {
+      std::mt19937 random(1234);
+
+      std::vector<Aabb> boxes = generateBoxes(numberOfObjects, random);
+      float worldSize = getWorldSize(numberOfObjects);
+
+      // building
+      AabbTree tree;
+      std::vector<int32_t> proxies(numberOfObjects);
+
+      double buildTime = bestOf(1, [&]()
+      {
+         for(uint32_t i = 0; i < numberOfObjects; i++)
+         {
+            proxies[i] = tree.createProxy(boxes[i], i);
+         }
+      });
+
+      double rebuildTime = bestOf(1, [&]()
+      {
+         tree.rebuild();
+      });
+
+      // a tenth of the boxes moves a bit every frame, most of them stay in their fat box
+      std::uniform_real_distribution<float> step(-0.05f, 0.05f);
+      std::vector<glm::vec3> velocity(numberOfObjects, glm::vec3(0.f));
+
+      for(uint32_t i = 0; i < numberOfObjects; i += 10)
+      {
+         velocity[i] = glm::vec3(step(random), step(random), step(random));
+      }
+
+      uint32_t reinserted = 0;
+
+      double moveTime = bestOf(repeat, [&]()
+      {
+         reinserted = 0;
+
+         for(uint32_t i = 0; i < numberOfObjects; i += 10)
+         {
+            boxes[i].min += velocity[i];
+            boxes[i].max += velocity[i];
+
+            reinserted += tree.moveProxy(proxies[i], boxes[i]) ? 1 : 0;
+         }
+      });
+
+      // rays from random points in random directions, the closest hit
+      std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+      std::uniform_real_distribution<float> direction(-1.f, 1.f);
+
+      std::vector<glm::vec3> rayOrigins, rayDirections;
+
+      for(uint32_t i = 0; i < NUMBER_OF_RAYS; i++)
+      {
+         rayOrigins.push_back(glm::vec3(position(random), position(random), position(random)));
+         rayDirections.push_back(glm::normalize(glm::vec3(direction(random), direction(random), direction(random)) + glm::vec3(1e-3f)));
+      }
+
+      float rayLength = worldSize * 0.25f;
+      std::vector<uint32_t> rayHits(NUMBER_OF_RAYS);
+
+      double rayTime = bestOf(repeat, [&]()
+      {
+         for(uint32_t i = 0; i < NUMBER_OF_RAYS; i++)
+         {
+            rayHits[i] = UINT32_MAX;
+
+            tree.raycast(rayOrigins[i], rayDirections[i], rayLength, [&](int32_t proxy, float distance)
+            {
+               rayHits[i] = tree.getUserData(proxy);
+               return distance;
+            });
+         }
+      });
+
+      // box queries about the size of a few objects
+      std::vector<Aabb> queries;
+
+      for(uint32_t i = 0; i < NUMBER_OF_QUERIES; i++)
+      {
+         glm::vec3 center(position(random), position(random), position(random));
+         queries.push_back(Aabb(center - glm::vec3(2.f), center + glm::vec3(2.f)));
+      }
+
+      std::vector<uint32_t> queryHits(NUMBER_OF_QUERIES);
+
+      double queryTime = bestOf(repeat, [&]()
+      {
+         for(uint32_t i = 0; i < NUMBER_OF_QUERIES; i++)
+         {
+            queryHits[i] = 0;
+
+            tree.query(queries[i], [&](int32_t)
+            {
+               queryHits[i]++;
+               return true;
+            });
+         }
+      });
+
+      // all pairs on one thread and split over the job system
+      std::vector<std::pair<uint32_t, uint32_t>> pairs;
+
+      double pairsTime = bestOf(repeat, [&]()
+      {
+         std::vector<AabbTree::PairTask> tasks;
+         tree.splitPairs(1, tasks);
+
+         pairs.clear();
+
+         for(const AabbTree::PairTask& task : tasks)
+         {
+            tree.findPairs(task, pairs);
+         }
+      });
+
+      std::vector<AabbTree::PairTask> tasks;
+      std::vector<std::vector<std::pair<uint32_t, uint32_t>>> pairsInJob;
+
+      double threadedPairsTime = bestOf(repeat, [&]()
+      {
+         tree.splitPairs(threads * 4, tasks);
+         pairsInJob.resize(tasks.size());
+
+         jobSystem.parallelFor(0, static_cast<uint32_t>(tasks.size()), 1, [&](uint32_t first, uint32_t last)
+         {
+            for(uint32_t task = first; task < last; task++)
+            {
+               pairsInJob[task].clear();
+               tree.findPairs(tasks[task], pairsInJob[task]);
+            }
+         });
+      });
+
+      size_t threadedPairs = 0;
+
+      for(const auto& pairsOfJob : pairsInJob)
+      {
+         threadedPairs += pairsOfJob.size();
+      }
+
+      // a camera in the middle of the boxes, looking along -z
+      glm::mat4 view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+      glm::mat4 projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, 0.1f, worldSize * 0.5f);
+      Frustum frustum(projection * view);
+
+      std::vector<uint32_t> visible;
+
+      double treeCullTime = bestOf(repeat, [&]()
+      {
+         visible.clear();
+
+         tree.query(frustum, [&](int32_t proxy)
+         {
+            visible.push_back(tree.getUserData(proxy));
+         });
+      });
+
+      size_t treeVisible = visible.size();
+
+      BoundsStreams streams;
+      streams.resize(numberOfObjects);
+
+      for(uint32_t i = 0; i < numberOfObjects; i++)
+      {
+         Bounds bounds;
+         bounds.min = boxes[i].min;
+         bounds.max = boxes[i].max;
+         bounds.center = boxes[i].getCenter();
+         bounds.radius = glm::length(boxes[i].getExtent());
+
+         streams.set(i, bounds, glm::mat4());
+      }
+
+      double flatCullTime = bestOf(repeat, [&]()
+      {
+         visible.clear();
+         frustum.cull(streams, 0, numberOfObjects, visible);
+      });
+
+      // every box on a sample of the rays and queries, and the pairs of both versions. all pairs only for small counts
+      bool matches = threadedPairs == pairs.size();
+
+      if(numberOfObjects <= MAX_OBJECTS_FOR_ALL_PAIRS)
+      {
+         size_t allPairs = 0;
+
+         for(uint32_t i = 0; i < numberOfObjects; i++)
+         {
+            for(uint32_t j = i + 1; j < numberOfObjects; j++)
+            {
+               allPairs += boxes[i].overlaps(boxes[j]) ? 1 : 0;
+            }
+         }
+
+         matches = matches && allPairs == pairs.size();
+      }
+
+      for(uint32_t i = 0; i < NUMBER_OF_CHECKS && i < NUMBER_OF_RAYS; i++)
+      {
+         uint32_t closest = UINT32_MAX;
+         float closestDistance = rayLength;
+
+         for(uint32_t j = 0; j < numberOfObjects; j++)
+         {
+            float distance;
+
+            if(intersectRay(boxes[j], rayOrigins[i], rayDirections[i], closestDistance, distance))
+            {
+               closest = j;
+               closestDistance = distance;
+            }
+         }
+
+         // two boxes can be hit at the same distance
+         if(closest != rayHits[i] && (closest == UINT32_MAX || rayHits[i] == UINT32_MAX))
+         {
+            matches = false;
+         }
+      }
+
+      for(uint32_t i = 0; i < NUMBER_OF_CHECKS && i < NUMBER_OF_QUERIES; i++)
+      {
+         uint32_t hits = 0;
+
+         for(uint32_t j = 0; j < numberOfObjects; j++)
+         {
+            hits += boxes[j].overlaps(queries[i]) ? 1 : 0;
+         }
+
+         matches = matches && hits == queryHits[i];
+      }
+
+      std::cout
+         << std::setw(8) << numberOfObjects << " objects, height " << tree.getHeight() << std::endl
+         << "   build         " << std::setw(9) << buildTime << " ms, rebuild " << rebuildTime << " ms" << std::endl
+         << "   move 10%      " << std::setw(9) << moveTime << " ms (" << reinserted << " reinserted)" << std::endl
+         << "   " << NUMBER_OF_RAYS << " rays  " << std::setw(9) << rayTime << " ms" << std::endl
+         << "   " << NUMBER_OF_QUERIES << " boxes " << std::setw(9) << queryTime << " ms" << std::endl
+         << "   pairs         " << std::setw(9) << pairsTime << " ms, x" << threads << " " << threadedPairsTime << " ms (" << pairs.size() << " pairs)" << std::endl
+         << "   cull tree     " << std::setw(9) << treeCullTime << " ms (" << treeVisible << " visible)" << std::endl
+         << "   cull flat     " << std::setw(9) << flatCullTime << " ms (" << visible.size() << " visible)" << std::endl
+         << (matches ? "" : "   MISMATCH\n");
+
+      valid = valid && matches;
+   }
+
+   return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
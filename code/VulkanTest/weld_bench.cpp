@@ -0,0 +1,238 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+
+#include "stdafx.h"
+#include "VertexWelder.h"
+
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+// Compares the vertex welding of Mesh::parseMesh against the std::unordered_map it used before.
+// Without an obj file it welds a generated grid, where every vertex is shared by up to 6 corners.
+//
+// usage: vulkantest_weld_bench [--obj <file>] [--grid <quads per side>] [--repeat <n>] [--threads <n>]
+
+namespace
+{
+   std::vector<Vertex> generateGrid(uint32_t size)
+   {
+      std::vector<Vertex> corners;
+      corners.reserve(size_t(size) * size * 6);
+
+      auto vertexAt = [size](uint32_t x, uint32_t y)
+      {
+         Vertex vertex ={};
+         vertex.position = glm::vec3(float(x), 0.0f, float(y));
+         vertex.colour   = glm::vec3(1.0f);
+         vertex.texCoord = glm::vec2(float(x) / size, float(y) / size);
+         return vertex;
+      };
+
+      for(uint32_t y = 0; y < size; y++)
+      {
+         for(uint32_t x = 0; x < size; x++)
+         {
+            corners.push_back(vertexAt(x, y));
+            corners.push_back(vertexAt(x + 1, y));
+            corners.push_back(vertexAt(x, y + 1));
+
+            corners.push_back(vertexAt(x + 1, y));
+            corners.push_back(vertexAt(x + 1, y + 1));
+            corners.push_back(vertexAt(x, y + 1));
+         }
+      }
+
+      return corners;
+   }
+
+   // same as Mesh::parseMesh, without the materials
+   std::vector<Vertex> loadCorners(const std::string& fileName)
+   {
+      tinyobj::attrib_t attrib;
+      std::vector<tinyobj::shape_t> shapes;
+      std::vector<tinyobj::material_t> materials;
+      std::string err;
+
+      if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), "./models/"))
+      {
+         throw std::runtime_error(err);
+      }
+
+      std::vector<Vertex> corners;
+
+      for(const auto& shape : shapes)
+      {
+         for(const auto& index : shape.mesh.indices)
+         {
+            Vertex vertex ={};
+            vertex.position =
+            {
+               attrib.vertices[3 * index.vertex_index + 0],
+               attrib.vertices[3 * index.vertex_index + 1],
+               attrib.vertices[3 * index.vertex_index + 2]
+            };
+            vertex.texCoord =
+            {
+               attrib.texcoords[2 * index.texcoord_index + 0],
+               1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+            };
+            vertex.colour ={ 1.0f, 1.0f, 1.0f };
+
+            corners.push_back(vertex);
+         }
+      }
+
+      return corners;
+   }
+
+   // the loop Mesh::loadMesh had
+   void weldUnorderedMap(const std::vector<Vertex>& corners, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+   {
+      std::unordered_map<Vertex, uint32_t> uniqueVertices ={};
+
+      for(const auto& vertex : corners)
+      {
+         if(uniqueVertices.count(vertex) == 0)
+         {
+            uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(vertex);
+         }
+
+         indices.push_back(static_cast<uint32_t>(uniqueVertices[vertex]));
+      }
+   }
+
+   // every corner has to map to a vertex equal to it
+   bool verify(const std::vector<Vertex>& corners, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+   {
+      if(indices.size() != corners.size())
+      {
+         return false;
+      }
+
+      for(size_t i = 0; i < corners.size(); i++)
+      {
+         if(indices[i] >= vertices.size() || !(vertices[indices[i]] == corners[i]))
+         {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
+   template<typename Function>
+   double bestOf(uint32_t repeat, Function function)
+   {
+      double best = std::numeric_limits<double>::max();
+
+      for(uint32_t i = 0; i < repeat; i++)
+      {
+         auto t1 = std::chrono::high_resolution_clock::now();
+         function();
+         auto t2 = std::chrono::high_resolution_clock::now();
+
+         best = std::min(best, std::chrono::duration<double, std::milli>(t2 - t1).count());
+      }
+
+      return best;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   std::string objFile;
+   uint32_t gridSize = 1000;
+   uint32_t repeat = 5;
+   uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+   for(int i = 1; i < argc; i++)
+   {
+      if(strcmp(argv[i], "--obj") == 0 && i + 1 < argc)
+      {
+         objFile = argv[++i];
+      }
+      else if(strcmp(argv[i], "--grid") == 0 && i + 1 < argc)
+      {
+         gridSize = static_cast<uint32_t>(atoi(argv[++i]));
+      }
+      else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+      {
+         repeat = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+      else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      {
+         threads = std::max(static_cast<uint32_t>(atoi(argv[++i])), 1u);
+      }
+   }
+
+   std::vector<Vertex> corners;
+
+   try
+   {
+      corners = objFile.empty() ? generateGrid(gridSize) : loadCorners(objFile);
+   }
+   catch(const std::runtime_error& e)
+   {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::cout << corners.size() << " corners, best of " << repeat << std::endl;
+
+   std::vector<Vertex> vertices;
+   std::vector<uint32_t> indices;
+
+   struct Result
+   {
+      std::string name;
+      double milliseconds;
+      size_t numberOfVertices;
+      bool valid;
+   };
+   std::vector<Result> results;
+
+   double time = bestOf(repeat, [&]()
+   {
+      vertices.clear();
+      indices.clear();
+      weldUnorderedMap(corners, vertices, indices);
+   });
+   results.push_back({ "unordered_map", time, vertices.size(), verify(corners, vertices, indices) });
+
+   time = bestOf(repeat, [&]()
+   {
+      VertexWelder::weld(corners.data(), corners.size(), vertices, indices, 1);
+   });
+   results.push_back({ "VertexWelder", time, vertices.size(), verify(corners, vertices, indices) });
+
+   time = bestOf(repeat, [&]()
+   {
+      VertexWelder::weld(corners.data(), corners.size(), vertices, indices, threads);
+   });
+   results.push_back({ "VertexWelder x" + std::to_string(threads), time, vertices.size(), verify(corners, vertices, indices) });
+
+   bool valid = true;
+
+   std::cout << std::fixed << std::setprecision(2);
+   for(const auto& result : results)
+   {
+      std::cout
+         << std::setw(20) << std::left << result.name
+         << std::setw(10) << std::right << result.milliseconds << " ms  "
+         << std::setw(6) << results[0].milliseconds / result.milliseconds << "x  "
+         << result.numberOfVertices << " vertices"
+         << (result.valid ? "" : "  INVALID")
+         << std::endl;
+
+      valid = valid && result.valid && result.numberOfVertices == results[0].numberOfVertices;
+   }
+
+   return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1038,6 +1038,9 @@ class LoadOption {
   int req_num_threads;
   bool triangulate;
   bool verbose;
+
+  // prepended to the `mtllib' file name, e.g. "./models/"
+  std::string mtl_basedir;
 };
 
 /// Parse wavefront .obj(.obj string data is expanded to linear char array
@@ -1340,6 +1343,33 @@ bool parseObj(attrib_t *attrib, std::vector<shape_t> *shapes,
             }
           }
         }
+
+        // The loops above never look at the last character, so the last line
+        // of the file has to be added here.
+        if (t == static_cast<size_t>((num_threads - 1))) {
+          size_t line_start = prev_pos;
+          if ((t > 0) && (prev_pos == start_idx)) {
+            // no line ending in this chunk, the line started in an earlier one
+            while ((line_start > 0) && (buf[line_start - 1] != '\n') &&
+                   (buf[line_start - 1] != '\r')) {
+              line_start--;
+            }
+          }
+
+          size_t line_end = len;
+          while ((line_end > line_start) &&
+                 ((buf[line_end - 1] == '\n') || (buf[line_end - 1] == '\r') ||
+                  (buf[line_end - 1] == '\0'))) {
+            line_end--;
+          }
+
+          if (line_end > line_start) {
+            LineInfo info;
+            info.pos = line_start;
+            info.len = line_end - line_start;
+            line_infos[t].push_back(info);
+          }
+        }
       }));
     }
 
@@ -1435,7 +1465,7 @@ bool parseObj(attrib_t *attrib, std::vector<shape_t> *shapes,
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
-    std::ifstream ifs(material_filename);
+    std::ifstream ifs(option.mtl_basedir + material_filename);
     if (ifs.good()) {
       LoadMtl(&material_map, materials, &ifs);
 
@@ -1507,11 +1537,30 @@ bool parseObj(attrib_t *attrib, std::vector<shape_t> *shapes,
       face_offsets[t] = face_offsets[t - 1] + command_count[t - 1].num_indices;
     }
 
+    // `usemtl' state carries over from the chunks of the previous threads.
+    int initial_material_ids[kMaxThreads];
+    {
+      int material_id = -1;  // -1 = default unknown material.
+      for (size_t t = 0; t < num_threads; t++) {
+        initial_material_ids[t] = material_id;
+        for (size_t i = 0; i < commands[t].size(); i++) {
+          if (commands[t][i].type == COMMAND_USEMTL &&
+              commands[t][i].material_name &&
+              commands[t][i].material_name_len > 0) {
+            std::string material_name(commands[t][i].material_name,
+                                      commands[t][i].material_name_len);
+            auto it = material_map.find(material_name);
+            material_id = (it != material_map.end()) ? it->second : -1;
+          }
+        }
+      }
+    }
+
     StackVector<std::thread, 16> workers;
 
     for (size_t t = 0; t < num_threads; t++) {
-      int material_id = -1;  // -1 = default unknown material.
       workers->push_back(std::thread([&, t]() {
+        int material_id = initial_material_ids[t];
         size_t v_count = v_offsets[t];
         size_t n_count = n_offsets[t];
         size_t t_count = t_offsets[t];
@@ -1527,8 +1576,9 @@ bool parseObj(attrib_t *attrib, std::vector<shape_t> *shapes,
               std::string material_name(commands[t][i].material_name,
                                         commands[t][i].material_name_len);
 
-              if (material_map.find(material_name) != material_map.end()) {
-                material_id = material_map[material_name];
+              auto it = material_map.find(material_name);
+              if (it != material_map.end()) {
+                material_id = it->second;
               } else {
                 // Assign invalid material ID
                 material_id = -1;